@@ -362,9 +362,8 @@ class Client(object):
         # requesting a key that does not exist may return garbage.
         key_data = {str(k):v for k,v in key_data.iteritems() if k in self.meta}
 
-        # need to get meta data so we can pack
-        meta = self.get_keys(key_data.keys(), with_meta=True)
-        
+        # pack using the meta data we already have, so the whole set
+        # is a single exchange instead of a get followed by a set.
         # create data items
         items = []
         batches = []
@@ -376,7 +375,7 @@ class Client(object):
             if key_data[key] == '__null__':
                 key_data[key] = ''
 
-            data = CatbusData(meta=meta[key].meta, value=key_data[key])
+            data = CatbusData(meta=self.meta[key], value=key_data[key])
 
             items.append(data)
 
@@ -438,11 +437,89 @@ class Client(object):
                 raise
 
 
+    def _read_file_windowed(self, host, session_id, page_size, progress=None):
+        pages = {}
+        received = 0
+        eof_page = None # first page past the end of the file
+        base = 0 # first page not yet received
+
+        self.__sock.settimeout(0.5)
+
+        max_window = min(self.read_window_size, CATBUS_FILE_MAX_WINDOW)
+        window = max_window
+
+        while True:
+            while base in pages:
+                base += 1
+
+            if eof_page is not None and base >= eof_page:
+                break
+
+            # request only the pages we are missing
+            page_mask = 0
+            last_page = base
+            for i in xrange(window):
+                page = base + i
+
+                if eof_page is not None and page >= eof_page:
+                    break
+
+                if page not in pages:
+                    page_mask |= (1 << i)
+                    last_page = page
+
+            msg = FileGetWindowMsg(session_id=session_id, offset=base * page_size, page_mask=page_mask)
+            self.__sock.sendto(msg.pack(), host)
+
+            try:
+                while True:
+                    data, sender = self.__sock.recvfrom(4096)
+                    data_msg = deserialize(data)
+
+                    if isinstance(data_msg, ErrorMsg):
+                        self.flush()
+                        raise ProtocolErrorException(data_msg.error_code, lookup_error_msg(data_msg.error_code))
+
+                    elif not isinstance(data_msg, FileDataMsg):
+                        self.flush()
+                        raise ProtocolErrorException("invalid message")
+
+                    if data_msg.session_id != session_id or \
+                       data_msg.offset % page_size != 0:
+                        continue
+
+                    page = data_msg.offset / page_size
+
+                    if page not in pages:
+                        pages[page] = data_msg.data
+                        received += data_msg.len
+
+                        if progress:
+                            progress(received)
+
+                    # short page is the end of the file
+                    if data_msg.len < page_size:
+                        eof_page = page + 1
+
+                    # pages arrive in order, so once the last one is in,
+                    # anything still missing from this window was lost.
+                    if page >= last_page or \
+                       (eof_page is not None and page + 1 >= eof_page):
+                        break
+
+                if window < max_window:
+                    window += 1
+
+            except socket.error:
+                window = max(1, window / 2)
+
+        return ''.join([pages[i] for i in xrange(eof_page)])
+
     def read_file(self, filename, progress=None):
         file_data = ''
 
         msg = FileOpenMsg(
-                flags=CATBUS_MSG_FILE_FLAG_READ,
+                flags=CATBUS_MSG_FILE_FLAG_READ | CATBUS_MSG_FILE_FLAG_WINDOW_REQ,
                 filename=filename,
                 offset=0,
                 data_len=0)
@@ -479,6 +556,16 @@ class Client(object):
         ack_offset = 0
         page_size = response.page_size
 
+        # server supports windowed reads
+        if response.flags & CATBUS_MSG_FILE_FLAG_WINDOWED:
+            file_data = self._read_file_windowed(host, session_id, page_size, progress=progress)
+
+            # close session
+            msg = FileCloseMsg(session_id=session_id)
+            self.__sock.sendto(msg.pack(), host)
+
+            return file_data
+
         self.__sock.settimeout(0.5)
 
         max_window = self.read_window_size
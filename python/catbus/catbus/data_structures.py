@@ -212,6 +212,8 @@ CATBUS_MSG_DATA_FLAG_TIME_SYNC          = 0x01
 
 CATBUS_MSG_LINK_FLAG_SOURCE             = 0x01
 CATBUS_MSG_LINK_FLAGS_DEST              = 0x04
+# node accepts LINK_DATA_MULTI
+CATBUS_MSG_LINK_FLAG_MULTI_DATA         = 0x08
 
 META_TAG_NAME = 'meta_tag_name'
 META_TAG_LOC = 'meta_tag_location'
@@ -0,0 +1,214 @@
+# <license>
+#
+#     This file is part of the Sapphire Operating System.
+#
+#     Copyright (C) 2013-2018  Jeremy Billheimer
+#
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+#
+#     You should have received a copy of the GNU General Public License
+#     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# </license>
+
+"""
+Simulated catbus nodes, for testing and benchmarking bulk clients.
+
+FakeNodeServer runs any number of nodes from one thread. Each node
+has its own socket on loopback and its own Database, and answers
+discover, lookup hash, get key meta, get keys and set keys messages.
+
+Unlike CatbusService, nodes do not announce, link or serve files, so
+a few hundred of them are cheap to run.
+
+latency delays every reply, to stand in for the round trip to a
+device on wifi. drop_rate drops that fraction of incoming requests,
+to exercise retries.
+"""
+
+import socket
+import select
+import time
+import random
+import heapq
+import logging
+
+from data_structures import *
+from messages import *
+from database import Database
+
+from sapphire.common import Ribbon
+
+
+class FakeNode(object):
+    def __init__(self, index):
+        self.index = index
+
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setblocking(0)
+        self.sock.bind(('127.0.0.1', 0))
+        self.host = self.sock.getsockname()
+
+        self.database = Database(name='fake_node_%d' % (index))
+        self.database.add_item('gfx_master_dimmer', 65535, 'uint16')
+        self.database.add_item('gfx_sub_dimmer', 65535, 'uint16')
+        self.database.add_item('pix_count', 60, 'uint16')
+        self.database.add_item('kv_test_key', index, 'uint32')
+
+        self.requests = 0
+
+    def _handle_discover(self, msg):
+        if (msg.flags & CATBUS_DISC_FLAG_QUERY_ALL) or self.database.query(*msg.query):
+            return AnnounceMsg(data_port=self.host[1], query=self.database.get_query())
+
+    def _handle_lookup_hash(self, msg):
+        resolved_hashes = []
+        for requested_hash in msg.hashes:
+            if requested_hash in self.database:
+                resolved_hashes.append(CatbusStringField(self.database.lookup_hash(requested_hash)))
+
+        return ResolvedHashMsg(keys=resolved_hashes)
+
+    def _handle_get_key_meta(self, msg):
+        keys = sorted(self.database.keys())
+        index = msg.page * CATBUS_MAX_KEY_META
+        page_count = (len(keys) / CATBUS_MAX_KEY_META) + 1
+
+        meta = [self.database.get_item(key).meta for key in keys[index:index + CATBUS_MAX_KEY_META]]
+
+        return KeyMetaMsg(page=msg.page, page_count=page_count, item_count=len(meta), meta=meta)
+
+    def _handle_get_keys(self, msg):
+        items = []
+
+        for hashed_key in msg.hashes:
+            try:
+                items.append(self.database.get_item(hashed_key))
+
+            except KeyError:
+                return ErrorMsg(error_code=CATBUS_ERROR_KEY_NOT_FOUND)
+
+        return KeyDataMsg(data=items)
+
+    def _handle_set_keys(self, msg):
+        reply_items = []
+
+        for item in msg.data:
+            try:
+                db_item = self.database.get_item(item.meta.hash)
+
+            except KeyError:
+                return ErrorMsg(error_code=CATBUS_ERROR_KEY_NOT_FOUND)
+
+            if db_item.meta.type != item.meta.type:
+                return ErrorMsg(error_code=CATBUS_ERROR_INVALID_TYPE)
+
+            if db_item.meta.flags & CATBUS_FLAGS_READ_ONLY:
+                return ErrorMsg(error_code=CATBUS_ERROR_READ_ONLY)
+
+            self.database[item.meta.hash] = item.value
+
+            reply_items.append(self.database.get_item(item.meta.hash))
+
+        return KeyDataMsg(data=reply_items)
+
+    def process(self, msg):
+        self.requests += 1
+
+        handlers = {
+            DiscoverMsg: self._handle_discover,
+            LookupHashMsg: self._handle_lookup_hash,
+            GetKeyMetaMsg: self._handle_get_key_meta,
+            GetKeysMsg: self._handle_get_keys,
+            SetKeysMsg: self._handle_set_keys,
+        }
+
+        try:
+            handler = handlers[type(msg)]
+
+        except KeyError:
+            return ErrorMsg(error_code=CATBUS_ERROR_UNKNOWN_MSG)
+
+        return handler(msg)
+
+
+class FakeNodeServer(Ribbon):
+    def initialize(self, count=200, latency=0.0, drop_rate=0.0):
+        self.name = 'fake_node_server'
+        self.latency = latency
+        self.drop_rate = drop_rate
+
+        self.nodes = [FakeNode(i) for i in xrange(count)]
+        self._socks = {node.sock: node for node in self.nodes}
+
+        # replies waiting for their latency to expire
+        self._replies = []
+        self._reply_seq = 0
+
+        self.requests_dropped = 0
+
+    @property
+    def hosts(self):
+        return [node.host for node in self.nodes]
+
+    def clean_up(self):
+        for node in self.nodes:
+            node.sock.close()
+
+    def _send_replies(self):
+        now = time.time()
+
+        while (len(self._replies) > 0) and (self._replies[0][0] <= now):
+            due, seq, sock, data, host = heapq.heappop(self._replies)
+
+            try:
+                sock.sendto(data, host)
+
+            except socket.error:
+                pass
+
+    def loop(self):
+        wait = 0.1
+        if len(self._replies) > 0:
+            wait = max(0.0, min(wait, self._replies[0][0] - time.time()))
+
+        readable, writable, exceptional = select.select(self._socks.keys(), [], [], wait)
+
+        for s in readable:
+            node = self._socks[s]
+
+            try:
+                data, host = s.recvfrom(4096)
+                msg = deserialize(data)
+
+            except (socket.error, UnknownMessageException, InvalidMessageException):
+                continue
+
+            if random.random() < self.drop_rate:
+                self.requests_dropped += 1
+                continue
+
+            try:
+                response = node.process(msg)
+
+            except Exception as e:
+                logging.exception(e)
+                continue
+
+            if response:
+                response.header.transaction_id = msg.header.transaction_id
+                response.header.origin_id = node.database['device_id']
+
+                self._reply_seq += 1
+                heapq.heappush(self._replies, (time.time() + self.latency, self._reply_seq, s, response.pack(), host))
+
+        self._send_replies()
@@ -58,6 +58,9 @@ CATBUS_MSG_TYPE_KEY_DATA                   = CATBUS_MSG_DATABASE_GROUP_OFFSET +
 
 CATBUS_MSG_TYPE_LINK                       = CATBUS_MSG_LINK_GROUP_OFFSET + 1
 CATBUS_MSG_TYPE_LINK_DATA                  = CATBUS_MSG_LINK_GROUP_OFFSET + 2
+CATBUS_MSG_TYPE_LINK_DATA_MULTI            = CATBUS_MSG_LINK_GROUP_OFFSET + 3
+
+CATBUS_MAX_LINK_DATA_ENTRIES               = 16
 
 CATBUS_MSG_TYPE_FILE_OPEN                  = ( 1 + CATBUS_MSG_FILE_GROUP_OFFSET )
 CATBUS_MSG_TYPE_FILE_CONFIRM               = ( 2 + CATBUS_MSG_FILE_GROUP_OFFSET )
@@ -70,9 +73,14 @@ CATBUS_MSG_TYPE_FILE_CHECK                 = ( 8 + CATBUS_MSG_FILE_GROUP_OFFSET
 CATBUS_MSG_TYPE_FILE_CHECK_RESPONSE        = ( 9 + CATBUS_MSG_FILE_GROUP_OFFSET )
 CATBUS_MSG_TYPE_FILE_LIST                  = ( 10 + CATBUS_MSG_FILE_GROUP_OFFSET )
 CATBUS_MSG_TYPE_FILE_LIST_DATA             = ( 11 + CATBUS_MSG_FILE_GROUP_OFFSET )
+CATBUS_MSG_TYPE_FILE_GET_WINDOW            = ( 12 + CATBUS_MSG_FILE_GROUP_OFFSET )
 
 CATBUS_MSG_FILE_FLAG_READ                  = 0x01
 CATBUS_MSG_FILE_FLAG_WRITE                 = 0x02
+CATBUS_MSG_FILE_FLAG_WINDOW_REQ            = 0x04
+CATBUS_MSG_FILE_FLAG_WINDOWED              = 0x08
+
+CATBUS_FILE_MAX_WINDOW                     = 8
 
 CATBUS_DISC_FLAG_QUERY_ALL                 = 0x01
 
@@ -233,6 +241,29 @@ class LinkDataMsg(StructField):
 
         self.header.msg_type = CATBUS_MSG_TYPE_LINK_DATA
 
+class LinkDataEntry(StructField):
+    def __init__(self, **kwargs):
+        fields = [CatbusHash(_name="source_hash"),
+                  CatbusHash(_name="dest_hash"),
+                  Uint16Field(_name="sequence"),
+                  Int32Field(_name="data")]
+
+        super(LinkDataEntry, self).__init__(_name="link_data_entry", _fields=fields, **kwargs)
+
+class LinkDataMultiMsg(StructField):
+    def __init__(self, **kwargs):
+        fields = [MsgHeader(_name="header"),
+                  Uint8Field(_name="flags"),
+                  NTPTimestampField(_name='ntp_timestamp'),
+                  CatbusQuery(_name="source_query"),
+                  Uint8Field(_name="count"),
+                  ArrayField(_name="entries", _field=LinkDataEntry)]
+
+        super(LinkDataMultiMsg, self).__init__(_name="link_data_multi_msg", _fields=fields, **kwargs)
+
+        self.header.msg_type = CATBUS_MSG_TYPE_LINK_DATA_MULTI
+        self.count = len(self.entries)
+
 
 class FileOpenMsg(StructField):
     def __init__(self, **kwargs):
@@ -281,6 +312,18 @@ class FileGetMsg(StructField):
 
         self.header.msg_type = CATBUS_MSG_TYPE_FILE_GET
 
+class FileGetWindowMsg(StructField):
+    def __init__(self, **kwargs):
+        fields = [MsgHeader(_name="header"),
+                  Uint8Field(_name="flags"),
+                  Uint32Field(_name="session_id"),
+                  Int32Field(_name="offset"),
+                  Uint8Field(_name="page_mask")]
+
+        super(FileGetWindowMsg, self).__init__(_name="file_get_window_msg", _fields=fields, **kwargs)
+
+        self.header.msg_type = CATBUS_MSG_TYPE_FILE_GET_WINDOW
+
 class FileCloseMsg(StructField):
     def __init__(self, **kwargs):
         fields = [MsgHeader(_name="header"),
@@ -372,6 +415,7 @@ messages = {
 
     CATBUS_MSG_TYPE_LINK:                   LinkMsg,
     CATBUS_MSG_TYPE_LINK_DATA:              LinkDataMsg,
+    CATBUS_MSG_TYPE_LINK_DATA_MULTI:        LinkDataMultiMsg,
 
     CATBUS_MSG_TYPE_FILE_OPEN:              FileOpenMsg,
     CATBUS_MSG_TYPE_FILE_CONFIRM:           FileConfirmMsg,
@@ -385,6 +429,7 @@ messages = {
 
     CATBUS_MSG_TYPE_FILE_LIST:              FileListMsg, 
     CATBUS_MSG_TYPE_FILE_LIST_DATA:         FileListDataMsg, 
+    CATBUS_MSG_TYPE_FILE_GET_WINDOW:        FileGetWindowMsg, 
 }
 
 
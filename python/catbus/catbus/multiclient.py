@@ -0,0 +1,437 @@
+# <license>
+#
+#     This file is part of the Sapphire Operating System.
+#
+#     Copyright (C) 2013-2018  Jeremy Billheimer
+#
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+#
+#     You should have received a copy of the GNU General Public License
+#     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# </license>
+
+"""
+Multiplexing catbus client.
+
+Client runs one exchange at a time and blocks on each reply. When
+talking to a lot of devices, almost all of that time is spent waiting
+on the network. MultiClient instead keeps many requests in flight on
+a single socket and matches replies back to their requests by
+transaction ID, so the total time for a bulk operation is close to
+the slowest device instead of the sum of all of them.
+
+Each request is retried on timeout the same way Client._exchange
+does it. The number of requests in flight is capped, so a large
+group does not flood the network or the devices' receive queues.
+
+The bulk operations return a BulkResult per host with the result,
+the error (if any) and the time the operation took for that host.
+"""
+
+import socket
+import select
+import time
+import random
+from collections import deque
+
+from data_structures import *
+from messages import *
+from options import *
+
+
+DEFAULT_MAX_IN_FLIGHT   = 32
+DEFAULT_TIMEOUT         = 1.0
+DEFAULT_TRIES           = 5
+
+
+class BulkResult(object):
+    def __init__(self, result=None, error=None, elapsed=0.0):
+        self.result = result
+        self.error = error
+        self.elapsed = elapsed
+
+    @property
+    def ok(self):
+        return self.error == None
+
+    def __str__(self):
+        if self.ok:
+            return "%s (%.1f ms)" % (self.result, self.elapsed * 1000.0)
+
+        return "Error: %s (%.1f ms)" % (self.error, self.elapsed * 1000.0)
+
+    def __repr__(self):
+        return str(self)
+
+
+class Request(object):
+    def __init__(self, msg, host, callback=None):
+        self.msg = msg
+        self.host = host
+        self.callback = callback
+
+        self.reply = None
+        self.sender = None
+        self.error = None
+
+        self.attempts = 0
+        self.start = None
+        self.elapsed = 0.0
+
+        self._deadline = None
+
+    @property
+    def done(self):
+        return (self.reply != None) or (self.error != None)
+
+
+class _Operation(object):
+    # tracks a bulk operation on one host, which may take several requests
+    def __init__(self, host):
+        self.host = host
+        self.start = None
+        self.result = {}
+        self.error = None
+        self.outstanding = 0
+        self.bulk_result = None
+
+    def finish(self, now):
+        if self.bulk_result != None:
+            return
+
+        if self.start == None:
+            self.start = now
+
+        if self.error != None:
+            self.result = None
+
+        self.bulk_result = BulkResult(self.result, self.error, now - self.start)
+
+
+def _normalize_host(host):
+    if isinstance(host, basestring):
+        # if no port is specified, set default
+        return (host, CATBUS_DISCOVERY_PORT)
+
+    return tuple(host)
+
+
+class MultiClient(object):
+    def __init__(self, max_in_flight=DEFAULT_MAX_IN_FLIGHT, timeout=DEFAULT_TIMEOUT, tries=DEFAULT_TRIES):
+        self.__sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.__sock.setblocking(0)
+
+        self.max_in_flight = max_in_flight
+        self.timeout = timeout
+        self.tries = tries
+
+        self._queue = deque()
+        self._pending = {}
+
+        # counters, for benchmarking
+        self.requests_sent = 0
+        self.retransmits = 0
+        self.stray_replies = 0
+
+    def close(self):
+        self.__sock.close()
+
+    def submit(self, msg, host, callback=None, front=False):
+        """Queue a request. callback(request) is called from run() when
+        the request completes, and may submit further requests.
+
+        Requests with front set go ahead of everything already queued.
+        """
+
+        request = Request(msg, _normalize_host(host), callback)
+
+        if front:
+            self._queue.appendleft(request)
+
+        else:
+            self._queue.append(request)
+
+        return request
+
+    def _send(self, request):
+        now = time.time()
+
+        if request.start == None:
+            request.start = now
+
+        if request.attempts > 0:
+            self.retransmits += 1
+
+        request.attempts += 1
+        request._deadline = now + self.timeout
+        self.requests_sent += 1
+
+        try:
+            self.__sock.sendto(request.msg.pack(), request.host)
+
+        except socket.error:
+            # treated as a lost packet, the timeout will retry it
+            pass
+
+    def _start(self, request):
+        # pick a transaction ID that isn't already in flight
+        while request.msg.header.transaction_id in self._pending:
+            request.msg.header.transaction_id = random.randint(0, pow(2, 32) - 1)
+
+        self._pending[request.msg.header.transaction_id] = request
+
+        self._send(request)
+
+    def _complete(self, request):
+        del self._pending[request.msg.header.transaction_id]
+
+        request.elapsed = time.time() - request.start
+
+        if request.callback:
+            request.callback(request)
+
+    def _receive(self):
+        while True:
+            try:
+                data, sender = self.__sock.recvfrom(4096)
+
+            except socket.error:
+                return
+
+            try:
+                reply_msg = deserialize(data)
+
+            except (UnknownMessageException, InvalidMessageException):
+                self.stray_replies += 1
+                continue
+
+            try:
+                request = self._pending[reply_msg.header.transaction_id]
+
+            except KeyError:
+                # late reply to a request that was already retried
+                # and completed, or something we didn't ask for.
+                self.stray_replies += 1
+                continue
+
+            if sender[0] != request.host[0]:
+                self.stray_replies += 1
+                continue
+
+            if isinstance(reply_msg, ErrorMsg):
+                request.error = ProtocolErrorException(reply_msg.error_code, lookup_error_msg(reply_msg.error_code))
+
+            else:
+                request.reply = reply_msg
+                request.sender = sender
+
+            self._complete(request)
+
+    def _check_timeouts(self):
+        now = time.time()
+
+        for request in self._pending.values():
+            if request._deadline > now:
+                continue
+
+            if request.attempts < self.tries:
+                self._send(request)
+
+            else:
+                request.error = NoResponseFromHost(request.msg.header.msg_type)
+                self._complete(request)
+
+    def run(self):
+        """Run until all submitted requests have completed."""
+
+        while (len(self._queue) > 0) or (len(self._pending) > 0):
+            while (len(self._queue) > 0) and (len(self._pending) < self.max_in_flight):
+                self._start(self._queue.popleft())
+
+            if len(self._pending) == 0:
+                continue
+
+            wait = min([r._deadline for r in self._pending.itervalues()]) - time.time()
+
+            if wait < 0.0:
+                wait = 0.0
+
+            try:
+                readable, writable, exceptional = select.select([self.__sock], [], [], wait)
+
+            except select.error:
+                readable = []
+
+            if len(readable) > 0:
+                self._receive()
+
+            self._check_timeouts()
+
+    def _run_operations(self, hosts, start_func):
+        operations = {}
+
+        for host in hosts:
+            op = _Operation(_normalize_host(host))
+            operations[host] = op
+
+            start_func(op)
+
+            if op.outstanding == 0:
+                op.finish(time.time())
+
+        self.run()
+
+        return {host: op.bulk_result for host, op in operations.iteritems()}
+
+    def _submit_op(self, op, msg, handler):
+        def callback(request):
+            if op.start == None or request.start < op.start:
+                op.start = request.start
+
+            op.outstanding -= 1
+
+            if op.error == None:
+                if request.error != None:
+                    op.error = request.error
+
+                else:
+                    try:
+                        handler(request.reply)
+
+                    except Exception as e:
+                        op.error = e
+
+            if op.outstanding == 0:
+                op.finish(time.time())
+
+        op.outstanding += 1
+
+        # follow up requests for an operation that is already under
+        # way go to the front of the queue, so operations complete
+        # in the order they started instead of all finishing at the end.
+        self.submit(msg, op.host, callback=callback, front=(op.start != None))
+
+    def ping(self, hosts):
+        """Ping each host. The result is the round trip time in seconds."""
+
+        def start(op):
+            def handler(reply):
+                op.result = time.time() - op.start
+
+            self._submit_op(op, DiscoverMsg(flags=CATBUS_DISC_FLAG_QUERY_ALL), handler)
+
+        return self._run_operations(hosts, start)
+
+    def _submit_get_keys(self, op, key_list, handler):
+        hashes = {}
+        for key in key_list:
+            hashes[catbus_string_hash(key)] = key
+
+        request_list = hashes.keys()
+
+        def make_chunk_handler(chunk):
+            def chunk_handler(reply):
+                received = [item.meta.hash for item in reply.data]
+
+                for h in chunk:
+                    if h not in received:
+                        raise KeyError(hashes[h])
+
+                for item in reply.data:
+                    handler(hashes[item.meta.hash], item)
+
+            return chunk_handler
+
+        while len(request_list) > 0:
+            chunk = request_list[:CATBUS_MAX_GET_KEY_ITEM_COUNT]
+            request_list = request_list[CATBUS_MAX_GET_KEY_ITEM_COUNT:]
+
+            self._submit_op(op, GetKeysMsg(hashes=chunk), make_chunk_handler(chunk))
+
+    def get_keys(self, hosts, *keys, **kwargs):
+        """Get keys from each host. The result is a dict of key: value,
+        or key: CatbusData if with_meta is set."""
+
+        with_meta = False
+        if 'with_meta' in kwargs and kwargs['with_meta']:
+            with_meta = True
+
+        # convert unicode to ascii
+        key_list = [str(k) for k in keys]
+
+        def start(op):
+            def handler(key, item):
+                if with_meta:
+                    op.result[key] = item
+
+                else:
+                    op.result[key] = item.value
+
+            self._submit_get_keys(op, key_list, handler)
+
+        return self._run_operations(hosts, start)
+
+    def set_keys(self, hosts, **kwargs):
+        """Set keys on each host. The result is a dict of key: value as
+        read back from the device."""
+
+        # convert unicode to ascii
+        key_data = {}
+        for k, v in kwargs.iteritems():
+            if isinstance(v, basestring):
+                # we do not support unicode, and things break if leaks into the system
+                v = str(v)
+
+            if v == '__null__':
+                v = ''
+
+            key_data[str(k)] = v
+
+        hashes = {}
+        for key in key_data:
+            hashes[catbus_string_hash(key)] = key
+
+        def start(op):
+            # need to get meta data so we can pack.
+            # this is the same two step exchange Client.set_keys does,
+            # but each host moves on to its set as soon as its own
+            # meta data arrives.
+            meta = {}
+
+            def set_handler(reply):
+                for item in reply.data:
+                    op.result[hashes[item.meta.hash]] = item.value
+
+            def meta_handler(key, item):
+                meta[key] = item.meta
+
+                if len(meta) < len(key_data):
+                    return
+
+                # filter into batches
+                batch = CatbusDataArray()
+
+                for key in key_data:
+                    item = CatbusData(meta=meta[key], value=key_data[key])
+
+                    if (len(batch) > 0) and (batch.size() + item.size() >= CATBUS_MAX_DATA):
+                        self._submit_op(op, SetKeysMsg(data=batch), set_handler)
+                        batch = CatbusDataArray()
+
+                    batch.append(item)
+
+                self._submit_op(op, SetKeysMsg(data=batch), set_handler)
+
+            self._submit_get_keys(op, key_data.keys(), meta_handler)
+
+        return self._run_operations(hosts, start)
@@ -25,6 +25,8 @@ import logging
 import time
 import threading
 import select
+import os
+import random
 from client import Client
 
 from messages import *
@@ -182,9 +184,16 @@ class Publisher(Ribbon):
 
 
 class Server(Ribbon):
-    def initialize(self, data_port=None, database=None, visible=True):
+    def initialize(self, data_port=None, database=None, visible=True, file_path=None):
         self._database = database
 
+        # directory served through the file messages, None to disable
+        self._file_path = file_path
+        self._file_sessions = {}
+
+        # set to False to behave like a server without windowed reads
+        self.file_windowing = True
+
         self.name = '%s.%s' % (self._database[META_TAG_NAME], 'server')
 
         self.visible = visible
@@ -239,6 +248,13 @@ class Server(Ribbon):
             SetKeysMsg: self._handle_set_keys,
             LinkMsg: self._handle_link,
             LinkDataMsg: self._handle_link_data,
+            LinkDataMultiMsg: self._handle_link_data_multi,
+            FileOpenMsg: self._handle_file_open,
+            FileGetMsg: self._handle_file_get,
+            FileGetWindowMsg: self._handle_file_get_window,
+            FileDataMsg: self._handle_file_data,
+            FileCloseMsg: self._handle_file_close,
+            FileDeleteMsg: self._handle_file_delete,
         }
 
         self._last_announce = time.time() - 10.0
@@ -435,6 +451,8 @@ class Server(Ribbon):
     def _handle_set_keys(self, msg, host):
         reply_items = []
 
+        # check every item before setting any of them, so an error
+        # doesn't leave the batch partially applied.
         for item in msg.data:
             try:
                 db_item = self._database.get_item(item.meta.hash)
@@ -450,6 +468,7 @@ class Server(Ribbon):
             if db_item.meta.flags & CATBUS_FLAGS_READ_ONLY:
                 raise GenericProtocolException
 
+        for item in msg.data:
             # set data
             self._database[item.meta.hash] = item.value
 
@@ -477,7 +496,7 @@ class Server(Ribbon):
                 return
 
             # change link flags and echo message back to sender
-            reply_msg = LinkMsg(flags=CATBUS_MSG_LINK_FLAGS_DEST,
+            reply_msg = LinkMsg(flags=CATBUS_MSG_LINK_FLAGS_DEST | CATBUS_MSG_LINK_FLAG_MULTI_DATA,
                                 source_hash=msg.source_hash,
                                 dest_hash=msg.dest_hash,
                                 query=msg.query)
@@ -506,6 +525,13 @@ class Server(Ribbon):
             self._send_list.append(entry)
 
     def _handle_link_data(self, msg, host):
+        self._receive_link_data(msg, msg.source_hash, msg.dest_hash, msg.sequence, msg.data, host)
+
+    def _handle_link_data_multi(self, msg, host):
+        for entry in msg.entries:
+            self._receive_link_data(msg, entry.source_hash, entry.dest_hash, entry.sequence, entry.data, host)
+
+    def _receive_link_data(self, msg, source_hash, dest_hash, sequence, data, host):
         # setup timestamp
         if (msg.flags & CATBUS_MSG_LINK_FLAGS_DEST) == 0:
             timestamp = util.now()
@@ -513,7 +539,7 @@ class Server(Ribbon):
             timestamp = util.ntp_to_datetime(msg.ntp_timestamp.seconds, msg.ntp_timestamp.fraction)
 
         try:
-            item = self._database.get_item(msg.dest_hash)
+            item = self._database.get_item(dest_hash)
 
         except KeyError:
             return
@@ -524,27 +550,27 @@ class Server(Ribbon):
 
         # check current receive cache
         try:
-            if self._receive_cache[msg.dest_hash][host]['sequence'] != msg.sequence:
+            if self._receive_cache[dest_hash][host]['sequence'] != sequence:
                 # set data
-                self._database[msg.dest_hash] = msg.data
+                self._database[dest_hash] = data
 
         except KeyError:
             # set data
-            self._database[msg.dest_hash] = msg.data
+            self._database[dest_hash] = data
 
         with self.__lock:
-            if msg.dest_hash not in self._receive_cache:
-                self._receive_cache[msg.dest_hash] = {}
+            if dest_hash not in self._receive_cache:
+                self._receive_cache[dest_hash] = {}
 
-            self._receive_cache[msg.dest_hash][host] = {
+            self._receive_cache[dest_hash][host] = {
                 'ttl': 32,
-                'data': msg.data,
-                'sequence': msg.sequence
+                'data': data,
+                'sequence': sequence
             }
 
         # get matching links
         with self.__lock:
-            links = [l for l in self._links if l.source_hash == msg.source_hash and query_tags(l.tags, msg.source_query)]
+            links = [l for l in self._links if l.source_hash == source_hash and query_tags(l.tags, msg.source_query)]
 
         for link in links:
             if link.callback:
@@ -552,8 +578,126 @@ class Server(Ribbon):
                 for hashed_key in msg.source_query:
                     source_query.append(self.resolve_hash(hashed_key, host))
 
-                link.callback(link.source_key, msg.data, source_query, timestamp)
+                link.callback(link.source_key, data, source_query, timestamp)
+
+
+    def _get_file_path(self, filename):
+        return os.path.join(self._file_path, os.path.basename(filename))
+
+    def _handle_file_open(self, msg, host):
+        if self._file_path is None:
+            return ErrorMsg(error_code=CATBUS_ERROR_FILE_NOT_FOUND)
+
+        flags = msg.flags
+
+        if flags & CATBUS_MSG_FILE_FLAG_WRITE:
+            data = ''
+
+        else:
+            try:
+                with open(self._get_file_path(msg.filename), 'rb') as f:
+                    data = f.read()
+
+            except IOError:
+                return ErrorMsg(error_code=CATBUS_ERROR_FILE_NOT_FOUND)
+
+        # accept windowed reads
+        if flags & CATBUS_MSG_FILE_FLAG_WINDOW_REQ:
+            flags &= ~CATBUS_MSG_FILE_FLAG_WINDOW_REQ
+
+            if self.file_windowing:
+                flags |= CATBUS_MSG_FILE_FLAG_WINDOWED
+
+        session_id = random.randint(0, pow(2, 32) - 1)
+
+        self._file_sessions[session_id] = {
+            'filename': msg.filename,
+            'flags': flags,
+            'data': data
+        }
+
+        return FileConfirmMsg(
+                flags=flags,
+                filename=msg.filename,
+                status=0,
+                session_id=session_id,
+                page_size=CATBUS_MAX_DATA)
+
+    def _make_file_data_msg(self, session_id, offset):
+        session = self._file_sessions[session_id]
+        data = session['data'][offset:offset + CATBUS_MAX_DATA]
+
+        return FileDataMsg(
+                flags=session['flags'],
+                session_id=session_id,
+                offset=offset,
+                len=len(data),
+                data=data)
+
+    def _handle_file_get(self, msg, host):
+        if msg.session_id not in self._file_sessions:
+            return ErrorMsg(error_code=CATBUS_ERROR_INVALID_FILE_SESSION)
+
+        return self._make_file_data_msg(msg.session_id, msg.offset)
+
+    def _handle_file_get_window(self, msg, host):
+        if msg.session_id not in self._file_sessions:
+            return ErrorMsg(error_code=CATBUS_ERROR_INVALID_FILE_SESSION)
+
+        session = self._file_sessions[msg.session_id]
+
+        if (session['flags'] & CATBUS_MSG_FILE_FLAG_WINDOWED) == 0:
+            return ErrorMsg(error_code=CATBUS_ERROR_PROTOCOL_ERROR)
+
+        for i in xrange(CATBUS_FILE_MAX_WINDOW):
+            if (msg.page_mask & (1 << i)) == 0:
+                continue
+
+            offset = msg.offset + i * CATBUS_MAX_DATA
+
+            self._send_data_msg(self._make_file_data_msg(msg.session_id, offset), host)
+
+            # the end of file page ends the window
+            if offset >= len(session['data']):
+                break
+
+    def _handle_file_data(self, msg, host):
+        if msg.session_id not in self._file_sessions:
+            return ErrorMsg(error_code=CATBUS_ERROR_INVALID_FILE_SESSION)
+
+        session = self._file_sessions[msg.session_id]
+
+        if msg.offset == len(session['data']):
+            session['data'] += msg.data[:msg.len]
+
+            return FileGetMsg(
+                    flags=session['flags'],
+                    session_id=msg.session_id,
+                    offset=len(session['data']))
+
+    def _handle_file_close(self, msg, host):
+        if msg.session_id not in self._file_sessions:
+            return ErrorMsg(error_code=CATBUS_ERROR_INVALID_FILE_SESSION)
+
+        session = self._file_sessions.pop(msg.session_id)
+
+        if session['flags'] & CATBUS_MSG_FILE_FLAG_WRITE:
+            with open(self._get_file_path(session['filename']), 'wb') as f:
+                f.write(session['data'])
+
+        return FileAckMsg()
+
+    def _handle_file_delete(self, msg, host):
+        if self._file_path is None:
+            return ErrorMsg(error_code=CATBUS_ERROR_FILE_NOT_FOUND)
+
+        try:
+            os.remove(self._get_file_path(msg.filename))
+
+        except OSError:
+            return ErrorMsg(error_code=CATBUS_ERROR_FILE_NOT_FOUND)
 
+        return FileAckMsg()
 
     def _process_msg(self, msg, host):
         response = self._msg_handlers[type(msg)](msg, host)
@@ -613,10 +757,10 @@ class Server(Ribbon):
             # broadcast links
             with self.__lock:
                 for link in self._links:
-                    link_flags = 0
+                    link_flags = CATBUS_MSG_LINK_FLAG_MULTI_DATA
 
                     if link.source:
-                        link_flags = CATBUS_MSG_LINK_FLAG_SOURCE
+                        link_flags |= CATBUS_MSG_LINK_FLAG_SOURCE
                     
                     query = CatbusQuery()
                     query._value = link.tags
@@ -1,9 +1,19 @@
 import unittest
+import os
+import socket
+import time
+import shutil
+import tempfile
 
 from catbus import *
 from catbus.database import Database
 from catbus.data_structures import catbus_string_hash
 from catbus.options import CATBUS_DISCOVERY_PORT
+from catbus.messages import FileDataMsg, SetKeysMsg, LinkDataMultiMsg, LinkDataEntry, CATBUS_MAX_DATA
+from catbus.messages import serialize
+from catbus.multiclient import MultiClient
+from catbus.fakenode import FakeNodeServer
+from catbus.data_structures import ProtocolErrorException, NoResponseFromHost
 
 
 class DatabaseTests(unittest.TestCase):
@@ -73,12 +83,73 @@ class ProtocolTestsLocal(unittest.TestCase, ProtocolTestBase):
 
     def setUp(self):
         self.catbus = CatbusService(name='catbus', location='test_location', tags=[self.CATBUS_TEST_TAG])
+
+        for i in xrange(30):
+            self.catbus.add_item('batch_key_%d' % (i), 0, 'uint32')
+
         self.client = Client()
         self.client.connect(('localhost', self.catbus._data_port))
 
     def tearDown(self):
         self.catbus.stop()
 
+    def test_set_batch(self):
+        exchanges = []
+        exchange = self.client._exchange
+
+        def counting_exchange(msg, *args, **kwargs):
+            exchanges.append(msg)
+            return exchange(msg, *args, **kwargs)
+
+        self.client._exchange = counting_exchange
+
+        values = {'batch_key_%d' % (i): i * 1000 for i in xrange(30)}
+        self.client.set_keys(**values)
+
+        # 30 uint32 keys fit in one message, and no meta data round trip
+        self.assertEqual(len(exchanges), 1)
+
+        for k, v in values.iteritems():
+            self.assertEqual(self.catbus[k], v)
+
+    def test_set_batch_read_only(self):
+        device_id = self.catbus['device_id']
+
+        items = self.client.get_keys('batch_key_0', 'device_id', with_meta=True)
+        items['batch_key_0'].value = 123
+        items['device_id'].value = 123
+
+        # the server rejects the message, which this server reports by not replying
+        with self.assertRaises(NoResponseFromHost):
+            self.client._exchange(SetKeysMsg(data=[items['batch_key_0'], items['device_id']]), tries=1)
+
+        # a read only key in the batch means nothing gets set
+        self.assertEqual(self.catbus['batch_key_0'], 0)
+        self.assertEqual(self.catbus['device_id'], device_id)
+
+    def test_link_data_multi(self):
+        entries = [LinkDataEntry(source_hash=catbus_string_hash('source_%d' % (i)),
+                                 dest_hash=catbus_string_hash('batch_key_%d' % (i)),
+                                 sequence=i + 1,
+                                 data=i * 10 + 5) for i in xrange(4)]
+
+        msg = LinkDataMultiMsg(entries=entries)
+        self.assertEqual(msg.count, 4)
+
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.sendto(serialize(msg), ('localhost', self.catbus._data_port))
+        sock.close()
+
+        # the server applies link data asynchronously
+        for i in xrange(20):
+            if self.catbus['batch_key_3'] == 35:
+                break
+
+            time.sleep(0.05)
+
+        for i in xrange(4):
+            self.assertEqual(self.catbus['batch_key_%d' % (i)], i * 10 + 5)
+
 class ProtocolTestsRemote(unittest.TestCase, ProtocolTestBase):
     CATBUS_TEST_TAG = '__catbus_remote_test__'
 
@@ -87,3 +158,151 @@ class ProtocolTestsRemote(unittest.TestCase, ProtocolTestBase):
         self.client.connect(('10.0.0.117', CATBUS_DISCOVERY_PORT))
 
 
+
+
+class FileTransferTestsLocal(unittest.TestCase):
+    CATBUS_TEST_TAG = '___CATBUS_UNIT_TEST____'
+    FILE_SIZE = 64 * 1024 + 100
+
+    def setUp(self):
+        self.file_path = tempfile.mkdtemp()
+        self.file_data = os.urandom(self.FILE_SIZE)
+
+        with open(os.path.join(self.file_path, 'test_file'), 'wb') as f:
+            f.write(self.file_data)
+
+        self.catbus = CatbusService(name='catbus', location='test_location', tags=[self.CATBUS_TEST_TAG], file_path=self.file_path)
+        self.client = Client()
+        self.client.connect(('localhost', self.catbus._data_port), get_meta=False)
+
+    def tearDown(self):
+        self.catbus.stop()
+        shutil.rmtree(self.file_path)
+
+    def test_read_window_throughput(self):
+        for window in [1, 2, 4, 8]:
+            self.client.set_window(window, self.client.write_window_size)
+
+            start = time.time()
+            data = self.client.read_file('test_file')
+            elapsed = time.time() - start
+
+            self.assertEqual(data, self.file_data)
+
+            print "\nwindow %d: %.1f KB/s" % (window, (len(data) / 1024.0) / elapsed),
+
+    def test_read_legacy_server(self):
+        # server without windowed reads, client falls back to stop and wait
+        self.catbus._server.file_windowing = False
+
+        self.assertEqual(self.client.read_file('test_file'), self.file_data)
+
+    def test_read_selective_retransmit(self):
+        server = self.catbus._server
+        send = server._send_data_msg
+        count = [0]
+
+        # drop every 5th data page
+        def lossy_send(msg, host):
+            if isinstance(msg, FileDataMsg):
+                count[0] += 1
+
+                if count[0] % 5 == 0:
+                    return
+
+            send(msg, host)
+
+        server._send_data_msg = lossy_send
+
+        self.client.set_window(8, self.client.write_window_size)
+        self.assertEqual(self.client.read_file('test_file'), self.file_data)
+
+    def test_read_page_sizes(self):
+        for size in [0, 1, CATBUS_MAX_DATA, CATBUS_MAX_DATA * 8, CATBUS_MAX_DATA * 8 + 1]:
+            data = os.urandom(size)
+
+            with open(os.path.join(self.file_path, 'test_size'), 'wb') as f:
+                f.write(data)
+
+            self.assertEqual(self.client.read_file('test_size'), data)
+
+    def test_write(self):
+        self.client.write_file('test_write', file_data=self.file_data)
+        self.assertEqual(self.client.read_file('test_write'), self.file_data)
+
+
+class MultiClientTestsLocal(unittest.TestCase):
+    NODE_COUNT = 50
+
+    def setUp(self):
+        self.server = FakeNodeServer(count=self.NODE_COUNT, latency=0.01)
+        self.client = MultiClient(max_in_flight=16, timeout=0.2)
+
+    def tearDown(self):
+        self.client.close()
+        self.server.stop()
+        self.server.join()
+
+    def test_get_keys(self):
+        results = self.client.get_keys(self.server.hosts, 'kv_test_key', 'pix_count')
+
+        self.assertEqual(len(results), self.NODE_COUNT)
+
+        for node in self.server.nodes:
+            r = results[node.host]
+
+            self.assertTrue(r.ok)
+            self.assertEqual(r.result, {'kv_test_key': node.index, 'pix_count': 60})
+            self.assertTrue(r.elapsed >= 0.01)
+
+    def test_set_keys(self):
+        results = self.client.set_keys(self.server.hosts, gfx_master_dimmer=1234, gfx_sub_dimmer=5678)
+
+        for node in self.server.nodes:
+            self.assertEqual(results[node.host].result, {'gfx_master_dimmer': 1234, 'gfx_sub_dimmer': 5678})
+            self.assertEqual(node.database['gfx_master_dimmer'], 1234)
+            self.assertEqual(node.database['gfx_sub_dimmer'], 5678)
+
+    def test_ping(self):
+        results = self.client.ping(self.server.hosts)
+
+        for r in results.itervalues():
+            self.assertTrue(r.ok)
+            self.assertTrue(r.result >= 0.01)
+
+    def test_errors(self):
+        results = self.client.get_keys(self.server.hosts[:2], 'not_a_key')
+
+        for r in results.itervalues():
+            self.assertIsInstance(r.error, ProtocolErrorException)
+
+        results = self.client.set_keys(self.server.hosts[:2], device_id=0)
+
+        for r in results.itervalues():
+            self.assertIsInstance(r.error, ProtocolErrorException)
+
+        # one host that never answers doesn't hold up the rest
+        dead_host = ('127.0.0.1', 1)
+        results = self.client.ping(self.server.hosts + [dead_host])
+
+        self.assertIsInstance(results[dead_host].error, NoResponseFromHost)
+        self.assertEqual(len([r for r in results.itervalues() if r.ok]), self.NODE_COUNT)
+
+    def test_retries(self):
+        self.server.drop_rate = 0.3
+
+        results = self.client.get_keys(self.server.hosts, 'kv_test_key')
+
+        for node in self.server.nodes:
+            self.assertEqual(results[node.host].result, {'kv_test_key': node.index})
+
+        self.assertTrue(self.client.retransmits > 0)
+
+    def test_concurrency(self):
+        # 50 nodes at 10 ms each would take 500 ms one at a time
+        start = time.time()
+        results = self.client.get_keys(self.server.hosts, 'kv_test_key')
+        elapsed = time.time() - start
+
+        self.assertEqual(len([r for r in results.itervalues() if r.ok]), self.NODE_COUNT)
+        self.assertTrue(elapsed < 0.4)
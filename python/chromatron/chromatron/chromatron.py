@@ -43,6 +43,7 @@ from sapphire.common.util import now
 import streamer
 
 import catbus
+from catbus.multiclient import MultiClient, BulkResult
 import code_gen
 
 import click
@@ -672,6 +673,49 @@ class Chromatron(object):
         self.set_key('gfx_transpose', False)
 
 
+# default number of devices a group works on at the same time
+GROUP_MAX_CONCURRENCY = 16
+
+
+def run_concurrent(items, func, max_concurrency=GROUP_MAX_CONCURRENCY):
+    """Run func(item) on each item from a pool of at most max_concurrency
+    threads. Returns a BulkResult for each item, in the same order."""
+
+    results = [None] * len(items)
+    lock = threading.Lock()
+    # note list() is shadowed by the 'list' CLI command in this module
+    work = [(i, item) for i, item in enumerate(items)]
+
+    def worker():
+        while True:
+            with lock:
+                if len(work) == 0:
+                    return
+
+                i, item = work.pop(0)
+
+            start = time.time()
+
+            try:
+                results[i] = BulkResult(result=func(item), elapsed=time.time() - start)
+
+            except Exception as e:
+                results[i] = BulkResult(error=e, elapsed=time.time() - start)
+
+    threads = []
+    for i in xrange(max(1, min(max_concurrency, len(items)))):
+        t = threading.Thread(target=worker)
+        t.daemon = True
+        t.start()
+
+        threads.append(t)
+
+    for t in threads:
+        t.join()
+
+    return results
+
+
 class DeviceGroup(DictMixin, object):
     def __init__(self, *args, **kwargs):
         try:
@@ -679,6 +723,11 @@ class DeviceGroup(DictMixin, object):
         except KeyError:
             host = None
 
+        try:
+            self.max_concurrency = kwargs['max_concurrency']
+        except KeyError:
+            self.max_concurrency = GROUP_MAX_CONCURRENCY
+
         self.group = {}
         self.matches = {}
         self.tags = args
@@ -753,7 +802,6 @@ class DeviceGroup(DictMixin, object):
         self.group = {}
 
         scan_group = []
-        threads = []
 
         def scan_func(device):
             device.init_scan()
@@ -762,13 +810,7 @@ class DeviceGroup(DictMixin, object):
             ct = Chromatron(host=match['host'][0], init_scan=False)
             scan_group.append(ct)
 
-            t = threading.Thread(target=scan_func, args=[ct])
-            t.start()
-
-            threads.append(t)
-
-        for t in threads:
-            t.join()
+        run_concurrent(scan_group, scan_func, self.max_concurrency)
 
         for ct in scan_group:
             try:
@@ -838,17 +880,93 @@ class DeviceGroup(DictMixin, object):
 
         return self
 
+    def run_bulk(self, func, max_concurrency=None):
+        """Run func(device) on every device in the group, with at most
+        max_concurrency devices in progress at a time.
+
+        Returns a dict of device_id: BulkResult, which holds the
+        result or the exception raised, and the time it took.
+        """
+
+        if max_concurrency == None:
+            max_concurrency = self.max_concurrency
+
+        devices = self.group.values()
+        results = run_concurrent(devices, func, max_concurrency)
+
+        return {d.device_id: r for d, r in zip(devices, results)}
+
+    def _run_catbus_bulk(self, op, fallback, *args, **kwargs):
+        # devices we can reach over the network are handled by a
+        # single multiplexing client, the rest fall back to a thread
+        # per device.
+        network = {}
+        local = []
+
+        for d in self.group.itervalues():
+            if d.client.is_connected():
+                network[d.client._connected_host] = d
+
+            else:
+                local.append(d)
+
+        results = {}
+
+        if len(network) > 0:
+            client = MultiClient(max_in_flight=self.max_concurrency)
+
+            try:
+                host_results = getattr(client, op)(network.keys(), *args, **kwargs)
+
+            finally:
+                client.close()
+
+            for host, r in host_results.iteritems():
+                results[network[host].device_id] = r
+
+        local_results = run_concurrent(local, fallback, self.max_concurrency)
+
+        for d, r in zip(local, local_results):
+            results[d.device_id] = r
+
+        return results
+
+    def get_keys_bulk(self, *keys):
+        """Get keys from every device in the group.
+
+        Returns a dict of device_id: BulkResult, where the result is
+        a dict of key: value.
+        """
+
+        return self._run_catbus_bulk('get_keys', lambda d: d.get_keys(*keys), *keys)
+
+    def set_keys_bulk(self, **kwargs):
+        """Set keys on every device in the group.
+
+        Returns a dict of device_id: BulkResult.
+        """
+
+        return self._run_catbus_bulk('set_keys', lambda d: d.set_keys(**kwargs), **kwargs)
+
     def make_func(self, f):
         def wrapper(*args, **kwargs):
-            results = {}
-            for d in self.group.itervalues():
+            def call(d):
                 try:
                     method = d.__getattribute__(f)
 
                 except AttributeError:
                     method = d._device.__getattribute__(f)
 
-                results[d.device_id] = method(*args, **kwargs)
+                return method(*args, **kwargs)
+
+            bulk_results = self.run_bulk(call)
+
+            results = {}
+            for device_id, r in bulk_results.iteritems():
+                if not r.ok:
+                    raise r.error
+
+                results[device_id] = r.result
 
             return results
 
@@ -856,30 +974,26 @@ class DeviceGroup(DictMixin, object):
 
     @property
     def dimmer(self):
-        results = {}
-        for d in self.group.itervalues():
-            results[d.device_id] = d.dimmer
-
-        return results
+        return {k: r.result for k, r in self.run_bulk(lambda d: d.dimmer).iteritems()}
 
     @dimmer.setter
     def dimmer(self, value):
-        for d in self.group.itervalues():
+        def set_dimmer(d):
             d.dimmer = value
 
+        self.run_bulk(set_dimmer)
+
     @property
     def sub_dimmer(self):
-        results = {}
-        for d in self.group.itervalues():
-            results[d.device_id] = d.sub_dimmer
-
-        return results
+        return {k: r.result for k, r in self.run_bulk(lambda d: d.sub_dimmer).iteritems()}
 
     @sub_dimmer.setter
     def sub_dimmer(self, value):
-        for d in self.group.itervalues():
+        def set_sub_dimmer(d):
             d.sub_dimmer = value
 
+        self.run_bulk(set_sub_dimmer)
+
     # @property
     # def hue(self):
     #     return []
@@ -32,7 +32,7 @@ from catbus import catbus_string_hash
 import trig
 from copy import copy
 
-VM_ISA_VERSION  = 8
+VM_ISA_VERSION  = 10
 
 RETURN_VAL_ADDR = 0
 RETURN_VAL_NAME = '___return_val'
@@ -1177,6 +1177,14 @@ class IntermediateNode(Node):
     def get_data_nodes(self):
         return []
 
+    # registers written by this node
+    def get_output_nodes(self):
+        return []
+
+    # registers read by this node
+    def get_input_nodes(self):
+        return self.get_data_nodes()
+
 class DataIR(IntermediateNode):
     def __init__(self, **kwargs):
         super(DataIR, self).__init__(**kwargs)
@@ -1317,6 +1325,12 @@ class CallIR(IntermediateNode):
         data.append(self.dest)
         return data
 
+    def get_output_nodes(self):
+        return [self.dest]
+
+    def get_input_nodes(self):
+        return [a for a in self.params]
+
     def __str__(self):
         s = '%3d %s CALL %s -> %s' % (self.line_no, self.indent * self.level, self.name, self.dest)
 
@@ -1469,6 +1483,12 @@ class NotIR(IntermediateNode):
     def get_data_nodes(self):
         return [self.dest, self.source]
 
+    def get_output_nodes(self):
+        return [self.dest]
+
+    def get_input_nodes(self):
+        return [self.source]
+
     def is_constant_op(self):
         return isinstance(self.source, ConstIR)
 
@@ -1487,6 +1507,12 @@ class BinopIR(IntermediateNode):
     def get_data_nodes(self):
         return [self.dest, self.left, self.right]
 
+    def get_output_nodes(self):
+        return [self.dest]
+
+    def get_input_nodes(self):
+        return [self.left, self.right]
+
     def is_constant_op(self):
         return isinstance(self.left, ConstIR) and isinstance(self.right, ConstIR)
 
@@ -1533,6 +1559,12 @@ class BinopIR(IntermediateNode):
         elif self.op == 'mod':
             val = self.left.name % self.right.name
 
+        elif self.op == 'lshift':
+            val = self.left.name << self.right.name
+
+        elif self.op == 'div_pow2':
+            val = self.left.name >> self.right.name
+
         # make sure we only emit integers
         val = int(val)
 
@@ -1570,6 +1602,12 @@ class CopyIR(IntermediateNode):
     def get_data_nodes(self):
         return [self.dest, self.src]
 
+    def get_output_nodes(self):
+        return [self.dest]
+
+    def get_input_nodes(self):
+        return [self.src]
+
     def __str__(self):
         return '%3d %s COPY %s = %s' % (self.line_no, self.indent * self.level, self.dest, self.src)
 
@@ -1582,6 +1620,12 @@ class ObjectLoadIR(IntermediateNode):
     def get_data_nodes(self):
         return [self.dest, self.src]
 
+    def get_output_nodes(self):
+        return [self.dest]
+
+    def get_input_nodes(self):
+        return [self.src]
+
     def is_constant_op(self):
         return False
 
@@ -1621,6 +1665,12 @@ class IndexLoadIR(IntermediateNode):
     def get_data_nodes(self):
         return [self.dest, self.src, self.x, self.y]
 
+    def get_output_nodes(self):
+        return [self.dest]
+
+    def get_input_nodes(self):
+        return [self.src, self.x, self.y]
+
     def is_constant_op(self):
         return False
 
@@ -1728,6 +1778,10 @@ class JumpIfLessThanWithPreIncIR(IntermediateNode):
     def get_data_nodes(self):
         return [self.op1, self.op2]
 
+    # op1 is incremented in place
+    def get_output_nodes(self):
+        return [self.op1]
+
     def __str__(self):
         return '%3d %s JUMP IF LESS THAN PRE INC ++%s < %s -> %s' % (self.line_no, self.indent * self.level, self.op1, self.op2, self.target.name)
 
@@ -2404,6 +2458,408 @@ class CodeGeneratorPass3(object):
 
         return state
 
+# Liveness analysis for temp registers.
+# Runs on the flattened IR from Pass3.
+# Var registers are never tracked, they are visible outside
+# of the VM and must keep their values.
+class TempLiveness(object):
+    def __init__(self, code):
+        self.code = code
+
+        self.uses = []
+        self.defs = []
+        self.succs = []
+        self.live_in = []
+        self.live_out = []
+
+        self.analyze()
+
+    def get_temps(self, nodes):
+        return set([a.name for a in nodes if isinstance(a, TempIR)])
+
+    def get_successors(self, i, labels):
+        ir = self.code[i]
+
+        if isinstance(ir, JumpIR):
+            return [labels[ir.target.name]]
+
+        elif isinstance(ir, (JumpIfZeroIR, JumpIfGteIR, JumpIfLessThanWithPreIncIR)):
+            return [i + 1, labels[ir.target.name]]
+
+        elif isinstance(ir, (ReturnIR, EndFunctionIR)):
+            return []
+
+        elif i + 1 < len(self.code):
+            return [i + 1]
+
+        return []
+
+    def analyze(self):
+        labels = {}
+        for i in xrange(len(self.code)):
+            if isinstance(self.code[i], LabelIR):
+                labels[self.code[i].name] = i
+
+        for i in xrange(len(self.code)):
+            ir = self.code[i]
+
+            self.uses.append(self.get_temps(ir.get_input_nodes()))
+            self.defs.append(self.get_temps(ir.get_output_nodes()))
+            self.succs.append(self.get_successors(i, labels))
+            self.live_in.append(set())
+            self.live_out.append(set())
+
+        # iterate backwards until nothing changes
+        changed = True
+        while changed:
+            changed = False
+
+            for i in reversed(xrange(len(self.code))):
+                live_out = set()
+                for succ in self.succs[i]:
+                    live_out |= self.live_in[succ]
+
+                live_in = self.uses[i] | (live_out - self.defs[i])
+
+                if live_in != self.live_in[i] or live_out != self.live_out[i]:
+                    self.live_in[i] = live_in
+                    self.live_out[i] = live_out
+                    changed = True
+
+    def get_intervals(self):
+        # a temp's interval covers every instruction where it is
+        # defined, used, or live. since loops jump backwards, a temp
+        # used inside a loop but defined before it stays live for
+        # the entire loop body.
+        intervals = {}
+
+        for i in xrange(len(self.code)):
+            for reg in self.live_in[i] | self.live_out[i] | self.uses[i] | self.defs[i]:
+                try:
+                    intervals[reg][1] = i
+
+                except KeyError:
+                    intervals[reg] = [i, i]
+
+        return intervals
+
+    def get_call_crossings(self):
+        # temps that are live across a call to a script function.
+        # the callee's temps may be allocated to any free address,
+        # so these must not share an address with anything.
+        functions = [ir.name for ir in self.code if isinstance(ir, FunctionIR)]
+        crossings = set()
+
+        for i in xrange(len(self.code)):
+            ir = self.code[i]
+
+            if isinstance(ir, CallIR) and ir.name in functions:
+                crossings |= self.live_out[i] - self.defs[i]
+
+        return crossings
+
+
+# Machine independent optimizations on the flattened IR.
+# Runs between Pass3 and Pass4, before registers have addresses.
+class CodeGeneratorOptimizer(object):
+    # pixel object attributes which cannot change while the VM is running
+    invariant_pix_attrs = ['count', 'size_x', 'size_y', 'index']
+
+    block_ends = (LabelIR, JumpIR, JumpIfZeroIR, JumpIfGteIR,
+                  JumpIfLessThanWithPreIncIR, ReturnIR, EndFunctionIR)
+
+    def __init__(self):
+        self.functions = []
+
+    def is_barrier(self, ir):
+        # script functions may write any global, and published vars
+        # can be changed over catbus while the VM is yielded.
+        return isinstance(ir, CallIR) and \
+               (ir.name in self.functions or ir.name == 'yield_frames')
+
+    def get_power_of_2(self, reg):
+        if not isinstance(reg, ConstIR) or not isinstance(reg.name, (int, long)):
+            return None
+
+        for k in xrange(1, 31):
+            if reg.name == (1 << k):
+                return k
+
+        return None
+
+    def fold(self, ir):
+        if isinstance(ir, NotIR) and ir.is_constant_op():
+            return CopyIR(ir.dest, ConstIR(int(not ir.source.name), line_no=ir.line_no), level=ir.level, line_no=ir.line_no)
+
+        if not isinstance(ir, BinopIR):
+            return None
+
+        if ir.is_constant_op():
+            # division is left to the VM if the result depends on
+            # how it rounds, or if it divides by zero.
+            if ir.op in ['div', 'mod', 'div_pow2'] and \
+               (ir.right.name <= 0 or ir.left.name < 0):
+                return None
+
+            const = ir.fold()
+
+            # the VM works in 32 bits
+            if const.name < -2**31 or const.name >= 2**31:
+                return None
+
+            return CopyIR(ir.dest, const, level=ir.level, line_no=ir.line_no)
+
+        # algebraic identities
+        left = ir.left.name if isinstance(ir.left, ConstIR) else None
+        right = ir.right.name if isinstance(ir.right, ConstIR) else None
+        src = None
+
+        if ir.op == 'add' and right == 0:
+            src = ir.left
+
+        elif ir.op == 'add' and left == 0:
+            src = ir.right
+
+        elif ir.op == 'sub' and right == 0:
+            src = ir.left
+
+        elif ir.op == 'mult' and right == 1:
+            src = ir.left
+
+        elif ir.op == 'mult' and left == 1:
+            src = ir.right
+
+        elif ir.op == 'mult' and (left == 0 or right == 0):
+            src = ConstIR(0, line_no=ir.line_no)
+
+        elif ir.op == 'div' and right == 1:
+            src = ir.left
+
+        if src is None:
+            return None
+
+        return CopyIR(ir.dest, src, level=ir.level, line_no=ir.line_no)
+
+    def propagate_constants(self, code):
+        # track registers holding a known constant within
+        # a basic block and fold anything that reads them.
+        changed = False
+        consts = {}
+
+        for i in xrange(len(code)):
+            ir = code[i]
+
+            if isinstance(ir, (BinopIR, NotIR, CopyIR)):
+                for attr in ['left', 'right', 'source', 'src']:
+                    reg = getattr(ir, attr, None)
+
+                    if isinstance(reg, (VarIR, TempIR)) and reg.name in consts:
+                        setattr(ir, attr, consts[reg.name])
+                        changed = True
+
+                folded = self.fold(ir)
+                if folded is not None:
+                    code[i] = ir = folded
+                    changed = True
+
+            if isinstance(ir, self.block_ends) or self.is_barrier(ir):
+                consts = {}
+                continue
+
+            for reg in ir.get_output_nodes():
+                consts.pop(reg.name, None)
+
+            if isinstance(ir, CopyIR) and \
+               isinstance(ir.dest, (VarIR, TempIR)) and \
+               isinstance(ir.src, ConstIR):
+
+                consts[ir.dest.name] = ir.src
+
+        return changed
+
+    def reduce_strength(self, code):
+        for ir in code:
+            if not isinstance(ir, BinopIR):
+                continue
+
+            if ir.op == 'mult':
+                k = self.get_power_of_2(ir.right)
+                if k is not None:
+                    ir.op = 'lshift'
+                    ir.right = ConstIR(k, line_no=ir.line_no)
+                    continue
+
+                k = self.get_power_of_2(ir.left)
+                if k is not None:
+                    ir.op = 'lshift'
+                    ir.left = ir.right
+                    ir.right = ConstIR(k, line_no=ir.line_no)
+
+            elif ir.op == 'div':
+                k = self.get_power_of_2(ir.right)
+                if k is not None:
+                    ir.op = 'div_pow2'
+                    ir.right = ConstIR(k, line_no=ir.line_no)
+
+    def find_loops(self, code):
+        # a loop is a label plus the last jump back to it.
+        labels = {}
+        loops = []
+
+        for i in xrange(len(code)):
+            ir = code[i]
+
+            if isinstance(ir, LabelIR):
+                labels[ir.name] = i
+
+            elif isinstance(ir, (JumpIR, JumpIfZeroIR, JumpIfGteIR, JumpIfLessThanWithPreIncIR)):
+                try:
+                    top = labels[ir.target.name]
+
+                except KeyError:
+                    continue
+
+                loops = [a for a in loops if a[0] != top]
+                loops.append((top, i))
+
+        # innermost first, so hoisted code can move
+        # out of the enclosing loop on the next round.
+        return sorted(loops, key=lambda a: a[1] - a[0])
+
+    def is_single_entry(self, code, top, bottom):
+        # the loop must only be entered by falling into the top label
+        prev = code[top - 1]
+        if isinstance(prev, (JumpIR, ReturnIR)):
+            return False
+
+        inner_labels = [ir.name for ir in code[top + 1:bottom + 1] if isinstance(ir, LabelIR)]
+        inner_labels.append(code[top].name)
+
+        for i in range(top) + range(bottom + 1, len(code)):
+            target = getattr(code[i], 'target', None)
+
+            if isinstance(target, LabelIR) and target.name in inner_labels:
+                return False
+
+        return True
+
+    def is_hoistable(self, ir):
+        if isinstance(ir, ObjectLoadIR):
+            return isinstance(ir.src, PixelObjIR) and ir.src.attr in self.invariant_pix_attrs
+
+        return isinstance(ir, (BinopIR, NotIR, CopyIR))
+
+    def is_invariant(self, ir, candidates, defined, written, live_in):
+        if not self.is_hoistable(ir) or not isinstance(ir.dest, TempIR):
+            return False
+
+        # a temp carried around the loop is not invariant
+        if ir.dest.name in live_in:
+            return False
+
+        for reg in ir.get_input_nodes():
+            if isinstance(reg, VarIR):
+                if written is None or reg.name in written:
+                    return False
+
+            elif isinstance(reg, TempIR):
+                # every earlier write to the temp must be hoisted
+                if not all(j in candidates for j in defined.get(reg.name, [])):
+                    return False
+
+            elif not isinstance(reg, (ConstIR, ObjIR)):
+                return False
+
+        return True
+
+    def hoist_loop(self, code, top, bottom, liveness):
+        body = code[top:bottom + 1]
+
+        if any(self.is_barrier(ir) for ir in body):
+            written = None
+
+        else:
+            written = set()
+            for ir in body:
+                written |= set([a.name for a in ir.get_output_nodes()])
+
+                if isinstance(ir, (ArrayOpIR, IndexStoreIR)):
+                    written.add(ir.dest.name)
+
+        excluded = set()
+
+        while True:
+            candidates = set()
+            defined = {}
+
+            for i in xrange(top, bottom + 1):
+                ir = code[i]
+
+                if i not in excluded and \
+                   self.is_invariant(ir, candidates, defined, written, liveness.live_in[top]):
+                    candidates.add(i)
+
+                for reg in ir.get_output_nodes():
+                    if isinstance(reg, TempIR):
+                        defined.setdefault(reg.name, []).append(i)
+
+            # a temp can only move if all of its writes move with it.
+            # anything computed from a temp that stays must stay too,
+            # so run again without those writes.
+            pruned = set()
+            for indexes in defined.itervalues():
+                if not all(j in candidates for j in indexes):
+                    pruned |= candidates & set(indexes)
+
+            if len(pruned) == 0:
+                break
+
+            excluded |= pruned
+
+        hoisted = sorted(candidates)
+
+        if len(hoisted) == 0:
+            return code
+
+        return code[:top] + \
+               [code[i] for i in hoisted] + \
+               [code[i] for i in xrange(top, bottom + 1) if i not in hoisted] + \
+               code[bottom + 1:]
+
+    def hoist_invariants(self, code):
+        while True:
+            liveness = TempLiveness(code)
+
+            for top, bottom in self.find_loops(code):
+                if not self.is_single_entry(code, top, bottom):
+                    continue
+
+                updated_code = self.hoist_loop(code, top, bottom, liveness)
+
+                if len(updated_code) != len(code) or \
+                   not all(a is b for a, b in zip(updated_code, code)):
+                    break
+
+            else:
+                return code
+
+            code = updated_code
+
+    def generate(self, state):
+        code = state['code']
+
+        self.functions = [ir.name for ir in code if isinstance(ir, FunctionIR)]
+
+        while self.propagate_constants(code):
+            pass
+
+        self.reduce_strength(code)
+
+        state['code'] = self.hoist_invariants(code)
+
+        return state
+
+
 # collect registers
 class CodeGeneratorPass4(object):
     def __init__(self):
@@ -2411,32 +2867,195 @@ class CodeGeneratorPass4(object):
 
         self.optimize_register_usage = True
 
-    def generate(self, state):
-        register_usage = {}
+    def count_refs(self, code):
+        refs = {}
 
-        code = state['code']
+        for ir in code:
+            for reg in ir.get_data_nodes():
+                if isinstance(reg, TempIR):
+                    try:
+                        refs[reg.name] += 1
+
+                    except KeyError:
+                        refs[reg.name] = 1
+
+        return refs
+
+    def count_defs(self, code):
+        defs = {}
+
+        for ir in code:
+            for reg in ir.get_output_nodes():
+                if isinstance(reg, TempIR):
+                    try:
+                        defs[reg.name] += 1
+
+                    except KeyError:
+                        defs[reg.name] = 1
+
+        return defs
+
+    def replace_temp(self, ir, name, replacement):
+        for attr, value in ir.__dict__.iteritems():
+            if isinstance(value, TempIR) and value.name == name:
+                setattr(ir, attr, replacement)
+
+            elif isinstance(value, list):
+                for i in xrange(len(value)):
+                    if isinstance(value[i], TempIR) and value[i].name == name:
+                        value[i] = replacement
+
+    def propagate_copies(self, code):
+        defs = self.count_defs(code)
+        refs = self.count_refs(code)
 
-        # first pass, collect registers and the instruction
-        # address ranges they are used
         for i in xrange(len(code)):
             ir = code[i]
-            for reg in ir.get_data_nodes():
-                if not isinstance(reg, TempIR):
+
+            if not isinstance(ir, CopyIR):
+                continue
+
+            # temp = const:
+            # the temp is never written again, so every
+            # use can read the constant directly.
+            if isinstance(ir.dest, TempIR) and \
+               isinstance(ir.src, ConstIR) and \
+               defs[ir.dest.name] == 1:
+
+                for ir2 in code:
+                    if ir2 is not None and ir2 is not ir:
+                        self.replace_temp(ir2, ir.dest.name, ir.src)
+
+                code[i] = None
+
+            # temp = var:
+            # replace uses in the same basic block, as long
+            # as the var is not written before the last use.
+            elif isinstance(ir.dest, TempIR) and \
+                 isinstance(ir.src, VarIR) and \
+                 defs[ir.dest.name] == 1:
+
+                uses = []
+
+                for j in xrange(i + 1, len(code)):
+                    ir2 = code[j]
+
+                    if ir2 is None:
+                        continue
+
+                    if isinstance(ir2, (LabelIR, JumpIR, JumpIfZeroIR, JumpIfGteIR,
+                                        JumpIfLessThanWithPreIncIR, ReturnIR, CallIR)):
+                        # uses in a terminator are fine, but stop looking after it
+                        if ir.dest.name in [a.name for a in ir2.get_input_nodes()]:
+                            uses.append(ir2)
+
+                        break
+
+                    if ir.dest.name in [a.name for a in ir2.get_input_nodes()]:
+                        uses.append(ir2)
+
+                    if ir.src.name in [a.name for a in ir2.get_output_nodes()]:
+                        break
+
+                if len(uses) == refs[ir.dest.name] - 1:
+                    for ir2 in uses:
+                        self.replace_temp(ir2, ir.dest.name, ir.src)
+
+                    code[i] = None
+
+            # var = temp:
+            # if the previous instruction computed the temp and
+            # nothing else reads it, it can write to the var directly.
+            elif isinstance(ir.src, TempIR) and \
+                 isinstance(ir.dest, VarIR) and \
+                 i > 0 and \
+                 code[i - 1] is not None and \
+                 refs[ir.src.name] == 2:
+
+                prev = code[i - 1]
+                outputs = prev.get_output_nodes()
+
+                if len(outputs) == 1 and \
+                   outputs[0].name == ir.src.name and \
+                   getattr(prev, 'dest', None) is outputs[0]:
+
+                    prev.dest = ir.dest
+                    code[i] = None
+
+        return [ir for ir in code if ir is not None]
+
+    def remove_dead_temps(self, code):
+        # remove side effect free instructions whose
+        # result is a temp that is never read.
+        pure_ops = (BinopIR, NotIR, CopyIR, IndexLoadIR)
+
+        while True:
+            liveness = TempLiveness(code)
+            updated_code = []
+
+            for i in xrange(len(code)):
+                ir = code[i]
+
+                if isinstance(ir, pure_ops) and \
+                   isinstance(ir.dest, TempIR) and \
+                   ir.dest.name not in liveness.live_out[i]:
                     continue
 
-                if reg.name not in register_usage:
-                    # first instance of this register
-                    # record start address
-                    register_usage[reg.name] = [i, None]
+                updated_code.append(ir)
 
-                else:
-                    # register already recorded, update
-                    # last address
-                    register_usage[reg.name][1] = i
+            if len(updated_code) == len(code):
+                return code
+
+            code = updated_code
+
+    def allocate_temps(self, code, start_addr):
+        # linear scan register allocation.
+        # temps are sorted by the start of their live interval,
+        # and take the address of any interval that has already ended.
+        liveness = TempLiveness(code)
+        intervals = liveness.get_intervals()
+        crossings = liveness.get_call_crossings()
+
+        addrs = {}
+        next_addr = start_addr
+        free = []
+        active = []
+
+        for reg in sorted(intervals, key=lambda a: (intervals[a][0], a)):
+            start, end = intervals[reg]
+
+            # expire intervals which ended before this one starts
+            for a in list(active):
+                if intervals[a][1] < start:
+                    active.remove(a)
+                    free.append(addrs[a])
+
+            if reg in crossings or len(free) == 0 or not self.optimize_register_usage:
+                addrs[reg] = next_addr
+                next_addr += 1
+
+            else:
+                free.sort()
+                addrs[reg] = free.pop(0)
 
-        # second pass, assign addresses to registers
+            # call crossing temps are never released
+            if reg not in crossings:
+                active.append(reg)
+
+        return addrs, next_addr
+
+    def generate(self, state):
+        code = state['code']
+
+        if self.optimize_register_usage:
+            code = self.propagate_copies(code)
+            code = self.remove_dead_temps(code)
+
+            state['code'] = code
+
+        # assign addresses to registers
         registers = {}
-        address_pool = []
+        temps = []
         addr = 0
 
         # assign return value
@@ -2453,9 +3072,6 @@ class CodeGeneratorPass4(object):
             if isinstance(ir, FunctionIR):
                 self.current_function = ir.name
 
-                # on new function, reset address pool
-                address_pool = []
-
             for reg in ir.get_data_nodes():
                 # check type
                 if not isinstance(reg, DataIR):
@@ -2474,19 +3090,11 @@ class CodeGeneratorPass4(object):
                     registers[reg.name] = reg
                     reg.line_no = ir.line_no
 
-                    # if temp reg, try and get address from pool
-                    try:
-                        # check if we have this optimization enabled
-                        if not self.optimize_register_usage:
-                            raise IndexError
-
-                        if isinstance(reg, TempIR):
-                            reg.addr = address_pool.pop()
-
-                        else:
-                            raise IndexError
+                    # temps are allocated after everything else
+                    if isinstance(reg, TempIR):
+                        temps.append(reg)
 
-                    except IndexError:
+                    else:
                         reg.addr = addr
                         addr += 1
 
@@ -2506,20 +3114,23 @@ class CodeGeneratorPass4(object):
                     if not reg.line_no:
                         reg.line_no = ir.line_no
 
-                    if isinstance(reg, TempIR):
-                        # check if this is the last time this temp reg 
-                        # is used.
-                        if i == register_usage[reg.name][1]:
-                            # print i, reg, register_usage[reg.name]
-                            # add this address into the address pool
-                            if i not in address_pool:
-                                # pass
-                                address_pool.append(reg.addr)
-                                # print address_pool
-
             if isinstance(ir, DefineIR):
                 registers[ir.name].declared = True
 
+        temp_addrs, addr = self.allocate_temps(code, addr)
+
+        if addr > 256:
+            raise TooManyVars('%d registers, maximum is 256' % (addr))
+
+        for reg in temps:
+            reg.addr = temp_addrs[reg.name]
+
+        # copy temp addresses to all other instances
+        for ir in code:
+            for reg in ir.get_data_nodes():
+                if isinstance(reg, TempIR):
+                    reg.addr = temp_addrs[reg.name]
+
 
         data_table = {
             'registers': {},
@@ -2747,6 +3358,37 @@ class Mod(BinInstruction):
     symbol = "%"
     opcode = 0x0E
 
+# strength reduced multiply and divide by a power of 2.
+# op2 holds the shift count.
+class ShiftLeft(BinInstruction):
+    mnemonic = 'SHL'
+    symbol = "<<"
+    opcode = 0x44
+
+# signed divide, rounds toward zero the same as DIV
+class DivPow2(BinInstruction):
+    mnemonic = 'DIV_POW2'
+    symbol = ">>"
+    opcode = 0x45
+
+# add a signed 16 bit immediate value to a register.
+# this saves the data load for the constant operand.
+class AddImmediate(Instruction):
+    mnemonic = 'ADDI'
+    opcode = 0x41
+
+    def __init__(self, result, op1, imm):
+        super(AddImmediate, self).__init__()
+        self.result = result
+        self.op1 = op1
+        self.imm = imm
+
+    def __str__(self):
+        return "%-16s %16s <- %16s    + %d" % (self.mnemonic, self.result, self.op1, self.imm)
+
+    def assemble(self):
+        return [self.opcode, self.result.addr, self.op1.addr, self.imm & 0xff, (self.imm >> 8) & 0xff]
+
 
 class BaseJmp(Instruction):
     mnemonic = 'JMP'
@@ -2790,22 +3432,71 @@ class JmpIfZeroPostDec(JmpConditional):
     opcode = 0x12
     mnemonic = 'JMP_IF_Z_DEC'
 
-class JmpIfGte(BaseJmp):
-    opcode = 0x13
-    mnemonic = 'JMP_IF_GTE'
-
+# compare and branch
+class JmpCompare(BaseJmp):
     def __init__(self, op1, op2, label):
-        super(JmpIfGte, self).__init__(label)
+        super(JmpCompare, self).__init__(label)
 
         self.op1 = op1
         self.op2 = op2
 
     def __str__(self):
-        return "%s, %s >= %s -> %s" % (self.mnemonic, self.op1, self.op2, self.label)
+        return "%s, %s %s %s -> %s" % (self.mnemonic, self.op1, self.symbol, self.op2, self.label)
 
     def assemble(self):
         return [self.opcode, self.op1.addr, self.op2.addr, ('label', self.label.name), 0]
 
+    def test(self, a, b):
+        raise NotImplementedError(self.mnemonic)
+
+class JmpIfGte(JmpCompare):
+    opcode = 0x13
+    mnemonic = 'JMP_IF_GTE'
+    symbol = ">="
+
+    def test(self, a, b):
+        return a >= b
+
+class JmpIfEq(JmpCompare):
+    opcode = 0x3C
+    mnemonic = 'JMP_IF_EQ'
+    symbol = "=="
+
+    def test(self, a, b):
+        return a == b
+
+class JmpIfNeq(JmpCompare):
+    opcode = 0x3D
+    mnemonic = 'JMP_IF_NEQ'
+    symbol = "!="
+
+    def test(self, a, b):
+        return a != b
+
+class JmpIfGt(JmpCompare):
+    opcode = 0x3E
+    mnemonic = 'JMP_IF_GT'
+    symbol = ">"
+
+    def test(self, a, b):
+        return a > b
+
+class JmpIfLt(JmpCompare):
+    opcode = 0x3F
+    mnemonic = 'JMP_IF_LT'
+    symbol = "<"
+
+    def test(self, a, b):
+        return a < b
+
+class JmpIfLte(JmpCompare):
+    opcode = 0x40
+    mnemonic = 'JMP_IF_LTE'
+    symbol = "<="
+
+    def test(self, a, b):
+        return a <= b
+
 
 class JmpIfLessThanPreInc(BaseJmp):
     opcode = 0x14
@@ -3041,6 +3732,34 @@ class LoadFromArrayVFade(LoadFromPixArray):
 
 
 
+# load from pixel array, add or subtract, and store back.
+# fused form of LFAx / ADD|SUB / LTAx on the same pixel index.
+class PixArrayOpInstruction(Instruction):
+    def __init__(self, attr, src, index_x, index_y, obj):
+        super(PixArrayOpInstruction, self).__init__()
+        self.attr = attr
+        self.src = src
+        self.index_x = index_x
+        self.index_y = index_y
+        self.obj = obj
+
+    def __str__(self):
+        return "%s %s.%s[%s][%s] %s= %s" % (self.mnemonic, self.obj.obj, self.attr, self.index_x, self.index_y, self.symbol, self.src)
+
+    def assemble(self):
+        return [self.opcode, PIX_ATTRS[self.attr], self.src.addr, self.index_x.addr, self.index_y.addr, self.obj.addr]
+
+class PixArrayAdd(PixArrayOpInstruction):
+    mnemonic = 'PIX_ADD'
+    opcode = 0x42
+    symbol = "+"
+
+class PixArraySub(PixArrayOpInstruction):
+    mnemonic = 'PIX_SUB'
+    opcode = 0x43
+    symbol = "-"
+
+
 class ArrayOpInstruction(Instruction):
     def __init__(self, result, op1):
         super(ArrayOpInstruction, self).__init__()
@@ -3138,7 +3857,7 @@ class Halt(Instruction):
 
 class YieldFrames(Instruction):
     mnemonic = 'YIELD_FRAMES'
-    opcode = 0x3c
+    opcode = 0x3B
 
     def __init__(self, op1):
         self.op1 = op1
@@ -3306,6 +4025,8 @@ bin_ops = [
     Mul,
     Div,
     Mod,
+    ShiftLeft,
+    DivPow2,
     CompareEq,
     CompareNeq,
     CompareGt,
@@ -3385,7 +4106,7 @@ class CodeGeneratorPass5(object):
                     self.append_code(ins)
 
                 elif ir.name == 'yield_frames':
-                    ins = YieldFrames(ir.dest, ir.params[0])
+                    ins = YieldFrames(ir.params[0])
                     self.append_code(ins)
 
                 elif ir.name == 'rand':
@@ -3446,6 +4167,8 @@ class CodeGeneratorPass5(object):
                     'mult': Mul,
                     'div': Div,
                     'mod': Mod,
+                    'lshift': ShiftLeft,
+                    'div_pow2': DivPow2,
                 }
 
                 assert not isinstance(ir.dest, ObjIR)
@@ -3591,6 +4314,225 @@ class CodeGeneratorPass5(object):
         return state
 
 
+# Peephole optimizer.
+# Fuses common instruction sequences into superinstructions.
+# Each fused sequence saves one or more dispatches in the VM,
+# which also count against VM_MAX_CYCLES.
+class CodeGeneratorPeephole(object):
+    # compare followed by jump if zero becomes a jump
+    # on the inverted comparison.
+    inverted_compares = {
+        CompareEq: JmpIfNeq,
+        CompareNeq: JmpIfEq,
+        CompareGt: JmpIfLte,
+        CompareGtE: JmpIfLt,
+        CompareLt: JmpIfGte,
+        CompareLtE: JmpIfGt,
+    }
+
+    def __init__(self, state):
+        self.code = state['code']
+        self.state = state
+
+    def get_operands(self, ins):
+        operands = []
+
+        for v in ins.__dict__.itervalues():
+            if isinstance(v, DataIR):
+                operands.append(v)
+
+            elif isinstance(v, list):
+                operands.extend([a for a in v if isinstance(a, DataIR)])
+
+        return operands
+
+    def count_refs(self, code):
+        refs = {}
+
+        for ins in code:
+            for op in self.get_operands(ins):
+                try:
+                    refs[op.name] += 1
+
+                except KeyError:
+                    refs[op.name] = 1
+
+        return refs
+
+    def is_temp(self, reg, refs, count):
+        # temp registers which are only referenced by the
+        # sequence being fused can be eliminated.
+        return isinstance(reg, TempIR) and refs[reg.name] == count
+
+    def get_immediate(self, reg):
+        if not isinstance(reg, ConstIR) or not isinstance(reg.name, (int, long)):
+            return None
+
+        if reg.name < -32768 or reg.name > 32767:
+            return None
+
+        return reg.name
+
+    def fuse_pix_op(self, code, i, refs):
+        # LFAx t <- obj[x][y]
+        # ADD|SUB t <- t op v
+        # LTAx obj[x][y] <- t
+        if i + 2 >= len(code):
+            return None
+
+        load, op, store = code[i:i + 3]
+
+        if not isinstance(load, LoadFromPixArray) or \
+           not isinstance(store, LoadToPixArray) or \
+           not isinstance(op, (Add, Sub)):
+            return None
+
+        if load.name != store.name or load.obj.obj != store.obj.obj:
+            return None
+
+        if load.index_x.name != store.index_x.name or load.index_y.name != store.index_y.name:
+            return None
+
+        t = load.dest
+
+        if op.result.name != t.name or store.src.name != t.name:
+            return None
+
+        if op.op1.name == t.name and op.op2.name != t.name:
+            src = op.op2
+
+        elif isinstance(op, Add) and op.op2.name == t.name and op.op1.name != t.name:
+            src = op.op1
+
+        else:
+            return None
+
+        if not self.is_temp(t, refs, 4):
+            return None
+
+        if isinstance(op, Add):
+            return PixArrayAdd(load.name, src, store.index_x, store.index_y, store.obj)
+
+        else:
+            return PixArraySub(load.name, src, store.index_x, store.index_y, store.obj)
+
+    def fuse_compare_branch(self, code, i, refs):
+        if i + 1 >= len(code):
+            return None
+
+        comp, jmp = code[i:i + 2]
+
+        if type(comp) not in self.inverted_compares or type(jmp) != JmpIfZero:
+            return None
+
+        if jmp.op1.name != comp.result.name or not self.is_temp(comp.result, refs, 2):
+            return None
+
+        return self.inverted_compares[type(comp)](comp.op1, comp.op2, jmp.label)
+
+    def fuse_binop_mov(self, code, i, refs):
+        # binop into a temp, followed by a move of that temp,
+        # writes directly to the move destination.
+        if i + 1 >= len(code):
+            return None
+
+        binop, mov = code[i:i + 2]
+
+        if not isinstance(binop, BinInstruction) or type(mov) != Mov:
+            return None
+
+        if mov.src.name != binop.result.name or not self.is_temp(binop.result, refs, 2):
+            return None
+
+        return type(binop)(mov.dest, binop.op1, binop.op2)
+
+    def fuse_add_immediate(self, ins):
+        if type(ins) == Add:
+            imm = self.get_immediate(ins.op2)
+            if imm is not None:
+                return AddImmediate(ins.result, ins.op1, imm)
+
+            imm = self.get_immediate(ins.op1)
+            if imm is not None:
+                return AddImmediate(ins.result, ins.op2, imm)
+
+        elif type(ins) == Sub:
+            imm = self.get_immediate(ins.op2)
+            if imm is not None and imm > -32768:
+                return AddImmediate(ins.result, ins.op1, -imm)
+
+        return None
+
+    def is_jump_to_next(self, code, i):
+        if type(code[i]) != Jmp:
+            return False
+
+        # skip over labels following the jump
+        for ins in code[i + 1:]:
+            if not isinstance(ins, Label):
+                break
+
+            if ins.name == code[i].label.name:
+                return True
+
+        return False
+
+    def optimize(self, code):
+        refs = self.count_refs(code)
+        optimized = []
+
+        i = 0
+        while i < len(code):
+            ins = self.fuse_pix_op(code, i, refs)
+            if ins is not None:
+                optimized.append(ins)
+                i += 3
+                continue
+
+            ins = self.fuse_compare_branch(code, i, refs)
+            if ins is None:
+                ins = self.fuse_binop_mov(code, i, refs)
+
+            if ins is not None:
+                optimized.append(ins)
+                i += 2
+                continue
+
+            if self.is_jump_to_next(code, i):
+                i += 1
+                continue
+
+            ins = self.fuse_add_immediate(code[i])
+            if ins is not None:
+                optimized.append(ins)
+
+            else:
+                optimized.append(code[i])
+
+            i += 1
+
+        return optimized
+
+    def generate(self):
+        for func in self.code:
+            code = self.code[func]
+
+            # run until nothing else can be fused
+            while True:
+                optimized = self.optimize(code)
+
+                if len(optimized) == len(code) and \
+                   all(a is b for a, b in zip(optimized, code)):
+                    break
+
+                code = optimized
+
+            # modify in place, the Python VM runs from the same lists
+            self.code[func][:] = code
+
+        return self.state
+
+
 # Process labels and jumps
 class CodeGeneratorPass6(object):
     def __init__(self, state):
@@ -4253,6 +5195,14 @@ class VM(object):
 
                     continue
 
+            elif isinstance(ins, JmpCompare):
+                if ins.test(self.memory[ins.op1.name], self.memory[ins.op2.name]):
+
+                    # JUMP!
+                    pc = self.labels[ins.label.name]
+
+                    continue
+
             # elif isinstance(ins, JmpNotZero):
             #     if self.get_var(ins.op1.name) != 0:
             #
@@ -4295,6 +5245,36 @@ class VM(object):
             elif isinstance(ins, Sub):
                 self.memory[ins.result.name] = self.memory[ins.op1.name] - self.memory[ins.op2.name]
 
+            elif isinstance(ins, AddImmediate):
+                self.memory[ins.result.name] = self.memory[ins.op1.name] + ins.imm
+
+            elif isinstance(ins, PixArrayOpInstruction):
+                index_x = self.memory[ins.index_x.name]
+                index_y = self.memory[ins.index_y.name]
+
+                ary = self.gfx_data[ins.attr]
+                i = self.calc_index(index_x, index_y)
+
+                if isinstance(ins, PixArrayAdd):
+                    a = ary[i] + self.memory[ins.src.name]
+
+                else:
+                    a = ary[i] - self.memory[ins.src.name]
+
+                if ins.attr == 'hue':
+                    # wraparound to 16 bit range.
+                    a %= 65536
+
+                else:
+                    # clamp to our 16 bit range.
+                    if a > 65535:
+                        a = 65535
+
+                    elif a < 0:
+                        a = 0
+
+                ary[i] = a
+
             elif isinstance(ins, Mul):
                 self.memory[ins.result.name] = self.memory[ins.op1.name] * self.memory[ins.op2.name]
 
@@ -4304,6 +5284,13 @@ class VM(object):
             elif isinstance(ins, Mod):
                 self.memory[ins.result.name] = self.memory[ins.op1.name] % self.memory[ins.op2.name]
 
+            elif isinstance(ins, ShiftLeft):
+                self.memory[ins.result.name] = self.memory[ins.op1.name] << self.memory[ins.op2.name]
+
+            elif isinstance(ins, DivPow2):
+                # same rounding as Div in this VM
+                self.memory[ins.result.name] = self.memory[ins.op1.name] >> self.memory[ins.op2.name]
+
             elif isinstance(ins, CompareEq):
                 self.memory[ins.result.name] = self.memory[ins.op1.name] == self.memory[ins.op2.name]
 
@@ -4676,6 +5663,16 @@ def compile_text(text, debug_print=False, script_name=''):
         for i in state3['code']:
             print i
 
+    optimizer = CodeGeneratorOptimizer()
+    state3 = optimizer.generate(state3)
+
+    if debug_print:
+        print ''
+        print ''
+        print 'OPTIMIZER'
+        for i in state3['code']:
+            print i
+
     cg4 = CodeGeneratorPass4()
     state4 = cg4.generate(state3)
 
@@ -4708,6 +5705,18 @@ def compile_text(text, debug_print=False, script_name=''):
             for ins in state5['code'][func]:
                 print '    ', ins
 
+    peephole = CodeGeneratorPeephole(state5)
+    state5 = peephole.generate()
+
+    if debug_print:
+        print ''
+        print ''
+        print 'PEEPHOLE'
+        for func in state5['code']:
+            print func
+            for ins in state5['code'][func]:
+                print '    ', ins
+
     cg6 = CodeGeneratorPass6(state5)
     state6 = cg6.generate()
 
@@ -0,0 +1,224 @@
+# <license>
+#
+#     This file is part of the Sapphire Operating System.
+#
+#     Copyright (C) 2013-2018  Jeremy Billheimer
+#
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+#
+#     You should have received a copy of the GNU General Public License
+#     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# </license>
+
+"""
+Benchmark for DeviceGroup bulk operations.
+
+Starts a FakeNodeServer with a number of simulated nodes on loopback
+and builds a DeviceGroup over them. Then times a get and a set of the
+dimmer keys on the whole group three ways:
+
+    sequential  - one device at a time, which is what DeviceGroup
+                  method calls used to do
+    threaded    - DeviceGroup.run_bulk, a thread per device in
+                  progress, each with its own blocking Client
+    multiplexed - DeviceGroup.get_keys_bulk/set_keys_bulk, all
+                  requests on one socket through a MultiClient
+
+Every result is checked against the node databases. The bench exits
+with a non-zero code if any device fails or returns the wrong value.
+
+Usage:
+    python group_bench.py [--nodes N] [--latency MS] [--drop RATE] [--concurrency N]
+"""
+
+import sys
+import time
+import argparse
+
+from catbus import Client
+from catbus.fakenode import FakeNodeServer
+
+from chromatron import DeviceGroup, run_concurrent
+
+
+TEST_KEYS = ['gfx_master_dimmer', 'gfx_sub_dimmer', 'kv_test_key']
+
+
+class BenchDevice(object):
+    # stands in for a Chromatron that is connected over the network
+    def __init__(self, node):
+        self.node = node
+        self.device_id = node.database['device_id']
+
+        self.client = Client()
+        self.client.connect(node.host)
+
+    def get_keys(self, *args):
+        return self.client.get_keys(*args)
+
+    def set_keys(self, **kwargs):
+        self.client.set_keys(**kwargs)
+
+
+def make_group(server, max_concurrency):
+    # DeviceGroup normally discovers and scans real devices,
+    # so build one around the simulated nodes instead.
+    group = DeviceGroup.__new__(DeviceGroup)
+    group.max_concurrency = max_concurrency
+    group.group = {}
+    group.matches = {}
+
+    for node in server.nodes:
+        d = BenchDevice(node)
+        group.group[d.device_id] = d
+
+    return group
+
+
+def check(group, results, expected):
+    errors = 0
+
+    for d in group.group.itervalues():
+        try:
+            r = results[d.device_id]
+
+        except KeyError:
+            errors += 1
+            continue
+
+        if not r.ok:
+            errors += 1
+            continue
+
+        for key, value in expected(d.node).iteritems():
+            if d.node.database[key] != value:
+                errors += 1
+
+            elif (r.result != None) and (r.result[key] != value):
+                errors += 1
+
+    return errors
+
+
+def run_sequential(group, func):
+    devices = group.group.values()
+    results = run_concurrent(devices, func, max_concurrency=1)
+
+    return {d.device_id: r for d, r in zip(devices, results)}
+
+
+def run_test(group, method, get_func, set_func, get_bulk, set_bulk):
+    # use a new value each pass, so a set that silently did
+    # nothing shows up as an error.
+    value = int(time.time() * 1000) & 0xffff
+
+    def expected_get(node):
+        return {k: node.database[k] for k in TEST_KEYS}
+
+    def expected_set(node):
+        return {'gfx_master_dimmer': value, 'gfx_sub_dimmer': value / 2}
+
+    start = time.time()
+    if method == 'sequential':
+        results = run_sequential(group, get_func)
+
+    elif method == 'threaded':
+        results = group.run_bulk(get_func)
+
+    else:
+        results = get_bulk()
+
+    get_time = time.time() - start
+    errors = check(group, results, expected_get)
+
+    start = time.time()
+    if method == 'sequential':
+        results = run_sequential(group, lambda d: set_func(d, value))
+
+    elif method == 'threaded':
+        results = group.run_bulk(lambda d: set_func(d, value))
+
+    else:
+        results = set_bulk(value)
+
+    set_time = time.time() - start
+
+    # the blocking set_keys doesn't return anything, so
+    # check() only looks at the node databases for those.
+    errors += check(group, results, expected_set)
+
+    latencies = sorted(r.elapsed for r in results.itervalues())
+    p99 = latencies[int(len(latencies) * 0.99) - 1] if len(latencies) > 0 else 0.0
+
+    return get_time, set_time, p99, errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description='DeviceGroup bulk operation benchmark')
+    parser.add_argument('--nodes', type=int, default=200, help='number of simulated nodes')
+    parser.add_argument('--latency', type=float, default=20.0, help='simulated reply latency in ms')
+    parser.add_argument('--drop', type=float, default=0.0, help='fraction of requests the nodes drop')
+    parser.add_argument('--concurrency', type=int, default=32, help='max devices in progress at once')
+    args = parser.parse_args()
+
+    server = FakeNodeServer(count=args.nodes, latency=args.latency / 1000.0, drop_rate=args.drop)
+
+    try:
+        # meta data is fetched while connecting, at no latency
+        server.latency = 0.0
+        group = make_group(server, args.concurrency)
+        server.latency = args.latency / 1000.0
+
+        print "Nodes:        %d" % (args.nodes)
+        print "Latency:      %.1f ms" % (args.latency)
+        print "Drop rate:    %.2f" % (args.drop)
+        print "Concurrency:  %d" % (args.concurrency)
+        print ""
+        print "method          get (ms)    set (ms)    p99 set/device (ms)  errors"
+
+        def get_func(d):
+            return d.get_keys(TEST_KEYS)
+
+        def set_func(d, value):
+            d.set_keys(gfx_master_dimmer=value, gfx_sub_dimmer=value / 2)
+
+        def get_bulk():
+            return group.get_keys_bulk(*TEST_KEYS)
+
+        def set_bulk(value):
+            return group.set_keys_bulk(gfx_master_dimmer=value, gfx_sub_dimmer=value / 2)
+
+        failed = False
+
+        for method in ['sequential', 'threaded', 'multiplexed']:
+            get_time, set_time, p99, errors = run_test(group, method, get_func, set_func, get_bulk, set_bulk)
+
+            print "%-12s %11.1f %11.1f %22.1f %7d" % \
+                (method, get_time * 1000.0, set_time * 1000.0, p99 * 1000.0, errors)
+
+            if errors > 0:
+                failed = True
+
+    finally:
+        server.stop()
+        server.join()
+
+    if failed:
+        print "FAIL: some devices returned errors or wrong values"
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,262 @@
+# <license>
+#
+#     This file is part of the Sapphire Operating System.
+#
+#     Copyright (C) 2013-2018  Jeremy Billheimer
+#
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+#
+#     You should have received a copy of the GNU General Public License
+#     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# </license>
+
+"""
+Benchmark for the frame stream protocol.
+
+For each pixel count and scene, reports bytes/frame for the legacy
+16 bit stream and the 8 bit frame stream, and the frame rate achieved
+over UDP.
+
+By default, frames are sent over loopback to a FrameDecoder, which
+assembles them the same way server.c does, and the FPS is the number
+of frames it completed. With --host, frames are sent to a device and
+the FPS is the send rate.
+
+Before anything is timed, every scene is encoded and decoded in
+process and checked against the source pixels. The bench exits with
+a non-zero code on a mismatch.
+
+Usage:
+    python stream_bench.py [--host HOST] [--seconds SECONDS]
+"""
+
+import sys
+import time
+import math
+import socket
+import random
+import argparse
+import threading
+
+import streamer
+from streamer import encode_frame, FrameDecoder, FRAME_KEYFRAME_INTERVAL, PIXEL_MSG_MAX_LEN
+
+
+PIXEL_COUNTS = [60, 150, 300, 600, 1024]
+
+CHECK_FRAMES = 100
+
+LEGACY_HEADER_LEN = 5
+
+
+def scene_rainbow(pix_count, frame):
+    pixels = []
+    for i in xrange(pix_count):
+        h = ((i * 6 + frame * 4) % 1536)
+        sector = h / 256
+        x = h % 256
+
+        if sector == 0:
+            pixels.append((255, x, 0))
+        elif sector == 1:
+            pixels.append((255 - x, 255, 0))
+        elif sector == 2:
+            pixels.append((0, 255, x))
+        elif sector == 3:
+            pixels.append((0, 255 - x, 255))
+        elif sector == 4:
+            pixels.append((x, 0, 255))
+        else:
+            pixels.append((255, 0, 255 - x))
+
+    return pixels
+
+def scene_sparse(pix_count, frame):
+    pixels = [(0, 0, 0)] * pix_count
+
+    # a few dots moving over a dark strip
+    for i in xrange(4):
+        pos = (frame * (i + 1) + i * pix_count / 4) % pix_count
+        pixels[pos] = (255, 64 * i, 255 - 64 * i)
+
+    return pixels
+
+def scene_solid(pix_count, frame):
+    v = int(127.5 + 127.5 * math.sin(frame / 20.0))
+
+    return [(v, v / 2, 255 - v)] * pix_count
+
+def scene_noise(pix_count, frame):
+    rand = random.Random(frame)
+
+    return [(rand.randint(0, 255), rand.randint(0, 255), rand.randint(0, 255)) for i in xrange(pix_count)]
+
+SCENES = [('rainbow', scene_rainbow),
+          ('sparse', scene_sparse),
+          ('solid', scene_solid),
+          ('noise', scene_noise)]
+
+
+def legacy_bytes(pix_count):
+    msgs = (pix_count + PIXEL_MSG_MAX_LEN - 1) / PIXEL_MSG_MAX_LEN
+
+    return msgs * LEGACY_HEADER_LEN + pix_count * 6
+
+
+class FrameSource(object):
+    def __init__(self, scene, pix_count):
+        self.scene = scene
+        self.pix_count = pix_count
+        self.frame = 0
+        self.prev = None
+
+    def next(self):
+        pixels = self.scene(self.pix_count, self.frame)
+        prev = self.prev
+
+        if self.frame % FRAME_KEYFRAME_INTERVAL == 0:
+            prev = None
+
+        msgs = encode_frame(pixels, self.frame, prev=prev, base_frame=self.frame - 1)
+
+        self.prev = pixels
+        self.frame = (self.frame + 1) & 0xffff
+
+        return pixels, msgs
+
+
+def check(scene, pix_count):
+    source = FrameSource(scene, pix_count)
+    decoder = FrameDecoder(max_pixels=pix_count)
+    total_bytes = 0
+    total_msgs = 0
+
+    for i in xrange(CHECK_FRAMES):
+        pixels, msgs = source.next()
+
+        latched = False
+        for msg in msgs:
+            latched = decoder.process(msg)
+            total_bytes += len(msg)
+
+        total_msgs += len(msgs)
+
+        if not latched or decoder.front != pixels:
+            return None
+
+    return float(total_bytes) / CHECK_FRAMES, float(total_msgs) / CHECK_FRAMES
+
+
+class Receiver(threading.Thread):
+    def __init__(self, pix_count):
+        super(Receiver, self).__init__()
+
+        self.daemon = True
+        self.decoder = FrameDecoder(max_pixels=pix_count)
+
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(('127.0.0.1', 0))
+        self.sock.settimeout(0.1)
+        self.port = self.sock.getsockname()[1]
+
+        self._stop_event = threading.Event()
+
+    def stop(self):
+        self._stop_event.set()
+        self.join()
+        self.sock.close()
+
+    def run(self):
+        while not self._stop_event.is_set():
+            try:
+                msg = self.sock.recv(2048)
+
+            except socket.timeout:
+                continue
+
+            self.decoder.process(msg)
+
+
+def run_stream(scene, pix_count, host, seconds):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    receiver = None
+
+    if host is None:
+        receiver = Receiver(pix_count)
+        receiver.start()
+        addr = ('127.0.0.1', receiver.port)
+
+    else:
+        addr = (host, streamer.PIXEL_SERVER_PORT)
+
+    source = FrameSource(scene, pix_count)
+    frames_sent = 0
+
+    start = time.time()
+    while time.time() - start < seconds:
+        pixels, msgs = source.next()
+
+        for msg in msgs:
+            sock.sendto(msg, addr)
+
+        frames_sent += 1
+
+    # let the receiver drain its socket
+    time.sleep(0.2)
+    elapsed = time.time() - start - 0.2
+
+    sock.close()
+
+    if receiver is not None:
+        receiver.stop()
+        return receiver.decoder.frames_latched / elapsed
+
+    return frames_sent / elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Frame stream benchmark')
+    parser.add_argument('--host', default=None, help='send to a device instead of loopback')
+    parser.add_argument('--seconds', type=float, default=1.0, help='time per test')
+    args = parser.parse_args()
+
+    if args.host is None:
+        print "Target: loopback decoder"
+
+    else:
+        print "Target: %s" % (args.host)
+
+    print ""
+    print "pixels  scene     legacy B/f   frame B/f   msgs/f    ratio      fps"
+
+    for pix_count in PIXEL_COUNTS:
+        for name, scene in SCENES:
+            result = check(scene, pix_count)
+
+            if result is None:
+                print "FAIL: %s at %d pixels did not decode to its source frames" % (name, pix_count)
+                return 1
+
+            frame_bytes, frame_msgs = result
+            legacy = legacy_bytes(pix_count)
+
+            fps = run_stream(scene, pix_count, args.host, args.seconds)
+
+            print "%6d  %-8s %11d %11.1f %8.2f %8.2f %8.1f" % \
+                (pix_count, name, legacy, frame_bytes, frame_msgs, legacy / frame_bytes, fps)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -27,6 +27,7 @@ import socket
 import time
 import threading
 import struct
+import colorsys
 
 
 from elysianfields import *
@@ -79,6 +80,309 @@ class PixelRGBMsg(StructField):
 
         self.type = CHROMA_MSG_TYPE_RGB
 
+# Frame stream, see server.h for the message format.
+CHROMA_MSG_TYPE_FRAME_RGB8  = 3
+
+CHROMA_FRAME_FLAGS_EOF      = 0x01
+CHROMA_FRAME_FLAGS_RLE      = 0x02
+CHROMA_FRAME_FLAGS_DELTA    = 0x04
+
+CHROMA_RUN_TYPE_MASK        = 0xc0
+CHROMA_RUN_REPEAT           = 0x80
+CHROMA_RUN_SKIP             = 0xc0
+CHROMA_RUN_LITERAL_MAX      = 128
+CHROMA_RUN_MAX              = 64
+
+CHROMA_FRAME_MAX_DATA       = 480
+
+# send a full frame this often, so a lost delta frame can't
+# leave the device behind for long.
+FRAME_KEYFRAME_INTERVAL     = 30
+
+class PixelFrameMsg(StructField):
+    def __init__(self, **kwargs):
+        fields = [Uint8Field(_name="type"),
+                  Uint8Field(_name="flags"),
+                  Uint16Field(_name="frame"),
+                  Uint16Field(_name="base_frame"),
+                  Uint16Field(_name="index"),
+                  Uint16Field(_name="count")]
+
+        super(PixelFrameMsg, self).__init__(_name="pixel_frame_msg", _fields=fields, **kwargs)
+
+        self.type = CHROMA_MSG_TYPE_FRAME_RGB8
+
+FRAME_HEADER_LEN = PixelFrameMsg().size()
+
+def _encode_runs(pixels, prev=None):
+    """Split a list of (r, g, b) tuples into runs.
+
+    Returns a list of (code, count, pixels) tuples, where pixels holds
+    the literal pixels, the one repeated pixel, or nothing for a skip.
+    Skips are only generated if prev is given.
+    """
+    runs = []
+    n = len(pixels)
+    i = 0
+
+    while i < n:
+        # unchanged from previous frame
+        if prev is not None and pixels[i] == prev[i]:
+            j = i + 1
+            while j < n and j - i < CHROMA_RUN_MAX and pixels[j] == prev[j]:
+                j += 1
+
+            runs.append((CHROMA_RUN_SKIP, j - i, []))
+            i = j
+            continue
+
+        # repeated pixel
+        j = i + 1
+        while j < n and j - i < CHROMA_RUN_MAX and pixels[j] == pixels[i]:
+            j += 1
+
+        if j - i >= 2:
+            runs.append((CHROMA_RUN_REPEAT, j - i, [pixels[i]]))
+            i = j
+            continue
+
+        # literals, up until something cheaper starts
+        j = i + 1
+        while j < n and j - i < CHROMA_RUN_LITERAL_MAX:
+            if prev is not None and pixels[j] == prev[j]:
+                break
+
+            if j + 1 < n and pixels[j] == pixels[j + 1]:
+                break
+
+            j += 1
+
+        runs.append((0, j - i, pixels[i:j]))
+        i = j
+
+    return runs
+
+def _pack_runs(runs):
+    data = bytearray()
+
+    for code, count, pixels in runs:
+        data.append(code | (count - 1))
+
+        for r, g, b in pixels:
+            data.append(r)
+            data.append(g)
+            data.append(b)
+
+    return data
+
+def _pack_raw(pixels):
+    data = bytearray()
+
+    for r, g, b in pixels:
+        data.append(r)
+        data.append(g)
+        data.append(b)
+
+    return data
+
+def _run_len(run):
+    return 1 + len(run[2]) * 3
+
+def encode_frame(pixels, frame, prev=None, base_frame=0):
+    """Encode a list of 8 bit (r, g, b) tuples as frame stream messages.
+
+    If prev is given, pixels unchanged from it are skipped and the
+    messages are a delta on top of base_frame.
+
+    Returns a list of message strings.
+    """
+    if prev is not None and len(prev) != len(pixels):
+        prev = None
+
+    flags = 0
+    if prev is not None:
+        flags |= CHROMA_FRAME_FLAGS_DELTA
+
+    else:
+        base_frame = 0
+
+    # split runs into chunks that fit in a message
+    chunks = []
+    chunk = []
+    chunk_len = 0
+
+    for run in _encode_runs(pixels, prev):
+        while chunk_len + _run_len(run) > CHROMA_FRAME_MAX_DATA:
+            code, count, run_pixels = run
+
+            # split a literal run across chunks
+            room = (CHROMA_FRAME_MAX_DATA - chunk_len - 1) / 3
+            if code == 0 and room > 0:
+                chunk.append((0, room, run_pixels[:room]))
+                run = (0, count - room, run_pixels[room:])
+
+            chunks.append(chunk)
+            chunk = []
+            chunk_len = 0
+
+        chunk.append(run)
+        chunk_len += _run_len(run)
+
+    if len(chunk) > 0:
+        chunks.append(chunk)
+
+    msgs = []
+    index = 0
+
+    for i in xrange(len(chunks)):
+        chunk = chunks[i]
+        count = sum([run[1] for run in chunk])
+        chunk_flags = flags
+
+        if i == len(chunks) - 1:
+            chunk_flags |= CHROMA_FRAME_FLAGS_EOF
+
+        data = _pack_runs(chunk)
+
+        # fall back to raw pixels if run coding doesn't help
+        if prev is None and len(data) >= count * 3:
+            data = _pack_raw(pixels[index:index + count])
+
+        else:
+            chunk_flags |= CHROMA_FRAME_FLAGS_RLE
+
+        header = PixelFrameMsg(flags=chunk_flags,
+                               frame=frame & 0xffff,
+                               base_frame=base_frame & 0xffff,
+                               index=index,
+                               count=count).pack()
+
+        msgs.append(header + str(data))
+        index += count
+
+    return msgs
+
+
+class FrameDecoder(object):
+    """Host side copy of the frame assembly in server.c.
+
+    Used to test the encoder and by stream_bench.py as a stand in
+    for a device.
+    """
+    def __init__(self, max_pixels=1024):
+        self.max_pixels = max_pixels
+        self.back = [(0, 0, 0)] * max_pixels
+        self.front = []
+
+        self.frame = 0
+        self.index = 0
+        self.frame_ok = False
+        self.latched_frame = 0
+        self.back_valid = False
+
+        self.frames_latched = 0
+        self.chunks_dropped = 0
+
+    def _decode(self, flags, index, count, data):
+        end = index + count
+
+        if (flags & CHROMA_FRAME_FLAGS_RLE) == 0:
+            if len(data) != count * 3:
+                return False
+
+            for i in xrange(count):
+                self.back[index + i] = (data[i * 3], data[i * 3 + 1], data[i * 3 + 2])
+
+            return True
+
+        pos = 0
+        while pos < len(data):
+            code = data[pos]
+            pos += 1
+
+            if (code & CHROMA_RUN_TYPE_MASK) == CHROMA_RUN_SKIP:
+                run = (code & ~CHROMA_RUN_TYPE_MASK) + 1
+                if (flags & CHROMA_FRAME_FLAGS_DELTA) == 0 or run > end - index:
+                    return False
+
+            elif (code & CHROMA_RUN_TYPE_MASK) == CHROMA_RUN_REPEAT:
+                run = (code & ~CHROMA_RUN_TYPE_MASK) + 1
+                if run > end - index or len(data) - pos < 3:
+                    return False
+
+                pixel = (data[pos], data[pos + 1], data[pos + 2])
+                pos += 3
+
+                for i in xrange(run):
+                    self.back[index + i] = pixel
+
+            else:
+                run = code + 1
+                if run > end - index or len(data) - pos < run * 3:
+                    return False
+
+                for i in xrange(run):
+                    self.back[index + i] = (data[pos], data[pos + 1], data[pos + 2])
+                    pos += 3
+
+            index += run
+
+        return index == end
+
+    def process(self, msg):
+        """Process one message, returns True if it completed a frame."""
+        if len(msg) < FRAME_HEADER_LEN:
+            return False
+
+        header = PixelFrameMsg().unpack(msg[:FRAME_HEADER_LEN])
+        flags = header.flags
+        frame = header.frame
+        base_frame = header.base_frame
+        index = header.index
+        count = header.count
+        data = bytearray(msg[FRAME_HEADER_LEN:])
+
+        if header.type != CHROMA_MSG_TYPE_FRAME_RGB8 or \
+           count == 0 or \
+           len(data) > CHROMA_FRAME_MAX_DATA or \
+           index + count > self.max_pixels:
+            self.chunks_dropped += 1
+            return False
+
+        if index == 0:
+            self.frame = frame
+            self.index = 0
+            self.frame_ok = True
+
+            if (flags & CHROMA_FRAME_FLAGS_DELTA) and \
+               (not self.back_valid or base_frame != self.latched_frame):
+                self.frame_ok = False
+
+        if not self.frame_ok or frame != self.frame or index != self.index:
+            self.frame_ok = False
+            self.chunks_dropped += 1
+            return False
+
+        self.back_valid = False
+
+        if not self._decode(flags, index, count, data):
+            self.frame_ok = False
+            self.chunks_dropped += 1
+            return False
+
+        self.index += count
+
+        if flags & CHROMA_FRAME_FLAGS_EOF:
+            self.front = self.back[:self.index]
+            self.latched_frame = self.frame
+            self.back_valid = True
+            self.frame_ok = False
+            self.frames_latched += 1
+
+            return True
+
+        return False
+
 
 class PixelArray(object):
     def __init__(self, name=None, length=0, value=0.0, streamer=None):
@@ -200,6 +504,10 @@ class Streamer(object):
 
         self.mode = 'hsv'
 
+        self.frame = 0
+        self.prev_frame = None
+        self.bytes_sent = 0
+
     def register_array(self, array):
         self.arrays[array.name] = array
 
@@ -321,3 +629,68 @@ class Streamer(object):
         for msg in msgs:
             self._sock.sendto(msg, (self.host, PIXEL_SERVER_PORT))
 
+
+    def _get_rgb8_pixels(self):
+        pixels = []
+
+        if self.mode == 'hsv':
+            hue = self.arrays['hue']
+            sat = self.arrays['sat']
+            val = self.arrays['val']
+
+            hue._lock()
+            sat._lock()
+            val._lock()
+
+            for h, s, v in zip(hue._get_list(), sat._get_list(), val._get_list()):
+                r, g, b = colorsys.hsv_to_rgb(h, s, v)
+
+                pixels.append((int(r * 255), int(g * 255), int(b * 255)))
+
+            hue._release()
+            sat._release()
+            val._release()
+
+        else:
+            r = self.arrays['r']
+            g = self.arrays['g']
+            b = self.arrays['b']
+
+            r._lock()
+            g._lock()
+            b._lock()
+
+            for pix_r, pix_g, pix_b in zip(r._get_list(), g._get_list(), b._get_list()):
+                pixels.append((int(pix_r * 255), int(pix_g * 255), int(pix_b * 255)))
+
+            r._release()
+            g._release()
+            b._release()
+
+        return pixels
+
+    def encode_frame(self, pixels):
+        prev = self.prev_frame
+
+        # periodic full frame
+        if self.frame % FRAME_KEYFRAME_INTERVAL == 0:
+            prev = None
+
+        msgs = encode_frame(pixels, self.frame, prev=prev, base_frame=self.frame - 1)
+
+        self.prev_frame = pixels
+        self.frame = (self.frame + 1) & 0xffff
+
+        return msgs
+
+    def update_frame(self):
+        """Send the current arrays as one 8 bit RGB frame.
+
+        Uses the hue/sat/val arrays in hsv mode and r/g/b otherwise.
+        The device only loads the frame once all of it has arrived.
+        """
+        msgs = self.encode_frame(self._get_rgb8_pixels())
+
+        for msg in msgs:
+            self._sock.sendto(msg, (self.host, PIXEL_SERVER_PORT))
+            self.bytes_sent += len(msg)
@@ -1140,6 +1140,55 @@ def init():
 """
 
 
+copy_propagation = """
+
+a = Number(publish=True)
+b = Number(publish=True)
+c = Number(publish=True)
+d = Number(publish=True)
+
+def init():
+    a = not d
+    b = not a
+    c = not d > 2
+    d = not (a == 0 or not b > 2)
+
+"""
+
+
+const_folding = """
+a = Number(publish=True)
+b = Number(publish=True)
+
+def init():
+    t = Number()
+    t = 3
+
+    a = t * 4 + 1
+    b = a - t * 2
+"""
+
+strength_reduction = """
+a = Number(publish=True)
+b = Number(publish=True)
+c = Number(publish=True)
+
+def init():
+    a += 100
+
+    b = a * 4
+    c = a / 8
+"""
+
+loop_invariant = """
+a = Number(publish=True)
+
+def init():
+    for i in pixels.count:
+        a += 65535 / pixels.count
+"""
+
+
 test_db_access = """
 
 a = Number(publish=True)
@@ -1157,6 +1206,94 @@ def init():
 """
 
 
+test_superinstructions = """
+a = Number(publish=True)
+b = Number(publish=True)
+c = Number(publish=True)
+d = Number(publish=True)
+e = Number(publish=True)
+f = Number(publish=True)
+g = Number(publish=True)
+h = Number(publish=True)
+
+def init():
+    # h is not known at compile time,
+    # so the compares can't be folded.
+    t = Number()
+    t = h + 5
+
+    if t > 4:
+        a = 1
+
+    if t >= 6:
+        b = 1
+
+    if t < 6:
+        c = 1
+
+    if t <= 4:
+        d = 1
+
+    if t == 5:
+        e = 1
+
+    if t != 5:
+        f = 1
+
+    g = t - 3
+    g = g + 100000
+
+def loop():
+    pass
+"""
+
+pix_superinstructions = """
+def init():
+    pixels.hue = 60000
+    pixels.val = 1000
+    pixels.sat = 65000
+
+def loop():
+    for x in pixels.size_x:
+        for y in pixels.size_y:
+            pixels[x][y].hue += 10000
+            pixels[x][y].val -= 3000
+            pixels[x][y].sat += 1000
+"""
+
+call_crossing_temps = """
+a = Number(publish=True)
+b = Number(publish=True)
+
+def f(_x):
+    return (_x * 3) + (_x * 5)
+
+def init():
+    a = f(2) + f(3) * f(4)
+
+    # temps live across the loop body
+    for i in 4:
+        b += (a - 780) * (i + 1)
+
+def loop():
+    pass
+"""
+
+register_pressure = """
+a = Number(publish=True)
+b = Number(publish=True)
+c = Number(publish=True)
+
+def init():
+    b = 2
+    c = 3
+""" + "".join(["""
+    a += (b + %d) * (c + %d) - (b * %d)""" % (i, i + 1, i + 2) for i in xrange(150)]) + """
+
+def loop():
+    pass
+"""
+
 
 class CGTestsBase(unittest.TestCase):
     def run_test(self, program, expected={}):
@@ -1440,6 +1577,31 @@ class CGTestsBase(unittest.TestCase):
                 'g': 1,
             })
 
+    def test_call_crossing_temps(self):
+        self.run_test(call_crossing_temps,
+            expected={
+                'a': 784,
+                'b': 40,
+            })
+
+    def test_register_pressure(self):
+        self.run_test(register_pressure,
+            expected={
+                'a': sum([(2 + i) * (3 + i + 1) - (2 * (i + 2)) for i in xrange(150)]),
+            })
+
+    def test_superinstructions(self):
+        self.run_test(test_superinstructions,
+            expected={
+                'a': 1,
+                'b': 0,
+                'c': 1,
+                'd': 0,
+                'e': 1,
+                'f': 0,
+                'g': 100002,
+            })
+
     def test_not(self):
         self.run_test(test_not,
             expected={
@@ -1876,6 +2038,136 @@ class CGHSVArrayTests(unittest.TestCase):
         self.assertEqual(regs['d'], 4)
 
 
+class CGRegisterAllocTests(unittest.TestCase):
+    def test_temp_reuse(self):
+        code = code_gen.compile_text(register_pressure)
+
+        temps = set([reg.addr for reg in code['vm_data']['registers'].itervalues() if isinstance(reg, code_gen.TempIR)])
+
+        # 450 temps in the source, only a handful are live at once
+        self.assertLess(len(temps), 4)
+
+    def test_call_crossing_temps(self):
+        code = code_gen.compile_text(call_crossing_temps)
+
+        regs = code['vm_data']['registers']
+
+        # the result of f(2) is live across the other calls,
+        # so it cannot share an address with any other temp
+        addrs = [reg.addr for reg in regs.itervalues() if isinstance(reg, code_gen.TempIR)]
+        crossing = [reg for reg in regs.itervalues() if isinstance(reg, code_gen.TempIR) and addrs.count(reg.addr) == 1]
+
+        self.assertGreater(len(crossing), 0)
+
+    def test_copy_propagation(self):
+        code = code_gen.compile_text(copy_propagation)
+
+        # NOT into a temp followed by a copy to a var
+        # should write the var directly.
+        movs = [ins for ins in code['vm_code']['init'] if isinstance(ins, code_gen.Mov)]
+
+        self.assertEqual(len(movs), 0)
+
+        nots = [ins for ins in code['vm_code']['init'] if isinstance(ins, code_gen.Not) and isinstance(ins.dest, code_gen.VarIR)]
+
+        self.assertEqual(len(nots), 4)
+
+
+class CGOptimizerTests(unittest.TestCase):
+    def run_program(self, program):
+        code = code_gen.compile_text(program)
+        vm = code_gen.VM(code['vm_code'], code['vm_data'])
+
+        vm.run_once()
+
+        return code['vm_code'], vm
+
+    def test_constant_folding(self):
+        code, vm = self.run_program(const_folding)
+
+        regs = vm.dump_registers()
+        self.assertEqual(regs['a'], 13)
+        self.assertEqual(regs['b'], 7)
+
+        self.assertFalse(any([isinstance(ins, code_gen.BinInstruction) for ins in code['init']]))
+
+    def test_strength_reduction(self):
+        code, vm = self.run_program(strength_reduction)
+
+        regs = vm.dump_registers()
+        self.assertEqual(regs['b'], 400)
+        self.assertEqual(regs['c'], 12)
+
+        self.assertFalse(any([isinstance(ins, (code_gen.Mul, code_gen.Div)) for ins in code['init']]))
+        self.assertEqual(len([ins for ins in code['init'] if isinstance(ins, code_gen.ShiftLeft)]), 1)
+        self.assertEqual(len([ins for ins in code['init'] if isinstance(ins, code_gen.DivPow2)]), 1)
+
+    def test_loop_invariant(self):
+        code, vm = self.run_program(loop_invariant)
+
+        count = vm.objects[code_gen.PIX_OBJ_TYPE]['pixels'].toBasic()['count']
+
+        regs = vm.dump_registers()
+        self.assertEqual(regs['a'], (65535 / count) * count)
+
+        # the divide runs once, before the top of the loop
+        loop_jmp = [ins for ins in code['init'] if isinstance(ins, code_gen.JmpIfLessThanPreInc)][0]
+        names = [ins.name if isinstance(ins, code_gen.Label) else None for ins in code['init']]
+        top = names.index(loop_jmp.label.name)
+
+        divs = [i for i in xrange(len(code['init'])) if isinstance(code['init'][i], code_gen.Div)]
+
+        self.assertEqual(len(divs), 1)
+        self.assertLess(divs[0], top)
+
+
+class CGPeepholeTests(unittest.TestCase):
+    def get_instructions(self, program, func):
+        code = code_gen.compile_text(program)
+
+        return code['vm_code'][func]
+
+    def test_compare_branch(self):
+        code = self.get_instructions(test_superinstructions, 'init')
+
+        self.assertFalse(any([isinstance(ins, code_gen.BinInstruction) and ins.symbol in ['>', '>=', '<', '<=', '==', '!='] for ins in code]))
+        self.assertFalse(any([isinstance(ins, code_gen.JmpIfZero) for ins in code]))
+        self.assertEqual(len([ins for ins in code if isinstance(ins, code_gen.JmpCompare)]), 6)
+
+    def test_add_immediate(self):
+        code = self.get_instructions(test_superinstructions, 'init')
+
+        imms = [ins.imm for ins in code if isinstance(ins, code_gen.AddImmediate)]
+
+        # 100000 does not fit in 16 bits
+        self.assertEqual(imms, [5, -3])
+
+    def test_pix_add(self):
+        code = self.get_instructions(pix_superinstructions, 'loop')
+
+        ops = [(type(ins), ins.attr) for ins in code if isinstance(ins, code_gen.PixArrayOpInstruction)]
+
+        self.assertEqual(ops, [(code_gen.PixArrayAdd, 'hue'), (code_gen.PixArraySub, 'val'), (code_gen.PixArrayAdd, 'sat')])
+        self.assertFalse(any([isinstance(ins, (code_gen.LoadFromPixArray, code_gen.LoadToPixArray)) for ins in code]))
+
+    def test_pix_add_run(self):
+        code = code_gen.compile_text(pix_superinstructions)
+        vm = code_gen.VM(code['vm_code'], code['vm_data'])
+
+        vm.run_once()
+
+        hsv = vm.dump_hsv()
+
+        for a in hsv['hue']:
+            self.assertEqual(a, 4464)
+
+        for a in hsv['val']:
+            self.assertEqual(a, 0)
+
+        for a in hsv['sat']:
+            self.assertEqual(a, 65535)
+
+
 class CGTestsLocal(CGTestsBase):
     def run_test(self, program, expected={}):
         code = code_gen.compile_text(program)
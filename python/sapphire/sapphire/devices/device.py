@@ -647,6 +647,14 @@ class Device(object):
 
         return info
 
+    def get_kvindex_info(self):
+        data = self.get_file("kvindex")
+
+        info = sapphiredata.KVIndexArray()
+        info.unpack(data)
+
+        return info
+
     def get_thread_info(self):
         data = self.get_file("threadinfo")
 
@@ -900,6 +908,32 @@ class Device(object):
 
         return s
 
+    def cli_kvindexinfo(self, line):
+        info = self.get_kvindex_info()
+
+        names = ['send', 'send_source', 'rxcache', 'links']
+
+        s = "\nIndex        Size  Count Deleted MaxProbe Rebuilds  Lookups   Probes/Lookup\n"
+
+        for name, n in zip(names, info):
+            probes_per_lookup = 0.0
+            if n.lookups > 0:
+                probes_per_lookup = float(n.probes) / n.lookups
+
+            s += "%-12s %5u %5u %7u %8u %8u %8u %8.2f" % \
+                (name,
+                 n.size,
+                 n.count,
+                 n.deleted,
+                 n.max_probe,
+                 n.rebuilds,
+                 n.lookups,
+                 probes_per_lookup)
+
+            s += "\n"
+
+        return s
+
     def cli_gcinfo(self, line):
         info = self.get_gc_info()
 
@@ -933,7 +967,7 @@ class Device(object):
         else:
             info = self.get_thread_info()
 
-        s = "\nAddr  Line  Flags  Data         Time     Runs  Avg      Alarm     Name\n"
+        s = "\nAddr  Line  Flags   Pri Data         Time     Runs  Avg      Max      Alarm   Lat max  Lat avg Late max Late avg  Name\n"
 
         for n in info:
 
@@ -964,23 +998,47 @@ class Device(object):
             else:
                 flags += '-'
 
+            if n.flags & 32:
+                flags += 'R'
+            else:
+                flags += '-'
+
             try:
                 avg_time = n.run_time / n.runs
 
             except ZeroDivisionError:
                 avg_time = 0
 
-            s += "%5x  %4d   %5s %4d %12d %8d %5d %12d %s\n" % \
+            s += "%5x  %4d  %6s %4d %4d %12d %8d %5d %8d %10d %8d %8d %8d %8d  %s\n" % \
                 (n.addr,
                  n.line,
                  flags,
+                 n.priority,
                  n.data_size,
                  n.run_time,
                  n.runs,
                  avg_time,
+                 n.run_time_max,
                  n.alarm,
+                 n.latency_max,
+                 n.latency_avg,
+                 n.alarm_late_max,
+                 n.alarm_late_avg,
                  n.name)
 
+        # run time histogram, bin edges are in microseconds
+        labels = []
+        for i in xrange(sapphiredata.THREAD_RUN_HIST_BINS - 1):
+            labels.append("<%d" % (1 << (sapphiredata.THREAD_RUN_HIST_MIN_SHIFT + i)))
+
+        labels.append(">=%d" % (1 << (sapphiredata.THREAD_RUN_HIST_MIN_SHIFT + sapphiredata.THREAD_RUN_HIST_BINS - 2)))
+
+        s += "\nRun times (us), percent of runs\n"
+        s += "".join(["%7s" % l for l in labels]) + "  Name\n"
+
+        for n in info:
+            s += "".join(["%7.1f" % (c * 100.0 / 255) for c in n.run_hist]) + "  %s\n" % (n.name)
+
         return s
 
     def cli_handleinfo(self, line):
@@ -1003,6 +1061,8 @@ class Device(object):
             15: "kv_link",
             16: "kv_send",
             17: "kv_rx_cache",
+            18: "kv_index",
+            19: "kv_persist",
         }
 
         total_size = 0
@@ -1269,6 +1329,15 @@ class Device(object):
               params["mem_peak_usage"],
               params["mem_heap_size"])
 
+        params = self.get_kv("mem_fragmentation", "mem_gc_max_pause", "mem_gc_max_moved", "mem_gc_bytes_moved", "mem_gc_passes")
+
+        s += "\nFrag:%3d%% GC passes:%6d Moved:%8d bytes Max step:%5d bytes Max pause:%5d uS" % \
+             (params["mem_fragmentation"],
+              params["mem_gc_passes"],
+              params["mem_gc_bytes_moved"],
+              params["mem_gc_max_moved"],
+              params["mem_gc_max_pause"])
+
         return s
 
     def cli_loaderinfo(self, line):
@@ -89,6 +89,10 @@ class DnsCacheArray(ArrayField):
 
         super(DnsCacheArray, self).__init__(_field=field, **kwargs)
 
+# must match threading.h
+THREAD_RUN_HIST_BINS        = 8
+THREAD_RUN_HIST_MIN_SHIFT   = 8
+
 class ThreadInfoField(StructField):
     def __init__(self, **kwargs):
         fields = [StringField(_name="name", _length=64),
@@ -99,7 +103,14 @@ class ThreadInfoField(StructField):
                   Uint32Field(_name="runs"),
                   Uint16Field(_name="line"),
                   Uint64Field(_name="alarm"),
-                  ArrayField(_name="reserved", _field=Uint8Field, _length=24)]
+                  Uint8Field(_name="priority"),
+                  Uint32Field(_name="latency_max"),
+                  Uint32Field(_name="latency_avg"),
+                  Uint16Field(_name="run_time_max"),
+                  Uint16Field(_name="alarm_late_max"),
+                  Uint16Field(_name="alarm_late_avg"),
+                  ArrayField(_name="run_hist", _field=Uint8Field, _length=THREAD_RUN_HIST_BINS),
+                  ArrayField(_name="reserved", _field=Uint8Field, _length=1)]
 
         super(ThreadInfoField, self).__init__(_fields=fields, **kwargs)
 
@@ -167,6 +178,24 @@ class KVReceiveCacheArray(ArrayField):
 
         super(KVReceiveCacheArray, self).__init__(_field=field, **kwargs)
 
+class KVIndexField(StructField):
+    def __init__(self, **kwargs):
+        fields = [Uint16Field(_name="size"),
+                  Uint16Field(_name="count"),
+                  Uint16Field(_name="deleted"),
+                  Uint16Field(_name="max_probe"),
+                  Uint16Field(_name="rebuilds"),
+                  Uint32Field(_name="lookups"),
+                  Uint32Field(_name="probes")]
+
+        super(KVIndexField, self).__init__(_fields=fields, **kwargs)
+
+class KVIndexArray(ArrayField):
+    def __init__(self, **kwargs):
+        field = KVIndexField
+
+        super(KVIndexArray, self).__init__(_field=field, **kwargs)
+
 
 
 
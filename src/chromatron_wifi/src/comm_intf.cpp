@@ -315,6 +315,28 @@ static void set_rx_ready( void ){
     irqline_v_strobe_irq();
 }
 
+// advance rgb_index to the next chunk with changed pixels.
+// returns false and ends the array transfer if there are none left.
+static bool _intf_b_next_rgb_chunk( void ){
+
+    uint16_t pix_count = gfx_u16_get_pix_count();
+
+    while( rgb_index < pix_count ){
+
+        if( gfx_b_clear_rgb_dirty( rgb_index, WIFI_RGB_DATA_N_PIXELS ) ){
+
+            return true;
+        }
+
+        rgb_index += WIFI_RGB_DATA_N_PIXELS;
+    }
+
+    rgb_index = 0;
+    request_rgb_array = false;
+
+    return false;
+}
+
 void intf_v_process( void ){
 
     noInterrupts();
@@ -542,7 +564,7 @@ void intf_v_process( void ){
 
         _intf_i8_send_msg( WIFI_DATA_ID_RGB_PIX0, (uint8_t *)&msg, sizeof(msg) );
     }
-    else if( request_rgb_array ){
+    else if( request_rgb_array && _intf_b_next_rgb_chunk() ){
 
         // get pointers to the arrays
         uint8_t *r = gfx_u8p_get_red();
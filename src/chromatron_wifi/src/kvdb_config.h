@@ -30,6 +30,9 @@
 
 #define KVDB_MAX_ENTRIES                128
 
+// lookup cache entries, must be a power of 2
+#define KVDB_CACHE_SIZE                 8
+
 // #define KVDB_ENABLE_NAME_LOOKUP         
 
 #endif
@@ -44,9 +44,45 @@ void list_v_init( list_t *list ){
 
     list->head = -1;
     list->tail = -1;
+    list->count = 0;
+    list->size = 0;
     list->init = 1;
 }
 
+// update the count and size when a node is added or removed
+static void add_node( list_t *list, list_node_t node ){
+
+    list->count++;
+    list->size += list_u16_node_size( node );
+}
+
+static void remove_node( list_t *list, list_node_t node ){
+
+    list->count--;
+    list->size -= list_u16_node_size( node );
+}
+
+#ifdef ENABLE_LIST_VERIFY
+static void verify_list( list_t *list ){
+
+    uint16_t count = 0;
+    uint16_t size = 0;
+
+    list_node_t node = list->head;
+
+    while( node >= 0 ){
+
+        count++;
+        size += list_u16_node_size( node );
+
+        node = list_ln_next( node );
+    }
+
+    ASSERT( count == list->count );
+    ASSERT( size == list->size );
+}
+#endif
+
 
 list_node_t list_ln_create_node( void *data, uint16_t len ){
 
@@ -99,16 +135,11 @@ uint8_t list_u8_count( list_t *list ){
 
     ASSERT( list->init != 0 );
 
-    uint8_t count = 0;
+    #ifdef ENABLE_LIST_VERIFY
+    verify_list( list );
+    #endif
 
-    list_node_t node = list->head;
-
-    while( node >= 0 ){
-
-        count++;
-
-        node = list_ln_next( node );
-    }
+    uint8_t count = list->count;
 
     END_ATOMIC;
 
@@ -121,16 +152,11 @@ uint16_t list_u16_size( list_t *list ){
 
     ASSERT( list->init != 0 );
 
-    uint16_t size = 0;
+    #ifdef ENABLE_LIST_VERIFY
+    verify_list( list );
+    #endif
 
-    list_node_t node = list->head;
-
-    while( node >= 0 ){
-
-        size += list_u16_node_size( node );
-
-        node = list_ln_next( node );
-    }
+    uint16_t size = list->size;
 
     END_ATOMIC;
 
@@ -189,6 +215,8 @@ void list_v_insert_after( list_t *list, list_node_t node, list_node_t new_node )
 
     state->next = new_node;
 
+    add_node( list, new_node );
+
     END_ATOMIC;
 }
 
@@ -207,6 +235,8 @@ void list_v_insert_tail( list_t *list, list_node_t node ){
 
         state->prev = -1;
         state->next = -1;
+
+        add_node( list, node );
     }
     else{
 
@@ -245,6 +275,8 @@ void list_v_insert_head( list_t *list, list_node_t node ){
         list->head = node;
     }
 
+    add_node( list, node );
+
     END_ATOMIC;
 }
 
@@ -281,6 +313,8 @@ void list_v_remove( list_t *list, list_node_t node ){
         next_state->prev = state->prev;
     }
 
+    remove_node( list, node );
+
     END_ATOMIC;
 }
 
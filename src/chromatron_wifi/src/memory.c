@@ -12,6 +12,41 @@ static mem_rt_data_t mem_rt_data;
 static uint32_t mem_allocs;
 static uint32_t mem_alloc_fails;
 
+// incremental garbage collector state
+static bool gc_active;
+static mem_block_header_t *gc_clean;
+static mem_block_header_t *gc_dirty;
+
+// free handle bitmap, a set bit is an allocated handle
+static uint8_t handle_map[( MAX_MEM_HANDLES + 7 ) / 8];
+static uint16_t handle_map_hint;
+
+#ifdef ENABLE_MEM_POOLS
+
+// slots are padded the same way heap blocks are
+#define MEM_POOL_SLOT_SIZE( size ) ( ( sizeof(mem_block_header_t) + ( size ) + 1 + 3 ) & ~3 )
+
+static uint8_t pool_small[MEM_POOL_SMALL_COUNT * MEM_POOL_SLOT_SIZE( MEM_POOL_SMALL_SIZE )] __attribute__((aligned(4)));
+static uint8_t pool_small_map[( MEM_POOL_SMALL_COUNT + 7 ) / 8];
+static uint8_t pool_large[MEM_POOL_LARGE_COUNT * MEM_POOL_SLOT_SIZE( MEM_POOL_LARGE_SIZE )] __attribute__((aligned(4)));
+static uint8_t pool_large_map[( MEM_POOL_LARGE_COUNT + 7 ) / 8];
+
+typedef struct{
+    uint8_t *slots;
+    uint8_t *map;
+    uint16_t size;
+    uint16_t count;
+    uint16_t hint;
+} mem_pool_t;
+
+// smallest first
+static mem_pool_t pools[] = {
+    { pool_small, pool_small_map, MEM_POOL_SMALL_SIZE, MEM_POOL_SMALL_COUNT, 0 },
+    { pool_large, pool_large_map, MEM_POOL_LARGE_SIZE, MEM_POOL_LARGE_COUNT, 0 },
+};
+
+#endif
+
 
 #define ASSERT(a)
 #define ASSERT_MSG(a, b)
@@ -63,6 +98,128 @@ static void set_dirty( mem_block_header_t *header ){
     header->size |= MEM_SIZE_DIRTY_MASK;
 }
 
+// set up a bitmap for count entries.
+// the unused bits in the last byte are marked as allocated.
+static void map_v_init( uint8_t *map, uint16_t count, uint16_t *hint ){
+
+    uint16_t bytes = ( count + 7 ) / 8;
+
+    memset( map, 0, bytes );
+
+    for( uint16_t i = count; i < ( bytes * 8 ); i++ ){
+
+        map[i / 8] |= ( 1 << ( i % 8 ) );
+    }
+
+    *hint = 0;
+}
+
+// find a free entry in a bitmap and mark it as allocated.
+// hint is the first byte that may have a free bit, all bytes
+// before it are full.
+// returns -1 if the map is full.
+static int16_t map_i16_acquire( uint8_t *map, uint16_t count, uint16_t *hint ){
+
+    uint16_t bytes = ( count + 7 ) / 8;
+
+    while( *hint < bytes ){
+
+        uint8_t byte = map[*hint];
+
+        if( byte != 0xff ){
+
+            uint8_t bit = 0;
+
+            while( ( byte & ( 1 << bit ) ) != 0 ){
+
+                bit++;
+            }
+
+            map[*hint] |= ( 1 << bit );
+
+            return ( *hint * 8 ) + bit;
+        }
+
+        ( *hint )++;
+    }
+
+    return -1;
+}
+
+static void map_v_release( uint8_t *map, uint16_t index, uint16_t *hint ){
+
+    map[index / 8] &= ~( 1 << ( index % 8 ) );
+
+    if( ( index / 8 ) < *hint ){
+
+        *hint = index / 8;
+    }
+}
+
+static void map_v_set( uint8_t *map, uint16_t index ){
+
+    map[index / 8] |= ( 1 << ( index % 8 ) );
+}
+
+#ifdef ENABLE_MEM_POOLS
+// get a slot from the smallest pool that fits.
+// returns 0 if the size is too large for the pools, or the pool is full.
+static mem_block_header_t *pool_p_alloc( uint16_t size ){
+
+    for( uint8_t i = 0; i < cnt_of_array(pools); i++ ){
+
+        mem_pool_t *pool = &pools[i];
+
+        if( size > pool->size ){
+
+            continue;
+        }
+
+        int16_t slot = map_i16_acquire( pool->map, pool->count, &pool->hint );
+
+        if( slot < 0 ){
+
+            mem_rt_data.pool_fails++;
+
+            return 0;
+        }
+
+        mem_rt_data.pool_used++;
+
+        return (mem_block_header_t *)( pool->slots + ( slot * MEM_POOL_SLOT_SIZE( pool->size ) ) );
+    }
+
+    return 0;
+}
+
+// returns TRUE if the block is in a pool
+static bool pool_b_release( mem_block_header_t *header ){
+
+    uint8_t *ptr = (uint8_t *)header;
+
+    for( uint8_t i = 0; i < cnt_of_array(pools); i++ ){
+
+        mem_pool_t *pool = &pools[i];
+
+        uint16_t slot_size = MEM_POOL_SLOT_SIZE( pool->size );
+
+        if( ( ptr < pool->slots ) ||
+            ( ptr >= ( pool->slots + ( pool->count * slot_size ) ) ) ){
+
+            continue;
+        }
+
+        map_v_release( pool->map, ( ptr - pool->slots ) / slot_size, &pool->hint );
+
+        mem_rt_data.pool_used--;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+#endif
+
 #ifndef ENABLE_EXTENDED_VERIFY
 static void verify_handle( mem_handle_t handle ){
 
@@ -92,12 +249,23 @@ void mem2_v_init( uint8_t *_heap, uint16_t size ){
     mem_rt_data.data_space = 0;
     mem_rt_data.dirty_space = 0;
 
+    gc_active = FALSE;
+
     for( uint16_t i = 0; i < MAX_MEM_HANDLES; i++ ){
 
         handles[i] = 0;
     }
 
     mem_rt_data.handles_used = 0;
+
+    map_v_init( handle_map, MAX_MEM_HANDLES, &handle_map_hint );
+
+    #ifdef ENABLE_MEM_POOLS
+    for( uint8_t i = 0; i < cnt_of_array(pools); i++ ){
+
+        map_v_init( pools[i].map, pools[i].count, &pools[i].hint );
+    }
+    #endif
 }
 
 // for debug only, returns a copy of the header at given index
@@ -173,38 +341,60 @@ static mem_handle_t alloc( uint16_t size, mem_type_t8 type ){
 
     size += padding_len;
 
-    // check if there is free space available
-    if( mem_rt_data.free_space < ( size + sizeof(mem_block_header_t) + 1 ) ){
+    // get a handle
+    int16_t index = map_i16_acquire( handle_map, MAX_MEM_HANDLES, &handle_map_hint );
+
+    // if a handle was not found
+    if( index < 0 ){
 
-        // allocation failed
+        // handle allocation failed
         goto finish;
     }
 
-    // get a handle
-    for( handle = 0; handle < MAX_MEM_HANDLES; handle++ ){
+    mem_block_header_t *header = 0;
+
+    #ifdef ENABLE_MEM_POOLS
+    header = pool_p_alloc( size );
+    #endif
 
-        if( handles[handle] == 0 ){
+    if( header == 0 ){
 
-            mem_rt_data.handles_used++;
+        uint16_t block_size = size + sizeof(mem_block_header_t) + 1;
 
-            break;
+        // check if there is free space available
+        if( mem_rt_data.free_space < block_size ){
+
+            // return the handle
+            map_v_release( handle_map, index, &handle_map_hint );
+
+            // allocation failed
+            goto finish;
         }
-    }
 
-    // if a handle was not found
-    if( handle >= MAX_MEM_HANDLES ){
+        // create the memory block
+        header = (mem_block_header_t *)free_space_ptr;
 
-        // reset handle to unallocated
-        handle = -1;
+        // adjust free space
+        free_space_ptr += block_size;
 
-        // handle allocation failed
-        goto finish;
+        mem_rt_data.free_space -= block_size;
+
+        ASSERT_MSG( mem_rt_data.free_space <= mem_rt_data.heap_size, "Free space invalid!" );
+
+        // adjust used space counter
+        mem_rt_data.used_space += block_size;
+
+        // adjust peak usage state
+        if( mem_rt_data.peak_usage < mem_rt_data.used_space ){
+
+            mem_rt_data.peak_usage = mem_rt_data.used_space;
+        }
     }
 
-    // create the memory block
-    handles[handle] = free_space_ptr;
+    handle = index;
+    handles[handle] = header;
 
-    mem_block_header_t *header = handles[handle];
+    mem_rt_data.handles_used++;
 
     header->size = size;
     header->handle = handle;
@@ -224,22 +414,6 @@ static mem_handle_t alloc( uint16_t size, mem_type_t8 type ){
 
     *canary = generate_canary( header );
 
-    // adjust free space
-    free_space_ptr += MEM_BLOCK_SIZE( header );
-
-    mem_rt_data.free_space -= MEM_BLOCK_SIZE( header );
-
-    ASSERT_MSG( mem_rt_data.free_space <= mem_rt_data.heap_size, "Free space invalid!" );
-
-    // adjust used space counter
-    mem_rt_data.used_space += MEM_BLOCK_SIZE( header );
-
-    // adjust peak usage state
-    if( mem_rt_data.peak_usage < mem_rt_data.used_space ){
-
-        mem_rt_data.peak_usage = mem_rt_data.used_space;
-    }
-
     handle = swizzle(handle);
 
     mem_allocs++;
@@ -319,10 +493,18 @@ int8_t mem2_i8_realloc( mem_handle_t handle, uint16_t size ){
     new_handle = unswizzle( new_handle );
     mem_block_header_t *new_header = handles[new_handle];
 
-    // move data to new handle
+    // move data to new handle.
+    // if the block is shrinking, only copy what fits.
+    uint16_t copy_len = header->size;
+
+    if( copy_len > new_header->size ){
+
+        copy_len = new_header->size;
+    }
+
     uint8_t *old_ptr = (uint8_t*)handles[handle] + sizeof( mem_block_header_t );
     uint8_t *new_ptr = (uint8_t*)handles[new_handle] + sizeof( mem_block_header_t );
-    memcpy( new_ptr, old_ptr, header->size );
+    memcpy( new_ptr, old_ptr, copy_len );
 
     // release old handle
     release_block( handle );
@@ -332,6 +514,9 @@ int8_t mem2_i8_realloc( mem_handle_t handle, uint16_t size ){
     handles[handle]     = new_header;
     handles[new_handle] = 0;
 
+    map_v_set( handle_map, handle );
+    map_v_release( handle_map, new_handle, &handle_map_hint );
+
 
 end:
 
@@ -400,11 +585,21 @@ static void release_block( mem_handle_t handle ){
     // clear the handle
     handles[handle] = 0;
 
+    map_v_release( handle_map, handle, &handle_map_hint );
+
     mem_rt_data.handles_used--;
 
     // decrement data space used
     mem_rt_data.data_space -= header->size;
 
+    #ifdef ENABLE_MEM_POOLS
+    // pool slots are not in the heap, they can be reused right away
+    if( pool_b_release( header ) ){
+
+        return;
+    }
+    #endif
+
     // set the flags to dirty so the defragmenter can pick it up
     set_dirty( header );
 
@@ -525,6 +720,14 @@ void mem2_v_get_rt_data( mem_rt_data_t *rt_data ){
 
 
     *rt_data = mem_rt_data;
+
+    // dirty space can't be used until the garbage collector runs
+    uint32_t unallocated = (uint32_t)mem_rt_data.free_space + mem_rt_data.dirty_space;
+
+    if( unallocated > 0 ){
+
+        rt_data->fragmentation = ( (uint32_t)mem_rt_data.dirty_space * 100 ) / unallocated;
+    }
 }
 
 // return amount of free memory available
@@ -559,94 +762,74 @@ error indications will likely be misleading.
 
 YOU HAVE BEEN WARNED!
 
+The heap is compacted incrementally, at most MEM_GC_STEP_BYTES bytes
+and MEM_GC_STEP_BLOCKS blocks per call. See the sapphireos version
+for how the pass is kept consistent between calls.
+
 */
 void mem2_v_collect_garbage( void ){
 
-    if( mem2_u16_get_dirty() < MEM_DEFRAG_THRESHOLD ){
-
-        return;
-    }
-
-    mem_block_header_t *clean;
-    mem_block_header_t *next_block;
-    mem_block_header_t *dirty;
+    if( !gc_active ){
 
-    clean = ( mem_block_header_t * )heap;
-    next_block = ( mem_block_header_t * )heap;
-    dirty = ( mem_block_header_t * )heap;
+        if( mem2_u16_get_dirty() < MEM_DEFRAG_THRESHOLD ){
 
-    // search for a dirty block (loop while clean blocks)
-    while( ( is_dirty( dirty ) == FALSE ) &&
-            ( dirty < ( mem_block_header_t * )free_space_ptr ) ){
+            return;
+        }
 
-        dirty = (mem_block_header_t *)( (uint8_t *)dirty + MEM_BLOCK_SIZE( dirty ) );
+        gc_clean = ( mem_block_header_t * )heap;
+        gc_dirty = ( mem_block_header_t * )heap;
+        gc_active = TRUE;
     }
 
-    // clean pointer needs to lead dirty pointer
-    if( clean < dirty ){
+    uint16_t bytes = 0;
+    uint16_t blocks = 0;
 
-        clean = dirty;
-    }
+    while( ( gc_clean < ( mem_block_header_t * )free_space_ptr ) &&
+           ( bytes < MEM_GC_STEP_BYTES ) &&
+           ( blocks < MEM_GC_STEP_BLOCKS ) ){
 
-    while( clean < ( mem_block_header_t * )free_space_ptr ){
+        blocks++;
 
-        // search for a clean block (loop while dirty)
-        // (couldn't find anymore clean blocks to move, so there should be
-        // no clean blocks between the dirty pointer and the free pointer)
-        while( is_dirty( clean ) == TRUE ){
+        uint16_t block_size = MEM_BLOCK_SIZE( gc_clean );
 
-            clean = (mem_block_header_t *)( (uint8_t *)clean + MEM_BLOCK_SIZE( clean ) );
+        // skip dirty blocks
+        if( is_dirty( gc_clean ) ){
 
-            // if the free space is reached, the routine is finished
-            if( clean >= ( mem_block_header_t * )free_space_ptr ){
+            gc_clean = (mem_block_header_t *)( (uint8_t *)gc_clean + block_size );
 
-                goto done_defrag;
-            }
+            continue;
         }
 
-        // get next block
-        next_block = (mem_block_header_t *)( (uint8_t *)clean + MEM_BLOCK_SIZE( clean ) );
+        if( gc_clean != gc_dirty ){
 
-        // switch the handle from the old block to the new block
-        handles[clean->handle] = dirty;
-        // NOTE:
-        // Could do this instead, and save the need to store the handle index
-        // in the block, saving 2 bytes per object.
-        /*
-        for( uint16_t i = 0; i < MAX_MEM_HANDLES; i++ ){
+            // switch the handle from the old block to the new block
+            handles[gc_clean->handle] = gc_dirty;
 
-            if( handles[i] == clean ){
+            // copy the clean block down to the dirty pointer.
+            // the two blocks can overlap.
+            memmove( gc_dirty, gc_clean, block_size );
 
-                handles[i] = dirty;
-                break;
-            }
+            bytes += block_size;
         }
-        */
-
-        // copy the clean block to the dirty block pointer
-        memcpy( dirty, clean, MEM_BLOCK_SIZE( clean ) );
-
-        // increment dirty pointer
-        dirty = (mem_block_header_t *)( (uint8_t *)dirty + MEM_BLOCK_SIZE( dirty ) );
 
-        // assign clean pointer to next block
-        clean = next_block;
+        gc_dirty = (mem_block_header_t *)( (uint8_t *)gc_dirty + block_size );
+        gc_clean = (mem_block_header_t *)( (uint8_t *)gc_clean + block_size );
     }
 
-done_defrag:
-    // EVENT( EVENT_ID_MEM_DEFRAG, 1 );
+    if( gc_clean >= ( mem_block_header_t * )free_space_ptr ){
 
-    // there should be no clean blocks between the dirty and free pointers,
-    // set the free pointer to the dirty pointer
-    free_space_ptr = (uint8_t *)dirty;
+        // there are no clean blocks between the dirty and free pointers,
+        // everything past the dirty pointer is now free
+        uint16_t reclaimed = free_space_ptr - (uint8_t *)gc_dirty;
 
-    // the dirty space is now free
-    mem_rt_data.free_space += mem_rt_data.dirty_space;
+        free_space_ptr = (uint8_t *)gc_dirty;
 
-    // no more dirty space
-    mem_rt_data.dirty_space = 0;
+        mem_rt_data.free_space += reclaimed;
+        mem_rt_data.dirty_space -= reclaimed;
 
-    // run canary check
-    mem2_v_check_canaries();
-}
+        gc_active = FALSE;
 
+        // run canary check
+        mem2_v_check_canaries();
+    }
+}
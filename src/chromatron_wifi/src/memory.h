@@ -35,6 +35,26 @@
 
 #define MEM_DEFRAG_THRESHOLD    512
 
+// most bytes the defragmenter will move, and blocks it will look at,
+// in one call. a pass that needs more than this continues on the next call.
+#define MEM_GC_STEP_BYTES       1024
+#define MEM_GC_STEP_BLOCKS      64
+
+// small object pools:
+// allocations that fit are placed in fixed size slots outside of the
+// heap, so they are never moved by the garbage collector and never
+// leave dirty space behind. if a pool is full the allocation falls
+// back to the heap. comment out MEM_POOL_SMALL_COUNT to disable.
+// the large pool is sized for wifi_msg_kv_batch_t list nodes.
+#define MEM_POOL_SMALL_SIZE     28
+#define MEM_POOL_SMALL_COUNT    32
+#define MEM_POOL_LARGE_SIZE     124
+#define MEM_POOL_LARGE_COUNT    8
+
+#ifdef MEM_POOL_SMALL_COUNT
+    #define ENABLE_MEM_POOLS
+#endif
+
 typedef int16_t mem_handle_t;
 
 typedef uint8_t mem_type_t8;
@@ -63,6 +83,9 @@ typedef struct{
     uint16_t dirty_space;
     uint16_t data_space;
     uint16_t peak_usage;
+    uint16_t fragmentation;     // percent of unallocated heap that is dirty
+    uint16_t pool_used;         // pool slots in use
+    uint16_t pool_fails;        // pool allocations that fell back to the heap
 } mem_rt_data_t;
 
 void mem2_v_init( uint8_t *_heap, uint16_t size );
@@ -29,4 +29,7 @@
 
 #define VM_MAX_IMAGE_SIZE   4096
 
+// opcode histogram, used by the vm_bench tool
+// #define VM_ENABLE_PROFILE
+
 #endif
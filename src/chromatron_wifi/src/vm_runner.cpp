@@ -48,167 +48,275 @@ static bool run_faders;
 
 static list_t kv_send_list;
 
+// publish and write keys are resolved to DB indexes when the VM is
+// loaded, so the frame loop does not search the DB for every key.
+// last is the value most recently queued for transport, so only keys
+// that change are sent.
+typedef struct{
+    catbus_hash_t32 hash;
+    int32_t last;
+    int16_t index;
+    uint8_t addr;
+} vm_binding_t;
+
+static vm_binding_t publish_bindings[KVDB_MAX_ENTRIES];
+static vm_binding_t write_bindings[KVDB_MAX_ENTRIES];
+static uint16_t publish_binding_count;
+static uint16_t write_binding_count;
+
+// DB generation the indexes were resolved against
+static uint16_t binding_generation;
+
+// send every key on the next frame, not just the changed ones
+static bool kv_send_all;
+static uint32_t last_kv_send_all;
+
+// everything is sent at this interval anyway, in case the
+// other side lost a batch or was reset.
+#define KV_SEND_ALL_INTERVAL    1000
+
+// if this many batches are still waiting, the link has fallen behind.
+// the backlog is dropped and everything is sent again.
+#define KV_SEND_LIST_MAX        8
+
+static void _vm_v_resolve_bindings( void ){
+
+    for( uint16_t i = 0; i < publish_binding_count; i++ ){
+
+        publish_bindings[i].index = kvdb_i16_get_index_for_hash( publish_bindings[i].hash );
+    }
 
-static int8_t _vm_i8_run_vm( bool init ){
-
-    // check that VM was loaded with no errors
-    if( vm_info.status < 0 ){
+    for( uint16_t i = 0; i < write_binding_count; i++ ){
 
-        return -20;
+        write_bindings[i].index = kvdb_i16_get_index_for_hash( write_bindings[i].hash );
     }
 
-    // check that VM has not halted:
-    if( vm_info.return_code == VM_STATUS_HALT ){
+    binding_generation = kvdb_u16_get_generation();
 
-        return 0;
-    }
+    kv_send_all = true;
+}
 
-    int32_t *data_table = (int32_t *)&vm_slab[vm_state.data_start];
+static void _vm_v_init_bindings( void ){
 
-    // init pixel array pointer
-    gfx_pixel_array_t *pix_array = (gfx_pixel_array_t *)( vm_slab + vm_state.pix_obj_start );
+    publish_binding_count = vm_state.publish_count;
+
+    if( publish_binding_count > KVDB_MAX_ENTRIES ){
+
+        publish_binding_count = KVDB_MAX_ENTRIES;
+    }
 
-    // load published vars
     vm_publish_t *publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
 
-    uint32_t count = vm_state.publish_count;
+    for( uint16_t i = 0; i < publish_binding_count; i++ ){
 
-    while( count > 0 ){
+        publish_bindings[i].hash = publish[i].hash;
+        publish_bindings[i].addr = publish[i].addr;
+        publish_bindings[i].last = 0;
+    }
+
+    write_binding_count = vm_state.write_keys_count;
 
-        kvdb_i8_get( publish->hash, &data_table[publish->addr] );
+    if( write_binding_count > KVDB_MAX_ENTRIES ){
 
-        publish++;
-        count--;
+        write_binding_count = KVDB_MAX_ENTRIES;
     }
 
-    uint32_t start_time = micros();
+    uint32_t *hash = (uint32_t *)&vm_slab[vm_state.write_keys_start];
 
-    int8_t return_code;
+    for( uint16_t i = 0; i < write_binding_count; i++ ){
 
-    if( init ){
+        write_bindings[i].hash = hash[i];
+        write_bindings[i].addr = 0;
+        write_bindings[i].last = 0;
+    }
 
-        // gfx_v_reset();
-        gfx_v_init_pixel_arrays( pix_array, vm_state.pix_obj_count );
+    _vm_v_resolve_bindings();
+}
 
-        return_code = vm_i8_run_init( vm_slab, &vm_state );
+static void _vm_v_check_bindings( void ){
+
+    // keys added or removed since the last frame (usually by the
+    // other side sending us a batch) move entries around in the DB.
+    if( binding_generation != kvdb_u16_get_generation() ){
+
+        _vm_v_resolve_bindings();
     }
-    else{
+}
 
-        return_code = vm_i8_run_loop( vm_slab, &vm_state );
+static void _vm_v_load_published( int32_t *data_table ){
+
+    for( uint16_t i = 0; i < publish_binding_count; i++ ){
+
+        // data table is 32 bit aligned, checked when loading
+        kvdb_i8_get_by_index( publish_bindings[i].index, &data_table[publish_bindings[i].addr] );
     }
+}
 
-    // if return is anything other than OK, send status immediately
-    if( return_code != 0 ){
+static void _vm_v_store_published( int32_t *data_table ){
 
-        intf_v_request_vm_info();
+    for( uint16_t i = 0; i < publish_binding_count; i++ ){
+
+        kvdb_i8_set_by_index( publish_bindings[i].index, data_table[publish_bindings[i].addr] );
     }
+}
 
-    uint32_t end_time = micros();
-    uint32_t elapsed;
+static void _vm_v_flush_batch( wifi_msg_kv_batch_t *batch ){
 
-    if( end_time >= start_time ){
-        
-        elapsed = end_time - start_time;
+    if( batch->count == 0 ){
+
+        return;
+    }
+
+    list_node_t ln = list_ln_create_node( batch, sizeof(wifi_msg_kv_batch_t) );
+
+    if( ln < 0 ){
+
+        // values in this batch are marked as sent, so
+        // send everything next frame to recover them.
+        kv_send_all = true;
     }
     else{
-        
-        elapsed = UINT32_MAX - ( start_time - end_time );
+
+        list_v_insert_head( &kv_send_list, ln );
     }
 
-    vm_info.loop_time = elapsed;
-    vm_info.max_cycles = vm_state.max_cycles;
-    vm_info.return_code = return_code;
+    memset( batch, 0, sizeof(wifi_msg_kv_batch_t) );
+}
 
-    wifi_msg_kv_batch_t batch;
-    list_node_t ln = -1;
+static void _vm_v_queue_kv( wifi_msg_kv_batch_t *batch, vm_binding_t *binding, int32_t data, bool send_all ){
 
-    // reset send list
-    list_v_destroy( &kv_send_list );
+    if( !send_all && ( data == binding->last ) ){
 
-    // store published vars back to DB
-    publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
+        return;
+    }
 
-    count = vm_state.publish_count;
+    binding->last = data;
 
-    while( count > 0 ){
+    batch->entries[batch->count].hash = binding->hash;
+    batch->entries[batch->count].data = data;
+    batch->count++;
 
-        kvdb_i8_set( publish->hash, data_table[publish->addr] );
+    if( batch->count >= WIFI_KV_BATCH_LEN ){
 
-        publish++;
-        count--;
+        _vm_v_flush_batch( batch );
     }
+}
 
-    // load published vars to messages for transport
-    publish = (vm_publish_t *)&vm_slab[vm_state.publish_start];
+static void _vm_v_queue_changes( int32_t *data_table ){
 
-    count = vm_state.publish_count;
+    // batches from earlier frames are still sent (the list is FIFO,
+    // so newer values for the same key arrive later).
+    if( list_u8_count( &kv_send_list ) >= KV_SEND_LIST_MAX ){
 
-    while( count > 0 ){
+        list_v_destroy( &kv_send_list );
+        kv_send_all = true;
+    }
 
-        memset( &batch, 0, sizeof(batch) );
+    if( ( millis() - last_kv_send_all ) >= KV_SEND_ALL_INTERVAL ){
 
-        for( uint32_t i = 0; i < WIFI_KV_BATCH_LEN; i++ ){
+        kv_send_all = true;
+    }
 
-            batch.count++;
-            batch.entries[i].hash = publish->hash;
-            batch.entries[i].data = data_table[publish->addr];
+    bool send_all = kv_send_all;
+    kv_send_all = false;
 
-            publish++;
-            count--;
+    if( send_all ){
 
-            if( count == 0 ){
+        last_kv_send_all = millis();
+    }
 
-                break;
-            }
-        }
+    wifi_msg_kv_batch_t batch;
+    memset( &batch, 0, sizeof(batch) );
 
-        ln = list_ln_create_node( &batch, sizeof(batch) );
+    // published vars
+    for( uint16_t i = 0; i < publish_binding_count; i++ ){
 
-        if( ln < 0 ){
+        _vm_v_queue_kv( &batch, &publish_bindings[i], data_table[publish_bindings[i].addr], send_all );
+    }
 
-            break;
-        }
+    // write keys, which the VM set in the DB
+    for( uint16_t i = 0; i < write_binding_count; i++ ){
 
-        list_v_insert_head( &kv_send_list, ln );
+        // access the data this way prevents an alignment error when
+        // loading the batch array
+        int32_t data = 0;
+        kvdb_i8_get_by_index( write_bindings[i].index, &data );
+
+        _vm_v_queue_kv( &batch, &write_bindings[i], data, send_all );
     }
 
-    // load write keys from DB
-    count = vm_state.write_keys_count;
-    uint32_t *hash = (uint32_t *)&vm_slab[vm_state.write_keys_start];
+    _vm_v_flush_batch( &batch );
+}
 
-    while( count > 0 ){
 
-        memset( &batch, 0, sizeof(batch) );
+static int8_t _vm_i8_run_vm( bool init ){
 
-        for( uint32_t i = 0; i < WIFI_KV_BATCH_LEN; i++ ){
+    // check that VM was loaded with no errors
+    if( vm_info.status < 0 ){
 
-            batch.count++;
-            batch.entries[i].hash = *hash;
+        return -20;
+    }
 
-            // access the data this way prevents an alignment error when
-            // loading the batch array
-            int32_t data = 0;
-            kvdb_i8_get( *hash, &data );
-            batch.entries[i].data = data;
+    // check that VM has not halted:
+    if( vm_info.return_code == VM_STATUS_HALT ){
 
-            hash++;
-            count--;
+        return 0;
+    }
 
-            if( count == 0 ){
+    int32_t *data_table = (int32_t *)&vm_slab[vm_state.data_start];
 
-                break;
-            }
-        }
+    // init pixel array pointer
+    gfx_pixel_array_t *pix_array = (gfx_pixel_array_t *)( vm_slab + vm_state.pix_obj_start );
 
-        ln = list_ln_create_node( &batch, sizeof(batch) );
+    _vm_v_check_bindings();
 
-        if( ln < 0 ){
+    // load published vars
+    _vm_v_load_published( data_table );
 
-            break;
-        }
+    uint32_t start_time = micros();
 
-        list_v_insert_head( &kv_send_list, ln );
+    int8_t return_code;
+
+    if( init ){
+
+        // gfx_v_reset();
+        gfx_v_init_pixel_arrays( pix_array, vm_state.pix_obj_count );
+
+        return_code = vm_i8_run_init( vm_slab, &vm_state );
     }
+    else{
+
+        return_code = vm_i8_run_loop( vm_slab, &vm_state );
+    }
+
+    // if return is anything other than OK, send status immediately
+    if( return_code != 0 ){
+
+        intf_v_request_vm_info();
+    }
+
+    uint32_t end_time = micros();
+    uint32_t elapsed;
+
+    if( end_time >= start_time ){
+        
+        elapsed = end_time - start_time;
+    }
+    else{
+        
+        elapsed = UINT32_MAX - ( start_time - end_time );
+    }
+
+    vm_info.loop_time = elapsed;
+    vm_info.max_cycles = vm_state.max_cycles;
+    vm_info.max_call_depth = vm_state.max_call_depth;
+    vm_info.return_code = return_code;
+
+    // store published vars back to DB
+    _vm_v_store_published( data_table );
+
+    // queue changed keys for transport
+    _vm_v_queue_changes( data_table );
 
 
 end:
@@ -259,7 +367,18 @@ void vm_v_process( void ){
         // TODO this will have rollover issues
         uint32_t elapsed = micros() - start;
 
+        if( elapsed > UINT16_MAX ){
+
+            elapsed = UINT16_MAX;
+        }
+
         vm_info.fader_time = elapsed;
+        vm_info.active_faders = gfx_u16_get_active_faders();
+
+        if( elapsed > vm_info.max_fader_time ){
+
+            vm_info.max_fader_time = elapsed;
+        }
 
         run_faders = false;
     }
@@ -274,6 +393,9 @@ void vm_v_reset( void ){
     vm_len = 0;
     memset( vm_slab, 0, sizeof(vm_slab) );
 
+    publish_binding_count = 0;
+    write_binding_count = 0;
+
 }
 
 int8_t vm_i8_load( uint8_t *data, uint16_t len ){
@@ -281,6 +403,7 @@ int8_t vm_i8_load( uint8_t *data, uint16_t len ){
     // reset status codes
     vm_info.status = -127;
     vm_info.return_code = -127;
+    vm_info.max_fader_time = 0;
 
     int8_t status = 0;
 
@@ -372,6 +495,8 @@ int8_t vm_i8_load( uint8_t *data, uint16_t len ){
             count--;
         }
 
+        _vm_v_init_bindings();
+
         status = _vm_i8_run_vm( true );
     }
 
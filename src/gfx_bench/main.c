@@ -0,0 +1,318 @@
+// <license>
+//
+//     This file is part of the Sapphire Operating System.
+//
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+//
+//
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// </license>
+
+/*
+
+Host benchmark for the gfx fader and sync loops.
+
+Runs gfx_v_process_faders and gfx_v_sync_array at 300, 600 and 1024
+pixels and reports the time per tick. Two scenes are run:
+
+    full    - every pixel gets a new target each VM frame
+    sparse  - 1 in 16 pixels gets a new target each VM frame
+
+The fader state layout is selected at compile time, so build once
+as-is and once with GFX_PACKED_FADERS to compare the two.
+
+Before timing anything, the bench checks that gfx_v_hsv_to_rgb_block
+and gfx_v_hsv_to_rgbw_block are bit exact with the per pixel
+gfx_v_hsv_to_rgb and gfx_v_hsv_to_rgbw conversions, for every hue
+over a range of saturation, value and master dimmer settings. It
+returns a non-zero exit code on a mismatch, so it can be used as a
+regression check in scripts.
+
+Usage:
+    gfx_bench [ticks]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory.h"
+#include "kvdb.h"
+#include "gfx_lib.h"
+
+#define DEFAULT_TICKS   10000
+
+// VM frame rate vs fader rate, targets change every few fader ticks
+#define TICKS_PER_FRAME 5
+
+#define SCENE_FULL      0
+#define SCENE_SPARSE    1
+
+static const uint16_t pixel_counts[] = { 300, 600, 1024 };
+
+#define N_PIXEL_COUNTS ( sizeof(pixel_counts) / sizeof(pixel_counts[0]) )
+
+static gfx_pixel_array_t pix_array;
+
+static const uint16_t check_levels[] = {
+    0, 1, 255, 256, 1000, 21845, 32767, 32768, 43690, 50000, 65279, 65534, 65535
+};
+
+#define N_CHECK_LEVELS ( sizeof(check_levels) / sizeof(check_levels[0]) )
+
+static const uint16_t check_dimmers[] = { 65535, 40000, 1000, 0 };
+
+#define N_CHECK_DIMMERS ( sizeof(check_dimmers) / sizeof(check_dimmers[0]) )
+
+#define CHECK_BLOCK_SIZE 256
+
+static uint32_t check_errors;
+
+
+static uint64_t get_ns( void ){
+
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void setup( uint16_t pix_count ){
+
+    gfx_params_t params;
+    gfx_v_get_params( &params );
+
+    params.pix_count    = pix_count;
+    params.pix_size_x   = pix_count;
+    params.pix_size_y   = 1;
+
+    gfx_v_set_params( &params );
+    gfx_v_reset();
+    gfx_v_init_pixel_arrays( &pix_array, 1 );
+}
+
+static void set_master_dimmer( uint16_t dimmer ){
+
+    gfx_params_t params;
+    gfx_v_get_params( &params );
+
+    params.master_dimmer = dimmer;
+    params.sub_dimmer = 65535;
+
+    gfx_v_set_params( &params );
+
+    // let the master fader settle
+    for( uint16_t i = 0; i < 1000; i++ ){
+
+        gfx_v_process_faders();
+    }
+}
+
+static void check_block( uint16_t s, uint16_t v ){
+
+    uint16_t h_array[CHECK_BLOCK_SIZE];
+    uint16_t s_array[CHECK_BLOCK_SIZE];
+    uint16_t v_array[CHECK_BLOCK_SIZE];
+    uint8_t r[CHECK_BLOCK_SIZE];
+    uint8_t g[CHECK_BLOCK_SIZE];
+    uint8_t b[CHECK_BLOCK_SIZE];
+    uint8_t misc[CHECK_BLOCK_SIZE];
+    uint8_t rw[CHECK_BLOCK_SIZE];
+    uint8_t gw[CHECK_BLOCK_SIZE];
+    uint8_t bw[CHECK_BLOCK_SIZE];
+    uint8_t w[CHECK_BLOCK_SIZE];
+
+    for( uint32_t base = 0; base < 65536; base += CHECK_BLOCK_SIZE ){
+
+        for( uint16_t i = 0; i < CHECK_BLOCK_SIZE; i++ ){
+
+            h_array[i] = base + i;
+            s_array[i] = s;
+            v_array[i] = v;
+        }
+
+        gfx_v_hsv_to_rgb_block( h_array, s_array, v_array, CHECK_BLOCK_SIZE, r, g, b, misc );
+        gfx_v_hsv_to_rgbw_block( h_array, s_array, v_array, CHECK_BLOCK_SIZE, rw, gw, bw, w );
+
+        for( uint16_t i = 0; i < CHECK_BLOCK_SIZE; i++ ){
+
+            uint16_t r16, g16, b16, w16;
+            uint16_t dimmed_val = gfx_u16_get_dimmed_val( v );
+
+            gfx_v_hsv_to_rgb( h_array[i], s, dimmed_val, &r16, &g16, &b16 );
+
+            r16 /= 64;
+            g16 /= 64;
+            b16 /= 64;
+
+            uint8_t dither = ( ( r16 & 0x0003 ) << 4 ) |
+                             ( ( g16 & 0x0003 ) << 2 ) |
+                             ( b16 & 0x0003 );
+
+            if( ( r[i] != r16 / 4 ) ||
+                ( g[i] != g16 / 4 ) ||
+                ( b[i] != b16 / 4 ) ||
+                ( misc[i] != dither ) ){
+
+                if( check_errors == 0 ){
+
+                    printf( "RGB mismatch: h %u s %u v %u\n", h_array[i], s, v );
+                }
+
+                check_errors++;
+            }
+
+            gfx_v_hsv_to_rgbw( h_array[i], s, dimmed_val, &r16, &g16, &b16, &w16 );
+
+            if( ( rw[i] != r16 / 256 ) ||
+                ( gw[i] != g16 / 256 ) ||
+                ( bw[i] != b16 / 256 ) ||
+                ( w[i] != w16 / 256 ) ){
+
+                if( check_errors == 0 ){
+
+                    printf( "RGBW mismatch: h %u s %u v %u\n", h_array[i], s, v );
+                }
+
+                check_errors++;
+            }
+        }
+    }
+}
+
+static uint32_t check_hsv_to_rgb( void ){
+
+    check_errors = 0;
+
+    setup( 16 );
+
+    for( uint8_t d = 0; d < N_CHECK_DIMMERS; d++ ){
+
+        set_master_dimmer( check_dimmers[d] );
+
+        for( uint8_t i = 0; i < N_CHECK_LEVELS; i++ ){
+
+            for( uint8_t j = 0; j < N_CHECK_LEVELS; j++ ){
+
+                check_block( check_levels[i], check_levels[j] );
+            }
+        }
+    }
+
+    set_master_dimmer( 65535 );
+
+    return check_errors;
+}
+
+static void set_targets( uint8_t scene, uint16_t pix_count, uint32_t frame ){
+
+    uint16_t step = 1;
+
+    if( scene == SCENE_SPARSE ){
+
+        step = 16;
+    }
+
+    for( uint16_t i = 0; i < pix_count; i += step ){
+
+        uint16_t h = ( i * 200 ) + ( frame * 1000 );
+        uint16_t v = ( frame & 1 ) ? 65535 : 32768;
+
+        gfx_v_set_hsv( h, 65535, v, i );
+    }
+}
+
+static double run_scene( uint8_t scene, uint16_t pix_count, uint32_t ticks ){
+
+    setup( pix_count );
+
+    uint64_t elapsed = 0;
+
+    for( uint32_t i = 0; i < ticks; i++ ){
+
+        if( ( i % TICKS_PER_FRAME ) == 0 ){
+
+            set_targets( scene, pix_count, i / TICKS_PER_FRAME );
+        }
+
+        // only the fader engine is timed
+        uint64_t start = get_ns();
+
+        gfx_v_process_faders();
+        gfx_v_sync_array();
+
+        elapsed += get_ns() - start;
+    }
+
+    return (double)elapsed / ticks;
+}
+
+int main( int argc, char *argv[] ){
+
+    uint32_t ticks = DEFAULT_TICKS;
+
+    if( argc > 1 ){
+
+        ticks = strtoul( argv[1], 0, 0 );
+
+        if( ticks == 0 ){
+
+            ticks = 1;
+        }
+    }
+
+    mem2_v_init();
+    kvdb_v_init();
+    gfxlib_v_init();
+
+    #ifdef GFX_PACKED_FADERS
+    printf( "Layout:  packed\n" );
+    #else
+    printf( "Layout:  arrays\n" );
+    #endif
+
+    uint32_t errors = check_hsv_to_rgb();
+
+    if( errors > 0 ){
+
+        printf( "FAIL: %u block conversion mismatches\n", errors );
+        return 1;
+    }
+
+    printf( "HSV to RGB block check passed\n" );
+    printf( "Ticks:   %u\n\n", ticks );
+    printf( "pixels   scene      ns/tick    ns/pixel\n" );
+
+    for( uint8_t i = 0; i < N_PIXEL_COUNTS; i++ ){
+
+        uint16_t pix_count = pixel_counts[i];
+
+        if( pix_count > MAX_PIXELS ){
+
+            printf( "%6u   skipped, MAX_PIXELS is %u\n", pix_count, MAX_PIXELS );
+            continue;
+        }
+
+        double full = run_scene( SCENE_FULL, pix_count, ticks );
+        double sparse = run_scene( SCENE_SPARSE, pix_count, ticks );
+
+        printf( "%6u   full    %10.1f  %10.2f\n", pix_count, full, full / pix_count );
+        printf( "%6u   sparse  %10.1f  %10.2f\n", pix_count, sparse, sparse / pix_count );
+    }
+
+    return 0;
+}
@@ -158,6 +158,19 @@ uint16_t crc_u16_partial_block(uint16_t crc, uint8_t *ptr, uint16_t length){
 
 #endif
 
+uint16_t crc_u16_start( void ){
+
+    return 0xffff;
+}
+
+uint16_t crc_u16_finish( uint16_t crc ){
+
+    crc = crc_u16_byte( crc, 0 );
+    crc = crc_u16_byte( crc, 0 );
+
+    return crc;
+}
+
 uint16_t crc_u16_byte(uint16_t crc, uint8_t data){
 	
 	uint8_t temp;
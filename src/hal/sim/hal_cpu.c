@@ -45,3 +45,31 @@ char *itoa(long i, char* s, int dummy_radix) {
     sprintf(s, "%ld", i);
     return s;
 }
+
+// there is no internal flash image on the simulator
+void memcpy_PF( void *dest, uint32_t src, size_t len ){
+
+    memset( dest, 0, len );
+}
+
+#ifdef SIM_NEEDS_STRLCPY
+size_t strlcpy( char *dst, const char *src, size_t size ){
+
+    size_t len = strlen( src );
+
+    if( size > 0 ){
+
+        size_t copy_len = len;
+
+        if( copy_len >= size ){
+
+            copy_len = size - 1;
+        }
+
+        memcpy( dst, src, copy_len );
+        dst[copy_len] = 0;
+    }
+
+    return len;
+}
+#endif
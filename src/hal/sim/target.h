@@ -44,6 +44,12 @@
 
 #define MEM_HEAP_SIZE           10000
 
+// small object pools
+#define MEM_POOL_SMALL_SIZE     24
+#define MEM_POOL_SMALL_COUNT    32
+#define MEM_POOL_LARGE_SIZE     64
+#define MEM_POOL_LARGE_COUNT    16
+
 // flash fs
 #define FLASH_FS_MAX_USER_FILES 16
 
@@ -2223,10 +2223,12 @@ error:
 
 run_wifi:
 
-    thread_t_create( wifi_comm_thread,
-                     PSTR("wifi_comm"),
-                     0,
-                     0 );
+    // services the UART link to the wifi module
+    thread_v_set_priority( thread_t_create( wifi_comm_thread,
+                                            PSTR("wifi_comm"),
+                                            0,
+                                            0 ),
+                           THREAD_PRIORITY_HIGH );
 
     thread_t_create( wifi_connection_manager_thread,
                      PSTR("wifi_connection_manager"),
@@ -0,0 +1,296 @@
+// <license>
+//
+//     This file is part of the Sapphire Operating System.
+//
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+//
+//
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// </license>
+
+/*
+
+Host benchmark for persisted KV values.
+
+Formats the simulated flash file system, then persists 10, 100 and
+500 keys that have no RAM pointer, so every get and set goes through
+the kv_data file. At each key count it reports:
+
+    set     - kv_i8_set_by_meta on random keys, including the flushes
+              that write the queued values to the file
+    get     - kv_i8_get_by_meta on random keys, through the persist index
+    scan    - the same get done by reading the file block by block,
+              which is how persisted keys were found before the index
+
+Every key is read back both ways after the sets and checked. The
+bench returns a non-zero exit code on a mismatch, so it can be used
+as a regression check in scripts.
+
+Usage:
+    kv_bench [ops]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "system.h"
+#include "threading.h"
+#include "memory.h"
+#include "flash25.h"
+#include "flash_fs.h"
+#include "ffs_block.h"
+#include "fs.h"
+#include "hash.h"
+#include "kvdb.h"
+#include "keyvalue.h"
+
+#define DEFAULT_OPS     1000
+
+#define MAX_KEYS        500
+
+static const uint16_t key_counts[] = { 10, 100, 500 };
+#define N_KEY_COUNTS    ( sizeof(key_counts) / sizeof(key_counts[0]) )
+
+// same layout as keyvalue.c
+typedef struct{
+    catbus_hash_t32 hash;
+    sapphire_type_t8 type;
+    uint8_t array_len;
+    uint8_t reserved[4];
+} bench_block_header_t;
+#define BLOCK_DATA_LEN  SAPPHIRE_TYPE_MAX_LEN
+
+static catbus_hash_t32 hashes[MAX_KEYS];
+static int32_t values[MAX_KEYS];
+
+static kv_meta_t meta = {
+    SAPPHIRE_TYPE_INT32, 0, KV_FLAGS_PERSIST, 0, 0, ""
+};
+
+
+static uint64_t get_ns( void ){
+
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// there is no scheduler running, so do what it and the flash garbage
+// collector thread would do between operations, outside of the timing.
+static void collect_garbage( void ){
+
+    while( mem2_u16_get_dirty() >= MEM_DEFRAG_THRESHOLD ){
+
+        mem2_v_collect_garbage();
+    }
+
+    while( ffs_block_u16_dirty_blocks() > 0 ){
+
+        ffs_block_i8_erase( ffs_block_fb_get_dirty() );
+    }
+}
+
+// find a key by scanning the whole file
+static int8_t scan_get( catbus_hash_t32 hash, int32_t *data ){
+
+    file_t f = fs_f_open_P( PSTR("kv_data"), FS_MODE_READ_ONLY );
+
+    if( f < 0 ){
+
+        return -1;
+    }
+
+    fs_v_seek( f, sizeof(kv_persist_file_header_t) );
+
+    int8_t status = -1;
+    bench_block_header_t hdr;
+
+    while( fs_i16_read( f, &hdr, sizeof(hdr) ) == sizeof(hdr) ){
+
+        if( hdr.hash == hash ){
+
+            if( fs_i16_read( f, data, sizeof(int32_t) ) == sizeof(int32_t) ){
+
+                status = 0;
+            }
+
+            break;
+        }
+
+        fs_v_seek( f, fs_i32_tell( f ) + BLOCK_DATA_LEN );
+    }
+
+    fs_f_close( f );
+
+    return status;
+}
+
+static void add_keys( uint16_t start, uint16_t count ){
+
+    for( uint16_t i = start; i < count; i++ ){
+
+        char name[CATBUS_STRING_LEN];
+        snprintf( name, sizeof(name), "bench_key_%u", i );
+
+        hashes[i] = hash_u32_string( name );
+        values[i] = i;
+
+        kv_i8_set_by_meta( &meta, hashes[i], &values[i], sizeof(values[i]) );
+
+        collect_garbage();
+    }
+
+    kv_v_persist_flush();
+    collect_garbage();
+}
+
+static double run_sets( uint16_t count, uint32_t ops ){
+
+    uint64_t elapsed = 0;
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        uint16_t key = rand() % count;
+        values[key] = rand();
+
+        uint64_t start = get_ns();
+
+        kv_i8_set_by_meta( &meta, hashes[key], &values[key], sizeof(values[key]) );
+
+        elapsed += get_ns() - start;
+
+        collect_garbage();
+    }
+
+    uint64_t start = get_ns();
+    kv_v_persist_flush();
+    elapsed += get_ns() - start;
+
+    collect_garbage();
+
+    return (double)elapsed / ops;
+}
+
+static double run_gets( uint16_t count, uint32_t ops, bool scan ){
+
+    uint64_t elapsed = 0;
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        uint16_t key = rand() % count;
+        int32_t data = 0;
+
+        uint64_t start = get_ns();
+
+        if( scan ){
+
+            scan_get( hashes[key], &data );
+        }
+        else{
+
+            kv_i8_get_by_meta( &meta, hashes[key], &data, sizeof(data) );
+        }
+
+        elapsed += get_ns() - start;
+
+        collect_garbage();
+    }
+
+    return (double)elapsed / ops;
+}
+
+static uint32_t check_keys( uint16_t count ){
+
+    uint32_t errors = 0;
+
+    for( uint16_t i = 0; i < count; i++ ){
+
+        int32_t data = 0;
+        kv_i8_get_by_meta( &meta, hashes[i], &data, sizeof(data) );
+
+        if( data != values[i] ){
+
+            errors++;
+        }
+
+        data = 0;
+
+        if( ( scan_get( hashes[i], &data ) < 0 ) || ( data != values[i] ) ){
+
+            errors++;
+        }
+
+        collect_garbage();
+    }
+
+    return errors;
+}
+
+int main( int argc, char *argv[] ){
+
+    uint32_t ops = DEFAULT_OPS;
+
+    if( argc > 1 ){
+
+        ops = strtoul( argv[1], 0, 0 );
+
+        if( ops == 0 ){
+
+            ops = 1;
+        }
+    }
+
+    srand( 0 );
+
+    mem2_v_init();
+    thread_v_init();
+    flash25_v_init();
+    ffs_v_format();
+    fs_v_init();
+    kvdb_v_init();
+    kv_v_init();
+
+    printf( "Ops:     %u\n\n", ops );
+    printf( "keys     set ns/op   get ns/op  scan ns/op\n" );
+
+    uint16_t keys = 0;
+
+    for( uint8_t i = 0; i < N_KEY_COUNTS; i++ ){
+
+        add_keys( keys, key_counts[i] );
+        keys = key_counts[i];
+
+        double set = run_sets( keys, ops );
+
+        uint32_t errors = check_keys( keys );
+
+        if( errors > 0 ){
+
+            printf( "FAIL: %u mismatched values with %u keys\n", errors, keys );
+            return 1;
+        }
+
+        double get = run_gets( keys, ops, FALSE );
+        double scan = run_gets( keys, ops, TRUE );
+
+        printf( "%4u  %12.1f %11.1f %11.1f\n", keys, set, get, scan );
+    }
+
+    return 0;
+}
@@ -21,8 +21,10 @@
 // </license>
 
 #include <inttypes.h>
+#include <string.h>
+#include <math.h>
 
-#ifdef ESP8266
+#if defined(ESP8266) || defined(__SIM__)
 
 #include "bool.h"
 #include "trig.h"
@@ -47,6 +49,46 @@ static uint16_t pix0_16bit_red;
 static uint16_t pix0_16bit_green;
 static uint16_t pix0_16bit_blue;
 
+static uint16_t global_hs_fade = 1000;
+static uint16_t global_v_fade = 1000;
+
+// per pixel fader state.
+// the default layout keeps each field in its own array.
+// GFX_PACKED_FADERS packs all of a pixel's fader state into one
+// struct, so a fader update touches a single 22 byte block
+// instead of eleven arrays.
+#ifdef GFX_PACKED_FADERS
+
+typedef struct{
+    uint16_t hue;
+    uint16_t target_hue;
+    int16_t hue_step;
+    uint16_t sat;
+    uint16_t target_sat;
+    int16_t sat_step;
+    uint16_t hs_fade;
+    uint16_t val;
+    uint16_t target_val;
+    int16_t val_step;
+    uint16_t v_fade;
+} gfx_fader_t;
+
+static gfx_fader_t faders[MAX_PIXELS];
+
+#define HUE( i )            faders[i].hue
+#define SAT( i )            faders[i].sat
+#define VAL( i )            faders[i].val
+#define TARGET_HUE( i )     faders[i].target_hue
+#define TARGET_SAT( i )     faders[i].target_sat
+#define TARGET_VAL( i )     faders[i].target_val
+#define HS_FADE( i )        faders[i].hs_fade
+#define V_FADE( i )         faders[i].v_fade
+#define HUE_STEP( i )       faders[i].hue_step
+#define SAT_STEP( i )       faders[i].sat_step
+#define VAL_STEP( i )       faders[i].val_step
+
+#else
+
 static uint16_t hue[MAX_PIXELS];
 static uint16_t sat[MAX_PIXELS];
 static uint16_t val[MAX_PIXELS];
@@ -55,8 +97,6 @@ static uint16_t target_hue[MAX_PIXELS];
 static uint16_t target_sat[MAX_PIXELS];
 static uint16_t target_val[MAX_PIXELS];
 
-static uint16_t global_hs_fade = 1000;
-static uint16_t global_v_fade = 1000;
 static uint16_t hs_fade[MAX_PIXELS];
 static uint16_t v_fade[MAX_PIXELS];
 
@@ -64,6 +104,37 @@ static int16_t hue_step[MAX_PIXELS];
 static int16_t sat_step[MAX_PIXELS];
 static int16_t val_step[MAX_PIXELS];
 
+#define HUE( i )            hue[i]
+#define SAT( i )            sat[i]
+#define VAL( i )            val[i]
+#define TARGET_HUE( i )     target_hue[i]
+#define TARGET_SAT( i )     target_sat[i]
+#define TARGET_VAL( i )     target_val[i]
+#define HS_FADE( i )        hs_fade[i]
+#define V_FADE( i )         v_fade[i]
+#define HUE_STEP( i )       hue_step[i]
+#define SAT_STEP( i )       sat_step[i]
+#define VAL_STEP( i )       val_step[i]
+
+#endif
+
+// pixel bitmaps, 1 bit per pixel.
+// fader_active marks pixels that may still be fading.
+// hsv_dirty marks pixels whose faded HSV has changed since the last sync.
+// rgb_dirty marks pixels whose RGB output has changed since the
+// comm interface last sent them.
+#define PIX_BITMAP_BYTES ( ( MAX_PIXELS + 7 ) / 8 )
+static uint8_t fader_active[PIX_BITMAP_BYTES];
+static uint8_t hsv_dirty[PIX_BITMAP_BYTES];
+static uint8_t rgb_dirty[PIX_BITMAP_BYTES];
+
+static uint16_t active_faders;
+
+// resend the whole RGB array once a second, in case the
+// receiver missed a chunk or was reset.
+#define RGB_REFRESH_TICKS ( 1000 / FADER_RATE )
+static uint8_t rgb_refresh_ticks;
+
 static uint16_t pix_master_dimmer = 0;
 static uint16_t pix_sub_dimmer = 0;
 static uint16_t target_dimmer = 0;
@@ -101,11 +172,32 @@ static uint8_t smootherstep_lookup[DIMMER_LOOKUP_SIZE] = {
     #include "smootherstep.csv"
 };
 
+#ifdef GFX_HUE_SECTOR_LUT
+// hue sector for each 256 step bucket of hue.
+// buckets that straddle a sector boundary are marked split.
+#define HUE_SECTOR_SPLIT 0xff
+static uint8_t hue_sector_lookup[256];
+#endif
+
 #define NOISE_TABLE_SIZE 256
 static uint8_t noise_table[NOISE_TABLE_SIZE];
 
-static int32_t kv_test_key;
 
+static void mark_fader_active( uint16_t index ){
+
+    fader_active[index / 8] |= ( 1 << ( index % 8 ) );
+}
+
+static void mark_hsv_dirty( uint16_t index ){
+
+    hsv_dirty[index / 8] |= ( 1 << ( index % 8 ) );
+}
+
+static void mark_all_dirty( void ){
+
+    memset( hsv_dirty, 0xff, sizeof(hsv_dirty) );
+    memset( rgb_dirty, 0xff, sizeof(rgb_dirty) );
+}
 
 static void compute_dimmer_lookup( void ){
 
@@ -119,6 +211,40 @@ static void compute_dimmer_lookup( void ){
     }
 }
 
+static uint8_t compare_hue_sector( uint16_t h ){
+
+    if( h <= 21845 ){
+
+        return 0;
+    }
+    else if( h <= 43690 ){
+
+        return 1;
+    }
+
+    return 2;
+}
+
+#ifdef GFX_HUE_SECTOR_LUT
+static void compute_hue_sector_lookup( void ){
+
+    for( uint16_t i = 0; i < 256; i++ ){
+
+        uint8_t low = compare_hue_sector( i << 8 );
+        uint8_t high = compare_hue_sector( ( i << 8 ) | 0xff );
+
+        if( low == high ){
+
+            hue_sector_lookup[i] = low;
+        }
+        else{
+
+            hue_sector_lookup[i] = HUE_SECTOR_SPLIT;
+        }
+    }
+}
+#endif
+
 static void setup_master_array( void ){
 
     // check if pixel arrays are configured
@@ -280,6 +406,10 @@ void gfx_v_set_params( gfx_params_t *params ){
 
     update_master_fader();
 
+    // pixel count, mode or dimmer curve may have changed,
+    // so all of the RGB output needs to be regenerated.
+    mark_all_dirty();
+
     sync_db();
 
     virtual_array_sub_position      = virtual_array_start / pix_count;
@@ -362,6 +492,8 @@ int32_t gfx_i32_get_obj_attr( uint8_t obj, uint8_t attr, uint8_t addr ){
 void gfx_v_set_pix_count( uint16_t setting ){
 
     pix_count = setting;
+
+    mark_all_dirty();
 }
 
 uint16_t gfx_u16_get_pix_count( void ){
@@ -461,10 +593,11 @@ void _gfx_v_set_hue_1d( uint16_t h, uint16_t index ){
         return;
     }
 
-    target_hue[index] = h;
+    TARGET_HUE( index ) = h;
+    mark_fader_active( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    hue_step[index] = 0;
+    HUE_STEP( index ) = 0;
 }
 
 void _gfx_v_set_sat_1d( uint16_t s, uint16_t index ){
@@ -475,10 +608,11 @@ void _gfx_v_set_sat_1d( uint16_t s, uint16_t index ){
         return;
     }
 
-    target_sat[index] = s;
+    TARGET_SAT( index ) = s;
+    mark_fader_active( index );
     
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    sat_step[index] = 0;
+    SAT_STEP( index ) = 0;
 }
 
 void _gfx_v_set_val_1d( uint16_t v, uint16_t index ){
@@ -489,10 +623,11 @@ void _gfx_v_set_val_1d( uint16_t v, uint16_t index ){
         return;
     }
 
-    target_val[index] = v;
+    TARGET_VAL( index ) = v;
+    mark_fader_active( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    val_step[index] = 0;
+    VAL_STEP( index ) = 0;
 }
 
 void _gfx_v_set_hs_fade_1d( uint16_t a, uint16_t index ){
@@ -503,11 +638,12 @@ void _gfx_v_set_hs_fade_1d( uint16_t a, uint16_t index ){
         return;
     }
 
-    hs_fade[index] = a;
+    HS_FADE( index ) = a;
+    mark_fader_active( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    hue_step[index] = 0;
-    sat_step[index] = 0;
+    HUE_STEP( index ) = 0;
+    SAT_STEP( index ) = 0;
 }
 
 void _gfx_v_set_v_fade_1d( uint16_t a, uint16_t index ){
@@ -518,40 +654,35 @@ void _gfx_v_set_v_fade_1d( uint16_t a, uint16_t index ){
         return;
     }
 
-    v_fade[index] = a;
+    V_FADE( index ) = a;
+    mark_fader_active( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    val_step[index] = 0;
+    VAL_STEP( index ) = 0;
 }
 
 
 
-static uint16_t* _gfx_u16p_get_array_ptr( uint8_t attr ){
-
-    uint16_t *ptr = target_val;
+static uint16_t _gfx_u16_get_attr( uint8_t attr, uint16_t index ){
 
     if( attr == PIX_ATTR_HUE ){
 
-        ptr = target_hue;
+        return TARGET_HUE( index );
     }
     else if( attr == PIX_ATTR_SAT ){
 
-        ptr = target_sat;
-    }
-    else if( attr == PIX_ATTR_VAL ){
-
-        ptr = target_val;
+        return TARGET_SAT( index );
     }
     else if( attr == PIX_ATTR_HS_FADE ){
 
-        ptr = hs_fade;
+        return HS_FADE( index );
     }
     else if( attr == PIX_ATTR_V_FADE ){
 
-        ptr = v_fade;
+        return V_FADE( index );
     }
 
-    return ptr;
+    return TARGET_VAL( index );
 }
 
 void gfx_v_array_move( uint8_t obj, uint8_t attr, int32_t src ){
@@ -615,15 +746,13 @@ void gfx_v_array_add( uint8_t obj, uint8_t attr, int32_t src ){
         return;
     }
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
     for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
 
         uint16_t index = i + pix_arrays[obj].index;
 
         index %= pix_count;
 
-        int32_t a = *( ptr + index );
+        int32_t a = _gfx_u16_get_attr( attr, index );
 
         a += src;
 
@@ -674,15 +803,13 @@ void gfx_v_array_sub( uint8_t obj, uint8_t attr, int32_t src ){
         return;
     }
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
     for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
 
         uint16_t index = i + pix_arrays[obj].index;
 
         index %= pix_count;
 
-        int32_t a = *( ptr + index );
+        int32_t a = _gfx_u16_get_attr( attr, index );
 
         a -= src;
 
@@ -733,15 +860,13 @@ void gfx_v_array_mul( uint8_t obj, uint8_t attr, int32_t src ){
         return;
     }
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
     for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
 
         uint16_t index = i + pix_arrays[obj].index;
 
         index %= pix_count;
 
-        int32_t a = *( ptr + index );
+        int32_t a = _gfx_u16_get_attr( attr, index );
 
         a *= src;
 
@@ -792,15 +917,13 @@ void gfx_v_array_div( uint8_t obj, uint8_t attr, int32_t src ){
         return;
     }
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
     for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
 
         uint16_t index = i + pix_arrays[obj].index;
 
         index %= pix_count;
 
-        int32_t a = *( ptr + index );
+        int32_t a = _gfx_u16_get_attr( attr, index );
 
         a /= src;
 
@@ -851,15 +974,13 @@ void gfx_v_array_mod( uint8_t obj, uint8_t attr, int32_t src ){
         return;
     }
 
-    uint16_t *ptr = _gfx_u16p_get_array_ptr( attr );
-    
     for( uint16_t i = 0; i < pix_arrays[obj].count; i++ ){
 
         uint16_t index = i + pix_arrays[obj].index;
 
         index %= pix_count;
 
-        int32_t a = *( ptr + index );
+        int32_t a = _gfx_u16_get_attr( attr, index );
 
         a %= src;
 
@@ -903,6 +1024,7 @@ void gfx_v_array_mod( uint8_t obj, uint8_t attr, int32_t src ){
 }
 
 
+#ifndef GFX_PACKED_FADERS
 uint16_t *gfx_u16p_get_hue( void ){
 
     return target_hue;
@@ -917,6 +1039,7 @@ uint16_t *gfx_u16p_get_val( void ){
 
     return target_val;
 }
+#endif
 
 uint8_t *gfx_u8p_get_red( void ){
 
@@ -1089,7 +1212,7 @@ uint16_t gfx_u16_get_hue( uint16_t x, uint16_t y, uint8_t obj ){
     
     index %= MAX_PIXELS;
 
-    return target_hue[index];
+    return TARGET_HUE( index );
 }
 
 void gfx_v_set_sat( uint16_t s, uint16_t x, uint16_t y, uint8_t obj ){
@@ -1109,7 +1232,7 @@ uint16_t gfx_u16_get_sat( uint16_t x, uint16_t y, uint8_t obj ){
     
     index %= MAX_PIXELS;
 
-    return target_sat[index];
+    return TARGET_SAT( index );
 }
 
 void gfx_v_set_val( uint16_t v, uint16_t x, uint16_t y, uint8_t obj ){
@@ -1129,7 +1252,7 @@ uint16_t gfx_u16_get_val( uint16_t x, uint16_t y, uint8_t obj ){
     
     index %= MAX_PIXELS;
 
-    return target_val[index];
+    return TARGET_VAL( index );
 }
 
 void gfx_v_set_hs_fade( uint16_t a, uint16_t x, uint16_t y, uint8_t obj ){
@@ -1140,11 +1263,12 @@ void gfx_v_set_hs_fade( uint16_t a, uint16_t x, uint16_t y, uint8_t obj ){
         return;
     }
 
-    hs_fade[index] = a;
+    HS_FADE( index ) = a;
+    mark_fader_active( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    hue_step[index] = 0;
-    sat_step[index] = 0;
+    HUE_STEP( index ) = 0;
+    SAT_STEP( index ) = 0;
 }
 
 uint16_t gfx_u16_get_hs_fade( uint16_t x, uint16_t y, uint8_t obj ){
@@ -1153,7 +1277,7 @@ uint16_t gfx_u16_get_hs_fade( uint16_t x, uint16_t y, uint8_t obj ){
     
     index %= MAX_PIXELS;
 
-    return hs_fade[index];
+    return HS_FADE( index );
 }
 
 void gfx_v_set_v_fade( uint16_t a, uint16_t x, uint16_t y, uint8_t obj ){
@@ -1164,10 +1288,11 @@ void gfx_v_set_v_fade( uint16_t a, uint16_t x, uint16_t y, uint8_t obj ){
         return;
     }
 
-    v_fade[index] = a;
+    V_FADE( index ) = a;
+    mark_fader_active( index );
 
     // reset fader, this will trigger the fader process to recalculate the fader steps.
-    val_step[index] = 0;
+    VAL_STEP( index ) = 0;
 }
 
 uint16_t gfx_u16_get_v_fade( uint16_t x, uint16_t y, uint8_t obj ){
@@ -1176,7 +1301,7 @@ uint16_t gfx_u16_get_v_fade( uint16_t x, uint16_t y, uint8_t obj ){
     
     index %= MAX_PIXELS;
         
-    return v_fade[index];
+    return V_FADE( index );
 }
 
 
@@ -1190,9 +1315,9 @@ uint16_t gfx_u16_get_is_fading( uint16_t x, uint16_t y, uint8_t obj ){
 
             index %= pix_count;
 
-            if( ( target_hue[i] != hue[i] ) ||
-                ( target_sat[i] != sat[i] ) ||
-                ( target_val[i] != val[i] ) ){
+            if( ( TARGET_HUE( i ) != HUE( i ) ) ||
+                ( TARGET_SAT( i ) != SAT( i ) ) ||
+                ( TARGET_VAL( i ) != VAL( i ) ) ){
 
                 return 1;
             }
@@ -1205,9 +1330,9 @@ uint16_t gfx_u16_get_is_fading( uint16_t x, uint16_t y, uint8_t obj ){
         uint16_t i = calc_index( obj, x, y );
 
         if( i < MAX_PIXELS ){        
-            if( ( target_hue[i] == hue[i] ) &&
-                ( target_sat[i] == sat[i] ) &&
-                ( target_val[i] == val[i] ) ){
+            if( ( TARGET_HUE( i ) == HUE( i ) ) &&
+                ( TARGET_SAT( i ) == SAT( i ) ) &&
+                ( TARGET_VAL( i ) == VAL( i ) ) ){
 
                 return 0;
             }
@@ -1232,22 +1357,28 @@ void gfx_v_reset( void ){
     // we do this on the entire array, regardless of pix_count.
     for( uint16_t i = 0; i < MAX_PIXELS; i++ ){
 
-        hue[i] = 0;
-        sat[i] = 65535;
-        val[i] = 0;
+        HUE( i ) = 0;
+        SAT( i ) = 65535;
+        VAL( i ) = 0;
 
-        target_hue[i] = 0;
-        target_sat[i] = 65535;
-        target_val[i] = 0;
+        TARGET_HUE( i ) = 0;
+        TARGET_SAT( i ) = 65535;
+        TARGET_VAL( i ) = 0;
 
-        hue_step[i] = 0;
-        sat_step[i] = 0;
-        val_step[i] = 0;
+        HUE_STEP( i ) = 0;
+        SAT_STEP( i ) = 0;
+        VAL_STEP( i ) = 0;
 
-        hs_fade[i] = global_hs_fade;
-        v_fade[i]  = global_v_fade;
+        HS_FADE( i ) = global_hs_fade;
+        V_FADE( i )  = global_v_fade;
     }
 
+    // everything is at its target, nothing to fade
+    memset( fader_active, 0, sizeof(fader_active) );
+    active_faders = 0;
+
+    mark_all_dirty();
+
     // reset pixel objects
     pix_array_count = 0;
 
@@ -1295,212 +1426,416 @@ uint16_t gfx_u16_get_dimmed_val( uint16_t _val ){
     return linterp_table_lookup( x, dimmer_lookup );
 }
 
-void gfx_v_process_faders( void ){
+static uint8_t hue_sector( uint16_t h ){
 
-    // update master dimmer
-    if( dimmer_step != 0 ){
+    #ifdef GFX_HUE_SECTOR_LUT
+    uint8_t sector = hue_sector_lookup[h >> 8];
 
-        int32_t diff = (int32_t)target_dimmer - (int32_t)current_dimmer;
+    // only the two buckets holding a sector boundary need compares
+    if( sector != HUE_SECTOR_SPLIT ){
 
-        if( abs32( diff ) < abs16( dimmer_step ) ){
+        return sector;
+    }
+    #endif
 
-            current_dimmer = target_dimmer;
-            dimmer_step = 0;
+    return compare_hue_sector( h );
+}
+
+// converts a block of pixels with the master dimmer applied,
+// same results as gfx_u16_get_dimmed_val and gfx_v_hsv_to_rgb
+// followed by the 8 bit and dither packing.
+void gfx_v_hsv_to_rgb_block(
+    const uint16_t *h,
+    const uint16_t *s,
+    const uint16_t *v,
+    uint16_t n,
+    uint8_t *r,
+    uint8_t *g,
+    uint8_t *b,
+    uint8_t *dither ){
+
+    for( uint16_t i = 0; i < n; i++ ){
+
+        uint16_t temp_r = 0;
+        uint16_t temp_g = 0;
+        uint16_t temp_b = 0;
+        uint16_t temp_s = 65535 - s[i];
+
+        uint8_t sector = hue_sector( h[i] );
+
+        if( sector == 0 ){
+
+            temp_r = ( 21845 - h[i] ) * 3;
+            temp_g = 65535 - temp_r;
+        }
+        else if( sector == 1 ){
+
+            temp_g = ( 43690 - h[i] ) * 3;
+            temp_b = 65535 - temp_g;
         }
         else{
 
-            current_dimmer += dimmer_step;
+            temp_b = ( 65535 - h[i] ) * 3;
+            temp_r = 65535 - temp_b;
+        }
+
+        // floor saturation
+        if( temp_r < temp_s ){
+
+            temp_r = temp_s;
+        }
+
+        if( temp_g < temp_s ){
+
+            temp_g = temp_s;
+        }
+
+        if( temp_b < temp_s ){
+
+            temp_b = temp_s;
         }
+
+        // apply master dimmer and brightness
+        uint32_t dimmed_val = gfx_u16_get_dimmed_val( v[i] );
+
+        uint16_t r16 = ( temp_r * dimmed_val ) >> 16;
+        uint16_t g16 = ( temp_g * dimmed_val ) >> 16;
+        uint16_t b16 = ( temp_b * dimmed_val ) >> 16;
+
+        // top 8 bits are the output, the next 2 bits are the dither
+        r[i] = r16 >> 8;
+        g[i] = g16 >> 8;
+        b[i] = b16 >> 8;
+
+        dither[i] = ( ( r16 >> 2 ) & 0x30 ) |
+                    ( ( g16 >> 4 ) & 0x0c ) |
+                    ( ( b16 >> 6 ) & 0x03 );
     }
+}
 
-    for( uint16_t i = 0; i < pix_count; i++ ){
+// RGBW version of gfx_v_hsv_to_rgb_block, same results as
+// gfx_u16_get_dimmed_val and gfx_v_hsv_to_rgbw scaled to 8 bits.
+void gfx_v_hsv_to_rgbw_block(
+    const uint16_t *h,
+    const uint16_t *s,
+    const uint16_t *v,
+    uint16_t n,
+    uint8_t *r,
+    uint8_t *g,
+    uint8_t *b,
+    uint8_t *w ){
 
-        // check if fader step needs to be updated
-        if( ( hue_step[i] == 0 ) && ( target_hue[i] != hue[i] ) ){
+    for( uint16_t i = 0; i < n; i++ ){
 
-            int32_t diff, step;
+        uint32_t temp_r = 0;
+        uint32_t temp_g = 0;
+        uint32_t temp_b = 0;
+        uint32_t temp_s = s[i];
 
-            uint16_t hs_fade_steps = hs_fade[i] / FADER_RATE;
+        uint8_t sector = hue_sector( h[i] );
 
-            if( hs_fade_steps <= 1 ){
+        // apply saturation to RGB
+        if( sector == 0 ){
 
-                hs_fade_steps = 2;
-            }
+            temp_r = (uint16_t)( ( 21845 - h[i] ) * 3 );
+            temp_g = 65535 - temp_r;
 
-            diff = (int32_t)target_hue[i] - (int32_t)hue[i];
+            temp_r = ( temp_r * temp_s ) >> 16;
+            temp_g = ( temp_g * temp_s ) >> 16;
+        }
+        else if( sector == 1 ){
 
-            // adjust to shortest distance and allow the fade to wrap around
-            // the hue circle
-            if( abs32(diff) > 32768 ){
+            temp_g = (uint16_t)( ( 43690 - h[i] ) * 3 );
+            temp_b = 65535 - temp_g;
 
-                if( diff > 0 ){
+            temp_g = ( temp_g * temp_s ) >> 16;
+            temp_b = ( temp_b * temp_s ) >> 16;
+        }
+        else{
 
-                    diff -= 65536;
-                }
-                else{
+            temp_b = (uint16_t)( ( 65535 - h[i] ) * 3 );
+            temp_r = 65535 - temp_b;
 
-                    diff += 65536;
-                }
-            }
+            temp_r = ( temp_r * temp_s ) >> 16;
+            temp_b = ( temp_b * temp_s ) >> 16;
+        }
+
+        // apply master dimmer and brightness
+        uint32_t dimmed_val = gfx_u16_get_dimmed_val( v[i] );
 
-            step = diff / hs_fade_steps;
+        r[i] = ( ( temp_r * dimmed_val ) >> 16 ) >> 8;
+        g[i] = ( ( temp_g * dimmed_val ) >> 16 ) >> 8;
+        b[i] = ( ( temp_b * dimmed_val ) >> 16 ) >> 8;
+        w[i] = ( ( ( 65535 - temp_s ) * dimmed_val ) >> 16 ) >> 8;
+    }
+}
 
-            if( step > 32768 ){
+// returns TRUE if the pixel's faded HSV changed
+static bool process_pixel_fader( uint16_t i ){
 
-                step = 32768;
-            }
-            else if( step < -32767 ){
+    bool changed = FALSE;
 
-                step = -32767;
-            }
-            else if( step == 0 ){
+    // check if fader step needs to be updated
+    if( ( HUE_STEP( i ) == 0 ) && ( TARGET_HUE( i ) != HUE( i ) ) ){
 
-                if( diff >= 0 ){
+        int32_t diff, step;
 
-                    step = 1;
-                }
-                else{
+        uint16_t hs_fade_steps = HS_FADE( i ) / FADER_RATE;
 
-                    step = -1;
-                }
+        if( hs_fade_steps <= 1 ){
+
+            hs_fade_steps = 2;
+        }
+
+        diff = (int32_t)TARGET_HUE( i ) - (int32_t)HUE( i );
+
+        // adjust to shortest distance and allow the fade to wrap around
+        // the hue circle
+        if( abs32(diff) > 32768 ){
+
+            if( diff > 0 ){
+
+                diff -= 65536;
             }
+            else{
 
-            hue_step[i] = step;
+                diff += 65536;
+            }
         }
 
-        if( hue_step[i] != 0 ){
+        step = diff / hs_fade_steps;
 
-            uint16_t h = hue[i];
-            uint16_t th = target_hue[i];
-            int16_t step_h = hue_step[i];
+        if( step > 32768 ){
 
-            int32_t diff = (int32_t)th - (int32_t)h;
+            step = 32768;
+        }
+        else if( step < -32767 ){
 
-            if( abs32( diff ) < abs16( step_h ) ){
+            step = -32767;
+        }
+        else if( step == 0 ){
 
-                hue[i] = th;
-                hue_step[i] = 0;
+            if( diff >= 0 ){
+
+                step = 1;
             }
             else{
 
-                hue[i] += step_h;
+                step = -1;
             }
         }
 
-        // check if fader step needs to be updated
-        if( ( sat_step[i] == 0 ) && ( target_sat[i] != sat[i] ) ){
+        HUE_STEP( i ) = step;
+    }
 
-            int32_t diff, step;
+    if( HUE_STEP( i ) != 0 ){
 
-            uint16_t hs_fade_steps = hs_fade[i] / FADER_RATE;
+        uint16_t h = HUE( i );
+        uint16_t th = TARGET_HUE( i );
+        int16_t step_h = HUE_STEP( i );
 
-            if( hs_fade_steps <= 1 ){
+        int32_t diff = (int32_t)th - (int32_t)h;
 
-                hs_fade_steps = 2;
-            }
+        if( abs32( diff ) < abs16( step_h ) ){
 
-            diff = (int32_t)target_sat[i] - (int32_t)sat[i];
-            step = diff / hs_fade_steps;
+            HUE( i ) = th;
+            HUE_STEP( i ) = 0;
+        }
+        else{
 
-            if( step > 32768 ){
+            HUE( i ) += step_h;
+        }
 
-                step = 32768;
-            }
-            else if( step < -32767 ){
+        changed = TRUE;
+    }
 
-                step = -32767;
-            }
-            else if( step == 0 ){
+    // check if fader step needs to be updated
+    if( ( SAT_STEP( i ) == 0 ) && ( TARGET_SAT( i ) != SAT( i ) ) ){
 
-                if( diff >= 0 ){
+        int32_t diff, step;
 
-                    step = 1;
-                }
-                else{
+        uint16_t hs_fade_steps = HS_FADE( i ) / FADER_RATE;
 
-                    step = -1;
-                }
-            }
+        if( hs_fade_steps <= 1 ){
 
-            sat_step[i] = step;
+            hs_fade_steps = 2;
         }
 
-        if( sat_step[i] != 0 ){
+        diff = (int32_t)TARGET_SAT( i ) - (int32_t)SAT( i );
+        step = diff / hs_fade_steps;
+
+        if( step > 32768 ){
 
-            uint16_t s = sat[i];
-            uint16_t ts = target_sat[i];
-            int16_t step_s = sat_step[i];
+            step = 32768;
+        }
+        else if( step < -32767 ){
 
-            int32_t diff = (int32_t)ts - (int32_t)s;
+            step = -32767;
+        }
+        else if( step == 0 ){
 
-            if( abs32( diff ) < abs16( step_s ) ){
+            if( diff >= 0 ){
 
-                sat[i] = ts;
-                sat_step[i] = 0;
+                step = 1;
             }
             else{
 
-                sat[i] += step_s;
+                step = -1;
             }
         }
 
-        // check if fader step needs to be updated
-        if( ( val_step[i] == 0 ) && ( target_val[i] != val[i] ) ){
+        SAT_STEP( i ) = step;
+    }
 
-            int32_t diff, step;
+    if( SAT_STEP( i ) != 0 ){
 
-            uint16_t v_fade_steps = v_fade[i] / FADER_RATE;
+        uint16_t s = SAT( i );
+        uint16_t ts = TARGET_SAT( i );
+        int16_t step_s = SAT_STEP( i );
 
-            if( v_fade_steps <= 1 ){
+        int32_t diff = (int32_t)ts - (int32_t)s;
 
-                v_fade_steps = 2;
-            }
+        if( abs32( diff ) < abs16( step_s ) ){
+
+            SAT( i ) = ts;
+            SAT_STEP( i ) = 0;
+        }
+        else{
+
+            SAT( i ) += step_s;
+        }
+
+        changed = TRUE;
+    }
+
+    // check if fader step needs to be updated
+    if( ( VAL_STEP( i ) == 0 ) && ( TARGET_VAL( i ) != VAL( i ) ) ){
+
+        int32_t diff, step;
+
+        uint16_t v_fade_steps = V_FADE( i ) / FADER_RATE;
+
+        if( v_fade_steps <= 1 ){
+
+            v_fade_steps = 2;
+        }
+
+        diff = (int32_t)TARGET_VAL( i ) - (int32_t)VAL( i );
+        step = diff / v_fade_steps;
 
-            diff = (int32_t)target_val[i] - (int32_t)val[i];
-            step = diff / v_fade_steps;
+        if( step > 32768 ){
 
-            if( step > 32768 ){
+            step = 32768;
+        }
+        else if( step < -32767 ){
+
+            step = -32767;
+        }
+        else if( step == 0 ){
+
+            if( diff >= 0 ){
 
-                step = 32768;
+                step = 1;
             }
-            else if( step < -32767 ){
+            else{
 
-                step = -32767;
+                step = -1;
             }
-            else if( step == 0 ){
+        }
 
-                if( diff >= 0 ){
+        VAL_STEP( i ) = step;   
+    }
 
-                    step = 1;
-                }
-                else{
+    if( VAL_STEP( i ) != 0 ){
 
-                    step = -1;
-                }
-            }
+        uint16_t v = VAL( i );
+        uint16_t tv = TARGET_VAL( i );
+        int16_t step_v = VAL_STEP( i );
+
+        int32_t diff = (int32_t)tv - (int32_t)v;
+
+        if( abs32( diff ) < abs16( step_v ) ){
 
-            val_step[i] = step;   
+            VAL( i ) = tv;
+            VAL_STEP( i ) = 0;
         }
+        else{
+
+            VAL( i ) += step_v;
+        }
+
+        changed = TRUE;
+    }
+
+    return changed;
+}
+
+void gfx_v_process_faders( void ){
+
+    // update master dimmer
+    if( dimmer_step != 0 ){
+
+        int32_t diff = (int32_t)target_dimmer - (int32_t)current_dimmer;
+
+        if( abs32( diff ) < abs16( dimmer_step ) ){
+
+            current_dimmer = target_dimmer;
+            dimmer_step = 0;
+        }
+        else{
+
+            current_dimmer += dimmer_step;
+        }
+
+        // master dimmer affects every pixel
+        memset( hsv_dirty, 0xff, sizeof(hsv_dirty) );
+    }
+
+    uint16_t active = 0;
 
-        if( val_step[i] != 0 ){
+    // only visit pixels that were set or are still fading
+    for( uint16_t n = 0; ( n < PIX_BITMAP_BYTES ) && ( ( n * 8 ) < pix_count ); n++ ){
 
-            uint16_t v = val[i];
-            uint16_t tv = target_val[i];
-            int16_t step_v = val_step[i];
+        uint8_t bits = fader_active[n];
 
-            int32_t diff = (int32_t)tv - (int32_t)v;
+        for( uint8_t bit = 0; bits != 0; bit++, bits >>= 1 ){
 
-            if( abs32( diff ) < abs16( step_v ) ){
+            uint16_t i = ( n * 8 ) + bit;
 
-                val[i] = tv;
-                val_step[i] = 0;
+            if( ( bits & 1 ) == 0 ){
+
+                continue;
+            }
+
+            if( i >= pix_count ){
+
+                break;
+            }
+
+            if( process_pixel_fader( i ) ){
+
+                mark_hsv_dirty( i );
+            }
+
+            // a pixel that is not at its target always has a non-zero
+            // step after processing, so zero steps means it is done.
+            if( ( HUE_STEP( i ) | SAT_STEP( i ) | VAL_STEP( i ) ) == 0 ){
+
+                fader_active[n] &= ~( 1 << bit );
             }
             else{
 
-                val[i] += step_v;
+                active++;
             }
         }
     }
+
+    active_faders = active;
+}
+
+uint16_t gfx_u16_get_active_faders( void ){
+
+    return active_faders;
 }
 
 void gfxlib_v_init( void ){
@@ -1509,17 +1844,19 @@ void gfxlib_v_init( void ){
 
     compute_dimmer_lookup();
 
+    #ifdef GFX_HUE_SECTOR_LUT
+    compute_hue_sector_lookup();
+    #endif
+
     // initialize pixel arrays to defaults
     gfx_v_reset();
 
     update_master_fader();
 }
 
-// convert all HSV to RGB
+// convert changed HSV to RGB
 void gfx_v_sync_array( void ){
 
-    uint16_t r, g, b, w;
-    uint8_t dither;
     uint16_t dimmed_val;
 
     // PWM modes will use pixel 0 and need 16 bits.
@@ -1527,79 +1864,119 @@ void gfx_v_sync_array( void ){
     // HSV converversion loop, we'll just always compute the 16 bit values
     // here, and then go on with the 8 bit arrays.
 
-    dimmed_val = gfx_u16_get_dimmed_val( val[0] );
+    dimmed_val = gfx_u16_get_dimmed_val( VAL( 0 ) );
 
     gfx_v_hsv_to_rgb(
-        hue[0],
-        sat[0],
+        HUE( 0 ),
+        SAT( 0 ),
         dimmed_val,
         &pix0_16bit_red,
         &pix0_16bit_green,
         &pix0_16bit_blue
     );
 
-    if( pix_mode == PIX_MODE_SK6812_RGBW ){
-
-        for( uint16_t i = 0; i < pix_count; i++ ){
-
-            // process master dimmer
-            dimmed_val = gfx_u16_get_dimmed_val( val[i] );
-
-            gfx_v_hsv_to_rgbw(
-                hue[i],
-                sat[i],
-                dimmed_val,
-                &r,
-                &g,
-                &b,
-                &w
-            );
-      
-            r /= 256;
-            g /= 256;
-            b /= 256;
-            w /= 256;
-        
-            array_red[i] = r;
-            array_green[i] = g;
-            array_blue[i] = b;
-            array_misc[i] = w;
+    bool rgbw = ( pix_mode == PIX_MODE_SK6812_RGBW );
+
+    uint16_t h[8], s[8], v[8];
+    uint8_t r[8], g[8], b[8], misc[8];
+    uint8_t bits[8];
+
+    // only pixels that faded since the last sync need converting.
+    // static scenes skip over the bitmap a byte at a time.
+    for( uint16_t n = 0; ( n < PIX_BITMAP_BYTES ) && ( ( n * 8 ) < pix_count ); n++ ){
+
+        uint8_t dirty = hsv_dirty[n];
+
+        if( dirty == 0 ){
+
+            continue;
+        }
+
+        hsv_dirty[n] = 0;
+
+        // gather this byte's dirty pixels so they convert in one block
+        uint8_t count = 0;
+
+        for( uint8_t bit = 0; dirty != 0; bit++, dirty >>= 1 ){
+
+            uint16_t i = ( n * 8 ) + bit;
+
+            if( ( dirty & 1 ) == 0 ){
+
+                continue;
+            }
+
+            if( i >= pix_count ){
+
+                break;
+            }
+
+            bits[count] = bit;
+            h[count] = HUE( i );
+            s[count] = SAT( i );
+            v[count] = VAL( i );
+            count++;
+        }
+
+        if( rgbw ){
+
+            gfx_v_hsv_to_rgbw_block( h, s, v, count, r, g, b, misc );
+        }
+        else{
+
+            gfx_v_hsv_to_rgb_block( h, s, v, count, r, g, b, misc );
+        }
+
+        // write back, only marking pixels whose output changed
+        for( uint8_t c = 0; c < count; c++ ){
+
+            uint16_t i = ( n * 8 ) + bits[c];
+
+            if( ( array_red[i] == r[c] ) &&
+                ( array_green[i] == g[c] ) &&
+                ( array_blue[i] == b[c] ) &&
+                ( array_misc[i] == misc[c] ) ){
+
+                continue;
+            }
+
+            array_red[i] = r[c];
+            array_green[i] = g[c];
+            array_blue[i] = b[c];
+            array_misc[i] = misc[c];
+
+            rgb_dirty[n] |= ( 1 << bits[c] );
         }
     }
-    else{
 
-        for( uint16_t i = 0; i < pix_count; i++ ){
-
-            // process master dimmer
-            dimmed_val = gfx_u16_get_dimmed_val( val[i] );
-
-            gfx_v_hsv_to_rgb(
-                hue[i],
-                sat[i],
-                dimmed_val,
-                &r,
-                &g,
-                &b
-            );
-      
-            r /= 64;
-            g /= 64;
-            b /= 64;
-
-            dither =  ( r & 0x0003 ) << 4;
-            dither |= ( g & 0x0003 ) << 2;
-            dither |= ( b & 0x0003 );
-
-            r /= 4;
-            g /= 4;
-            b /= 4;
-        
-            array_red[i] = r;
-            array_green[i] = g;
-            array_blue[i] = b;
-            array_misc[i] = dither;
+    rgb_refresh_ticks++;
+
+    if( rgb_refresh_ticks >= RGB_REFRESH_TICKS ){
+
+        rgb_refresh_ticks = 0;
+
+        memset( rgb_dirty, 0xff, sizeof(rgb_dirty) );
+    }
+}
+
+// returns TRUE if any pixel in the range has changed RGB output
+// since it was last sent, and clears the range.
+bool gfx_b_clear_rgb_dirty( uint16_t index, uint16_t count ){
+
+    bool dirty = FALSE;
+
+    for( uint16_t i = index; ( i < ( index + count ) ) && ( i < MAX_PIXELS ); i++ ){
+
+        uint8_t mask = 1 << ( i % 8 );
+
+        if( rgb_dirty[i / 8] & mask ){
+
+            rgb_dirty[i / 8] &= ~mask;
+            dirty = TRUE;
         }
     }
+
+    return dirty;
 }
 
 
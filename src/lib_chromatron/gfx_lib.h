@@ -29,7 +29,9 @@
 #include "bool.h"
 #include "catbus_common.h"
 
+#ifndef MAX_PIXELS
 #define MAX_PIXELS              320
+#endif
 
 #define FADER_RATE              20
 
@@ -168,11 +170,13 @@ uint16_t gfx_u16_get_pix0_green( void );
 uint16_t gfx_u16_get_pix0_blue( void );
 
 void gfx_v_clear( void );
+uint16_t gfx_u16_get_active_faders( void );
 void gfx_v_reset_faders( void );
 
 void gfxlib_v_init( void );
 
 void gfx_v_sync_array( void );
+bool gfx_b_clear_rgb_dirty( uint16_t index, uint16_t count );
 
 void gfx_v_hsv_to_rgb(
     uint16_t h,
@@ -191,6 +195,26 @@ void gfx_v_hsv_to_rgbw(
     uint16_t *b,
     uint16_t *w );
 
+void gfx_v_hsv_to_rgb_block(
+    const uint16_t *h,
+    const uint16_t *s,
+    const uint16_t *v,
+    uint16_t n,
+    uint8_t *r,
+    uint8_t *g,
+    uint8_t *b,
+    uint8_t *dither );
+
+void gfx_v_hsv_to_rgbw_block(
+    const uint16_t *h,
+    const uint16_t *s,
+    const uint16_t *v,
+    uint16_t n,
+    uint8_t *r,
+    uint8_t *g,
+    uint8_t *b,
+    uint8_t *w );
+
 void gfx_v_reset( void );
 void gfx_v_init_pixel_arrays( gfx_pixel_array_t *array_ptr, uint8_t count );
 
@@ -20,6 +20,10 @@
 // 
 // </license>
 
+// the graphics engine drives the wifi co-processor, there is nothing
+// to run on the simulator.
+#ifndef __SIM__
+
 #include "system.h"
 #include "util.h"
 #include "logging.h"
@@ -370,10 +374,12 @@ void gfx_v_init( void ){
     GFX_TIMER.CTRLB = 0;
 
 
-    thread_t_create( gfx_control_thread,
-                PSTR("gfx_control"),
-                0,
-                0 );
+    // the frame timing runs from this thread
+    thread_v_set_priority( thread_t_create( gfx_control_thread,
+                                            PSTR("gfx_control"),
+                                            0,
+                                            0 ),
+                           THREAD_PRIORITY_HIGH );
 }
 
 bool gfx_b_running( void ){
@@ -766,3 +772,4 @@ end:
 PT_END( pt );
 }
 
+#endif
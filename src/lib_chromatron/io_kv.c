@@ -22,6 +22,10 @@
 // </license>
  */
 
+// the IO pin names only exist on the xmega, there is nothing
+// to run on the simulator.
+#ifndef __SIM__
+
 
 #include "sapphire.h"
 #include "io_kv.h"
@@ -364,10 +368,4 @@ void iokv_v_init( void ){
 // PT_END( pt );
 // }
 
-
-
-
-
-
-
-
+#endif
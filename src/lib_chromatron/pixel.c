@@ -20,6 +20,10 @@
 // 
 // </license>
 
+// the pixel driver needs the xmega hardware, there is nothing
+// to run on the simulator.
+#ifndef __SIM__
+
 
 #include "sapphire.h"
 
@@ -743,6 +747,23 @@ uint8_t pixel_u8_get_mode( void ){
     return pix_mode;
 }
 
+// returns number of pixels that fit starting at index, 0 if none
+static uint16_t transfer_count( uint16_t index, uint16_t len ){
+
+    if( index >= MAX_PIXELS ){
+
+        log_v_debug_P( PSTR("pix transfer out of bounds") );
+        return 0;
+    }
+
+    if( len > ( MAX_PIXELS - index ) ){
+
+        len = MAX_PIXELS - index;
+    }
+
+    return len;
+}
+
 void pixel_v_load_rgb(
     uint16_t index,
     uint16_t len,
@@ -751,17 +772,10 @@ void pixel_v_load_rgb(
     uint8_t *b,
     uint8_t *d ){
 
-    uint16_t transfer_count = len;
+    uint16_t count = transfer_count( index, len );
 
-    if( ( index + transfer_count ) > MAX_PIXELS ){
-
-        transfer_count = MAX_PIXELS - index;
-    }
-
-    // bounds check
-    if( ( index + transfer_count ) > MAX_PIXELS ){
+    if( count == 0 ){
 
-        log_v_debug_P( PSTR("pix transfer out of bounds") );
         return;
     }
 
@@ -770,14 +784,131 @@ void pixel_v_load_rgb(
     // the pixel driver touching them
     ATOMIC;
 
-    memcpy( &array_r[index], r, transfer_count );
-    memcpy( &array_g[index], g, transfer_count );
-    memcpy( &array_b[index], b, transfer_count );
-    memcpy( &array_misc.dither[index], d, transfer_count );
+    memcpy( &array_r[index], r, count );
+    memcpy( &array_g[index], g, count );
+    memcpy( &array_b[index], b, count );
+
+    // no dither/white channel
+    if( d == 0 ){
+
+        memset( &array_misc.dither[index], 0, count );
+    }
+    else{
+
+        memcpy( &array_misc.dither[index], d, count );
+    }
 
     END_ATOMIC;
 }
 
+// load interleaved 16 bit RGB directly into the pixel arrays
+void pixel_v_load_rgb16( uint16_t index, uint16_t len, uint16_t *rgb ){
+
+    uint16_t count = transfer_count( index, len );
+
+    if( count == 0 ){
+
+        return;
+    }
+
+    uint8_t *r = &array_r[index];
+    uint8_t *g = &array_g[index];
+    uint8_t *b = &array_b[index];
+    uint8_t *d = &array_misc.dither[index];
+
+    ATOMIC;
+
+    // RGBW mode doesn't support dithering, and we have no white
+    if( pix_mode == PIX_MODE_SK6812_RGBW ){
+
+        while( count > 0 ){
+
+            *r++ = rgb[0] >> 8;
+            *g++ = rgb[1] >> 8;
+            *b++ = rgb[2] >> 8;
+            *d++ = 0;
+
+            rgb += 3;
+            count--;
+        }
+    }
+    else{
+
+        while( count > 0 ){
+
+            // top 8 bits are the pixel, next 2 are the dither
+            uint16_t r10 = rgb[0] >> 6;
+            uint16_t g10 = rgb[1] >> 6;
+            uint16_t b10 = rgb[2] >> 6;
+
+            *r++ = r10 >> 2;
+            *g++ = g10 >> 2;
+            *b++ = b10 >> 2;
+            *d++ = ( ( r10 & 0x0003 ) << 4 ) |
+                   ( ( g10 & 0x0003 ) << 2 ) |
+                   ( b10 & 0x0003 );
+
+            rgb += 3;
+            count--;
+        }
+    }
+
+    END_ATOMIC;
+}
+
+// convert interleaved 16 bit HSV directly into the pixel arrays
+void pixel_v_load_hsv16( uint16_t index, uint16_t len, uint16_t *hsv ){
+
+    uint16_t count = transfer_count( index, len );
+
+    uint16_t r, g, b, w;
+    uint8_t misc;
+
+    for( uint16_t i = index; i < ( index + count ); i++ ){
+
+        // RGBW mode doesn't support dithering, it uses this
+        // channel for white instead.
+        if( pix_mode == PIX_MODE_SK6812_RGBW ){
+
+            gfx_v_hsv_to_rgbw( hsv[0], hsv[1], hsv[2], &r, &g, &b, &w );
+
+            r /= 256;
+            g /= 256;
+            b /= 256;
+            misc = w / 256;
+        }
+        else{
+
+            gfx_v_hsv_to_rgb( hsv[0], hsv[1], hsv[2], &r, &g, &b );
+
+            r /= 64;
+            g /= 64;
+            b /= 64;
+
+            misc =  ( r & 0x0003 ) << 4;
+            misc |= ( g & 0x0003 ) << 2;
+            misc |= ( b & 0x0003 );
+
+            r /= 4;
+            g /= 4;
+            b /= 4;
+        }
+
+        hsv += 3;
+
+        // conversion is too slow to run with interrupts off,
+        // so only the store of each pixel is atomic.
+        ATOMIC;
+
+        array_r[i] = r;
+        array_g[i] = g;
+        array_b[i] = b;
+        array_misc.dither[i] = misc;
+
+        END_ATOMIC;
+    }
+}
+
 void pixel_v_get_rgb_totals( uint16_t *r, uint16_t *g, uint16_t *b ){
 
     *r = 0;
@@ -792,3 +923,4 @@ void pixel_v_get_rgb_totals( uint16_t *r, uint16_t *g, uint16_t *b ){
     }
 }
 
+#endif
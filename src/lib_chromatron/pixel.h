@@ -84,6 +84,9 @@ void pixel_v_load_rgb(
     uint8_t *b,
     uint8_t *d );
 
+void pixel_v_load_rgb16( uint16_t index, uint16_t len, uint16_t *rgb );
+void pixel_v_load_hsv16( uint16_t index, uint16_t len, uint16_t *hsv );
+
 void pixel_v_get_rgb_totals( uint16_t *r, uint16_t *g, uint16_t *b );
 
 #endif
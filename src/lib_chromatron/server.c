@@ -20,6 +20,10 @@
 // 
 // </license>
 
+// the frame server needs the graphics engine, there is nothing
+// to run on the simulator.
+#ifndef __SIM__
+
 #include "sapphire.h"
 
 #include "graphics.h"
@@ -31,9 +35,39 @@
 
 static socket_t sock;
 
+// frame stream back buffer: r, g, b planes of MAX_PIXELS each
+#define FRAME_BUF_SIZE ( MAX_PIXELS * 3 )
+
+static mem_handle_t frame_h = -1;
+static uint16_t frame_number;
+static uint16_t frame_index; // next expected pixel index
+static bool frame_ok;
+static uint16_t latched_frame;
+static bool back_valid; // back buffer still holds latched_frame
+
+static uint32_t svr_packets;
+static uint32_t svr_pixels;
+static uint32_t svr_frames;
+static uint16_t svr_packet_rate;
+static uint32_t svr_pixel_rate;
+
+static uint32_t rate_start;
+static uint16_t rate_packets;
+static uint32_t rate_pixels;
+
+KV_SECTION_META kv_meta_t svr_info_kv[] = {
+    { SAPPHIRE_TYPE_UINT32,   0, KV_FLAGS_READ_ONLY,  &svr_packets,          0,                  "svr_packets" },
+    { SAPPHIRE_TYPE_UINT32,   0, KV_FLAGS_READ_ONLY,  &svr_pixels,           0,                  "svr_pixels" },
+    { SAPPHIRE_TYPE_UINT32,   0, KV_FLAGS_READ_ONLY,  &svr_frames,           0,                  "svr_frames" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &svr_packet_rate,      0,                  "svr_packet_rate" },
+    { SAPPHIRE_TYPE_UINT32,   0, KV_FLAGS_READ_ONLY,  &svr_pixel_rate,       0,                  "svr_pixel_rate" },
+};
+
 
 PT_THREAD( server_thread( pt_t *pt, void *state ) );
 
+static void reset_rates( void );
+
 
 
 void svr_v_init( void ){
@@ -45,6 +79,8 @@ void svr_v_init( void ){
     // set timeout
     sock_v_set_timeout( sock, CHROMA_SERVER_TIMEOUT );
 
+    reset_rates();
+
 
     // start server
     thread_t_create( server_thread,
@@ -54,6 +90,235 @@ void svr_v_init( void ){
 }
 
 
+static void reset_rates( void ){
+
+    svr_packet_rate = 0;
+    svr_pixel_rate = 0;
+
+    rate_packets = 0;
+    rate_pixels = 0;
+    rate_start = tmr_u32_get_system_time_ms();
+}
+
+// packets and pixels per second, averaged over at least 1 second
+static void count_packet( uint16_t pixels ){
+
+    svr_packets++;
+    svr_pixels += pixels;
+
+    rate_packets++;
+    rate_pixels += pixels;
+
+    uint32_t elapsed = tmr_u32_elapsed_time_ms( rate_start );
+
+    if( elapsed >= 1000 ){
+
+        svr_packet_rate = ( (uint32_t)rate_packets * 1000 ) / elapsed;
+        svr_pixel_rate = ( rate_pixels * 1000 ) / elapsed;
+
+        rate_packets = 0;
+        rate_pixels = 0;
+        rate_start = tmr_u32_get_system_time_ms();
+    }
+}
+
+static void release_frame_buffer( void ){
+
+    if( frame_h >= 0 ){
+
+        mem2_v_free( frame_h );
+        frame_h = -1;
+    }
+
+    frame_ok = FALSE;
+    back_valid = FALSE;
+}
+
+static int8_t decode_chunk( chroma_msg_frame_t *msg, uint16_t data_len ){
+
+    uint8_t *r = mem2_vp_get_ptr( frame_h );
+    uint8_t *g = r + MAX_PIXELS;
+    uint8_t *b = g + MAX_PIXELS;
+
+    uint8_t *data = &msg->data0;
+    uint8_t *data_end = data + data_len;
+    uint16_t index = msg->index;
+    uint16_t end = index + msg->count;
+
+    // raw RGB
+    if( ( msg->flags & CHROMA_FRAME_FLAGS_RLE ) == 0 ){
+
+        if( data_len != ( msg->count * 3 ) ){
+
+            return -1;
+        }
+
+        while( index < end ){
+
+            r[index] = *data++;
+            g[index] = *data++;
+            b[index] = *data++;
+            index++;
+        }
+
+        return 0;
+    }
+
+    while( data < data_end ){
+
+        uint8_t code = *data++;
+        uint8_t run;
+
+        if( ( code & CHROMA_RUN_TYPE_MASK ) == CHROMA_RUN_SKIP ){
+
+            if( ( msg->flags & CHROMA_FRAME_FLAGS_DELTA ) == 0 ){
+
+                return -1;
+            }
+
+            run = ( code & ~CHROMA_RUN_TYPE_MASK ) + 1;
+
+            if( run > ( end - index ) ){
+
+                return -1;
+            }
+        }
+        else if( ( code & CHROMA_RUN_TYPE_MASK ) == CHROMA_RUN_REPEAT ){
+
+            run = ( code & ~CHROMA_RUN_TYPE_MASK ) + 1;
+
+            if( ( run > ( end - index ) ) || ( ( data_end - data ) < 3 ) ){
+
+                return -1;
+            }
+
+            memset( &r[index], data[0], run );
+            memset( &g[index], data[1], run );
+            memset( &b[index], data[2], run );
+            data += 3;
+        }
+        else{
+
+            run = code + 1;
+
+            if( ( run > ( end - index ) ) || ( ( data_end - data ) < ( run * 3 ) ) ){
+
+                return -1;
+            }
+
+            for( uint8_t i = 0; i < run; i++ ){
+
+                r[index + i] = *data++;
+                g[index + i] = *data++;
+                b[index + i] = *data++;
+            }
+        }
+
+        index += run;
+    }
+
+    // chunk must cover exactly its pixel range
+    if( index != end ){
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static void latch_frame( uint16_t count ){
+
+    uint8_t *r = mem2_vp_get_ptr( frame_h );
+    uint8_t *g = r + MAX_PIXELS;
+    uint8_t *b = g + MAX_PIXELS;
+
+    if( pixel_u8_get_mode() == PIX_MODE_ANALOG ){
+
+        pixel_v_set_analog_rgb( r[0] * 257, g[0] * 257, b[0] * 257 );
+    }
+    else{
+
+        // load the whole frame in one go, so it is never shown half updated.
+        // 8 bit frames have no dither or white channel.
+        pixel_v_load_rgb( 0, count, r, g, b, 0 );
+    }
+}
+
+static void process_frame_chunk( chroma_msg_frame_t *msg, uint16_t data_len ){
+
+    // bounds check
+    if( ( msg->count == 0 ) ||
+        ( data_len > CHROMA_FRAME_MAX_DATA ) ||
+        ( ( (uint32_t)msg->index + msg->count ) > MAX_PIXELS ) ){
+
+        return;
+    }
+
+    if( frame_h < 0 ){
+
+        frame_h = mem2_h_alloc( FRAME_BUF_SIZE );
+
+        if( frame_h < 0 ){
+
+            return;
+        }
+
+        memset( mem2_vp_get_ptr( frame_h ), 0, FRAME_BUF_SIZE );
+
+        frame_ok = FALSE;
+        back_valid = FALSE;
+    }
+
+    // start of a new frame
+    if( msg->index == 0 ){
+
+        frame_number = msg->frame;
+        frame_index = 0;
+        frame_ok = TRUE;
+
+        // a delta frame only applies on top of its base frame
+        if( ( msg->flags & CHROMA_FRAME_FLAGS_DELTA ) &&
+            ( !back_valid || ( msg->base_frame != latched_frame ) ) ){
+
+            frame_ok = FALSE;
+        }
+    }
+
+    // drop the rest of a frame after a lost or out of order chunk
+    if( !frame_ok ||
+        ( msg->frame != frame_number ) ||
+        ( msg->index != frame_index ) ){
+
+        frame_ok = FALSE;
+        return;
+    }
+
+    // the back buffer no longer matches the last loaded frame
+    back_valid = FALSE;
+
+    if( decode_chunk( msg, data_len ) < 0 ){
+
+        frame_ok = FALSE;
+        return;
+    }
+
+    frame_index += msg->count;
+
+    count_packet( msg->count );
+
+    if( msg->flags & CHROMA_FRAME_FLAGS_EOF ){
+
+        latch_frame( frame_index );
+
+        svr_frames++;
+
+        latched_frame = frame_number;
+        back_valid = TRUE;
+        frame_ok = FALSE;
+    }
+}
+
+
 PT_THREAD( server_thread( pt_t *pt, void *state ) )
 {
 PT_BEGIN( pt );
@@ -71,8 +336,12 @@ PT_BEGIN( pt );
                 // re-enable pixel bridge and reset VM
                 gfx_v_pixel_bridge_enable();            
                 vm_v_reset();
+
+                release_frame_buffer();
             }
 
+            reset_rates();
+
             continue;
         }
 
@@ -93,12 +362,16 @@ PT_BEGIN( pt );
 
             chroma_msg_pixel_t *msg = (chroma_msg_pixel_t *)data;
 
-            // bounds check
-            if( msg->count > CHROMA_SVR_MAX_PIXELS ){
+            // bounds check, once per packet
+            if( ( msg->count > CHROMA_SVR_MAX_PIXELS ) ||
+                ( sock_i16_get_bytes_read( sock ) < 
+                  (int16_t)( offsetof( chroma_msg_pixel_t, data0 ) + ( msg->count * 6 ) ) ) ){
 
                 continue;
             }
 
+            count_packet( msg->count );
+
             if( pixel_u8_get_mode() == PIX_MODE_ANALOG ){
 
                 uint16_t r, g, b;
@@ -123,142 +396,33 @@ PT_BEGIN( pt );
 
                 pixel_v_set_analog_rgb( r, g, b );
             }
-            else{
-                 
-                uint8_t array_r[CHROMA_SVR_MAX_PIXELS];
-                uint8_t array_g[CHROMA_SVR_MAX_PIXELS];
-                uint8_t array_b[CHROMA_SVR_MAX_PIXELS];
-                uint8_t array_d[CHROMA_SVR_MAX_PIXELS];
-                    
-                // check if HSV
-                if( type == CHROMA_MSG_TYPE_HSV ){
-
-                    uint16_t r, g, b, w;
-
-                    // unpack HSV pointers
-                    uint16_t *h = &msg->data0;
-                    uint16_t *s = h + 1;
-                    uint16_t *v = s + 1;
-
-                    // convert to RGBW
-                    if( pixel_u8_get_mode() == PIX_MODE_SK6812_RGBW ){
-
-                        // RGBW mode doesn't support dithering, it uses this
-                        // channel for white instead.
-                        for( uint8_t i = 0; i < msg->count; i++ ){
-
-                            gfx_v_hsv_to_rgbw( *h, *s, *v, &r, &g, &b, &w );
-
-                            h += 3;
-                            s += 3;
-                            v += 3;
+            // convert straight from the packet into the pixel arrays
+            else if( type == CHROMA_MSG_TYPE_HSV ){
 
-                            array_r[i] = r / 256;
-                            array_g[i] = g / 256;
-                            array_b[i] = b / 256;
-                            array_d[i] = w / 256;
-                        }
-                    }
-                    // convert to RGB
-                    else{
-
-                        uint8_t dither;
-
-                        for( uint8_t i = 0; i < msg->count; i++ ){
-
-                            // update in place
-                            gfx_v_hsv_to_rgb( *h, *s, *v, &r, &g, &b );
-
-                            h += 3;
-                            s += 3;
-                            v += 3;
+                pixel_v_load_hsv16( msg->index, msg->count, &msg->data0 );
+            }
+            else{
 
-                            r /= 64;
-                            g /= 64;
-                            b /= 64;
+                pixel_v_load_rgb16( msg->index, msg->count, &msg->data0 );
+            }
+        }
+        else if( type == CHROMA_MSG_TYPE_FRAME_RGB8 ){
 
-                            dither =  ( r & 0x0003 ) << 4;
-                            dither |= ( g & 0x0003 ) << 2;
-                            dither |= ( b & 0x0003 );
+            int16_t len = sock_i16_get_bytes_read( sock );
 
-                            r /= 4;
-                            g /= 4;
-                            b /= 4;
+            if( len < (int16_t)CHROMA_FRAME_HEADER_LEN ){
 
-                            array_r[i] = r;
-                            array_g[i] = g;
-                            array_b[i] = b;
-                            array_d[i] = dither;
-                        }
-                    }
-                }
-                // RGB
-                else{
+                continue;
+            }
 
-                    // unpack RGB pointers
-                    uint16_t *r = &msg->data0;
-                    uint16_t *g = r + 1;
-                    uint16_t *b = g + 1;
-                    uint8_t dither;
-
-                    if( pixel_u8_get_mode() == PIX_MODE_SK6812_RGBW ){
-
-                        for( uint8_t i = 0; i < msg->count; i++ ){
-
-                            *r /= 256;
-                            *g /= 256;
-                            *b /= 256;
-
-                            dither = 0;
-                            
-                            array_r[i] = *r;
-                            array_g[i] = *g;
-                            array_b[i] = *b;
-                            array_d[i] = dither;
-
-                            r += 3;
-                            g += 3;
-                            b += 3;
-                        }
-                    }
-                    else{
-
-                        for( uint8_t i = 0; i < msg->count; i++ ){
-
-                            *r /= 64;
-                            *g /= 64;
-                            *b /= 64;
-
-                            dither =  ( *r & 0x0003 ) << 4;
-                            dither |= ( *g & 0x0003 ) << 2;
-                            dither |= ( *b & 0x0003 );
-
-                            *r /= 4;
-                            *g /= 4;
-                            *b /= 4;
-
-                            array_r[i] = *r;
-                            array_g[i] = *g;
-                            array_b[i] = *b;
-                            array_d[i] = dither;
-
-                            r += 3;
-                            g += 3;
-                            b += 3;
-                        }
-                    }
-                }
+            // stop pixel bridge if loading pixels directly
+            gfx_v_pixel_bridge_disable();
 
-                pixel_v_load_rgb( 
-                    msg->index, 
-                    msg->count, 
-                    array_r, 
-                    array_g, 
-                    array_b, 
-                    array_d );
-            }
+            process_frame_chunk( (chroma_msg_frame_t *)data, len - CHROMA_FRAME_HEADER_LEN );
         }
     }
 
 PT_END( pt );
 }
+
+#endif
@@ -43,6 +43,59 @@ typedef struct{
 #define CHROMA_SVR_MAX_PIXELS ( 80 )
 
 
+/*
+
+Frame stream message.
+
+A frame is sent as one or more chunks, each covering pixels
+[index, index + count). Chunks must arrive in order, starting at 0,
+and the last chunk of a frame has CHROMA_FRAME_FLAGS_EOF set. The
+server assembles the chunks into a back buffer and only loads the
+pixels when the whole frame has arrived. A frame with a missing or
+out of order chunk is dropped.
+
+Pixels are 8 bit RGB. Without CHROMA_FRAME_FLAGS_RLE the payload is
+count * 3 bytes of r, g, b. With it, the payload is a series of runs,
+each starting with a code byte:
+
+    0x00 - 0x7f: n + 1 literal pixels follow (3 bytes each)
+    0x80 - 0xbf: 1 pixel follows, repeated n + 1 times
+    0xc0 - 0xff: skip n + 1 pixels
+
+Skip runs are only valid in delta frames (CHROMA_FRAME_FLAGS_DELTA),
+where skipped pixels keep their value from base_frame. The server
+drops a delta frame if base_frame is not the last frame it loaded,
+so the sender should send a full frame periodically.
+
+*/
+#define CHROMA_MSG_TYPE_FRAME_RGB8         3
+
+#define CHROMA_FRAME_FLAGS_EOF             0x01
+#define CHROMA_FRAME_FLAGS_RLE             0x02
+#define CHROMA_FRAME_FLAGS_DELTA           0x04
+
+#define CHROMA_RUN_TYPE_MASK               0xc0
+#define CHROMA_RUN_REPEAT                  0x80
+#define CHROMA_RUN_SKIP                    0xc0
+#define CHROMA_RUN_LITERAL_MAX             128
+#define CHROMA_RUN_MAX                     64
+
+typedef struct{
+    uint8_t type;
+    uint8_t flags;
+    uint16_t frame;
+    uint16_t base_frame;
+    uint16_t index; // pixel index (NOT byte index)
+    uint16_t count; // pixel count (NOT byte count)
+    uint8_t data0;
+} chroma_msg_frame_t;
+
+#define CHROMA_FRAME_HEADER_LEN            offsetof( chroma_msg_frame_t, data0 )
+
+// payload limit per chunk, 160 pixels of raw 8 bit RGB
+#define CHROMA_FRAME_MAX_DATA              480
+
+
 
 void svr_v_init( void );
 
@@ -20,6 +20,10 @@
 // 
 // </license>
 
+// the VM loader drives the wifi co-processor, there is nothing
+// to run on the simulator.
+#ifndef __SIM__
+
 #include "system.h"
 #include "threading.h"
 #include "logging.h"
@@ -93,6 +97,9 @@ KV_SECTION_META kv_meta_t vm_info_kv[] = {
     { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.loop_time,    0,                  "vm_loop_time" },
     { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.fader_time,   0,                  "vm_fade_time" },
     { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.max_cycles,   0,                  "vm_max_cycles" },
+    { SAPPHIRE_TYPE_UINT8,    0, KV_FLAGS_READ_ONLY,  &vm_info.max_call_depth, 0,                "vm_call_depth" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.active_faders, 0,                 "vm_active_faders" },
+    { SAPPHIRE_TYPE_UINT16,   0, KV_FLAGS_READ_ONLY,  &vm_info.max_fader_time, 0,                "vm_max_fade_time" },
     { SAPPHIRE_TYPE_UINT8,    0, KV_FLAGS_READ_ONLY,  0,                     vm_i8_kv_handler,   "vm_isa" },
 };
 
@@ -425,6 +432,9 @@ static int8_t load_vm_wifi( catbus_hash_t32 hash ){
     vm_info.return_code = -127;
     vm_info.loop_time = 0;
     vm_info.fader_time = 0;
+    vm_info.max_call_depth = 0;
+    vm_info.active_faders = 0;
+    vm_info.max_fader_time = 0;
 
     return 0;
 
@@ -739,3 +749,5 @@ bool vm_b_running( void ){
 
     return vm_running;
 }
+
+#endif
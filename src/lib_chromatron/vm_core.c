@@ -27,6 +27,7 @@
 #include "vm_core.h"
 #include "trig.h"
 #include "vm_config.h"
+#include "memory.h"
 
 #ifdef VM_ENABLE_KV
 #include "keyvalue.h"
@@ -38,13 +39,90 @@
 
 static uint16_t cycles;
 
+#ifdef VM_ENABLE_PROFILE
+static vm_profile_t vm_profile;
+#endif
+
+#ifdef VM_ENABLE_GFX
+// fused load, add, and store of a pixel attribute.
+// wraparound and clamping are the same as the LTAx opcodes.
+static void _vm_v_pix_add( uint8_t attr, int32_t value, int32_t x, int32_t y, uint8_t obj ){
+
+    int32_t a;
+
+    if( attr == PIX_ATTR_HUE ){
+
+        a = gfx_u16_get_hue( x, y, obj ) + value;
+
+        // wraparound to 16 bit range.
+        a %= 65536;
+
+        gfx_v_set_hue( a, x, y, obj );
+
+        return;
+    }
+
+    if( attr == PIX_ATTR_SAT ){
+
+        a = gfx_u16_get_sat( x, y, obj );
+    }
+    else if( attr == PIX_ATTR_VAL ){
+
+        a = gfx_u16_get_val( x, y, obj );
+    }
+    else if( attr == PIX_ATTR_HS_FADE ){
+
+        a = gfx_u16_get_hs_fade( x, y, obj );
+    }
+    else if( attr == PIX_ATTR_V_FADE ){
+
+        a = gfx_u16_get_v_fade( x, y, obj );
+    }
+    else{
+
+        return;
+    }
+
+    a += value;
+
+    // clamp to our 16 bit range.
+    if( a > 65535 ){
+
+        a = 65535;
+    }
+    else if( a < 0 ){
+
+        a = 0;
+    }
+
+    if( attr == PIX_ATTR_SAT ){
+
+        gfx_v_set_sat( a, x, y, obj );
+    }
+    else if( attr == PIX_ATTR_VAL ){
+
+        gfx_v_set_val( a, x, y, obj );
+    }
+    else if( attr == PIX_ATTR_HS_FADE ){
+
+        gfx_v_set_hs_fade( a, x, y, obj );
+    }
+    else{
+
+        gfx_v_set_v_fade( a, x, y, obj );
+    }
+}
+#endif
+
 static int8_t _vm_i8_run_stream(
     uint8_t *stream,
     uint16_t offset,
-    uint64_t *rng_seed,
+    vm_state_t *state,
     int32_t *data ){
 
-#ifdef ESP8266
+// the sim target runs on a 64 bit host, where label addresses
+// do not fit in a pgm_read_word(), so it uses the direct table as well.
+#if defined(ESP8266) || defined(__SIM__)
     static void *opcode_table[] = {
 #else
     static void *const opcode_table[] PROGMEM = {
@@ -110,16 +188,16 @@ static int8_t _vm_i8_run_stream(
         &&opcode_db_load,	        // 57
         &&opcode_db_store,	        // 58
         &&opcode_yield_frames,      // 59
-        &&opcode_trap,	            // 60
-        &&opcode_trap,	            // 61
-        &&opcode_trap,	            // 62
-        &&opcode_trap,	            // 63
-        &&opcode_trap,	            // 64
-        &&opcode_trap,	            // 65
-        &&opcode_trap,	            // 66
-        &&opcode_trap,	            // 67
-        &&opcode_trap,	            // 68
-        &&opcode_trap,	            // 69
+        &&opcode_jmp_if_eq,         // 60
+        &&opcode_jmp_if_neq,        // 61
+        &&opcode_jmp_if_gt,         // 62
+        &&opcode_jmp_if_lt,         // 63
+        &&opcode_jmp_if_lte,        // 64
+        &&opcode_addi,              // 65
+        &&opcode_pix_add,           // 66
+        &&opcode_pix_sub,           // 67
+        &&opcode_shl,               // 68
+        &&opcode_div_pow2,          // 69
         &&opcode_trap,	            // 70
         &&opcode_trap,	            // 71
         &&opcode_trap,	            // 72
@@ -315,17 +393,27 @@ static int8_t _vm_i8_run_stream(
     uint16_t addr;
     catbus_hash_t32 hash;
 
-dispatch:
-    cycles++;
-
+// a program can only run away by jumping backwards, so the cycle
+// limit is only checked on taken branches, calls and returns.
+// straight line code always runs into a terminator, which the
+// verifier guarantees.
+branch:
     if( cycles > VM_MAX_CYCLES ){
 
         return VM_STATUS_ERR_MAX_CYCLES;
     }
 
+dispatch:
+    cycles++;
+
     opcode = *pc++;
 
-#ifdef ESP8266
+#ifdef VM_ENABLE_PROFILE
+    vm_profile.total_ops++;
+    vm_profile.opcodes[opcode]++;
+#endif
+
+#if defined(ESP8266) || defined(__SIM__)
     goto *opcode_table[opcode];
 #else
     void *target = (void*)pgm_read_word( &opcode_table[opcode] );
@@ -522,6 +610,50 @@ opcode_mod:
     goto dispatch;
 
 
+opcode_addi:
+
+    result = *pc++;
+    op1  = data[*pc++];
+
+    // signed 16 bit immediate
+    op2 = (int16_t)( pc[0] + ( pc[1] << 8 ) );
+    pc += 2;
+
+    data[result] = op1 + op2;
+
+    goto dispatch;
+
+
+opcode_shl:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++];
+
+    data[result] = (int32_t)( (uint32_t)op1 << ( op2 & 31 ) );
+
+    goto dispatch;
+
+
+opcode_div_pow2:
+
+    result = *pc++;
+    op1  = data[*pc++];
+    op2  = data[*pc++] & 31;
+
+    // signed divide by 2^op2.
+    // bias negative values so the shift rounds toward zero,
+    // same as opcode_div.
+    if( op1 < 0 ){
+
+        op1 += (int32_t)( ( (uint32_t)1 << op2 ) - 1 );
+    }
+
+    data[result] = op1 >> op2;
+
+    goto dispatch;
+
+
 opcode_jmp:
 
     addr = *pc++;
@@ -529,7 +661,7 @@ opcode_jmp:
 
     pc = stream + addr;
 
-    goto dispatch;
+    goto branch;
 
 
 opcode_jmp_if_z:
@@ -542,6 +674,8 @@ opcode_jmp_if_z:
     if( data[op1_addr] == 0 ){
 
         pc = stream + addr;
+
+        goto branch;
     }
 
     goto dispatch;
@@ -557,6 +691,8 @@ opcode_jmp_if_not_z:
     if( data[op1_addr] != 0 ){
 
         pc = stream + addr;
+
+        goto branch;
     }
 
     goto dispatch;
@@ -572,6 +708,8 @@ opcode_jmp_if_z_dec:
     if( data[op1_addr] == 0 ){
 
         pc = stream + addr;
+
+        goto branch;
     }
     else{
 
@@ -592,6 +730,8 @@ opcode_jmp_if_gte:
     if( data[op1_addr] >= data[op2_addr] ){
 
         pc = stream + addr;
+
+        goto branch;
     }
 
     goto dispatch;
@@ -610,6 +750,8 @@ opcode_jmp_if_l_pre_inc:
         addr += ( *pc ) << 8;
 
         pc = stream + addr;
+
+        goto branch;
     }
     else{
 
@@ -619,6 +761,96 @@ opcode_jmp_if_l_pre_inc:
     goto dispatch;
 
 
+opcode_jmp_if_eq:
+
+    op1_addr = *pc++;
+    op2_addr = *pc++;
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    if( data[op1_addr] == data[op2_addr] ){
+
+        pc = stream + addr;
+
+        goto branch;
+    }
+
+    goto dispatch;
+
+
+opcode_jmp_if_neq:
+
+    op1_addr = *pc++;
+    op2_addr = *pc++;
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    if( data[op1_addr] != data[op2_addr] ){
+
+        pc = stream + addr;
+
+        goto branch;
+    }
+
+    goto dispatch;
+
+
+opcode_jmp_if_gt:
+
+    op1_addr = *pc++;
+    op2_addr = *pc++;
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    if( data[op1_addr] > data[op2_addr] ){
+
+        pc = stream + addr;
+
+        goto branch;
+    }
+
+    goto dispatch;
+
+
+opcode_jmp_if_lt:
+
+    op1_addr = *pc++;
+    op2_addr = *pc++;
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    if( data[op1_addr] < data[op2_addr] ){
+
+        pc = stream + addr;
+
+        goto branch;
+    }
+
+    goto dispatch;
+
+
+opcode_jmp_if_lte:
+
+    op1_addr = *pc++;
+    op2_addr = *pc++;
+
+    addr = *pc++;
+    addr += ( *pc++ ) << 8;
+
+    if( data[op1_addr] <= data[op2_addr] ){
+
+        pc = stream + addr;
+
+        goto branch;
+    }
+
+    goto dispatch;
+
+
 opcode_print:
 
     src = *pc++;
@@ -633,21 +865,39 @@ opcode_ret:
     op1_addr = *pc++;
     data[RETURN_VAL_ADDR] = data[op1_addr];
 
-    return VM_STATUS_OK;
+    // return from the entry function ends the run
+    if( state->call_depth == 0 ){
+
+        return VM_STATUS_OK;
+    }
+
+    state->call_depth--;
+    pc = stream + state->call_stack[state->call_depth];
+
+    goto branch;
 
 
 opcode_call:
     addr = *pc++;
     addr += ( *pc++ ) << 8;
 
-    // call function, by recursively calling into VM
-    int8_t status = _vm_i8_run_stream( stream, addr, rng_seed, data );
-    if( status < 0 ){
+    if( state->call_depth >= VM_MAX_CALL_DEPTH ){
 
-        return status;
+        return VM_STATUS_ERR_STACK_OVERFLOW;
     }
 
-    goto dispatch;
+    // push return address and jump to function
+    state->call_stack[state->call_depth] = pc - stream;
+    state->call_depth++;
+
+    if( state->call_depth > state->max_call_depth ){
+
+        state->max_call_depth = state->call_depth;
+    }
+
+    pc = stream + addr;
+
+    goto branch;
 
 
 opcode_lta:
@@ -657,7 +907,17 @@ opcode_lta:
     index = data[*pc++];
     size = data[*pc++];
 
-    index %= size;
+    // the verifier guarantees size > 0, so only wrap
+    // indexes that are actually out of range.
+    if( (uint32_t)index >= (uint32_t)size ){
+
+        index %= size;
+
+        if( index < 0 ){
+
+            index += size;
+        }
+    }
 
     data[dest + index] = data[src];
 
@@ -671,7 +931,17 @@ opcode_lfa:
     index = data[*pc++];
     size = data[*pc++];
 
-    index %= size;
+    // the verifier guarantees size > 0, so only wrap
+    // indexes that are actually out of range.
+    if( (uint32_t)index >= (uint32_t)size ){
+
+        index %= size;
+
+        if( index < 0 ){
+
+            index += size;
+        }
+    }
 
     data[dest] = data[src + index];
 
@@ -687,8 +957,25 @@ opcode_lfa2d:
     size_x32 = data[*pc++];
     size_y32 = data[*pc++];
 
-    index_x32 %= size_x32;
-    index_y32 %= size_y32;
+    if( (uint32_t)index_x32 >= (uint32_t)size_x32 ){
+
+        index_x32 %= size_x32;
+
+        if( index_x32 < 0 ){
+
+            index_x32 += size_x32;
+        }
+    }
+
+    if( (uint32_t)index_y32 >= (uint32_t)size_y32 ){
+
+        index_y32 %= size_y32;
+
+        if( index_y32 < 0 ){
+
+            index_y32 += size_y32;
+        }
+    }
 
     data[dest] = data[src + index_x32 + (index_y32 * size_x32)];
 
@@ -703,8 +990,25 @@ opcode_lta2d:
     size_x32 = data[*pc++];
     size_y32 = data[*pc++];
 
-    index_x32 %= size_x32;
-    index_y32 %= size_y32;
+    if( (uint32_t)index_x32 >= (uint32_t)size_x32 ){
+
+        index_x32 %= size_x32;
+
+        if( index_x32 < 0 ){
+
+            index_x32 += size_x32;
+        }
+    }
+
+    if( (uint32_t)index_y32 >= (uint32_t)size_y32 ){
+
+        index_y32 %= size_y32;
+
+        if( index_y32 < 0 ){
+
+            index_y32 += size_y32;
+        }
+    }
 
     data[dest + index_x32 + (index_y32 * size_x32)] = data[src];
 
@@ -912,6 +1216,34 @@ opcode_lfavf:
 
     goto dispatch;
 
+opcode_pix_add:
+
+    attr = *pc++;
+    src  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    _vm_v_pix_add( attr, data[src], data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
+opcode_pix_sub:
+
+    attr = *pc++;
+    src  = *pc++;
+    index_x = *pc++;
+    index_y  = *pc++;
+    obj = *pc++;
+
+    #ifdef VM_ENABLE_GFX
+    _vm_v_pix_add( attr, -data[src], data[index_x], data[index_y], obj );
+    #endif
+
+    goto dispatch;
+
 opcode_array_add:
     
     obj = *pc++;
@@ -995,6 +1327,12 @@ opcode_array_div:
     op1 = data[*pc++];
     size = data[*pc++];
 
+    // the divisor is only known at run time
+    if( op1 == 0 ){
+
+        goto dispatch;
+    }
+
     if( obj == ARRAY_OBJ_TYPE ){
 
         for( uint16_t i = 0; i < size; i++ ){
@@ -1020,6 +1358,12 @@ opcode_array_mod:
     op1 = data[*pc++];
     size = data[*pc++];
 
+    // the divisor is only known at run time
+    if( op1 == 0 ){
+
+        goto dispatch;
+    }
+
     if( obj == ARRAY_OBJ_TYPE ){
 
         for( uint16_t i = 0; i < size; i++ ){
@@ -1077,7 +1421,7 @@ opcode_rand:
     }
     else{
 
-        val = rnd_u16_get_int_with_seed( rng_seed ) % diff;
+        val = rnd_u16_get_int_with_seed( &state->rng_seed ) % diff;
     }
 
     data[dest] = val + data[op1_addr];
@@ -1203,6 +1547,10 @@ opcode_yield_frames:
     data[RETURN_VAL_ADDR] = op1;
     data[RETURN_VAL_ADDR+1] = pc - stream; // figure offset out from pc
 
+    // the resume offset is kept in the state as well, the data
+    // segment can be written over KV and is not a verified target.
+    state->yield_next = pc - stream;
+
     return VM_STATUS_YIELD;
 
 
@@ -1217,7 +1565,14 @@ int8_t vm_i8_run(
     vm_state_t *state,
     int32_t *data ){
 
-    return _vm_i8_run_stream( stream, offset, &state->rng_seed, data );
+    if( !state->verified ){
+
+        return VM_STATUS_ERR_NOT_VERIFIED;
+    }
+
+    state->call_depth = 0;
+
+    return _vm_i8_run_stream( stream, offset, state, data );
 }
 
 
@@ -1225,6 +1580,11 @@ int8_t vm_i8_run_init(
     uint8_t *stream,
     vm_state_t *state ){
 
+    if( !state->verified ){
+
+        return VM_STATUS_ERR_NOT_VERIFIED;
+    }
+
     cycles = 0;
 
     state->frame_number = 0;
@@ -1234,7 +1594,9 @@ int8_t vm_i8_run_init(
 
     uint16_t offset = state->init_start;
 
-    int8_t status = _vm_i8_run_stream( code, offset, &state->rng_seed, data );
+    state->call_depth = 0;
+
+    int8_t status = _vm_i8_run_stream( code, offset, state, data );
 
     if( cycles > state->max_cycles ){
 
@@ -1249,6 +1611,11 @@ int8_t vm_i8_run_loop(
     uint8_t *stream,
     vm_state_t *state ){
 
+    if( !state->verified ){
+
+        return VM_STATUS_ERR_NOT_VERIFIED;
+    }
+
     cycles = 0;
     state->frame_number++;
 
@@ -1259,11 +1626,22 @@ int8_t vm_i8_run_loop(
       uint8_t *code = (uint8_t *)( stream + state->code_start );
       int32_t *data = (int32_t *)( stream + state->data_start );
 
-      // pick back up from yield location if needed
-      uint16_t offset = state->yield_next ? state->yield_next : state->loop_start;
+      // pick back up from yield location if needed.
+      // the call stack is only kept when resuming.
+      uint16_t offset = state->loop_start;
+
+      if( state->yield_next ){
+
+        offset = state->yield_next;
+      }
+      else{
+
+        state->call_depth = 0;
+      }
+
       state->yield_next = 0;
 
-      int8_t status = _vm_i8_run_stream( code, offset, &state->rng_seed, data );
+      int8_t status = _vm_i8_run_stream( code, offset, state, data );
 
       if( cycles > state->max_cycles ){
 
@@ -1273,7 +1651,6 @@ int8_t vm_i8_run_loop(
       // save yield location if that's how we stopped
       if (status == VM_STATUS_YIELD) {
         state->yield_frames = data[RETURN_VAL_ADDR];
-        state->yield_next = data[YIELD_NEXT_OFFSET_ADDR];
       }
 
       return status;
@@ -1335,12 +1712,516 @@ void vm_v_set_data(
         return;
     }
 
+    // array sizes are fixed at load time
+    if( ( state->array_size_regs[addr / 8] & ( 1 << ( addr % 8 ) ) ) != 0 ){
+
+        return;
+    }
+
     int32_t *data_table = (int32_t *)( stream + state->data_start );
 
     data_table[addr] = data;
 }
 
 
+// load time bytecode verifier.
+// the interpreter trusts register addresses, jump targets and
+// array bounds, so every program is checked once here before it
+// is allowed to run.
+typedef struct{
+    uint8_t *code;
+    uint16_t code_len;
+    int32_t *data;
+    uint16_t data_count;
+    uint8_t pix_obj_count;
+    uint8_t pass;
+    uint8_t starts[VM_MAX_IMAGE_SIZE / 8];
+    uint8_t written[256 / 8];
+    uint8_t *array_size_regs;
+} vm_verify_t;
+
+#define VERIFY_PASS_DECODE  0 // opcodes, lengths and register addresses
+#define VERIFY_PASS_ARRAYS  1 // array bounds
+#define VERIFY_PASS_TARGETS 2 // jump targets and array sizes
+
+static bool _vm_b_verify_reg( vm_verify_t *v, uint8_t addr ){
+
+    return addr < v->data_count;
+}
+
+static bool _vm_b_verify_write( vm_verify_t *v, uint8_t addr ){
+
+    if( !_vm_b_verify_reg( v, addr ) ){
+
+        return FALSE;
+    }
+
+    if( v->pass == VERIFY_PASS_DECODE ){
+
+        v->written[addr / 8] |= ( 1 << ( addr % 8 ) );
+    }
+
+    return TRUE;
+}
+
+static bool _vm_b_is_start( vm_verify_t *v, uint16_t addr ){
+
+    if( addr >= v->code_len ){
+
+        return FALSE;
+    }
+
+    return ( v->starts[addr / 8] & ( 1 << ( addr % 8 ) ) ) != 0;
+}
+
+static bool _vm_b_is_terminator( uint8_t opcode ){
+
+    // jmp, ret, halt
+    return ( opcode == 15 ) || ( opcode == 22 ) || ( opcode == 42 );
+}
+
+static bool _vm_b_is_padding( uint8_t *pc, uint16_t remaining ){
+
+    if( remaining > 4 ){
+
+        return FALSE;
+    }
+
+    for( uint8_t i = 0; i < remaining; i++ ){
+
+        if( pc[i] != 0 ){
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static bool _vm_b_verify_target( vm_verify_t *v, uint8_t *pc ){
+
+    if( v->pass != VERIFY_PASS_TARGETS ){
+
+        return TRUE;
+    }
+
+    return _vm_b_is_start( v, pc[0] + ( pc[1] << 8 ) );
+}
+
+// base is the first register of the array, sizes are the addresses
+// of the registers holding its dimensions. 1D arrays have no size_y.
+#define VERIFY_NO_DIM       0xffff
+
+static bool _vm_b_verify_size( vm_verify_t *v, uint16_t size ){
+
+    if( size == VERIFY_NO_DIM ){
+
+        return TRUE;
+    }
+
+    if( v->pass == VERIFY_PASS_DECODE ){
+
+        return _vm_b_verify_reg( v, size );
+    }
+    else if( v->pass == VERIFY_PASS_ARRAYS ){
+
+        v->array_size_regs[size / 8] |= ( 1 << ( size % 8 ) );
+
+        return v->data[size] > 0;
+    }
+
+    // array sizes are only read from the data segment,
+    // so the interpreter can rely on the checks above.
+    return ( v->written[size / 8] & ( 1 << ( size % 8 ) ) ) == 0;
+}
+
+static bool _vm_b_verify_array( vm_verify_t *v, uint8_t base, uint16_t size_x, uint16_t size_y, bool write ){
+
+    if( !_vm_b_verify_size( v, size_x ) || !_vm_b_verify_size( v, size_y ) ){
+
+        return FALSE;
+    }
+
+    if( v->pass == VERIFY_PASS_DECODE ){
+
+        return _vm_b_verify_reg( v, base );
+    }
+    else if( v->pass != VERIFY_PASS_ARRAYS ){
+
+        return TRUE;
+    }
+
+    // check each dimension before multiplying, so the
+    // product cannot overflow
+    if( v->data[size_x] > v->data_count ){
+
+        return FALSE;
+    }
+
+    int32_t len = v->data[size_x];
+
+    if( size_y != VERIFY_NO_DIM ){
+
+        if( v->data[size_y] > v->data_count ){
+
+            return FALSE;
+        }
+
+        len *= v->data[size_y];
+    }
+
+    if( ( len > v->data_count ) || ( ( base + len ) > v->data_count ) ){
+
+        return FALSE;
+    }
+
+    if( write ){
+
+        for( uint16_t i = base; i < base + len; i++ ){
+
+            v->written[i / 8] |= ( 1 << ( i % 8 ) );
+        }
+    }
+
+    return TRUE;
+}
+
+// returns the length of the instruction at pc, or 0 if it is invalid
+static uint8_t _vm_u8_verify_ins( vm_verify_t *v, uint8_t *pc, uint16_t remaining ){
+
+    uint8_t opcode = pc[0];
+    uint8_t len = 0;
+    bool ok = TRUE;
+
+    // operands start at pc[1]
+    uint8_t *op = pc + 1;
+
+    switch( opcode ){
+        case 0:  // mov
+        case 56: // not
+            len = 3;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) && _vm_b_verify_reg( v, op[1] );
+            break;
+
+        case 1:  // clr
+            len = 2;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] );
+            break;
+
+        case 2: case 3: case 4: case 5: case 6: case 7: // compares
+        case 8: case 9:                                 // and, or
+        case 10: case 11: case 12: case 13: case 14:    // add .. mod
+        case 40:                                        // rand
+        case 68: case 69:                               // shl, div_pow2
+            len = 4;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_reg( v, op[2] );
+            break;
+
+        case 15: // jmp
+        case 23: // call
+            len = 3;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_target( v, &op[0] );
+            break;
+
+        case 16: // jmp_if_z
+        case 17: // jmp_if_not_z
+            len = 4;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[0] ) && _vm_b_verify_target( v, &op[1] );
+            break;
+
+        case 18: // jmp_if_z_dec
+            len = 4;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) && _vm_b_verify_target( v, &op[1] );
+            break;
+
+        case 19: // jmp_if_gte
+        case 60: case 61: case 62: case 63: case 64: // jmp_if_eq .. jmp_if_lte
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[0] ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_target( v, &op[2] );
+            break;
+
+        case 20: // jmp_if_l_pre_inc
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_target( v, &op[2] );
+            break;
+
+        case 21: // print
+        case 22: // ret
+        case 41: // assert
+            len = 2;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[0] );
+            break;
+
+        case 24: // lta: dest array, src, index, size
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_array( v, op[0], op[3], VERIFY_NO_DIM, TRUE ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_reg( v, op[2] );
+            break;
+
+        case 25: // lfa: dest, src array, index, size
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) &&
+                 _vm_b_verify_array( v, op[1], op[3], VERIFY_NO_DIM, FALSE ) &&
+                 _vm_b_verify_reg( v, op[2] );
+            break;
+
+        case 26: // lfa2d: dest, src array, index x, index y, size x, size y
+            len = 7;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) &&
+                 _vm_b_verify_array( v, op[1], op[4], op[5], FALSE ) &&
+                 _vm_b_verify_reg( v, op[2] ) &&
+                 _vm_b_verify_reg( v, op[3] );
+            break;
+
+        case 27: // lta2d: dest array, src, index x, index y, size x, size y
+            len = 7;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_array( v, op[0], op[4], op[5], TRUE ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_reg( v, op[2] ) &&
+                 _vm_b_verify_reg( v, op[3] );
+            break;
+
+        case 28: case 29: case 30: // ltah, ltas, ltav
+        case 51: case 52:          // ltahsf, ltavf
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[0] ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_reg( v, op[2] );
+            break;
+
+        case 31: case 32: case 33: // lfah, lfas, lfav
+        case 43:                   // is_fading
+        case 49: case 50:          // lfahsf, lfavf
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) &&
+                 _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_reg( v, op[2] );
+            break;
+
+        case 34: case 35: case 36: case 37: case 38: case 39: // array ops
+            len = 6;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[3] ) && _vm_b_verify_reg( v, op[4] );
+
+            if( ok && ( op[0] == ARRAY_OBJ_TYPE ) ){
+
+                ok = _vm_b_verify_array( v, op[1], op[4], VERIFY_NO_DIM, TRUE );
+            }
+            break;
+
+        case 42: // halt
+            len = 1;
+            break;
+
+        case 44: // lib_call: hash, dest, param count, params
+            len = 7;
+            if( remaining < len ) break;
+
+            if( op[5] > 8 ){
+
+                ok = FALSE;
+                break;
+            }
+
+            len += op[5];
+            if( remaining < len ) break;
+
+            ok = _vm_b_verify_write( v, op[4] );
+
+            for( uint8_t i = 0; ok && ( i < op[5] ); i++ ){
+
+                ok = _vm_b_verify_reg( v, op[6 + i] );
+            }
+            break;
+
+        case 54: // obj_load: obj type, attr, obj index, dest
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[3] );
+
+            if( ok && ( op[0] == PIX_OBJ_TYPE ) ){
+
+                ok = op[2] < v->pix_obj_count;
+            }
+            break;
+
+        case 55: // obj_store, no-op
+            len = 5;
+            break;
+
+        case 57: // db_load: hash, dest
+            len = 6;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[4] );
+            break;
+
+        case 58: // db_store: hash, src
+            len = 6;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[4] );
+            break;
+
+        case 59: // yield_frames
+            len = 2;
+            break;
+
+        case 65: // addi: dest, src, 16 bit immediate
+            len = 5;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_write( v, op[0] ) && _vm_b_verify_reg( v, op[1] );
+            break;
+
+        case 66: case 67: // pix_add, pix_sub: attr, src, index x, index y, obj
+            len = 6;
+            if( remaining < len ) break;
+            ok = _vm_b_verify_reg( v, op[1] ) &&
+                 _vm_b_verify_reg( v, op[2] ) &&
+                 _vm_b_verify_reg( v, op[3] );
+            break;
+
+        default:
+            // trap, or an opcode this VM doesn't have
+            return 0;
+    }
+
+    if( !ok || ( remaining < len ) ){
+
+        return 0;
+    }
+
+    return len;
+}
+
+static int8_t _vm_i8_verify_image( vm_verify_t *v, uint8_t *stream, uint16_t len, vm_state_t *state ){
+
+    v->code          = stream + state->code_start;
+    v->code_len      = state->data_start - sizeof(uint32_t) - state->code_start;
+    v->data          = (int32_t *)( stream + state->data_start );
+    v->data_count    = state->data_count;
+    v->pix_obj_count = state->pix_obj_count;
+    v->array_size_regs = state->array_size_regs;
+
+    // data segment must fit in the image, and every
+    // register address has to fit in an operand byte.
+    if( ( ( state->data_start + state->data_len ) > len ) ||
+        ( v->data_count > 256 ) ||
+        ( v->code_len > VM_MAX_IMAGE_SIZE ) ){
+
+        return VM_STATUS_ERR_VERIFY_FAILED;
+    }
+
+    // published vars can be written over catbus
+    for( uint8_t i = 0; i < state->publish_count; i++ ){
+
+        vm_publish_t publish;
+        memcpy( &publish, stream + state->publish_start + ( i * sizeof(vm_publish_t) ), sizeof(publish) );
+
+        if( publish.addr >= v->data_count ){
+
+            return VM_STATUS_ERR_VERIFY_FAILED;
+        }
+
+        v->written[publish.addr / 8] |= ( 1 << ( publish.addr % 8 ) );
+    }
+
+    for( v->pass = VERIFY_PASS_DECODE; v->pass <= VERIFY_PASS_TARGETS; v->pass++ ){
+
+        uint16_t offset = 0;
+        uint8_t opcode = 0xff;
+
+        while( offset < v->code_len ){
+
+            // the code segment is zero padded to 32 bits
+            // after the last instruction.
+            if( _vm_b_is_terminator( opcode ) &&
+                _vm_b_is_padding( v->code + offset, v->code_len - offset ) ){
+
+                break;
+            }
+
+            if( v->pass == VERIFY_PASS_DECODE ){
+
+                v->starts[offset / 8] |= ( 1 << ( offset % 8 ) );
+            }
+
+            opcode = v->code[offset];
+            uint8_t ins_len = _vm_u8_verify_ins( v, v->code + offset, v->code_len - offset );
+
+            if( ins_len == 0 ){
+
+                state->verify_offset = offset;
+
+                return VM_STATUS_ERR_VERIFY_FAILED;
+            }
+
+            offset += ins_len;
+        }
+
+        // execution must not run off the end of the code
+        if( !_vm_b_is_terminator( opcode ) ){
+
+            state->verify_offset = offset;
+
+            return VM_STATUS_ERR_VERIFY_FAILED;
+        }
+    }
+
+    // entry points
+    if( !_vm_b_is_start( v, state->init_start ) ||
+        !_vm_b_is_start( v, state->loop_start ) ){
+
+        return VM_STATUS_ERR_VERIFY_FAILED;
+    }
+
+    state->verified = TRUE;
+
+    return VM_STATUS_OK;
+}
+
+static int8_t _vm_i8_verify( uint8_t *stream, uint16_t len, vm_state_t *state ){
+
+    // the verifier state is too large for the stack on
+    // some targets, so it only exists while verifying.
+    mem_handle_t h = mem2_h_alloc( sizeof(vm_verify_t) );
+
+    if( h < 0 ){
+
+        return VM_STATUS_ERR_NO_MEMORY;
+    }
+
+    vm_verify_t *v = mem2_vp_get_ptr( h );
+    memset( v, 0, sizeof(vm_verify_t) );
+
+    int8_t status = _vm_i8_verify_image( v, stream, len, state );
+
+    mem2_v_free( h );
+
+    return status;
+}
+
+
 int8_t vm_i8_load_program(
     uint8_t flags,
     uint8_t *stream,
@@ -1462,6 +2343,13 @@ int8_t vm_i8_load_program(
 
     state->data_start += sizeof(uint32_t);
 
+    int8_t status = _vm_i8_verify( stream, len, state );
+
+    if( status < 0 ){
+
+        return status;
+    }
+
     // init RNG seed
     state->rng_seed = 1;
 
@@ -1471,15 +2359,20 @@ int8_t vm_i8_load_program(
 }
 
 
+// eval streams are generated on the device by the automaton compiler
+// and are not run through the verifier.
 int8_t vm_i8_eval( uint8_t *stream, int32_t *data, int32_t *result ){
 
-    uint64_t rng_seed = rnd_u64_get_seed();
+    vm_state_t state;
+    memset( &state, 0, sizeof(state) );
+
+    state.rng_seed = rnd_u64_get_seed();
 
     cycles = 0;
 
-    int8_t status = _vm_i8_run_stream( stream, 0, &rng_seed, data );
+    int8_t status = _vm_i8_run_stream( stream, 0, &state, data );
 
-    rnd_v_seed( rng_seed );
+    rnd_v_seed( state.rng_seed );
 
     *result = data[RETURN_VAL_ADDR];
 
@@ -1487,3 +2380,14 @@ int8_t vm_i8_eval( uint8_t *stream, int32_t *data, int32_t *result ){
 }
 
 
+#ifdef VM_ENABLE_PROFILE
+void vm_v_reset_profile( void ){
+
+    memset( &vm_profile, 0, sizeof(vm_profile) );
+}
+
+void vm_v_get_profile( vm_profile_t *profile ){
+
+    *profile = vm_profile;
+}
+#endif
@@ -24,11 +24,13 @@
 #define _VM_CORE_H
 
 #include <stdint.h>
+#include "bool.h"
 
 
-#define VM_ISA_VERSION              8
+#define VM_ISA_VERSION              10
 
 #define RETURN_VAL_ADDR             0
+#define YIELD_NEXT_OFFSET_ADDR      ( RETURN_VAL_ADDR + 1 )
 
 #define FILE_MAGIC      0x20205846  // 'FX  '
 #define PROGRAM_MAGIC   0x474f5250  // 'PROG'
@@ -38,6 +40,9 @@
 
 #define VM_MAX_CYCLES               32768
 
+// maximum nesting of function calls within a script
+#define VM_MAX_CALL_DEPTH           8
+
 #define DATA_LEN                    4
 
 
@@ -49,8 +54,12 @@
 #define VM_STATUS_ERR_BAD_CODE_MAGIC    -5
 #define VM_STATUS_ERR_BAD_DATA_MAGIC    -6
 #define VM_STATUS_ERR_BAD_FILE_HASH     -7
+#define VM_STATUS_ERR_VERIFY_FAILED     -8
+#define VM_STATUS_ERR_NOT_VERIFIED      -9
+#define VM_STATUS_ERR_NO_MEMORY         -10
 
 #define VM_STATUS_ERR_MAX_CYCLES        -30
+#define VM_STATUS_ERR_STACK_OVERFLOW    -31
 
 #define VM_STATUS_CODE_MISALIGN         -40
 #define VM_STATUS_DATA_MISALIGN         -41
@@ -78,6 +87,9 @@ typedef struct __attribute__((packed)){
     uint16_t loop_time;
     uint16_t fader_time;
     uint16_t max_cycles;
+    uint8_t max_call_depth;
+    uint16_t active_faders;
+    uint16_t max_fader_time;
 } vm_info_t;
 
 // note this needs to pad to 32 bit alignment!
@@ -138,6 +150,23 @@ typedef struct{
 
     uint16_t yield_next;
     uint16_t yield_frames;
+
+    // return addresses for function calls.
+    // this is kept across a yield, so a function
+    // can yield and resume where it left off.
+    uint8_t call_depth;
+    uint8_t max_call_depth;
+    uint16_t call_stack[VM_MAX_CALL_DEPTH];
+
+    // set by the load time bytecode check.
+    // the interpreter will only run verified code.
+    bool verified;
+    uint16_t verify_offset; // code offset of the first bad instruction
+
+    // registers holding array dimensions.
+    // the array opcodes trust these, so they
+    // cannot be changed from outside the VM.
+    uint8_t array_size_regs[256 / 8];
 } vm_state_t;
 
 int8_t vm_i8_run(
@@ -180,4 +209,16 @@ int8_t vm_i8_load_program(
 
 int8_t vm_i8_eval( uint8_t *stream, int32_t *data, int32_t *result );
 
+
+// opcode profiling.
+// only available when VM_ENABLE_PROFILE is defined,
+// this adds a counter increment to every dispatch.
+typedef struct{
+    uint32_t total_ops;
+    uint32_t opcodes[256];
+} vm_profile_t;
+
+void vm_v_reset_profile( void );
+void vm_v_get_profile( vm_profile_t *profile );
+
 #endif
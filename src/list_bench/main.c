@@ -0,0 +1,293 @@
+// <license>
+//
+//     This file is part of the Sapphire Operating System.
+//
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+//
+//
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// </license>
+
+/*
+
+Microbenchmark for list counts and sizes.
+
+Builds lists of 1, 8, 32 and 96 nodes of mixed sizes and reports:
+
+    count   - list_u8_count
+    size    - list_u16_size
+    walk    - counting the nodes and their sizes by walking the list,
+              which is how count and size used to be computed
+    push    - a list_v_insert_tail and list_ln_remove_tail pair
+
+Then runs random inserts and removes at the head, tail and middle of
+a list and checks the count and size against a walk after each one.
+The bench returns a non-zero exit code on a mismatch, so it can be
+used as a regression check in scripts.
+
+Usage:
+    list_bench [ops]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "system.h"
+#include "threading.h"
+#include "memory.h"
+#include "list.h"
+
+#define DEFAULT_OPS     100000
+
+#define MAX_NODES       96
+#define MAX_NODE_SIZE   48
+
+static const uint8_t lengths[] = { 1, 8, 32, MAX_NODES };
+#define N_LENGTHS       ( sizeof(lengths) / sizeof(lengths[0]) )
+
+
+static uint64_t get_ns( void ){
+
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void walk( list_t *list, uint16_t *count, uint16_t *size ){
+
+    *count = 0;
+    *size = 0;
+
+    list_node_t node = list->head;
+
+    while( node >= 0 ){
+
+        ( *count )++;
+        *size += list_u16_node_size( node );
+
+        node = list_ln_next( node );
+    }
+}
+
+static list_node_t make_node( void ){
+
+    return list_ln_create_node( 0, ( rand() % MAX_NODE_SIZE ) + 1 );
+}
+
+static void build( list_t *list, uint8_t length ){
+
+    list_v_init( list );
+
+    for( uint8_t i = 0; i < length; i++ ){
+
+        list_v_insert_tail( list, make_node() );
+    }
+}
+
+// keep the results live so the calls are not optimized out
+static volatile uint32_t sink;
+
+static double time_count( list_t *list, uint32_t ops ){
+
+    uint64_t start = get_ns();
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        sink += list_u8_count( list );
+    }
+
+    return (double)( get_ns() - start ) / ops;
+}
+
+static double time_size( list_t *list, uint32_t ops ){
+
+    uint64_t start = get_ns();
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        sink += list_u16_size( list );
+    }
+
+    return (double)( get_ns() - start ) / ops;
+}
+
+static double time_walk( list_t *list, uint32_t ops ){
+
+    uint64_t start = get_ns();
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        uint16_t count, size;
+        walk( list, &count, &size );
+
+        sink += count + size;
+    }
+
+    return (double)( get_ns() - start ) / ops;
+}
+
+static double time_push( list_t *list, uint32_t ops ){
+
+    list_node_t node = make_node();
+
+    uint64_t start = get_ns();
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        list_v_insert_tail( list, node );
+        node = list_ln_remove_tail( list );
+    }
+
+    uint64_t elapsed = get_ns() - start;
+
+    list_v_release_node( node );
+
+    return (double)elapsed / ops;
+}
+
+static uint32_t check( list_t *list ){
+
+    uint16_t count, size;
+    walk( list, &count, &size );
+
+    if( ( list_u8_count( list ) != count ) ||
+        ( list_u16_size( list ) != size ) ){
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// random inserts and removes, checking count and size after each one
+static uint32_t run_random( uint32_t ops ){
+
+    uint32_t errors = 0;
+    list_t list;
+    list_v_init( &list );
+
+    for( uint32_t i = 0; i < ops; i++ ){
+
+        uint8_t count = list_u8_count( &list );
+        uint8_t op = rand() % 4;
+
+        if( ( count < MAX_NODES ) && ( ( count == 0 ) || ( op < 2 ) ) ){
+
+            list_node_t node = make_node();
+
+            if( node < 0 ){
+
+                errors++;
+                break;
+            }
+
+            if( count == 0 ){
+
+                list_v_insert_head( &list, node );
+            }
+            else if( op == 0 ){
+
+                list_v_insert_after( &list, list_ln_index( &list, rand() % count ), node );
+            }
+            else{
+
+                list_v_insert_head( &list, node );
+            }
+        }
+        else if( op == 2 ){
+
+            list_node_t node = list_ln_index( &list, rand() % count );
+
+            list_v_remove( &list, node );
+            list_v_release_node( node );
+        }
+        else{
+
+            list_v_release_node( list_ln_remove_tail( &list ) );
+        }
+
+        errors += check( &list );
+
+        mem2_v_collect_garbage();
+    }
+
+    list_v_destroy( &list );
+
+    errors += check( &list );
+
+    return errors;
+}
+
+int main( int argc, char *argv[] ){
+
+    uint32_t ops = DEFAULT_OPS;
+
+    if( argc > 1 ){
+
+        ops = strtoul( argv[1], 0, 0 );
+
+        if( ops == 0 ){
+
+            ops = 1;
+        }
+    }
+
+    srand( 0 );
+
+    mem2_v_init();
+
+    printf( "Ops:     %u\n\n", ops );
+    printf( "nodes  count ns/op  size ns/op  walk ns/op  push ns/op\n" );
+
+    uint32_t errors = 0;
+
+    for( uint8_t i = 0; i < N_LENGTHS; i++ ){
+
+        list_t list;
+        build( &list, lengths[i] );
+
+        errors += check( &list );
+
+        double count = time_count( &list, ops );
+        double size = time_size( &list, ops );
+        double walk = time_walk( &list, ops );
+        double push = time_push( &list, ops );
+
+        errors += check( &list );
+
+        printf( "%5u %12.1f %11.1f %11.1f %11.1f\n", lengths[i], count, size, walk, push );
+
+        list_v_destroy( &list );
+
+        while( mem2_u16_get_dirty() >= MEM_DEFRAG_THRESHOLD ){
+
+            mem2_v_collect_garbage();
+        }
+    }
+
+    errors += run_random( ops );
+
+    if( errors > 0 ){
+
+        printf( "FAIL: %u mismatched counts or sizes\n", errors );
+        return 1;
+    }
+
+    return 0;
+}
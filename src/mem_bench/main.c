@@ -0,0 +1,389 @@
+// <license>
+//
+//     This file is part of the Sapphire Operating System.
+//
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+//
+//
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// </license>
+
+/*
+
+Stress benchmark for the mem2 allocator.
+
+Keeps up to MAX_LIVE objects allocated and randomly allocates, frees
+and reallocates them. Every object is filled with a pattern and
+checked before it is freed, so a block that was moved or handed out
+twice shows up as an error. The garbage collector runs between
+operations, the way the scheduler would run it, and is timed
+separately from the allocations. The most bytes moved by a single
+garbage collector call is reported as well, since that sets how long
+interrupts are held off on the targets.
+
+Two workloads are run:
+
+    nodes   - only list node sized objects, which fit in the pools
+    mixed   - nodes plus larger buffers, up to MAX_BUF_SIZE bytes
+
+Before the workloads, the bench allocates until it runs out of
+handles and checks that every handle can be used.
+
+The bench returns a non-zero exit code on any error, so it can be
+used as a regression check in scripts.
+
+Usage:
+    mem_bench [ops]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "system.h"
+#include "threading.h"
+#include "memory.h"
+
+#define DEFAULT_OPS     100000
+
+#define MAX_LIVE        96
+#define MAX_BUF_SIZE    256
+
+// list node sizes seen on the targets:
+// catbus send entries, kv batches and thread states
+static const uint16_t node_sizes[] = { 8, 18, 20, 24, 40, 64 };
+#define N_NODE_SIZES    ( sizeof(node_sizes) / sizeof(node_sizes[0]) )
+
+typedef struct{
+    mem_handle_t handle;
+    uint16_t size;
+    uint8_t pattern;
+} live_t;
+
+static live_t live[MAX_LIVE];
+
+typedef struct{
+    uint64_t alloc_ns;
+    uint32_t allocs;
+    uint64_t free_ns;
+    uint32_t frees;
+    uint32_t reallocs;
+    uint64_t gc_ns;
+    uint32_t fails;
+    uint32_t errors;
+    uint32_t frag_total;
+    uint32_t frag_samples;
+    uint16_t peak_pool_used;
+} results_t;
+
+
+static uint64_t get_ns( void ){
+
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill( live_t *l ){
+
+    memset( mem2_vp_get_ptr( l->handle ), l->pattern, l->size );
+}
+
+static bool check( live_t *l ){
+
+    if( !mem2_b_verify_handle( l->handle ) ){
+
+        return FALSE;
+    }
+
+    if( mem2_u16_get_size( l->handle ) != l->size ){
+
+        return FALSE;
+    }
+
+    uint8_t *ptr = mem2_vp_get_ptr( l->handle );
+
+    for( uint16_t i = 0; i < l->size; i++ ){
+
+        if( ptr[i] != l->pattern ){
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static uint16_t random_size( bool mixed ){
+
+    if( mixed && ( ( rand() % 4 ) == 0 ) ){
+
+        return ( rand() % MAX_BUF_SIZE ) + 1;
+    }
+
+    return node_sizes[rand() % N_NODE_SIZES];
+}
+
+// run garbage collector steps until the dirty space is reclaimed
+static void collect_all( void ){
+
+    while( mem2_u16_get_dirty() >= MEM_DEFRAG_THRESHOLD ){
+
+        mem2_v_collect_garbage();
+    }
+}
+
+static void sample( results_t *results ){
+
+    mem_rt_data_t rt_data;
+    mem2_v_get_rt_data( &rt_data );
+
+    results->frag_total += rt_data.fragmentation;
+    results->frag_samples++;
+
+    if( rt_data.pool_used > results->peak_pool_used ){
+
+        results->peak_pool_used = rt_data.pool_used;
+    }
+}
+
+static void free_all( results_t *results ){
+
+    for( uint16_t i = 0; i < MAX_LIVE; i++ ){
+
+        if( live[i].handle < 0 ){
+
+            continue;
+        }
+
+        if( !check( &live[i] ) ){
+
+            results->errors++;
+        }
+
+        mem2_v_free( live[i].handle );
+        live[i].handle = -1;
+    }
+
+    collect_all();
+}
+
+static void run( uint32_t ops, bool mixed, results_t *results ){
+
+    memset( results, 0, sizeof(results_t) );
+
+    for( uint32_t op = 0; op < ops; op++ ){
+
+        live_t *l = &live[rand() % MAX_LIVE];
+
+        if( l->handle < 0 ){
+
+            l->size = random_size( mixed );
+            l->pattern = op;
+
+            uint64_t start = get_ns();
+
+            l->handle = mem2_h_alloc( l->size );
+
+            results->alloc_ns += get_ns() - start;
+            results->allocs++;
+
+            if( l->handle < 0 ){
+
+                results->fails++;
+                continue;
+            }
+
+            fill( l );
+        }
+        else if( ( rand() % 8 ) == 0 ){
+
+            if( !check( l ) ){
+
+                results->errors++;
+            }
+
+            uint16_t old_size = l->size;
+            l->size = random_size( mixed );
+
+            if( mem2_i8_realloc( l->handle, l->size ) < 0 ){
+
+                l->size = old_size;
+                results->fails++;
+                continue;
+            }
+
+            // the data that fit should have been moved
+            uint8_t *ptr = mem2_vp_get_ptr( l->handle );
+            uint16_t kept = old_size < l->size ? old_size : l->size;
+
+            for( uint16_t i = 0; i < kept; i++ ){
+
+                if( ptr[i] != l->pattern ){
+
+                    results->errors++;
+                    break;
+                }
+            }
+
+            fill( l );
+
+            results->reallocs++;
+        }
+        else{
+
+            if( !check( l ) ){
+
+                results->errors++;
+            }
+
+            uint64_t start = get_ns();
+
+            mem2_v_free( l->handle );
+
+            results->free_ns += get_ns() - start;
+            results->frees++;
+
+            l->handle = -1;
+        }
+
+        sample( results );
+
+        uint64_t start = get_ns();
+
+        mem2_v_collect_garbage();
+
+        results->gc_ns += get_ns() - start;
+    }
+
+    free_all( results );
+}
+
+// allocate until out of handles, every one should be usable
+static uint32_t check_handles( void ){
+
+    uint32_t errors = 0;
+    mem_handle_t h[MAX_MEM_HANDLES];
+    uint16_t count = 0;
+
+    while( count < MAX_MEM_HANDLES ){
+
+        h[count] = mem2_h_alloc( 1 );
+
+        if( h[count] < 0 ){
+
+            break;
+        }
+
+        *(uint8_t *)mem2_vp_get_ptr( h[count] ) = count;
+        count++;
+    }
+
+    for( uint16_t i = 0; i < count; i++ ){
+
+        if( *(uint8_t *)mem2_vp_get_ptr( h[i] ) != (uint8_t)i ){
+
+            errors++;
+        }
+
+        mem2_v_free( h[i] );
+    }
+
+    collect_all();
+
+    mem_rt_data_t rt_data;
+    mem2_v_get_rt_data( &rt_data );
+
+    if( rt_data.handles_used != 0 ){
+
+        errors++;
+    }
+
+    printf( "Handles: %u\n\n", count );
+
+    return errors;
+}
+
+int main( int argc, char *argv[] ){
+
+    uint32_t ops = DEFAULT_OPS;
+
+    if( argc > 1 ){
+
+        ops = strtoul( argv[1], 0, 0 );
+
+        if( ops == 0 ){
+
+            ops = 1;
+        }
+    }
+
+    srand( 0 );
+
+    mem2_v_init();
+
+    for( uint16_t i = 0; i < MAX_LIVE; i++ ){
+
+        live[i].handle = -1;
+    }
+
+    printf( "Ops:     %u\n", ops );
+
+    uint32_t errors = check_handles();
+
+    printf( "workload  alloc ns  free ns  gc ns/op  gc max B   allocs  reallocs  fails  frag %%  pool peak\n" );
+
+    for( uint8_t i = 0; i < 2; i++ ){
+
+        bool mixed = ( i == 1 );
+        results_t results;
+
+        run( ops, mixed, &results );
+
+        mem_rt_data_t rt_data;
+        mem2_v_get_rt_data( &rt_data );
+
+        printf( "%-8s %9.1f %8.1f %9.1f %9u %8u %9u %6u %7.1f %10u\n",
+                mixed ? "mixed" : "nodes",
+                results.allocs ? (double)results.alloc_ns / results.allocs : 0.0,
+                results.frees ? (double)results.free_ns / results.frees : 0.0,
+                (double)results.gc_ns / ops,
+                rt_data.gc_max_moved,
+                results.allocs,
+                results.reallocs,
+                results.fails,
+                results.frag_samples ? (double)results.frag_total / results.frag_samples : 0.0,
+                results.peak_pool_used );
+
+        errors += results.errors;
+    }
+
+    mem_rt_data_t rt_data;
+    mem2_v_get_rt_data( &rt_data );
+
+    printf( "\nPool fails: %u GC passes: %u GC bytes moved: %u\n",
+            rt_data.pool_fails, rt_data.gc_passes, rt_data.gc_bytes_moved );
+
+    if( errors > 0 ){
+
+        printf( "FAIL: %u errors\n", errors );
+        return 1;
+    }
+
+    return 0;
+}
@@ -44,6 +44,7 @@ typedef struct{
 } catbus_link_state_t;
 #define CATBUS_LINK_FLAGS_SOURCE        0x01
 #define CATBUS_LINK_FLAGS_DEST          0x04
+#define CATBUS_LINK_FLAGS_MULTI_DATA    CATBUS_MSG_LINK_FLAG_MULTI_DATA
 #define CATBUS_LINK_FLAGS_DELETE        0x80
 
 typedef struct{
@@ -51,8 +52,21 @@ typedef struct{
     catbus_hash_t32 source_hash;
     catbus_hash_t32 dest_hash;
     int8_t ttl;
+    uint8_t flags;
 } catbus_send_data_entry_t;
 
+// kvsend vfile record.
+// this is the send list entry without the flags, which is the layout
+// clients already parse.  entries are copied into it instead of being
+// flattened from the list, so the entry can change without changing
+// the file.
+typedef struct{
+    sock_addr_t raddr;
+    catbus_hash_t32 source_hash;
+    catbus_hash_t32 dest_hash;
+    int8_t ttl;
+} catbus_send_data_info_t;
+
 typedef struct{
     sock_addr_t raddr;
     catbus_hash_t32 dest_hash;
@@ -61,12 +75,58 @@ typedef struct{
     int8_t ttl;
 } catbus_receive_data_entry_t;
 
+typedef struct __attribute__((packed)){
+    uint16_t size;
+    uint16_t count;
+    uint16_t deleted;
+    uint16_t max_probe;
+    uint16_t rebuilds;
+    uint32_t lookups;
+    uint32_t probes;
+} catbus_index_stats_t;
+
 static bool link_enable;
 static list_t links;
 static list_t send_list;
 static list_t receive_cache;
 static uint16_t sequence;
 static uint8_t send_list_locked;
+
+// key hashes waiting for the publisher.
+// publishing a key only marks it pending, the publisher reads the
+// current value when it sends, so several publishes of the same key
+// before the publisher runs go out as one.
+// if the set is full, the key is sent right away instead.
+#define CATBUS_PUBLISH_PENDING_MAX      32
+
+static catbus_hash_t32 publish_pending[CATBUS_PUBLISH_PENDING_MAX];
+static uint8_t publish_pending_count;
+static uint32_t publish_pending_start;
+
+typedef struct{
+    mem_handle_t targets;
+    uint16_t target_count;
+    uint16_t target_index;
+    uint32_t start;
+    uint16_t sequence;
+    uint8_t count;
+    catbus_hash_t32 hashes[CATBUS_PUBLISH_PENDING_MAX];
+} publish_thread_state_t;
+
+// publish stats
+static uint32_t publish_msgs;
+static uint32_t publish_items;
+static uint16_t publish_latency;
+static uint16_t publish_latency_max;
+static uint16_t publish_overflows;
+
+KV_SECTION_META kv_meta_t catbus_publish_kv[] = {
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY, &publish_msgs,          0, "catbus_publish_msgs" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY, &publish_items,         0, "catbus_publish_items" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY, &publish_latency,       0, "catbus_publish_latency" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY, &publish_latency_max,   0, "catbus_publish_latency_max" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY, &publish_overflows,     0, "catbus_publish_overflows" },
+};
 #endif
 
 static socket_t sock;
@@ -80,6 +140,9 @@ static catbus_hash_t32 meta_tag_hashes[CATBUS_QUERY_LEN];
 
 PT_THREAD( catbus_server_thread( pt_t *pt, void *state ) );
 PT_THREAD( catbus_announce_thread( pt_t *pt, void *state ) );
+#ifdef ENABLE_CATBUS_LINK
+PT_THREAD( publish_thread( pt_t *pt, publish_thread_state_t *state ) );
+#endif
 
 
 // static uint32_t test_array[8];
@@ -156,26 +219,57 @@ static uint16_t sendlist_vfile_handler(
     uint16_t len )
 {
 
+    uint16_t ret_val = 0;
+
     // the pos and len values are already bounds checked by the FS driver
     switch( op ){
 
         case FS_VFILE_OP_READ:
-            list_u16_flatten( &send_list, pos, ptr, len );
+
+            while( len > 0 ){
+
+                uint16_t index = pos / sizeof(catbus_send_data_info_t);
+
+                catbus_send_data_entry_t *entry = list_vp_get_data( list_ln_index( &send_list, index ) );
+
+                catbus_send_data_info_t info;
+                info.raddr          = entry->raddr;
+                info.source_hash    = entry->source_hash;
+                info.dest_hash      = entry->dest_hash;
+                info.ttl            = entry->ttl;
+
+                uint16_t offset = pos - ( index * sizeof(info) );
+                uint16_t copy_len = sizeof(info) - offset;
+
+                if( copy_len > len ){
+
+                    copy_len = len;
+                }
+
+                memcpy( ptr, (uint8_t *)&info + offset, copy_len );
+
+                ptr += copy_len;
+                len -= copy_len;
+                pos += copy_len;
+                ret_val += copy_len;
+            }
+
             break;
 
         case FS_VFILE_OP_SIZE:
-            len = list_u16_size( &send_list );
+            ret_val = ( list_u16_size( &send_list ) / sizeof(catbus_send_data_entry_t) ) *
+                      sizeof(catbus_send_data_info_t);
             break;
 
         case FS_VFILE_OP_DELETE:
             break;
 
         default:
-            len = 0;
+            ret_val = 0;
             break;
     }
 
-    return len;
+    return ret_val;
 }
 
 static uint16_t receive_cache_vfile_handler(
@@ -206,6 +300,397 @@ static uint16_t receive_cache_vfile_handler(
 
     return len;
 }
+
+/*
+
+Hash indexes over the link tables.
+
+The send list, receive cache and links are lists, which the vfiles
+flatten as is. Each index is an open addressed table of list node
+handles in mem2, so lookups don't walk the whole list. The list stays
+the owner of the entries, the index only points at them.
+
+Deleted slots are marked so probe chains stay intact, and the table
+is rebuilt when live plus deleted slots pass 3/4 of its size.
+
+Lookups match on the full entry, so an index can hold several entries
+with the same key hash. send_source_index relies on that to find
+every destination for a source hash.
+
+*/
+
+#define CATBUS_INDEX_EMPTY          -1
+#define CATBUS_INDEX_DELETED        -2
+#define CATBUS_INDEX_MIN_SIZE       8
+#define CATBUS_INDEX_START          0xffff
+
+// entries expired per pass of the announce thread
+#define CATBUS_EXPIRE_BATCH         8
+
+typedef uint32_t ( *catbus_index_hash_func_t )( list_node_t ln );
+typedef bool ( *catbus_index_match_func_t )( list_node_t ln, const void *key );
+
+typedef struct{
+    mem_handle_t h;
+    catbus_index_hash_func_t hash_func;
+    catbus_index_stats_t stats;
+} catbus_index_t;
+
+static catbus_index_t send_index;
+static catbus_index_t send_source_index;
+static catbus_index_t receive_index;
+static catbus_index_t links_index;
+
+static uint32_t _catbus_u32_mix( uint32_t hash, uint32_t value ){
+
+    hash ^= value;
+    hash *= 0x01000193;
+    hash ^= hash >> 15;
+
+    return hash;
+}
+
+static uint32_t _catbus_u32_raddr_hash( uint32_t hash, sock_addr_t *raddr ){
+
+    hash = _catbus_u32_mix( hash, ip_u32_to_int( raddr->ipaddr ) );
+
+    return _catbus_u32_mix( hash, raddr->port );
+}
+
+static void _catbus_v_index_init( catbus_index_t *index, catbus_index_hash_func_t hash_func ){
+
+    memset( index, 0, sizeof(catbus_index_t) );
+
+    index->h = -1;
+    index->hash_func = hash_func;
+}
+
+static void _catbus_v_index_place( list_node_t *slots, uint16_t size, uint32_t hash, list_node_t ln ){
+
+    uint16_t mask = size - 1;
+    uint16_t pos = hash & mask;
+
+    while( slots[pos] >= 0 ){
+
+        pos = ( pos + 1 ) & mask;
+    }
+
+    slots[pos] = ln;
+}
+
+// rebuild the table at a size that fits count entries at half load
+static int8_t _catbus_i8_index_rebuild( catbus_index_t *index, uint16_t count ){
+
+    uint16_t size = CATBUS_INDEX_MIN_SIZE;
+
+    while( size < ( count * 2 ) ){
+
+        size *= 2;
+    }
+
+    mem_handle_t h = mem2_h_alloc2( size * sizeof(list_node_t), MEM_TYPE_CATBUS_INDEX );
+
+    if( h < 0 ){
+
+        return -1;
+    }
+
+    list_node_t *slots = mem2_vp_get_ptr( h );
+
+    for( uint16_t i = 0; i < size; i++ ){
+
+        slots[i] = CATBUS_INDEX_EMPTY;
+    }
+
+    if( index->h >= 0 ){
+
+        list_node_t *old_slots = mem2_vp_get_ptr( index->h );
+
+        for( uint16_t i = 0; i < index->stats.size; i++ ){
+
+            if( old_slots[i] >= 0 ){
+
+                _catbus_v_index_place( slots, size, index->hash_func( old_slots[i] ), old_slots[i] );
+            }
+        }
+
+        mem2_v_free( index->h );
+    }
+
+    index->h = h;
+    index->stats.size = size;
+    index->stats.deleted = 0;
+    index->stats.rebuilds++;
+
+    return 0;
+}
+
+static int8_t _catbus_i8_index_insert( catbus_index_t *index, list_node_t ln ){
+
+    uint16_t used = index->stats.count + index->stats.deleted + 1;
+
+    if( ( index->h < 0 ) || ( ( used * 4 ) > ( index->stats.size * 3 ) ) ){
+
+        if( _catbus_i8_index_rebuild( index, index->stats.count + 1 ) < 0 ){
+
+            return -1;
+        }
+    }
+
+    list_node_t *slots = mem2_vp_get_ptr( index->h );
+    uint16_t mask = index->stats.size - 1;
+    uint16_t pos = index->hash_func( ln ) & mask;
+
+    // reuse the first deleted slot in the chain
+    while( slots[pos] >= 0 ){
+
+        pos = ( pos + 1 ) & mask;
+    }
+
+    if( slots[pos] == CATBUS_INDEX_DELETED ){
+
+        index->stats.deleted--;
+    }
+
+    slots[pos] = ln;
+    index->stats.count++;
+
+    return 0;
+}
+
+// must be called before the node is released, the hash comes from its data
+static void _catbus_v_index_remove( catbus_index_t *index, list_node_t ln ){
+
+    if( index->h < 0 ){
+
+        return;
+    }
+
+    list_node_t *slots = mem2_vp_get_ptr( index->h );
+    uint16_t mask = index->stats.size - 1;
+    uint16_t pos = index->hash_func( ln ) & mask;
+
+    for( uint16_t i = 0; i < index->stats.size; i++ ){
+
+        if( slots[pos] == ln ){
+
+            slots[pos] = CATBUS_INDEX_DELETED;
+            index->stats.count--;
+            index->stats.deleted++;
+
+            return;
+        }
+
+        if( slots[pos] == CATBUS_INDEX_EMPTY ){
+
+            break;
+        }
+
+        pos = ( pos + 1 ) & mask;
+    }
+}
+
+// find the next entry matching key.
+// set *pos to CATBUS_INDEX_START for the first match, and pass it
+// back unchanged to get the next one.
+static list_node_t _catbus_ln_index_lookup( 
+    catbus_index_t *index, 
+    uint32_t hash, 
+    uint16_t *pos, 
+    catbus_index_match_func_t match, 
+    const void *key ){
+
+    if( index->h < 0 ){
+
+        return -1;
+    }
+
+    list_node_t *slots = mem2_vp_get_ptr( index->h );
+    uint16_t mask = index->stats.size - 1;
+
+    if( *pos == CATBUS_INDEX_START ){
+
+        *pos = hash & mask;
+        index->stats.lookups++;
+    }
+    else{
+
+        *pos = ( *pos + 1 ) & mask;
+    }
+
+    for( uint16_t probes = 1; probes <= index->stats.size; probes++ ){
+
+        index->stats.probes++;
+
+        list_node_t ln = slots[*pos];
+
+        if( ln == CATBUS_INDEX_EMPTY ){
+
+            break;
+        }
+
+        if( probes > index->stats.max_probe ){
+
+            index->stats.max_probe = probes;
+        }
+
+        if( ( ln >= 0 ) && match( ln, key ) ){
+
+            return ln;
+        }
+
+        *pos = ( *pos + 1 ) & mask;
+    }
+
+    return -1;
+}
+
+
+// send list: keyed by source, dest and remote address
+typedef struct{
+    catbus_hash_t32 source_hash;
+    catbus_hash_t32 dest_hash;
+    sock_addr_t *raddr;
+} catbus_send_key_t;
+
+static uint32_t _catbus_u32_send_hash( catbus_hash_t32 source_hash, catbus_hash_t32 dest_hash, sock_addr_t *raddr ){
+
+    uint32_t hash = _catbus_u32_mix( source_hash, dest_hash );
+
+    return _catbus_u32_raddr_hash( hash, raddr );
+}
+
+static uint32_t _catbus_u32_send_node_hash( list_node_t ln ){
+
+    catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+
+    return _catbus_u32_send_hash( entry->source_hash, entry->dest_hash, &entry->raddr );
+}
+
+static bool _catbus_b_send_match( list_node_t ln, const void *key ){
+
+    catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+    const catbus_send_key_t *send_key = key;
+
+    return ( entry->source_hash == send_key->source_hash ) && 
+           ( entry->dest_hash == send_key->dest_hash ) && 
+           ( memcmp( send_key->raddr, &entry->raddr, sizeof(sock_addr_t) ) == 0 );
+}
+
+// send list by source only, for the publisher
+static uint32_t _catbus_u32_send_source_node_hash( list_node_t ln ){
+
+    catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+
+    return _catbus_u32_mix( entry->source_hash, 0 );
+}
+
+static bool _catbus_b_send_source_match( list_node_t ln, const void *key ){
+
+    catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+
+    return entry->source_hash == *(const catbus_hash_t32 *)key;
+}
+
+// receive cache: keyed by remote address and dest
+typedef struct{
+    catbus_hash_t32 dest_hash;
+    sock_addr_t *raddr;
+} catbus_receive_key_t;
+
+static uint32_t _catbus_u32_receive_hash( catbus_hash_t32 dest_hash, sock_addr_t *raddr ){
+
+    return _catbus_u32_raddr_hash( _catbus_u32_mix( dest_hash, 0 ), raddr );
+}
+
+static uint32_t _catbus_u32_receive_node_hash( list_node_t ln ){
+
+    catbus_receive_data_entry_t *entry = (catbus_receive_data_entry_t *)list_vp_get_data( ln );
+
+    return _catbus_u32_receive_hash( entry->dest_hash, &entry->raddr );
+}
+
+static bool _catbus_b_receive_match( list_node_t ln, const void *key ){
+
+    catbus_receive_data_entry_t *entry = (catbus_receive_data_entry_t *)list_vp_get_data( ln );
+    const catbus_receive_key_t *receive_key = key;
+
+    return ip_b_addr_compare( entry->raddr.ipaddr, receive_key->raddr->ipaddr ) &&
+           ( entry->raddr.port == receive_key->raddr->port ) &&
+           ( entry->dest_hash == receive_key->dest_hash );
+}
+
+// links: keyed by source and dest, matched on the whole link
+static uint32_t _catbus_u32_link_hash( catbus_hash_t32 source_hash, catbus_hash_t32 dest_hash ){
+
+    return _catbus_u32_mix( source_hash, dest_hash );
+}
+
+static uint32_t _catbus_u32_link_node_hash( list_node_t ln ){
+
+    catbus_link_state_t *state = list_vp_get_data( ln );
+
+    return _catbus_u32_link_hash( state->source_hash, state->dest_hash );
+}
+
+static bool _catbus_b_compare_links( catbus_link_state_t *state, catbus_link_t link );
+
+static bool _catbus_b_link_match( list_node_t ln, const void *key ){
+
+    return _catbus_b_compare_links( (catbus_link_state_t *)key, ln );
+}
+
+static void _catbus_v_remove_send_entry( list_node_t ln ){
+
+    _catbus_v_index_remove( &send_index, ln );
+    _catbus_v_index_remove( &send_source_index, ln );
+
+    list_v_remove( &send_list, ln );
+    list_v_release_node( ln );
+}
+
+static void _catbus_v_remove_receive_entry( list_node_t ln ){
+
+    _catbus_v_index_remove( &receive_index, ln );
+
+    list_v_remove( &receive_cache, ln );
+    list_v_release_node( ln );
+}
+
+static uint16_t index_vfile_handler(
+    vfile_op_t8 op,
+    uint32_t pos,
+    void *ptr,
+    uint16_t len )
+{
+
+    catbus_index_stats_t stats[4];
+    stats[0] = send_index.stats;
+    stats[1] = send_source_index.stats;
+    stats[2] = receive_index.stats;
+    stats[3] = links_index.stats;
+
+    // the pos and len values are already bounds checked by the FS driver
+    switch( op ){
+
+        case FS_VFILE_OP_READ:
+            memcpy( ptr, (uint8_t *)stats + pos, len );
+            break;
+
+        case FS_VFILE_OP_SIZE:
+            len = sizeof(stats);
+            break;
+
+        case FS_VFILE_OP_DELETE:
+            break;
+
+        default:
+            len = 0;
+            break;
+    }
+
+    return len;
+}
 #endif
 
 static void _catbus_v_setup_tag_hashes( void ){
@@ -348,9 +833,20 @@ void catbus_v_init( void ){
         list_v_init( &send_list );
         list_v_init( &receive_cache );
 
+        _catbus_v_index_init( &send_index, _catbus_u32_send_node_hash );
+        _catbus_v_index_init( &send_source_index, _catbus_u32_send_source_node_hash );
+        _catbus_v_index_init( &receive_index, _catbus_u32_receive_node_hash );
+        _catbus_v_index_init( &links_index, _catbus_u32_link_node_hash );
+
         fs_f_create_virtual( PSTR("kvlinks"), links_vfile_handler );
         fs_f_create_virtual( PSTR("kvrxcache"), receive_cache_vfile_handler );
         fs_f_create_virtual( PSTR("kvsend"), sendlist_vfile_handler );
+        fs_f_create_virtual( PSTR("kvindex"), index_vfile_handler );
+
+        thread_t_create( THREAD_CAST(publish_thread),
+                         PSTR("catbus_publish"),
+                         0,
+                         sizeof(publish_thread_state_t) );
     }
     #endif
 
@@ -497,26 +993,30 @@ static void _catbus_v_send_announce( sock_addr_t *raddr, uint32_t discovery_id )
 }
 
 #ifdef ENABLE_CATBUS_LINK
-static void _catbus_v_add_to_send_list( catbus_hash_t32 source_hash, catbus_hash_t32 dest_hash, sock_addr_t *raddr ){
+static void _catbus_v_add_to_send_list( catbus_hash_t32 source_hash, catbus_hash_t32 dest_hash, sock_addr_t *raddr, uint8_t flags ){
 
     // check if entry already exists
-    list_node_t ln = send_list.head;
+    catbus_send_key_t key;
+    key.source_hash = source_hash;
+    key.dest_hash   = dest_hash;
+    key.raddr       = raddr;
 
-    while( ln >= 0 ){
+    uint16_t pos = CATBUS_INDEX_START;
+    list_node_t ln = _catbus_ln_index_lookup( &send_index, 
+                                              _catbus_u32_send_hash( source_hash, dest_hash, raddr ),
+                                              &pos,
+                                              _catbus_b_send_match,
+                                              &key );
 
-        catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
-
-        if( ( entry->source_hash == source_hash ) && 
-            ( entry->dest_hash == dest_hash ) && 
-            ( memcmp( raddr, &entry->raddr, sizeof(sock_addr_t) ) == 0 ) ){
+    if( ln >= 0 ){
 
-            // reset TTL
-            entry->ttl = 32;
+        catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
 
-            return;
-        }
+        // reset TTL
+        entry->ttl = 32;
+        entry->flags = flags;
 
-        ln = list_ln_next( ln );
+        return;
     }
 
     // create new entry
@@ -525,6 +1025,7 @@ static void _catbus_v_add_to_send_list( catbus_hash_t32 source_hash, catbus_hash
     entry.dest_hash     = dest_hash;
     entry.raddr         = *raddr;
     entry.ttl           = 32;
+    entry.flags         = flags;
 
     ln = list_ln_create_node2( &entry, sizeof(entry), MEM_TYPE_CATBUS_SEND );
 
@@ -533,8 +1034,25 @@ static void _catbus_v_add_to_send_list( catbus_hash_t32 source_hash, catbus_hash
         return;
     }
 
-    list_v_insert_tail( &send_list, ln );
-}
+    // an entry that isn't indexed would be sent to, but never found
+    // again, so don't keep it if the index is out of memory.
+    if( _catbus_i8_index_insert( &send_index, ln ) < 0 ){
+
+        list_v_release_node( ln );
+
+        return;
+    }
+
+    if( _catbus_i8_index_insert( &send_source_index, ln ) < 0 ){
+
+        _catbus_v_index_remove( &send_index, ln );
+        list_v_release_node( ln );
+
+        return;
+    }
+
+    list_v_insert_tail( &send_list, ln );
+}
 
 static bool _catbus_b_compare_links( catbus_link_state_t *state, catbus_link_t link ){
 
@@ -584,16 +1102,16 @@ static catbus_link_t _catbus_l_create_link(
     state.query             = *query;
     
     // check if we already have this link
-    catbus_link_t ln = links.head;
+    uint16_t pos = CATBUS_INDEX_START;
+    catbus_link_t ln = _catbus_ln_index_lookup( &links_index,
+                                                _catbus_u32_link_hash( source_hash, dest_hash ),
+                                                &pos,
+                                                _catbus_b_link_match,
+                                                &state );
 
-    while( ln > 0 ){
+    if( ln >= 0 ){
 
-        if( _catbus_b_compare_links( &state, ln ) ){
-
-            return ln;
-        }
-
-        ln = list_ln_next( ln );
+        return ln;
     }
 
     ln = list_ln_create_node2( &state, sizeof(state), MEM_TYPE_CATBUS_LINK );
@@ -603,6 +1121,13 @@ static catbus_link_t _catbus_l_create_link(
         return -1;
     }
 
+    if( _catbus_i8_index_insert( &links_index, ln ) < 0 ){
+
+        list_v_release_node( ln );
+
+        return -1;
+    }
+
     list_v_insert_tail( &links, ln );
 
     return ln;
@@ -626,7 +1151,7 @@ static void _catbus_v_send_link( catbus_link_t link ){
 
     msg->source_hash    = state->source_hash;
     msg->dest_hash      = state->dest_hash;
-    msg->flags          = state->flags;
+    msg->flags          = state->flags | CATBUS_LINK_FLAGS_MULTI_DATA;
     msg->query          = state->query;
 
     sock_addr_t raddr;
@@ -860,6 +1385,14 @@ int8_t catbus_i8_get(
     return 0;
 }
 
+// step to the next item in a packed catbus_data_t array
+static catbus_data_t *_catbus_p_next_data( catbus_data_t *data ){
+
+    uint16_t type_len = type_u16_size( data->meta.type ) * ( (uint16_t)data->meta.count + 1 );
+
+    return (catbus_data_t *)( (uint8_t *)data + sizeof(catbus_data_t) + ( type_len - 1 ) );
+}
+
 #ifdef ENABLE_CATBUS_LINK
 catbus_link_t catbus_l_send( catbus_hash_t32 source_hash, catbus_hash_t32 dest_hash, catbus_query_t *dest_query ){
 
@@ -878,119 +1411,567 @@ catbus_link_t catbus_l_recv( catbus_hash_t32 dest_hash, catbus_hash_t32 source_h
         return -1;
     }
 
-    return _catbus_l_create_link( FALSE, source_hash, dest_hash, source_query );
-}
+    return _catbus_l_create_link( FALSE, source_hash, dest_hash, source_query );
+}
+
+// destroy all links created on this node
+void catbus_v_purge_links( void ){
+
+    if( !link_enable ){
+
+        return;
+    }
+
+    list_node_t link = links.head;
+
+    while( link > 0 ){
+
+        catbus_link_state_t *state = list_vp_get_data( link );
+
+        state->flags |= CATBUS_LINK_FLAGS_DELETE;
+
+        link = list_ln_next( link );
+    }
+}
+
+
+static void _catbus_v_init_link_data( catbus_msg_link_data_t *msg, catbus_hash_t32 hash ){
+
+    _catbus_v_msg_init( &msg->header, CATBUS_MSG_TYPE_LINK_DATA, 0 );
+    msg->flags = 0;
+
+    #ifdef LIB_SNTP
+    msg->ntp_timestamp = sntp_t_now();
+
+    if( sntp_u8_get_status() == SNTP_STATUS_SYNCHRONIZED ){
+        
+        msg->flags |= CATBUS_MSG_DATA_FLAG_TIME_SYNC;
+    }
+    #endif
+
+    _catbus_v_get_query( &msg->source_query );
+
+    msg->source_hash = hash;
+}
+
+static void _catbus_v_init_link_data_multi( catbus_msg_link_data_multi_t *msg ){
+
+    _catbus_v_msg_init( &msg->header, CATBUS_MSG_TYPE_LINK_DATA_MULTI, 0 );
+    msg->flags = 0;
+
+    #ifdef LIB_SNTP
+    msg->ntp_timestamp = sntp_t_now();
+
+    if( sntp_u8_get_status() == SNTP_STATUS_SYNCHRONIZED ){
+        
+        msg->flags |= CATBUS_MSG_DATA_FLAG_TIME_SYNC;
+    }
+    #endif
+
+    _catbus_v_get_query( &msg->source_query );
+
+    msg->count = 0;
+}
+
+static bool _catbus_b_in_send_list( catbus_hash_t32 source_hash ){
+
+    uint16_t pos = CATBUS_INDEX_START;
+
+    return _catbus_ln_index_lookup( &send_source_index, 
+                                    _catbus_u32_mix( source_hash, 0 ),
+                                    &pos,
+                                    _catbus_b_send_source_match,
+                                    &source_hash ) >= 0;
+}
+
+// apply one received link data item, unless it is a repeat
+// of the last one received from this node for this key.
+static void _catbus_v_receive_link_data( sock_addr_t *raddr, catbus_hash_t32 dest_hash, uint16_t sequence, int32_t data ){
+
+    int32_t cached_sequence = -1;
+
+    // look for cache entry
+    catbus_receive_key_t key;
+    key.dest_hash   = dest_hash;
+    key.raddr       = raddr;
+
+    uint16_t pos = CATBUS_INDEX_START;
+    list_node_t ln = _catbus_ln_index_lookup( &receive_index,
+                                              _catbus_u32_receive_hash( dest_hash, raddr ),
+                                              &pos,
+                                              _catbus_b_receive_match,
+                                              &key );
+
+    if( ln >= 0 ){
+
+        catbus_receive_data_entry_t *entry = (catbus_receive_data_entry_t *)list_vp_get_data( ln );
+
+        cached_sequence = entry->sequence;
+
+        // update recorded data
+        entry->data = data;
+
+        // update recorded sequence
+        entry->sequence = sequence;
+
+        // reset ttl
+        entry->ttl = 32;
+    }
+    // no entry exists
+    else{
+
+        // create entry
+        catbus_receive_data_entry_t entry;
+        entry.raddr         = *raddr;
+        entry.dest_hash     = dest_hash;
+        entry.data          = data;
+        entry.sequence      = sequence;
+        entry.ttl           = 32;
+
+        ln = list_ln_create_node2( &entry, sizeof(entry), MEM_TYPE_CATBUS_RX_CACHE );     
+        
+        if( ln > 0 ){           
+
+            if( _catbus_i8_index_insert( &receive_index, ln ) < 0 ){
+
+                list_v_release_node( ln );
+            }
+            else{
+
+                list_v_insert_tail( &receive_cache, ln );
+            }
+        }
+    }
+
+    if( sequence != cached_sequence ){
+
+        catbus_i8_set( dest_hash, data );
+
+        if( kv_v_notify_hash_set != 0 ){
+
+            kv_v_notify_hash_set( dest_hash );                    
+        }
+    }
+}
+
+// send a key to every destination linked to it right away, as
+// plain LINK_DATA messages.  this is the fallback when the publisher
+// can't take the key, so a publish is never dropped.
+static void _catbus_v_send_direct( catbus_hash_t32 hash ){
+
+    int32_t data;
+
+    if( catbus_i8_get( hash, &data ) < 0 ){
+
+        return;
+    }
+
+    catbus_msg_link_data_t msg;
+
+    _catbus_v_init_link_data( &msg, hash );
+
+    sequence++;
+    msg.sequence    = sequence;
+    msg.data        = data;
+
+    uint16_t pos = CATBUS_INDEX_START;
+    list_node_t ln;
+
+    while( ( ln = _catbus_ln_index_lookup( &send_source_index,
+                                           _catbus_u32_mix( hash, 0 ),
+                                           &pos,
+                                           _catbus_b_send_source_match,
+                                           &hash ) ) >= 0 ){
+
+        catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+
+        msg.dest_hash = entry->dest_hash;
+
+        sock_i16_sendto( sock, (uint8_t *)&msg, sizeof(msg), &entry->raddr );
+
+        publish_items++;
+        publish_msgs++;
+    }
+}
+
+static void _catbus_v_add_to_pending( catbus_hash_t32 hash ){
+
+    for( uint8_t i = 0; i < publish_pending_count; i++ ){
+
+        if( publish_pending[i] == hash ){
+
+            return;
+        }
+    }
+
+    if( publish_pending_count >= cnt_of_array(publish_pending) ){
+
+        publish_overflows++;
+
+        _catbus_v_send_direct( hash );
+
+        return;
+    }
+
+    if( publish_pending_count == 0 ){
+
+        publish_pending_start = tmr_u32_get_system_time_ms();
+    }
+
+    publish_pending[publish_pending_count] = hash;
+    publish_pending_count++;
+}
+
+static int16_t _catbus_i16_batch_index( publish_thread_state_t *state, catbus_hash_t32 hash ){
+
+    for( uint8_t i = 0; i < state->count; i++ ){
+
+        if( state->hashes[i] == hash ){
+
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// gather the send list entries for every key in the batch
+static void _catbus_v_collect_targets( publish_thread_state_t *state ){
+
+    state->targets = -1;
+    state->target_count = 0;
+
+    uint16_t count = 0;
+
+    for( uint8_t i = 0; i < state->count; i++ ){
+
+        uint16_t pos = CATBUS_INDEX_START;
+
+        while( _catbus_ln_index_lookup( &send_source_index, 
+                                        _catbus_u32_mix( state->hashes[i], 0 ),
+                                        &pos,
+                                        _catbus_b_send_source_match,
+                                        &state->hashes[i] ) >= 0 ){
+
+            count++;
+        }
+    }
+
+    if( count == 0 ){
+
+        return;
+    }
+
+    mem_handle_t h = mem2_h_alloc( count * sizeof(list_node_t) );
+
+    if( h < 0 ){
+
+        publish_overflows += state->count;
+
+        for( uint8_t i = 0; i < state->count; i++ ){
+
+            _catbus_v_send_direct( state->hashes[i] );
+        }
+
+        return;
+    }
+
+    list_node_t *targets = mem2_vp_get_ptr( h );
+    uint16_t n = 0;
+
+    for( uint8_t i = 0; i < state->count; i++ ){
+
+        uint16_t pos = CATBUS_INDEX_START;
+        list_node_t ln;
+
+        while( ( ln = _catbus_ln_index_lookup( &send_source_index, 
+                                               _catbus_u32_mix( state->hashes[i], 0 ),
+                                               &pos,
+                                               _catbus_b_send_source_match,
+                                               &state->hashes[i] ) ) >= 0 ){
+
+            targets[n] = ln;
+            n++;
+        }
+    }
+
+    state->targets = h;
+    state->target_count = n;
+}
+
+static void _catbus_v_send_multi( mem_handle_t h, sock_addr_t *raddr ){
+
+    catbus_msg_link_data_multi_t *msg = mem2_vp_get_ptr( h );
+
+    publish_items += msg->count;
+    publish_msgs++;
+
+    sock_i16_sendto_m( sock, h, raddr );
+}
+
+// send every target for the destination of the target at first.
+// entries for nodes that accept LINK_DATA_MULTI are packed into as few
+// messages as possible, the rest get one LINK_DATA each.
+// sent targets are cleared from the target list.
+static void _catbus_v_send_to_dest( publish_thread_state_t *state, uint16_t first ){
+
+    list_node_t *targets = mem2_vp_get_ptr( state->targets );
+
+    catbus_send_data_entry_t *dest = (catbus_send_data_entry_t *)list_vp_get_data( targets[first] );
+    sock_addr_t raddr = dest->raddr;
+
+    // count entries that can go in multi messages, so each
+    // message can be allocated at its final size.
+    uint16_t multi_count = 0;
+
+    for( uint16_t i = first; i < state->target_count; i++ ){
+
+        if( targets[i] < 0 ){
+
+            continue;
+        }
+
+        catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( targets[i] );
+
+        if( ( entry->flags & CATBUS_LINK_FLAGS_MULTI_DATA ) &&
+            ( memcmp( &entry->raddr, &raddr, sizeof(sock_addr_t) ) == 0 ) ){
+
+            multi_count++;
+        }
+    }
+
+    // a single entry is smaller as a plain LINK_DATA
+    bool use_multi = multi_count > 1;
+
+    mem_handle_t h = -1;
+
+    for( uint16_t i = first; i < state->target_count; i++ ){
+
+        // allocating the message can move the target list
+        targets = mem2_vp_get_ptr( state->targets );
+
+        list_node_t ln = targets[i];
+
+        if( ln < 0 ){
+
+            continue;
+        }
+
+        catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+
+        if( memcmp( &entry->raddr, &raddr, sizeof(sock_addr_t) ) != 0 ){
+
+            continue;
+        }
+
+        targets[i] = -1;
+
+        int16_t index = _catbus_i16_batch_index( state, entry->source_hash );
+        int32_t data;
+
+        if( catbus_i8_get( entry->source_hash, &data ) < 0 ){
+
+            if( entry->flags & CATBUS_LINK_FLAGS_MULTI_DATA ){
+
+                multi_count--;
+            }
+
+            continue;
+        }
+
+        if( use_multi && ( entry->flags & CATBUS_LINK_FLAGS_MULTI_DATA ) && ( h < 0 ) ){
+
+            uint8_t msg_count = CATBUS_MAX_LINK_DATA_ENTRIES;
+
+            if( multi_count < msg_count ){
+
+                msg_count = multi_count;
+            }
+
+            h = mem2_h_alloc( sizeof(catbus_msg_link_data_multi_t) + 
+                              ( msg_count - 1 ) * sizeof(catbus_link_data_entry_t) );
+
+            if( h < 0 ){
+
+                // send the rest of this destination as plain LINK_DATA
+                use_multi = FALSE;
+            }
+            else{
+
+                catbus_msg_link_data_multi_t *msg = mem2_vp_get_ptr( h );
+
+                _catbus_v_init_link_data_multi( msg );
+            }
+
+            entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+        }
+
+        if( !use_multi || ( ( entry->flags & CATBUS_LINK_FLAGS_MULTI_DATA ) == 0 ) ){
+
+            catbus_msg_link_data_t msg;
+
+            _catbus_v_init_link_data( &msg, entry->source_hash );
+
+            msg.dest_hash   = entry->dest_hash;
+            msg.sequence    = state->sequence + index;
+            msg.data        = data;
+
+            sock_i16_sendto( sock, (uint8_t *)&msg, sizeof(msg), &raddr );
+
+            publish_items++;
+            publish_msgs++;
+
+            continue;
+        }
+
+        catbus_msg_link_data_multi_t *msg = mem2_vp_get_ptr( h );
+        catbus_link_data_entry_t *msg_entry = &msg->first_entry + msg->count;
+
+        msg_entry->source_hash  = entry->source_hash;
+        msg_entry->dest_hash    = entry->dest_hash;
+        msg_entry->sequence     = state->sequence + index;
+        msg_entry->data         = data;
+
+        msg->count++;
+        multi_count--;
+
+        // send when full, or when this was the last entry
+        if( ( msg->count >= CATBUS_MAX_LINK_DATA_ENTRIES ) ||
+            ( multi_count == 0 ) ){
+
+            _catbus_v_send_multi( h, &raddr );
+            h = -1;
+        }
+    }
+
+    // entries that were skipped after the message was allocated
+    // leave it short of its allocated size.
+    if( h >= 0 ){
+
+        catbus_msg_link_data_multi_t *msg = mem2_vp_get_ptr( h );
+
+        if( msg->count > 0 ){
+
+            _catbus_v_send_multi( h, &raddr );
+        }
+        else{
+
+            mem2_v_free( h );
+        }
+    }
+}
+
+PT_THREAD( publish_thread( pt_t *pt, publish_thread_state_t *state ) )
+{
+PT_BEGIN( pt );
+
+    while(1){
+
+        THREAD_WAIT_WHILE( pt, publish_pending_count == 0 );
 
-// destroy all links created on this node
-void catbus_v_purge_links( void ){
+        // take the pending set, publishes from here on start a new one
+        memcpy( state->hashes, publish_pending, publish_pending_count * sizeof(catbus_hash_t32) );
+        state->count = publish_pending_count;
+        state->start = publish_pending_start;
+        publish_pending_count = 0;
 
-    if( !link_enable ){
+        state->sequence = sequence + 1;
+        sequence += state->count;
 
-        return;
-    }
+        // entries can't be removed while the targets refer to them
+        send_list_locked++;
+            
+        _catbus_v_collect_targets( state );
 
-    list_node_t link = links.head;
+        state->target_index = 0;
 
-    while( link > 0 ){
+        while( state->target_index < state->target_count ){
 
-        catbus_link_state_t *state = list_vp_get_data( link );
+            list_node_t *targets = mem2_vp_get_ptr( state->targets );
 
-        state->flags |= CATBUS_LINK_FLAGS_DELETE;
+            if( targets[state->target_index] >= 0 ){
 
-        link = list_ln_next( link );
-    }
-}
+                _catbus_v_send_to_dest( state, state->target_index );
 
+                // pace destinations, not keys
+                TMR_WAIT( pt, 2 );
+            }
 
-typedef struct{
-    catbus_msg_link_data_t msg;
-    list_node_t ln;
-} publish_thread_state_t;
+            state->target_index++;
+        }
 
-PT_THREAD( publish_thread( pt_t *pt, publish_thread_state_t *state ) )
-{
-PT_BEGIN( pt );
+        if( state->targets >= 0 ){
 
-    send_list_locked++;
-        
-    state->ln = send_list.head;
+            mem2_v_free( state->targets );
+        }
 
-    while( state->ln > 0 ){
+        send_list_locked--;
 
-        catbus_send_data_entry_t *send_state = (catbus_send_data_entry_t *)list_vp_get_data( state->ln );
+        uint32_t elapsed = tmr_u32_elapsed_time_ms( state->start );
 
-        if( send_state->source_hash != state->msg.source_hash ){
+        if( elapsed > 65535 ){
 
-            goto end;
+            elapsed = 65535;
         }
 
-        state->msg.dest_hash = send_state->dest_hash;
-
-        sock_i16_sendto( sock, (uint8_t *)&state->msg, sizeof(state->msg), &send_state->raddr );
+        publish_latency = elapsed;
 
-        TMR_WAIT( pt, 2 );
+        if( publish_latency > publish_latency_max ){
 
-end:
-        state->ln = list_ln_next( state->ln );
+            publish_latency_max = publish_latency;
+        }
     }
-
-    send_list_locked--;
     
 PT_END( pt );
 }
-#endif
 
-int8_t catbus_i8_publish( catbus_hash_t32 hash ){
+static bool _catbus_b_publish_enabled( void ){
 
-    #ifdef ENABLE_CATBUS_LINK
     if( !link_enable ){
 
-        return 0;
+        return FALSE;
     }
 
-    // check if safe mode
-    if( sys_u8_get_mode() == SYS_MODE_SAFE ){    
+    // no publishing in safe mode
+    return sys_u8_get_mode() != SYS_MODE_SAFE;
+}
 
-        return 0;
-    }
+// queue a key for the publisher.
+// every publish goes through here, the publisher batches whatever
+// is pending when it runs.
+static void _catbus_v_publish( catbus_hash_t32 hash ){
 
-    if( kv_v_notify_hash_set != 0 ){ 
-    
-        kv_v_notify_hash_set( hash );
+    // nothing to do if no one is linked to this key
+    if( !_catbus_b_in_send_list( hash ) ){
+
+        return;
     }
 
-    publish_thread_state_t state;
+    _catbus_v_add_to_pending( hash );
+}
+#endif
+
+int8_t catbus_i8_publish( catbus_hash_t32 hash ){
 
-    _catbus_v_msg_init( &state.msg.header, CATBUS_MSG_TYPE_LINK_DATA, 0 );
-    state.msg.flags = 0;
+    #ifdef ENABLE_CATBUS_LINK
+    if( !_catbus_b_publish_enabled() ){
 
-    #ifdef LIB_SNTP
-    state.msg.ntp_timestamp = sntp_t_now();
+        return 0;
+    }
 
-    if( sntp_u8_get_status() == SNTP_STATUS_SYNCHRONIZED ){
-        
-        state.msg.flags |= CATBUS_MSG_DATA_FLAG_TIME_SYNC;
+    if( kv_v_notify_hash_set != 0 ){ 
+    
+        kv_v_notify_hash_set( hash );
     }
-    #endif
 
-    _catbus_v_get_query( &state.msg.source_query );
+    int32_t data;
 
-    state.msg.source_hash = hash;
-    
-    if( catbus_i8_get( hash, &state.msg.data ) < 0 ){
+    if( catbus_i8_get( hash, &data ) < 0 ){
 
         return -1;
     }
 
-    sequence++;
-    state.msg.sequence = sequence;
-
-    // we're not checking for success, since there is nothing we
-    // can do about it.
-    thread_t_create( THREAD_CAST(publish_thread),
-                     PSTR("catbus_publish"),
-                     &state,
-                     sizeof(state) );
+    _catbus_v_publish( hash );
     
     #endif
 
@@ -1004,23 +1985,141 @@ typedef struct{
     uint8_t flags;
     uint8_t timeout;
     bool close;
+    sock_addr_t raddr;
+    int32_t window_offset;
+    uint8_t window_mask;
+    uint32_t tick_time;
 } file_transfer_thread_state_t;
 #define FILE_SESSION_TIMEOUT            40
+#define FILE_SESSION_TICK               100
+
+// wakes the session thread when a window is requested
+#define FILE_SESSION_SIGNAL             SIGNAL_SYS_3
 
 
+// read a page from the session file and send it as FILE_DATA.
+// offsets past the end of the file send an empty page.
+static uint16_t _catbus_u16_send_file_page( 
+    file_transfer_thread_state_t *state, 
+    int32_t offset,
+    sock_addr_t *raddr ){
+
+    if( offset < 0 ){
+
+        return CATBUS_ERROR_PROTOCOL_ERROR;
+    }
+
+    // check remaining file size
+    int32_t file_size = fs_i32_get_size( state->file );
+    int32_t data_len = file_size - offset;
+
+    // check if we're at the end of the file
+    if( data_len < 0 ){
+
+        data_len = 0;
+    }
+
+    if( data_len > CATBUS_MAX_DATA ){
+
+        data_len = CATBUS_MAX_DATA;
+    }
+
+    // alloc data
+    mem_handle_t h = mem2_h_alloc( data_len + sizeof(catbus_msg_file_data_t) - 1 );
+
+    // check allocation
+    if( h < 0 ){
+
+        return CATBUS_ERROR_ALLOC_FAIL;
+    }
+
+    catbus_msg_file_data_t *data = (catbus_msg_file_data_t *)mem2_vp_get_ptr( h );
+
+    _catbus_v_msg_init( &data->header, CATBUS_MSG_TYPE_FILE_DATA, 0 );
+
+    // seek file
+    fs_v_seek( state->file, offset );
+
+    int16_t read_len = fs_i16_read( state->file, &data->data, data_len );
+
+    if( read_len < 0 ){
+        
+        read_len = 0;
+    }
+
+    data->flags         = state->flags;
+    data->session_id    = state->session_id;
+    data->offset        = offset;
+    data->len           = read_len;
+
+    sock_i16_sendto_m( sock, h, raddr );
+
+    return CATBUS_ERROR_OK;
+}
+
+// send the lowest page still requested in the current window
+static void _catbus_v_send_window_page( file_transfer_thread_state_t *state ){
+
+    uint8_t page = 0;
+
+    while( ( state->window_mask & ( 1 << page ) ) == 0 ){
+
+        page++;
+    }
+
+    state->window_mask &= ~( 1 << page );
+
+    int32_t offset = state->window_offset + ( (int32_t)page * CATBUS_MAX_DATA );
+
+    // the end of file page ends the window
+    if( offset >= fs_i32_get_size( state->file ) ){
+
+        state->window_mask = 0;
+    }
+
+    // if this fails, the client will request the page again
+    _catbus_u16_send_file_page( state, offset, &state->raddr );
+}
+
 PT_THREAD( catbus_file_session_thread( pt_t *pt, file_transfer_thread_state_t *state ) )
 {
 PT_BEGIN( pt );
    
     while( state->close == FALSE ){
 
-        TMR_WAIT( pt, 100 );
-        state->timeout--;       
+        // stream out requested pages, one per thread run
+        if( state->window_mask != 0 ){
 
-        if( state->timeout == 0 ){
+            _catbus_v_send_window_page( state );
 
-            break;
-        } 
+            THREAD_YIELD( pt );
+
+            continue;
+        }
+
+        // session timeout tick
+        if( tmr_i8_compare_time( state->tick_time ) <= 0 ){
+
+            state->timeout--;       
+
+            if( state->timeout == 0 ){
+
+                break;
+            } 
+
+            state->tick_time = tmr_u32_get_system_time_ms() + FILE_SESSION_TICK;
+
+            continue;
+        }
+
+        // sleep until the next tick or a window request.
+        // other signals may wake us early, the loop just
+        // goes back to sleep until the tick is due.
+        thread_v_set_signal_flag();
+        thread_v_set_alarm( state->tick_time );
+        THREAD_SLEEP( pt );
+        thread_v_clear_signal_flag();
+        thread_v_clear_signal( FILE_SESSION_SIGNAL );
     }
 
     fs_f_close( state->file );
@@ -1042,6 +2141,9 @@ static thread_t _catbus_t_create_file_transfer_session(
     state.flags         = flags;
     state.timeout       = FILE_SESSION_TIMEOUT;
     state.close         = FALSE;
+    state.window_offset = 0;
+    state.window_mask   = 0;
+    state.tick_time     = tmr_u32_get_system_time_ms() + FILE_SESSION_TICK;
 
     thread_t t = thread_t_create( 
                     THREAD_CAST(catbus_file_session_thread),
@@ -1326,6 +2428,14 @@ PT_BEGIN( pt );
                 goto end;
             }
 
+            // make sure the hash list fits in the message we received
+            if( ( sizeof(catbus_msg_get_keys_t) + ( ( msg->count - 1 ) * sizeof(catbus_hash_t32) ) ) >
+                (uint16_t)sock_i16_get_bytes_read( sock ) ){
+
+                error = CATBUS_ERROR_PROTOCOL_ERROR;
+                goto end;
+            }
+
             uint8_t reply_count = 0;
 
             catbus_hash_t32 *hash = &msg->first_hash;
@@ -1356,12 +2466,6 @@ PT_BEGIN( pt );
                 hash++;
             }
 
-            if( reply_len > CATBUS_MAX_DATA ){
-
-                error = CATBUS_ERROR_PROTOCOL_ERROR;
-                goto end;
-            }
-
             mem_handle_t h = mem2_h_alloc( reply_len + sizeof(catbus_msg_key_data_t) - sizeof(catbus_data_t) );
 
             if( h < 0 ){
@@ -1379,7 +2483,11 @@ PT_BEGIN( pt );
 
             reply->count = reply_count;
 
-            for( uint8_t i = 0; i < reply_count; i++ ){
+            // keys that were not found are skipped, so walk the whole
+            // request until every counted item is filled in.
+            uint8_t items = 0;
+
+            for( uint8_t i = 0; ( i < msg->count ) && ( items < reply_count ); i++ ){
 
                 if( kv_i8_lookup_hash( *hash, &meta, 0 ) == 0 ){
 
@@ -1391,16 +2499,15 @@ PT_BEGIN( pt );
                     data->meta.flags    = meta.flags;
                     data->meta.reserved = 0;
 
-                    if( kv_i8_get_by_hash( *hash, &data->data, type_len ) != KV_ERR_STATUS_OK ){
+                    if( kv_i8_get_by_meta( &meta, *hash, &data->data, type_len ) != KV_ERR_STATUS_OK ){
 
                         error = CATBUS_ERROR_KEY_NOT_FOUND;
                         mem2_v_free( h );
                         goto end;
                     }
 
-                    uint8_t *ptr = (uint8_t *)data;
-                    ptr += ( sizeof(catbus_data_t) + ( type_len - 1 ) );
-                    data = (catbus_data_t *)ptr;
+                    data = _catbus_p_next_data( data );
+                    items++;
                 }
 
                 hash++;
@@ -1419,6 +2526,8 @@ PT_BEGIN( pt );
                 goto end;
             }
 
+            uint8_t *msg_end = (uint8_t *)header + sock_i16_get_bytes_read( sock );
+
             // get reply message.
             // the set keys message is actually the same as key data.
             // so, instead of building a separate reply, we will update in place and
@@ -1426,13 +2535,38 @@ PT_BEGIN( pt );
             mem_handle_t h = sock_h_get_data_handle( sock );
 
             catbus_data_t *data = &msg->first_data;
+            kv_meta_t meta;
+
+            // kv index of each key, found by the check pass,
+            // so the set pass does not search for the keys again.
+            mem_handle_t index_h = mem2_h_alloc( msg->count * sizeof(int16_t) );
+
+            if( index_h < 0 ){
+
+                error = CATBUS_ERROR_ALLOC_FAIL;
+                goto end;
+            }
+
+            int16_t *kv_index = mem2_vp_get_ptr( index_h );
 
+            // check every item before setting any of them, so an error
+            // doesn't leave the batch partially applied.
             for( uint8_t i = 0; i < msg->count; i++ ){
-                kv_meta_t meta;
 
-                if( kv_i8_lookup_hash( data->meta.hash, &meta, 0 ) < 0 ){
+                if( ( (uint8_t *)data + sizeof(catbus_data_t) - 1 ) > msg_end ){
+
+                    error = CATBUS_ERROR_PROTOCOL_ERROR;
+                    mem2_v_free( index_h );
+                    goto end;
+                }
+
+                kv_index[i] = kv_i16_search_hash( data->meta.hash );
+
+                if( ( kv_index[i] < 0 ) ||
+                    ( kv_i8_lookup_index( kv_index[i], &meta, 0 ) < 0 ) ){
 
                     error = CATBUS_ERROR_KEY_NOT_FOUND;
+                    mem2_v_free( index_h );
                     goto end;
                 }
 
@@ -1440,6 +2574,7 @@ PT_BEGIN( pt );
                 if( data->meta.type != meta.type ){
 
                     error = CATBUS_ERROR_INVALID_TYPE;
+                    mem2_v_free( index_h );
                     goto end;
                 }
 
@@ -1447,15 +2582,41 @@ PT_BEGIN( pt );
                 if( meta.flags & KV_FLAGS_READ_ONLY ){
 
                     error = CATBUS_ERROR_READ_ONLY;
+                    mem2_v_free( index_h );
+                    goto end;
+                }
+
+                // data length comes from our meta data, not the message
+                data->meta.count = meta.array_len;
+
+                data = _catbus_p_next_data( data );
+
+                if( (uint8_t *)data > msg_end ){
+
+                    error = CATBUS_ERROR_PROTOCOL_ERROR;
+                    mem2_v_free( index_h );
+                    goto end;
+                }
+            }
+
+            data = &msg->first_data;
+
+            for( uint8_t i = 0; i < msg->count; i++ ){
+
+                if( kv_i8_lookup_index( kv_index[i], &meta, 0 ) < 0 ){
+
+                    error = CATBUS_ERROR_KEY_NOT_FOUND;
+                    mem2_v_free( index_h );
                     goto end;
                 }
 
                 uint16_t type_size = kv_u16_get_size_meta( &meta );
                     
                 // set value
-                if( kv_i8_set_by_hash( data->meta.hash, &data->data, type_size ) != KV_ERR_STATUS_OK ){
+                if( kv_i8_set_by_meta( &meta, data->meta.hash, &data->data, type_size ) != KV_ERR_STATUS_OK ){
 
                     error = CATBUS_ERROR_KEY_NOT_FOUND;
+                    mem2_v_free( index_h );
                     goto end;
                 }
 
@@ -1465,17 +2626,33 @@ PT_BEGIN( pt );
                 }
 
                 // get value, so we'll return what actually got set.
-                if( kv_i8_get_by_hash( data->meta.hash, &data->data, type_size ) != KV_ERR_STATUS_OK ){
+                if( kv_i8_get_by_meta( &meta, data->meta.hash, &data->data, type_size ) != KV_ERR_STATUS_OK ){
 
                     error = CATBUS_ERROR_KEY_NOT_FOUND;
+                    mem2_v_free( index_h );
                     goto end;
                 }
 
-                uint8_t *ptr = (uint8_t *)data;
+                data = _catbus_p_next_data( data );
+            }
+
+            mem2_v_free( index_h );
+
+            #ifdef ENABLE_CATBUS_LINK
+            // the keys were already checked and notified above,
+            // so they go straight to the publisher as one batch
+            if( _catbus_b_publish_enabled() ){
+
+                data = &msg->first_data;
+
+                for( uint8_t i = 0; i < msg->count; i++ ){
 
-                ptr += ( sizeof(catbus_data_t) + ( type_size - 1 ) );
-                data = (catbus_data_t *)ptr;
+                    _catbus_v_publish( data->meta.hash );
+
+                    data = _catbus_p_next_data( data );
+                }
             }
+            #endif
 
             // change msg type
             _catbus_v_msg_init( header, CATBUS_MSG_TYPE_KEY_DATA, header->transaction_id );
@@ -1516,7 +2693,7 @@ PT_BEGIN( pt );
                 }
 
                 // change link flags and echo message back to sender
-                msg->flags = CATBUS_LINK_FLAGS_DEST;
+                msg->flags = CATBUS_LINK_FLAGS_DEST | CATBUS_LINK_FLAGS_MULTI_DATA;
 
                 // update header
                 _catbus_v_msg_init( header, CATBUS_MSG_TYPE_LINK, header->transaction_id );
@@ -1536,7 +2713,7 @@ PT_BEGIN( pt );
                 sock_addr_t raddr;
                 sock_v_get_raddr( sock, &raddr );
 
-                _catbus_v_add_to_send_list( msg->source_hash, msg->dest_hash, &raddr );
+                _catbus_v_add_to_send_list( msg->source_hash, msg->dest_hash, &raddr, msg->flags & CATBUS_LINK_FLAGS_MULTI_DATA );
             }
         }
         else if( header->msg_type == CATBUS_MSG_TYPE_LINK_DATA ){
@@ -1551,63 +2728,35 @@ PT_BEGIN( pt );
             sock_addr_t raddr;
             sock_v_get_raddr( sock, &raddr );
 
-            int32_t cached_sequence = -1;
-
-            // look for cache entry
-            list_node_t ln = receive_cache.head;
-
-            while( ln > 0 ){
-
-                catbus_receive_data_entry_t *entry = (catbus_receive_data_entry_t *)list_vp_get_data( ln );
-
-                if( ip_b_addr_compare( entry->raddr.ipaddr, raddr.ipaddr ) &&
-                    ( entry->raddr.port == raddr.port ) &&
-                    ( entry->dest_hash == msg->dest_hash ) ){
-
-                    cached_sequence = entry->sequence;
-
-                    // update recorded data
-                    entry->data = msg->data;
-
-                    // update recorded sequence
-                    entry->sequence = msg->sequence;
-
-                    // reset ttl
-                    entry->ttl = 32;
+            _catbus_v_receive_link_data( &raddr, msg->dest_hash, msg->sequence, msg->data );
+        }
+        else if( header->msg_type == CATBUS_MSG_TYPE_LINK_DATA_MULTI ){
 
-                    break;
-                }
+            if( !link_enable ){
 
-                ln = list_ln_next( ln );
+                goto end;
             }
 
-            // no entry exists
-            if( ln < 0 ){
-
-                // create entry
-                catbus_receive_data_entry_t entry;
-                entry.raddr         = raddr;
-                entry.dest_hash     = msg->dest_hash;
-                entry.data          = msg->data;
-                entry.sequence      = msg->sequence;
-                entry.ttl           = 32;
+            catbus_msg_link_data_multi_t *msg = (catbus_msg_link_data_multi_t *)header;
 
-                ln = list_ln_create_node2( &entry, sizeof(entry), MEM_TYPE_CATBUS_RX_CACHE );     
-                
-                if( ln > 0 ){           
+            // check message length against entry count
+            if( ( msg->count == 0 ) ||
+                ( sock_i16_get_bytes_read( sock ) < 
+                  (int16_t)( sizeof(catbus_msg_link_data_multi_t) + ( msg->count - 1 ) * sizeof(catbus_link_data_entry_t) ) ) ){
 
-                    list_v_insert_tail( &receive_cache, ln );
-                }
+                goto end;
             }
 
-            if( msg->sequence != cached_sequence ){
+            sock_addr_t raddr;
+            sock_v_get_raddr( sock, &raddr );
+
+            catbus_link_data_entry_t *entry = &msg->first_entry;
 
-                catbus_i8_set( msg->dest_hash, msg->data );
+            for( uint8_t i = 0; i < msg->count; i++ ){
 
-                if( kv_v_notify_hash_set != 0 ){
+                _catbus_v_receive_link_data( &raddr, entry->dest_hash, entry->sequence, entry->data );
 
-                    kv_v_notify_hash_set( msg->dest_hash );                    
-                }
+                entry++;
             }
         }
         #endif
@@ -1624,6 +2773,15 @@ PT_BEGIN( pt );
                 goto end;
             }
 
+            uint8_t flags = msg->flags;
+
+            // accept windowed reads
+            if( flags & CATBUS_MSG_FILE_FLAG_WINDOW_REQ ){
+
+                flags &= ~CATBUS_MSG_FILE_FLAG_WINDOW_REQ;
+                flags |= CATBUS_MSG_FILE_FLAG_WINDOWED;
+            }
+
             // set file open mode
             mode_t8 mode = FS_MODE_READ_ONLY;
 
@@ -1644,7 +2802,7 @@ PT_BEGIN( pt );
             uint32_t session_id = ( (uint32_t)rnd_u16_get_int() << 16 ) | rnd_u16_get_int();
 
             // create session
-            thread_t t = _catbus_t_create_file_transfer_session( f, session_id, msg->flags );
+            thread_t t = _catbus_t_create_file_transfer_session( f, session_id, flags );
 
             if( t < 0 ){
 
@@ -1659,7 +2817,7 @@ PT_BEGIN( pt );
             catbus_msg_file_confirm_t reply;
             _catbus_v_msg_init( &reply.header, CATBUS_MSG_TYPE_FILE_CONFIRM, header->transaction_id );
 
-            reply.flags = msg->flags;
+            reply.flags = flags;
             memcpy( reply.filename, msg->filename, sizeof(reply.filename) );
             reply.status        = 0;
             reply.session_id    = session_id;
@@ -1692,57 +2850,46 @@ PT_BEGIN( pt );
             // reset session timeout
             session_state->timeout = FILE_SESSION_TIMEOUT;
 
-            // seek file
-            fs_v_seek( session_state->file, msg->offset );
-
-            // check remaining file size
-            int32_t file_size = fs_i32_get_size( session_state->file );
-            int32_t data_len = file_size - msg->offset;
-
-            // check if we're at the end of the file
-            if( msg->offset >= file_size ){
-
-                data_len = 0;
-            }
+            error = _catbus_u16_send_file_page( session_state, msg->offset, 0 );
+        }
+        else if( header->msg_type == CATBUS_MSG_TYPE_FILE_GET_WINDOW ){
+            
+            catbus_msg_file_get_window_t *msg = (catbus_msg_file_get_window_t *)header;
 
-            if( data_len < 0 ){
+            // get file session
+            if( file_session_thread < 0 ){
 
-                error = CATBUS_ERROR_PROTOCOL_ERROR;
+                log_v_debug_P( PSTR("invalid file session") );
+                error = CATBUS_ERROR_INVALID_FILE_SESSION;
                 goto end;
             }
 
-            if( data_len > CATBUS_MAX_DATA ){
-
-                data_len = CATBUS_MAX_DATA;
-            }
-
-            // alloc data
-            mem_handle_t h = mem2_h_alloc( data_len + sizeof(catbus_msg_file_data_t) - 1 );
+            file_transfer_thread_state_t *session_state = thread_vp_get_data( file_session_thread );
 
-            // check allocation
-            if( h < 0 ){
+            // check session
+            if( session_state->session_id != msg->session_id ){
 
-                error = CATBUS_ERROR_ALLOC_FAIL;
+                log_v_debug_P( PSTR("invalid file session") );
+                error = CATBUS_ERROR_INVALID_FILE_SESSION;
                 goto end;
             }
 
-            catbus_msg_file_data_t *data = (catbus_msg_file_data_t *)mem2_vp_get_ptr( h );
-
-            _catbus_v_msg_init( &data->header, CATBUS_MSG_TYPE_FILE_DATA, 0 );
-
-            int16_t read_len = fs_i16_read( session_state->file, &data->data, data_len );
+            if( ( session_state->flags & CATBUS_MSG_FILE_FLAG_WINDOWED ) == 0 ){
 
-            if( read_len < 0 ){
-                
-                read_len = 0;
+                error = CATBUS_ERROR_PROTOCOL_ERROR;
+                goto end;
             }
 
-            data->flags         = session_state->flags;
-            data->session_id    = session_state->session_id;
-            data->offset        = msg->offset;
-            data->len           = read_len;
+            // reset session timeout
+            session_state->timeout = FILE_SESSION_TIMEOUT;
+
+            // replaces any window still in progress, the client
+            // re-requests whatever it is missing.
+            sock_v_get_raddr( sock, &session_state->raddr );
+            session_state->window_offset    = msg->offset;
+            session_state->window_mask      = msg->page_mask;
 
-            sock_i16_sendto_m( sock, h, 0 );
+            thread_v_signal( FILE_SESSION_SIGNAL );
         }
         else if( header->msg_type == CATBUS_MSG_TYPE_FILE_DATA ){
 
@@ -2012,40 +3159,20 @@ PT_BEGIN( pt );
 
         // process link system periodic tasks        
 
-        catbus_hash_t32 hashes_published[16];
-        uint8_t hashes_published_index = 0;
-        memset( hashes_published, 0, sizeof(hashes_published) );
-        
+        // republish everything in the send list.
+        // the publisher merges keys linked to several destinations.
         ln = send_list.head;
-        next_ln = -1;
 
         while( ln > 0 ){
 
-            next_ln = list_ln_next( ln );
+            // let the publisher catch up if the pending set is full
+            THREAD_WAIT_WHILE( pt, publish_pending_count >= cnt_of_array(publish_pending) );
 
             catbus_send_data_entry_t *state = (catbus_send_data_entry_t *)list_vp_get_data( ln );
             
-            // check if we've already published this one
-            for( uint8_t i = 0; i < hashes_published_index; i++ ){
-
-                if( hashes_published[i] == state->source_hash ){
-
-                    goto next_send;
-                }
-            }
-
-            if( hashes_published_index < cnt_of_array(hashes_published) ){
-
-                hashes_published[hashes_published_index] = state->source_hash;
-                hashes_published_index++;
-            }
-
             catbus_i8_publish( state->source_hash );
 
-            TMR_WAIT( pt, 2 );
-             
-next_send:
-            ln = next_ln;
+            ln = list_ln_next( ln );
         }  
 
         // check for deleted links
@@ -2060,6 +3187,8 @@ next_send:
 
             if( state->flags & CATBUS_LINK_FLAGS_DELETE ){
 
+                _catbus_v_index_remove( &links_index, ln );
+
                 list_v_remove( &links, ln );
                 list_v_release_node( ln );
             }
@@ -2080,48 +3209,56 @@ next_send:
             ln = list_ln_next( ln );
         }
 
-        THREAD_WAIT_WHILE( pt, send_list_locked );
-
-        // expire any send entries
+        // expire send entries a few at a time, so a large send
+        // list doesn't hold up the other threads.
         ln = send_list.head;
-        next_ln = -1;
 
         while( ln > 0 ){
 
-            next_ln = list_ln_next( ln );
+            // the publisher holds on to send entries while it runs
+            THREAD_WAIT_WHILE( pt, send_list_locked );
 
-            catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
+            for( uint8_t i = 0; ( i < CATBUS_EXPIRE_BATCH ) && ( ln > 0 ); i++ ){
 
-            entry->ttl -= 4;
+                next_ln = list_ln_next( ln );
 
-            if( entry->ttl < 0 ){
+                catbus_send_data_entry_t *entry = (catbus_send_data_entry_t *)list_vp_get_data( ln );
 
-                list_v_remove( &send_list, ln );
-                list_v_release_node( ln );
-            } 
+                entry->ttl -= 4;
 
-            ln = next_ln;
+                if( entry->ttl < 0 ){
+
+                    _catbus_v_remove_send_entry( ln );
+                } 
+
+                ln = next_ln;
+            }
+
+            THREAD_YIELD( pt );
         }  
 
         // expire any cache entries
         ln = receive_cache.head;
-        next_ln = -1;
 
         while( ln > 0 ){
 
-            next_ln = list_ln_next( ln );
+            for( uint8_t i = 0; ( i < CATBUS_EXPIRE_BATCH ) && ( ln > 0 ); i++ ){
 
-            catbus_receive_data_entry_t *entry = (catbus_receive_data_entry_t *)list_vp_get_data( ln );
+                next_ln = list_ln_next( ln );
 
-            entry->ttl -= 4;
+                catbus_receive_data_entry_t *entry = (catbus_receive_data_entry_t *)list_vp_get_data( ln );
 
-            if( entry->ttl < 0 ){
+                entry->ttl -= 4;
 
-                list_v_remove( &receive_cache, ln );
-                list_v_release_node( ln );
-            } 
+                if( entry->ttl < 0 ){
 
-            ln = next_ln;
+                    _catbus_v_remove_receive_entry( ln );
+                } 
+
+                ln = next_ln;
+            }
+
+            THREAD_YIELD( pt );
         }  
         #endif
     }
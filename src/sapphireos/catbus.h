@@ -184,6 +184,30 @@ typedef struct __attribute__((packed)){
 } catbus_msg_link_data_t;
 #define CATBUS_MSG_TYPE_LINK_DATA               ( 2 + CATBUS_MSG_LINK_GROUP_OFFSET )
 
+// several link data items in one message, all from the same source node
+// to the same destination node.
+// only sent to nodes that set CATBUS_MSG_LINK_FLAG_MULTI_DATA in their
+// LINK messages, older nodes get one LINK_DATA per item.
+#define CATBUS_MSG_LINK_FLAG_MULTI_DATA         0x08
+
+typedef struct __attribute__((packed)){
+    catbus_hash_t32 source_hash;
+    catbus_hash_t32 dest_hash;
+    uint16_t sequence;
+    int32_t data;
+} catbus_link_data_entry_t;
+
+typedef struct __attribute__((packed)){
+    catbus_header_t header;
+    uint8_t flags;
+    ntp_ts_t ntp_timestamp;
+    catbus_query_t source_query;
+    uint8_t count;
+    catbus_link_data_entry_t first_entry;
+} catbus_msg_link_data_multi_t;
+#define CATBUS_MSG_TYPE_LINK_DATA_MULTI         ( 3 + CATBUS_MSG_LINK_GROUP_OFFSET )
+#define CATBUS_MAX_LINK_DATA_ENTRIES            16
+
 
 // FILE
 typedef struct __attribute__((packed)){
@@ -194,6 +218,11 @@ typedef struct __attribute__((packed)){
 #define CATBUS_MSG_TYPE_FILE_OPEN                ( 1 + CATBUS_MSG_FILE_GROUP_OFFSET )
 #define CATBUS_MSG_FILE_FLAG_READ               0x01
 #define CATBUS_MSG_FILE_FLAG_WRITE              0x02
+// client asks for windowed reads in FILE_OPEN.
+// server sets WINDOWED in FILE_CONFIRM if it supports them.
+// older servers echo the open flags, so they never set WINDOWED.
+#define CATBUS_MSG_FILE_FLAG_WINDOW_REQ         0x04
+#define CATBUS_MSG_FILE_FLAG_WINDOWED           0x08
 
 typedef struct __attribute__((packed)){
     catbus_header_t header;
@@ -276,6 +305,21 @@ typedef struct __attribute__((packed)){
 #define CATBUS_MSG_TYPE_FILE_LIST_DATA           ( 11 + CATBUS_MSG_FILE_GROUP_OFFSET )
 #define CATBUS_MAX_FILE_ENTRIES                  ( CATBUS_MAX_DATA / sizeof(catbus_file_meta_t) )
 
+// request a window of pages in a windowed read session.
+// bit n of page_mask requests the page at offset + n * page_size.
+// the server streams the requested pages back as FILE_DATA, in order.
+// a page past the end of the file is sent once with len 0, and ends
+// the window.
+typedef struct __attribute__((packed)){
+    catbus_header_t header;
+    uint8_t flags;
+    uint32_t session_id;
+    int32_t offset;
+    uint8_t page_mask;
+} catbus_msg_file_get_window_t;
+#define CATBUS_MSG_TYPE_FILE_GET_WINDOW          ( 12 + CATBUS_MSG_FILE_GROUP_OFFSET )
+#define CATBUS_FILE_MAX_WINDOW                   8
+
 
 void catbus_v_init( void );
 
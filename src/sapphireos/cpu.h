@@ -41,6 +41,7 @@
     #define PSTR(s) s
 
     #define strncpy_P strncpy
+    #define strlcpy_P strlcpy
     #define strncmp_P strncmp
     #define strcmp_P strcmp
     #define strlen_P strlen
@@ -65,6 +66,13 @@
     #define cli()
 
     char *itoa(long i, char* s, int dummy_radix);
+    void memcpy_PF( void *dest, uint32_t src, size_t len );
+
+    // glibc only provides strlcpy from 2.38 onwards
+    #if defined(__GLIBC__) && ( __GLIBC__ == 2 ) && ( __GLIBC_MINOR__ < 38 )
+        #define SIM_NEEDS_STRLCPY
+        size_t strlcpy( char *dst, const char *src, size_t size );
+    #endif
 
 #else
     #include <avr/io.h>
@@ -62,7 +62,9 @@ This module provides a low level SPI driver for 25 series flash memory.
     static uint8_t array[524288];
 #endif
 
+#ifndef __SIM__
 static bool aai_write_enabled;
+#endif
 
 #define BLOCK0_UNLOCK_CODE  0x1701
 static uint16_t block0_unlock;
@@ -32,6 +32,7 @@
 #include "ffs_fw.h"
 #include "crc.h"
 #include "kvdb.h"
+#include "list.h"
 
 // #define NO_LOGGING
 #include "logging.h"
@@ -40,6 +41,9 @@
 
 
 static uint32_t kv_persist_writes;
+static uint32_t kv_persist_coalesced;
+static uint32_t kv_persist_flushes;
+static uint16_t kv_persist_keys;
 static int32_t kv_test_key;
 
 static int16_t cached_index = -1;
@@ -93,6 +97,9 @@ static int8_t _kv_i8_dynamic_count_handler(
 
 KV_SECTION_META kv_meta_t kv_cfg[] = {
     { SAPPHIRE_TYPE_UINT32,  0, 0,                   &kv_persist_writes,  0,           "kv_persist_writes" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &kv_persist_coalesced, 0,         "kv_persist_coalesced" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &kv_persist_flushes, 0,           "kv_persist_flushes" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &kv_persist_keys,    0,           "kv_persist_keys" },
     { SAPPHIRE_TYPE_INT32,   0, 0,                   &kv_test_key,        0,           "kv_test_key" },
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  0, _kv_i8_dynamic_count_handler,  "kv_dynamic_count" },
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  0, _kv_i8_dynamic_count_handler,  "kv_dynamic_db_size" },
@@ -129,6 +136,7 @@ SERVICE_SECTION_START kv_svc_name_t svc_start = {"sapphire.device"};
 SERVICE_SECTION_END char svc_end[1] = "";
 
 static bool persist_fail;
+static bool persist_coalesce;
 static bool run_persist;
 
 typedef struct{
@@ -139,9 +147,43 @@ typedef struct{
 } kv_persist_block_header_t;
 #define KV_PERSIST_MAX_DATA_LEN     SAPPHIRE_TYPE_MAX_LEN
 #define KV_PERSIST_BLOCK_LEN        ( sizeof(kv_persist_block_header_t) + KV_PERSIST_MAX_DATA_LEN )
+#define KV_PERSIST_BLOCK_OFFSET( block ) \
+    ( sizeof(kv_persist_file_header_t) + ( (int32_t)( block ) * KV_PERSIST_BLOCK_LEN ) )
+
+// file block for each persisted hash, sorted by hash.
+// built when the file is loaded, so a persisted key is found without
+// scanning the file.
+typedef struct __attribute__((packed)){
+    catbus_hash_t32 hash;
+    uint16_t block;
+} kv_persist_index_t;
+
+static mem_handle_t persist_index_h = -1;
+static uint16_t persist_blocks;
+
+// the index grows this many entries at a time. a realloc needs
+// room for both copies, so growing by one entry per new key
+// quickly runs out of heap.
+#define KV_PERSIST_INDEX_GROW       16
+
+// sets to keys without a RAM pointer wait here until the flush timer
+// runs, so a burst of sets to the same key is one file write.
+// the data follows the struct.
+typedef struct{
+    catbus_hash_t32 hash;
+    sapphire_type_t8 type;
+    uint8_t array_len;
+    uint8_t len;
+} kv_persist_pending_t;
+
+static list_t persist_pending;
+
+#define KV_PERSIST_MAX_PENDING      8
+#define KV_PERSIST_FLUSH_DELAY      1000
 
 
 PT_THREAD( persist_thread( pt_t *pt, void *state ) );
+PT_THREAD( persist_flush_thread( pt_t *pt, void *state ) );
 
 static int8_t _kv_i8_persist_set_internal(
     file_t f,
@@ -392,12 +434,107 @@ int8_t kv_i8_get_name( catbus_hash_t32 hash, char name[KV_NAME_LEN] ){
 }
 
 
-static int8_t _kv_i8_init_persist( void ){
+// first entry with a hash >= hash
+static uint16_t _kv_u16_persist_index_lower_bound( kv_persist_index_t *index, catbus_hash_t32 hash ){
+
+    uint16_t first = 0;
+    uint16_t last = kv_persist_keys;
+
+    while( first < last ){
+
+        uint16_t middle = ( first + last ) / 2;
+
+        if( index[middle].hash < hash ){
+
+            first = middle + 1;
+        }
+        else{
+
+            last = middle;
+        }
+    }
+
+    return first;
+}
+
+// returns the file block for hash, or -1 if it is not in the file
+static int16_t _kv_i16_persist_index_get( catbus_hash_t32 hash ){
+
+    if( persist_index_h < 0 ){
+
+        return -1;
+    }
+
+    kv_persist_index_t *index = mem2_vp_get_ptr( persist_index_h );
+
+    uint16_t pos = _kv_u16_persist_index_lower_bound( index, hash );
+
+    if( ( pos < kv_persist_keys ) && ( index[pos].hash == hash ) ){
+
+        return index[pos].block;
+    }
+
+    return -1;
+}
+
+static int8_t _kv_i8_persist_index_add( catbus_hash_t32 hash, uint16_t block ){
+
+    uint16_t size = ( kv_persist_keys + 1 ) * sizeof(kv_persist_index_t);
+
+    if( persist_index_h < 0 ){
+
+        persist_index_h = mem2_h_alloc2( KV_PERSIST_INDEX_GROW * sizeof(kv_persist_index_t), MEM_TYPE_KV_PERSIST );
+
+        if( persist_index_h < 0 ){
+
+            return -1;
+        }
+    }
+    else if( mem2_u16_get_size( persist_index_h ) < size ){
+
+        size = ( kv_persist_keys + KV_PERSIST_INDEX_GROW ) * sizeof(kv_persist_index_t);
+
+        if( mem2_i8_realloc( persist_index_h, size ) < 0 ){
+
+            return -1;
+        }
+    }
+
+    kv_persist_index_t *index = mem2_vp_get_ptr( persist_index_h );
+
+    uint16_t pos = _kv_u16_persist_index_lower_bound( index, hash );
+
+    memmove( &index[pos + 1], &index[pos], ( kv_persist_keys - pos ) * sizeof(kv_persist_index_t) );
+
+    index[pos].hash = hash;
+    index[pos].block = block;
+
+    kv_persist_keys++;
+
+    return 0;
+}
+
+static void _kv_v_persist_index_reset( void ){
+
+    if( persist_index_h >= 0 ){
+
+        mem2_v_free( persist_index_h );
+        persist_index_h = -1;
+    }
+
+    kv_persist_keys = 0;
+    persist_blocks = 0;
+}
+
+// load values is FALSE in safe mode, where only the index is built
+static int8_t _kv_i8_init_persist( bool load_values ){
 
     bool file_retry = TRUE;
 
 retry:;
 
+    _kv_v_persist_index_reset();
+
     file_t f = fs_f_open_P( kv_data_fname, FS_MODE_WRITE_OVERWRITE | FS_MODE_CREATE_IF_NOT_FOUND );
 
     if( f < 0 ){
@@ -443,6 +580,25 @@ retry:;
 
     while( fs_i16_read( f, buf, sizeof(buf) ) == sizeof(buf) ){
 
+        // index the block. if a hash appears more than once,
+        // the first block is used, as a scan of the file would.
+        if( _kv_i16_persist_index_get( hdr->hash ) < 0 ){
+
+            if( _kv_i8_persist_index_add( hdr->hash, persist_blocks ) < 0 ){
+
+                fs_f_close( f );
+
+                return -1;
+            }
+        }
+
+        persist_blocks++;
+
+        if( !load_values ){
+
+            continue;
+        }
+
         // look up meta data, verify type matches, and check if there is
         // a memory pointer
         int8_t status = kv_i8_lookup_hash( hdr->hash, &meta, 0 );
@@ -472,26 +628,40 @@ void kv_v_init( void ){
 
     // fs_f_create_virtual( PSTR("kvmeta"), kv_meta_vfile_handler );
 
+    list_v_init( &persist_pending );
+
     // check if safe mode
     if( sys_u8_get_mode() != SYS_MODE_SAFE ){
 
         // initialize all persisted KV items
-        int8_t status = _kv_i8_init_persist();
+        int8_t status = _kv_i8_init_persist( TRUE );
 
         if( status == 0 ){
 
             persist_fail = FALSE;
+            persist_coalesce = TRUE;
 
             thread_t_create( persist_thread,
                          PSTR("kv_persist"),
                          0,
                          0 );
+
+            thread_t_create( persist_flush_thread,
+                         PSTR("kv_persist_flush"),
+                         0,
+                         0 );
         }
         else{
 
             persist_fail = TRUE;
         }
     }
+    else{
+
+        // no flush thread in safe mode, so sets are written
+        // straight to the file.
+        persist_fail = ( _kv_i8_init_persist( FALSE ) < 0 );
+    }
 }
 
 
@@ -513,18 +683,15 @@ static int8_t _kv_i8_persist_set_internal(
 
     kv_persist_block_header_t hdr;
 
-    fs_v_seek( f, sizeof(kv_persist_file_header_t) );
+    int16_t block = _kv_i16_persist_index_get( hash );
 
-    // seek to matching item or end of file
-    while( fs_i16_read( f, &hdr, sizeof(hdr) ) == sizeof(hdr) ){
+    if( block >= 0 ){
 
-        // check for match
-        if( hdr.hash == hash ){
+        fs_v_seek( f, KV_PERSIST_BLOCK_OFFSET( block ) );
 
-            // remember current position
-            int32_t pos = fs_i32_tell( f );
+        if( ( fs_i16_read( f, &hdr, sizeof(hdr) ) == sizeof(hdr) ) &&
+            ( hdr.hash == hash ) ){
 
-            // found our match
             // copy data into buffer
             fs_i16_read( f, buf, len );
 
@@ -535,15 +702,22 @@ static int8_t _kv_i8_persist_set_internal(
 
                 goto end;
             }
+        }
 
-            // back up the file position to before header
-            fs_v_seek( f, pos - sizeof(hdr) );
+        // back up the file position to before header
+        fs_v_seek( f, KV_PERSIST_BLOCK_OFFSET( block ) );
+    }
+    else{
 
-            break;
+        // new key, it goes on the end of the file
+        if( _kv_i8_persist_index_add( hash, persist_blocks ) < 0 ){
+
+            return -1;
         }
 
-        // advance position to next entry
-        fs_v_seek( f, fs_i32_tell( f ) + KV_PERSIST_MAX_DATA_LEN );
+        fs_v_seek( f, KV_PERSIST_BLOCK_OFFSET( persist_blocks ) );
+
+        persist_blocks++;
     }
 
     // set up header
@@ -584,6 +758,120 @@ end:
 }
 
 
+static int8_t _kv_i8_persist_write(
+    kv_meta_t *meta,
+    catbus_hash_t32 hash,
+    const void *data,
+    uint16_t len )
+{
+
+    file_t f = fs_f_open_P( kv_data_fname, FS_MODE_WRITE_OVERWRITE | FS_MODE_CREATE_IF_NOT_FOUND );
+
+    if( f < 0 ){
+
+        return -1;
+    }
+
+    int8_t status = _kv_i8_persist_set_internal( f, meta, hash, data, len );
+
+    fs_f_close( f );
+
+    return status;
+}
+
+static list_node_t _kv_ln_persist_pending_find( catbus_hash_t32 hash ){
+
+    list_node_t ln = persist_pending.head;
+
+    while( ln >= 0 ){
+
+        kv_persist_pending_t *pending = list_vp_get_data( ln );
+
+        if( pending->hash == hash ){
+
+            return ln;
+        }
+
+        ln = list_ln_next( ln );
+    }
+
+    return -1;
+}
+
+static int8_t _kv_i8_persist_pending_get( catbus_hash_t32 hash, void *data, uint16_t len ){
+
+    list_node_t ln = _kv_ln_persist_pending_find( hash );
+
+    if( ln < 0 ){
+
+        return -1;
+    }
+
+    kv_persist_pending_t *pending = list_vp_get_data( ln );
+
+    uint16_t copy_len = pending->len;
+
+    if( copy_len > len ){
+
+        copy_len = len;
+    }
+
+    // the file pads data with 0s, so match that
+    memset( data, 0, len );
+    memcpy( data, pending + 1, copy_len );
+
+    return 0;
+}
+
+void kv_v_persist_flush( void ){
+
+    if( list_u8_count( &persist_pending ) == 0 ){
+
+        return;
+    }
+
+    file_t f = fs_f_open_P( kv_data_fname, FS_MODE_WRITE_OVERWRITE | FS_MODE_CREATE_IF_NOT_FOUND );
+
+    if( f < 0 ){
+
+        // leave them pending, the next flush will try again
+        return;
+    }
+
+    kv_persist_flushes++;
+
+    // oldest first
+    list_node_t ln;
+
+    while( ( ln = persist_pending.tail ) >= 0 ){
+
+        kv_persist_pending_t *pending = list_vp_get_data( ln );
+
+        // copy out of the node, the file system allocates memory
+        uint8_t buf[KV_PERSIST_MAX_DATA_LEN];
+        catbus_hash_t32 hash = pending->hash;
+        uint16_t len = pending->len;
+        memcpy( buf, pending + 1, len );
+
+        kv_meta_t meta;
+        memset( &meta, 0, sizeof(meta) );
+        meta.type       = pending->type;
+        meta.array_len  = pending->array_len;
+
+        if( _kv_i8_persist_set_internal( f, &meta, hash, buf, len ) < 0 ){
+
+            // out of memory for the index, leave this and the
+            // rest pending for the next flush
+            break;
+        }
+
+        list_v_remove( &persist_pending, ln );
+        list_v_release_node( ln );
+    }
+
+    fs_f_close( f );
+}
+
 static int8_t _kv_i8_persist_set(
     kv_meta_t *meta,
     catbus_hash_t32 hash,
@@ -598,18 +886,54 @@ static int8_t _kv_i8_persist_set(
 
     ASSERT( len <= KV_PERSIST_MAX_DATA_LEN );
 
-    file_t f = fs_f_open_P( kv_data_fname, FS_MODE_WRITE_OVERWRITE | FS_MODE_CREATE_IF_NOT_FOUND );
+    if( !persist_coalesce ){
 
-    if( f < 0 ){
+        return _kv_i8_persist_write( meta, hash, data, len );
+    }
 
-        return -1;
+    // check if this key is already waiting to be written
+    list_node_t ln = _kv_ln_persist_pending_find( hash );
+
+    if( ( ln >= 0 ) &&
+        ( ( (kv_persist_pending_t *)list_vp_get_data( ln ) )->len != len ) ){
+
+        // length changed, replace the node
+        list_v_remove( &persist_pending, ln );
+        list_v_release_node( ln );
+        ln = -1;
     }
 
-    int8_t status = _kv_i8_persist_set_internal( f, meta, hash, data, len );
+    if( ln >= 0 ){
 
-    fs_f_close( f );
+        kv_persist_coalesced++;
+    }
+    else{
 
-    return status;
+        if( list_u8_count( &persist_pending ) >= KV_PERSIST_MAX_PENDING ){
+
+            kv_v_persist_flush();
+        }
+
+        ln = list_ln_create_node2( 0, sizeof(kv_persist_pending_t) + len, MEM_TYPE_KV_PERSIST );
+
+        if( ln < 0 ){
+
+            // no memory to hold it, write it now
+            return _kv_i8_persist_write( meta, hash, data, len );
+        }
+
+        list_v_insert_head( &persist_pending, ln );
+    }
+
+    kv_persist_pending_t *pending = list_vp_get_data( ln );
+
+    pending->hash       = hash;
+    pending->type       = meta->type;
+    pending->array_len  = meta->array_len;
+    pending->len        = len;
+    memcpy( pending + 1, data, len );
+
+    return 0;
 }
 
 static int8_t _kv_i8_internal_set(
@@ -694,6 +1018,17 @@ int8_t kv_i8_set_by_hash(
     return _kv_i8_internal_set( &meta, hash, data, len );
 }
 
+// set using meta data from a previous kv_i8_lookup_hash,
+// saves a second search when the caller already has it.
+int8_t kv_i8_set_by_meta(
+    kv_meta_t *meta,
+    catbus_hash_t32 hash,
+    const void *data,
+    uint16_t len )
+{
+    return _kv_i8_internal_set( meta, hash, data, len );
+}
+
 
 static int8_t _kv_i8_persist_get(
     kv_meta_t *meta,
@@ -701,29 +1036,32 @@ static int8_t _kv_i8_persist_get(
     void *data,
     uint16_t len )
 {
-    file_t f = fs_f_open_P( kv_data_fname, FS_MODE_READ_ONLY );
+    // a pending value is newer than the one in the file
+    if( _kv_i8_persist_pending_get( hash, data, len ) == 0 ){
 
-    if( f < 0 ){
+        return 0;
+    }
+
+    int16_t block = _kv_i16_persist_index_get( hash );
+
+    if( block < 0 ){
 
         return -1;
     }
 
-    fs_v_seek( f, sizeof(kv_persist_file_header_t) );
+    file_t f = fs_f_open_P( kv_data_fname, FS_MODE_READ_ONLY );
 
-    kv_persist_block_header_t hdr;
-    memset( &hdr, 0, sizeof(hdr) ); // init to all 0s in case the file is empty
+    if( f < 0 ){
 
-    // seek to matching item or end of file
-    while( fs_i16_read( f, &hdr, sizeof(hdr) ) == sizeof(hdr) ){
+        return -1;
+    }
 
-        if( hdr.hash == hash ){
+    fs_v_seek( f, KV_PERSIST_BLOCK_OFFSET( block ) );
 
-            break;
-        }
+    kv_persist_block_header_t hdr;
+    memset( &hdr, 0, sizeof(hdr) ); // init to all 0s in case the file is short
 
-        // advance position to next entry
-        fs_v_seek( f, fs_i32_tell( f ) + KV_PERSIST_MAX_DATA_LEN );
-    }
+    fs_i16_read( f, &hdr, sizeof(hdr) );
 
     uint16_t data_read = 0;
 
@@ -820,6 +1158,15 @@ int8_t kv_i8_get_by_hash(
     return _kv_i8_internal_get( &meta, hash, data, max_len );
 }
 
+int8_t kv_i8_get_by_meta(
+    kv_meta_t *meta,
+    catbus_hash_t32 hash,
+    void *data,
+    uint16_t max_len )
+{
+    return _kv_i8_internal_get( meta, hash, data, max_len );
+}
+
 
 int16_t kv_i16_len( catbus_hash_t32 hash )
 {
@@ -939,6 +1286,23 @@ end:
 PT_END( pt );
 }
 
+PT_THREAD( persist_flush_thread( pt_t *pt, void *state ) )
+{
+PT_BEGIN( pt );
+
+    while(1){
+
+        THREAD_WAIT_WHILE( pt, list_u8_count( &persist_pending ) == 0 );
+
+        // give more sets a chance to land on the pending keys
+        TMR_WAIT( pt, KV_PERSIST_FLUSH_DELAY );
+
+        kv_v_persist_flush();
+    }
+
+PT_END( pt );
+}
+
 
 int8_t kv_i8_publish( catbus_hash_t32 hash ){
     
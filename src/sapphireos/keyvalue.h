@@ -128,6 +128,7 @@ int16_t kv_i16_len( catbus_hash_t32 hash );
 sapphire_type_t8 kv_i8_type( catbus_hash_t32 hash );
 
 int8_t kv_i8_persist( catbus_hash_t32 hash );
+void kv_v_persist_flush( void );
     
 uint16_t kv_u16_get_size_meta( kv_meta_t *meta );
 
@@ -141,6 +142,18 @@ int8_t kv_i8_get_by_hash(
     void *data,
     uint16_t max_len );
 
+int8_t kv_i8_set_by_meta(
+    kv_meta_t *meta,
+    catbus_hash_t32 hash,
+    const void *data,
+    uint16_t len );
+
+int8_t kv_i8_get_by_meta(
+    kv_meta_t *meta,
+    catbus_hash_t32 hash,
+    void *data,
+    uint16_t max_len );
+
 int8_t kv_i8_link_get(
     catbus_hash_t32 hash,
     int32_t *data );
@@ -43,6 +43,10 @@ static uint16_t kv_count;
 static uint16_t db_size;
 static mem_handle_t handle = -1;
 
+// changes whenever entries move, so callers holding
+// indexes know to look them up again.
+static uint16_t generation;
+
 
 typedef struct __attribute__((packed)){
     catbus_hash_t32 hash;
@@ -62,77 +66,84 @@ typedef struct __attribute__((packed)){
 } name_entry_t;
 #endif
 
-static int16_t cached_index = -1;
-static catbus_hash_t32 cached_hash;
+// direct mapped cache of recent lookups.
+// indexes change when entries are added or removed, so those
+// clear the whole cache.
+typedef struct{
+    catbus_hash_t32 hash;
+    int16_t index;
+} cache_entry_t;
 
-static int16_t _kvdb_i16_search_hash( catbus_hash_t32 hash ){
+static cache_entry_t hash_cache[KVDB_CACHE_SIZE];
 
-    if( hash == 0 ){
+static uint8_t _kvdb_u8_cache_slot( catbus_hash_t32 hash ){
 
-        return -1;
-    }
+    return ( hash ^ ( hash >> 16 ) ) & ( KVDB_CACHE_SIZE - 1 );
+}
 
-    // check cache
-    if( ( cached_index >= 0 ) && ( cached_hash == hash ) ){
+// call whenever entries move
+static void _kvdb_v_reset_cache( void ){
 
-        return cached_index;
-    }
+    // hash 0 is never valid, so a zeroed entry never matches
+    memset( hash_cache, 0, sizeof(hash_cache) );
+
+    generation++;
+}
+
+// entries [0, kv_count) are in use and sorted by descending hash.
+// returns the first index whose hash is not greater than hash, which
+// is where hash is, or where it would be inserted.
+static int16_t _kvdb_i16_lower_bound( db_entry32_t *entry, catbus_hash_t32 hash ){
 
-    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
     int16_t first = 0;
-    int16_t last = db_size - 1;
-    int16_t middle = ( first + last ) / 2;
-    
-    // binary search through hash index
-    while( first <= last ){
+    int16_t last = kv_count;
 
-        if( entry[middle].hash > hash ){
+    while( first < last ){
 
-            first = middle + 1;
-        }    
-        else if( entry[middle].hash == hash ){
+        int16_t middle = ( first + last ) / 2;
 
-            cached_hash = hash;
-            cached_index = middle;
+        if( entry[middle].hash > hash ){
 
-            return middle;
+            first = middle + 1;
         }
         else{
 
-            last = middle - 1;
+            last = middle;
         }
-
-        middle = ( first + last ) / 2;
     }
 
-    return -1;
+    return first;
 }
 
-static void _kvdb_v_sort( void ){
+static int16_t _kvdb_i16_search_hash( catbus_hash_t32 hash ){
 
-    // bubble sort
+    if( hash == 0 ){
 
-    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+        return -1;
+    }
+
+    // check cache
+    cache_entry_t *cache = &hash_cache[_kvdb_u8_cache_slot( hash )];
 
-    bool swapped;
-    do{
+    if( cache->hash == hash ){
 
-        swapped = FALSE;
+        return cache->index;
+    }
+
+    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
     
-        for( uint16_t i = 1; i < db_size; i++ ){            
+    // binary search through hash index
+    int16_t index = _kvdb_i16_lower_bound( entry, hash );
 
-            if( entry[i - 1].hash < entry[i].hash ){
+    if( ( index < kv_count ) && ( entry[index].hash == hash ) ){
 
-                // swap values
-                db_entry32_t temp = entry[i];
-                entry[i] = entry[i - 1];
-                entry[i - 1] = temp;
+        cache->hash = hash;
+        cache->index = index;
 
-                swapped = TRUE;
-            }
-        }                
+        return index;
+    }
 
-    } while( swapped );
+    return -1;
 }
 
 #ifdef KVDB_ENABLE_NAME_LOOKUP
@@ -267,38 +278,29 @@ int8_t kvdb_i8_add( catbus_hash_t32 hash, int32_t data, uint8_t tag, char name[C
 
     db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
 
-    // find a free index
-    for( uint16_t i = 0; i < db_size; i++ ){
-
-        // check if free
-        if( entry[i].hash == 0 ){
+    // insert in sorted position
+    int16_t index = _kvdb_i16_lower_bound( entry, hash );
 
-            // add
-            entry[i].hash   = hash;
-            entry[i].data   = data;
-            entry[i].flags  = CATBUS_FLAGS_DYNAMIC;
-            entry[i].tag    = tag;
-            entry[i].type   = CATBUS_TYPE_INT32;
+    memmove( &entry[index + 1], &entry[index], ( kv_count - index ) * sizeof(db_entry32_t) );
 
-            #ifdef KVDB_ENABLE_NAME_LOOKUP
-            // add name
-            if( name != 0 ){
-
-                _kvdb_v_add_name( name );
-            }
-            #endif
-
-            break;
-        }
-    }
+    entry[index].hash   = hash;
+    entry[index].data   = data;
+    entry[index].flags  = CATBUS_FLAGS_DYNAMIC;
+    entry[index].tag    = tag;
+    entry[index].type   = CATBUS_TYPE_INT32;
 
     kv_count++;
 
-    // now we need to sort
+    // everything after the new entry moved
+    _kvdb_v_reset_cache();
 
-    // bubble sort
-    _kvdb_v_sort();
+    #ifdef KVDB_ENABLE_NAME_LOOKUP
+    // add name
+    if( name != 0 ){
 
+        _kvdb_v_add_name( name );
+    }
+    #endif
 
     return KVDB_STATUS_OK;
 }
@@ -321,22 +323,7 @@ int8_t kvdb_i8_set( catbus_hash_t32 hash, int32_t data ){
     // check if found
     if( index >= 0 ){
 
-        db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
-
-        bool changed = entry[index].data != data;
-
-        entry[index].data = data;
-
-        // check if there is a notifier and data is changing
-        if( ( kvdb_v_notify_set != 0 ) && ( changed ) ){
-
-            catbus_meta_t meta;
-            kvdb_i8_get_meta( hash, &meta );
-
-            kvdb_v_notify_set( hash, &meta, &data );
-        }
-
-        return KVDB_STATUS_OK;
+        return kvdb_i8_set_by_index( index, data );
     }
     
     return KVDB_STATUS_NOT_FOUND;    
@@ -355,10 +342,7 @@ int8_t kvdb_i8_get( catbus_hash_t32 hash, int32_t *data ){
     // check if found
     if( index >= 0 ){
 
-        db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
-        *data = entry[index].data;
-
-        return KVDB_STATUS_OK;
+        return kvdb_i8_get_by_index( index, data );
     }
     
     // not found
@@ -368,6 +352,130 @@ int8_t kvdb_i8_get( catbus_hash_t32 hash, int32_t *data ){
     return KVDB_STATUS_NOT_FOUND;
 }
 
+// index access, for callers that resolve their keys once.
+// indexes are valid until kvdb_u16_get_generation() changes.
+int8_t kvdb_i8_set_by_index( int16_t index, int32_t data ){
+
+    if( ( handle < 0 ) || ( index < 0 ) || ( index >= kv_count ) ){
+
+        return KVDB_STATUS_NOT_FOUND;
+    }
+
+    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+
+    bool changed = entry[index].data != data;
+
+    entry[index].data = data;
+
+    // check if there is a notifier and data is changing
+    if( ( kvdb_v_notify_set != 0 ) && ( changed ) ){
+
+        catbus_hash_t32 hash = entry[index].hash;
+
+        catbus_meta_t meta;
+        kvdb_i8_get_meta( hash, &meta );
+
+        kvdb_v_notify_set( hash, &meta, &data );
+    }
+
+    return KVDB_STATUS_OK;
+}
+
+int8_t kvdb_i8_get_by_index( int16_t index, int32_t *data ){
+
+    if( ( handle < 0 ) || ( index < 0 ) || ( index >= kv_count ) ){
+
+        *data = 0;
+
+        return KVDB_STATUS_NOT_FOUND;
+    }
+
+    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+    *data = entry[index].data;
+
+    return KVDB_STATUS_OK;
+}
+
+uint16_t kvdb_u16_get_generation( void ){
+
+    return generation;
+}
+
+// get count keys at once, data[i] is the value for hashes[i].
+// missing keys read as 0, and the rest are still read.
+int8_t kvdb_i8_get_multi( const catbus_hash_t32 *hashes, int32_t *data, uint16_t count ){
+
+    if( handle < 0 ){
+
+        return KVDB_STATUS_NOT_ENOUGH_SPACE;
+    }
+
+    int8_t status = KVDB_STATUS_OK;
+    db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+
+    for( uint16_t i = 0; i < count; i++ ){
+
+        int16_t index = _kvdb_i16_search_hash( hashes[i] );
+
+        if( index >= 0 ){
+
+            data[i] = entry[index].data;
+        }
+        else{
+
+            data[i] = 0;
+            status = KVDB_STATUS_NOT_FOUND;
+        }
+    }
+
+    return status;
+}
+
+// set count keys at once, hashes[i] is set to data[i].
+// missing keys are skipped, and the rest are still set.
+int8_t kvdb_i8_set_multi( const catbus_hash_t32 *hashes, const int32_t *data, uint16_t count ){
+
+    if( handle < 0 ){
+
+        return KVDB_STATUS_NOT_ENOUGH_SPACE;
+    }
+
+    int8_t status = KVDB_STATUS_OK;
+
+    for( uint16_t i = 0; i < count; i++ ){
+
+        int16_t index = _kvdb_i16_search_hash( hashes[i] );
+
+        if( index < 0 ){
+
+            status = KVDB_STATUS_NOT_FOUND;
+
+            continue;
+        }
+
+        // the notifier can allocate, so get the pointer each time
+        db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
+
+        if( entry[index].data == data[i] ){
+
+            continue;
+        }
+
+        entry[index].data = data[i];
+
+        if( kvdb_v_notify_set != 0 ){
+
+            catbus_meta_t meta;
+            kvdb_i8_get_meta( hashes[i], &meta );
+
+            int32_t temp = data[i];
+            kvdb_v_notify_set( hashes[i], &meta, &temp );
+        }
+    }
+
+    return status;
+}
+
 int8_t kvdb_i8_get_meta( catbus_hash_t32 hash, catbus_meta_t *meta ){
 
     if( handle < 0 ){
@@ -413,16 +521,15 @@ int8_t kvdb_i8_delete( catbus_hash_t32 hash ){
     if( index >= 0 ){
 
         db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
-        entry[index].hash = 0;
 
         kv_count--;
 
-        // need to resort
-
-        _kvdb_v_sort();
+        // close the gap, order is unchanged
+        memmove( &entry[index], &entry[index + 1], ( kv_count - index ) * sizeof(db_entry32_t) );
+        entry[kv_count].hash = 0;
 
         // reset cache
-        cached_index = -1;
+        _kvdb_v_reset_cache();
 
         return KVDB_STATUS_OK;
     }
@@ -439,24 +546,33 @@ void kvdb_v_delete_tag( uint8_t tag ){
 
     db_entry32_t *entry = (db_entry32_t *)mem2_vp_get_ptr( handle );
 
-    for( uint16_t i = 0; i < db_size; i++ ){
+    // compact the remaining entries, order is unchanged
+    uint16_t count = 0;
 
-        if( entry[i].hash == 0 ){
+    for( uint16_t i = 0; i < kv_count; i++ ){
+
+        if( entry[i].tag == tag ){
 
             continue;
         }
 
-        if( entry[i].tag == tag ){
+        if( count != i ){
 
-            entry[i].hash = 0;       
-            kv_count--;
+            entry[count] = entry[i];
         }
+
+        count++;
     }
 
-    // reset cache
-    cached_index = -1;
+    for( uint16_t i = count; i < kv_count; i++ ){
 
-    _kvdb_v_sort();
+        entry[i].hash = 0;
+    }
+
+    kv_count = count;
+
+    // reset cache
+    _kvdb_v_reset_cache();
 }
 
 int8_t kvdb_i8_publish( catbus_hash_t32 hash ){
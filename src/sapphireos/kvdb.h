@@ -36,6 +36,11 @@ uint16_t kvdb_u16_db_size( void );
 int8_t kvdb_i8_add( catbus_hash_t32 hash, int32_t data, uint8_t tag, char name[CATBUS_STRING_LEN] );
 int8_t kvdb_i8_set( catbus_hash_t32 hash, int32_t data );
 int8_t kvdb_i8_get( catbus_hash_t32 hash, int32_t *data );
+int8_t kvdb_i8_get_multi( const catbus_hash_t32 *hashes, int32_t *data, uint16_t count );
+int8_t kvdb_i8_set_multi( const catbus_hash_t32 *hashes, const int32_t *data, uint16_t count );
+int8_t kvdb_i8_set_by_index( int16_t index, int32_t data );
+int8_t kvdb_i8_get_by_index( int16_t index, int32_t *data );
+uint16_t kvdb_u16_get_generation( void );
 int8_t kvdb_i8_get_meta( catbus_hash_t32 hash, catbus_meta_t *meta );
 int8_t kvdb_i8_delete( catbus_hash_t32 hash );
 void kvdb_v_delete_tag( uint8_t tag );
@@ -27,6 +27,10 @@
 
 #include "memory.h"
 
+// uncomment to check the list count and size against the nodes
+// every time they are read. this walks the list, so it is slow.
+// #define ENABLE_LIST_VERIFY
+
 typedef mem_handle_t list_node_t;
 
 typedef struct{
@@ -39,6 +43,8 @@ typedef struct{
     uint8_t init;
     list_node_t head;
     list_node_t tail;
+    uint16_t count;
+    uint16_t size;  // data bytes in all nodes
 } list_t;
 
 
@@ -39,6 +39,15 @@ Heap format: used and dirty blocks - free space
 
 Memory overhead is 6 bytes per handle used
 
+Free handles are tracked in a bitmap, so getting a handle only has to
+look for the first byte that is not 0xff instead of scanning handles[].
+
+If the small object pools are enabled, small allocations are placed in
+fixed size slots outside of the heap. They have the same header and
+canary as a heap block, so the rest of the API does not need to know
+the difference. A freed slot is put straight back in its pool's bitmap
+instead of being marked dirty.
+
 */
 
 
@@ -49,6 +58,7 @@ Memory overhead is 6 bytes per handle used
 #include "keyvalue.h"
 
 #include "fs.h"
+#include "timers.h"
 #include "memory.h"
 
 //#define NO_LOGGING
@@ -67,6 +77,17 @@ Memory overhead is 6 bytes per handle used
 
 static void *handles[MAX_MEM_HANDLES];
 
+// handles are swizzled by 1 and have to fit in a mem_handle_t
+#if MAX_MEM_HANDLES > 127
+    #define MEM_HANDLE_COUNT 127
+#else
+    #define MEM_HANDLE_COUNT MAX_MEM_HANDLES
+#endif
+
+// free handle bitmap, a set bit is an allocated handle
+static uint8_t handle_map[( MAX_MEM_HANDLES + 7 ) / 8];
+static uint16_t handle_map_hint;
+
 #ifdef __SIM__
     static uint8_t _heap[MEM_HEAP_SIZE];
     static uint8_t *heap = _heap;
@@ -81,6 +102,39 @@ static uint16_t stack_usage;
 
 static uint32_t mem_allocs;
 static uint32_t mem_alloc_fails;
+static uint32_t mem_alloc_time_total;
+
+// incremental garbage collector state
+static bool gc_active;
+static mem_block_header_t *gc_clean;
+static mem_block_header_t *gc_dirty;
+
+#ifdef ENABLE_MEM_POOLS
+
+#define MEM_POOL_SLOT_SIZE( size ) ( sizeof(mem_block_header_t) + ( size ) + 1 )
+
+static uint8_t pool_small[MEM_POOL_SMALL_COUNT * MEM_POOL_SLOT_SIZE( MEM_POOL_SMALL_SIZE )];
+static uint8_t pool_small_map[( MEM_POOL_SMALL_COUNT + 7 ) / 8];
+static uint16_t pool_small_hint;
+static uint8_t pool_large[MEM_POOL_LARGE_COUNT * MEM_POOL_SLOT_SIZE( MEM_POOL_LARGE_SIZE )];
+static uint8_t pool_large_map[( MEM_POOL_LARGE_COUNT + 7 ) / 8];
+static uint16_t pool_large_hint;
+
+typedef struct{
+    uint8_t *slots;
+    uint8_t *map;
+    uint16_t *hint; // kept outside the packed struct so it can be passed by pointer
+    uint16_t size;
+    uint16_t count;
+} mem_pool_t;
+
+// smallest first
+static mem_pool_t pools[] = {
+    { pool_small, pool_small_map, &pool_small_hint, MEM_POOL_SMALL_SIZE, MEM_POOL_SMALL_COUNT },
+    { pool_large, pool_large_map, &pool_large_hint, MEM_POOL_LARGE_SIZE, MEM_POOL_LARGE_COUNT },
+};
+
+#endif
 
 #ifndef __SIM__
     extern uint8_t __stack, __heap_start, _end;
@@ -173,6 +227,20 @@ static int8_t mem_i8_kv_handler(
 
             a = mem2_u16_stack_count();
         }
+        else if( hash == __KV__mem_alloc_time_avg ){
+
+            mem_rt_data_t rt_data;
+            mem2_v_get_rt_data( &rt_data );
+
+            a = rt_data.alloc_time_avg;
+        }
+        else if( hash == __KV__mem_fragmentation ){
+
+            mem_rt_data_t rt_data;
+            mem2_v_get_rt_data( &rt_data );
+
+            a = rt_data.fragmentation;
+        }
         else{
 
             ASSERT( FALSE );
@@ -196,6 +264,15 @@ KV_SECTION_META kv_meta_t mem_info_kv[] = {
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.dirty_space,   0,  "mem_dirty" },
     { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &mem_allocs,                0,  "mem_allocs" },
     { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &mem_alloc_fails,           0,  "mem_alloc_fails" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.alloc_time_max, 0, "mem_alloc_time_max" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  0, mem_i8_kv_handler,           "mem_alloc_time_avg" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  0, mem_i8_kv_handler,           "mem_fragmentation" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.pool_used,     0,  "mem_pool_used" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.pool_fails,    0,  "mem_pool_fails" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.gc_max_pause,  0,  "mem_gc_max_pause" },
+    { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.gc_max_moved,  0,  "mem_gc_max_moved" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.gc_bytes_moved, 0, "mem_gc_bytes_moved" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &mem_rt_data.gc_passes,     0,  "mem_gc_passes" },
 };
 
 
@@ -246,6 +323,128 @@ static void set_dirty( mem_block_header_t *header ){
     header->size |= MEM_SIZE_DIRTY_MASK;
 }
 
+// set up a bitmap for count entries.
+// the unused bits in the last byte are marked as allocated.
+static void map_v_init( uint8_t *map, uint16_t count, uint16_t *hint ){
+
+    uint16_t bytes = ( count + 7 ) / 8;
+
+    memset( map, 0, bytes );
+
+    for( uint16_t i = count; i < ( bytes * 8 ); i++ ){
+
+        map[i / 8] |= ( 1 << ( i % 8 ) );
+    }
+
+    *hint = 0;
+}
+
+// find a free entry in a bitmap and mark it as allocated.
+// hint is the first byte that may have a free bit, all bytes
+// before it are full.
+// returns -1 if the map is full.
+static int16_t map_i16_acquire( uint8_t *map, uint16_t count, uint16_t *hint ){
+
+    uint16_t bytes = ( count + 7 ) / 8;
+
+    while( *hint < bytes ){
+
+        uint8_t byte = map[*hint];
+
+        if( byte != 0xff ){
+
+            uint8_t bit = 0;
+
+            while( ( byte & ( 1 << bit ) ) != 0 ){
+
+                bit++;
+            }
+
+            map[*hint] |= ( 1 << bit );
+
+            return ( *hint * 8 ) + bit;
+        }
+
+        ( *hint )++;
+    }
+
+    return -1;
+}
+
+static void map_v_release( uint8_t *map, uint16_t index, uint16_t *hint ){
+
+    map[index / 8] &= ~( 1 << ( index % 8 ) );
+
+    if( ( index / 8 ) < *hint ){
+
+        *hint = index / 8;
+    }
+}
+
+static void map_v_set( uint8_t *map, uint16_t index ){
+
+    map[index / 8] |= ( 1 << ( index % 8 ) );
+}
+
+#ifdef ENABLE_MEM_POOLS
+// get a slot from the smallest pool that fits.
+// returns 0 if the size is too large for the pools, or the pool is full.
+static mem_block_header_t *pool_p_alloc( uint16_t size ){
+
+    for( uint8_t i = 0; i < cnt_of_array(pools); i++ ){
+
+        mem_pool_t *pool = &pools[i];
+
+        if( size > pool->size ){
+
+            continue;
+        }
+
+        int16_t slot = map_i16_acquire( pool->map, pool->count, pool->hint );
+
+        if( slot < 0 ){
+
+            mem_rt_data.pool_fails++;
+
+            return 0;
+        }
+
+        mem_rt_data.pool_used++;
+
+        return (mem_block_header_t *)( pool->slots + ( slot * MEM_POOL_SLOT_SIZE( pool->size ) ) );
+    }
+
+    return 0;
+}
+
+// returns TRUE if the block is in a pool
+static bool pool_b_release( mem_block_header_t *header ){
+
+    uint8_t *ptr = (uint8_t *)header;
+
+    for( uint8_t i = 0; i < cnt_of_array(pools); i++ ){
+
+        mem_pool_t *pool = &pools[i];
+
+        uint16_t slot_size = MEM_POOL_SLOT_SIZE( pool->size );
+
+        if( ( ptr < pool->slots ) ||
+            ( ptr >= ( pool->slots + ( pool->count * slot_size ) ) ) ){
+
+            continue;
+        }
+
+        map_v_release( pool->map, ( ptr - pool->slots ) / slot_size, pool->hint );
+
+        mem_rt_data.pool_used--;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+#endif
+
 #ifndef ENABLE_EXTENDED_VERIFY
 static void verify_handle( mem_handle_t handle ){
 
@@ -303,6 +502,8 @@ void mem2_v_init( void ){
 	mem_rt_data.data_space = 0;
 	mem_rt_data.dirty_space = 0;
 
+    gc_active = FALSE;
+
 	for( uint16_t i = 0; i < MAX_MEM_HANDLES; i++ ){
 
 		handles[i] = 0;
@@ -310,6 +511,15 @@ void mem2_v_init( void ){
 
 	mem_rt_data.handles_used = 0;
 
+    map_v_init( handle_map, MEM_HANDLE_COUNT, &handle_map_hint );
+
+    #ifdef ENABLE_MEM_POOLS
+    for( uint8_t i = 0; i < cnt_of_array(pools); i++ ){
+
+        map_v_init( pools[i].map, pools[i].count, pools[i].hint );
+    }
+    #endif
+
     fs_f_create_virtual( PSTR("handleinfo"), mem_info_vfile_handler );
 }
 
@@ -395,40 +605,64 @@ static mem_handle_t alloc( uint16_t size, mem_type_t8 type ){
 
     MEM_ATOMIC;
 
+    uint32_t start_time = tmr_u32_get_system_time_us();
+
     mem_handle_t handle = -1;
 
-    // check if there is free space available
-    if( mem_rt_data.free_space < ( size + sizeof(mem_block_header_t) + 1 ) ){
+    // get a handle
+    int16_t index = map_i16_acquire( handle_map, MEM_HANDLE_COUNT, &handle_map_hint );
 
-        // allocation failed
+    // if a handle was not found
+    if( index < 0 ){
+
+        // handle allocation failed
         goto finish;
     }
 
-    // get a handle
-    for( handle = 0; handle < MAX_MEM_HANDLES; handle++ ){
+    mem_block_header_t *header = 0;
+
+    #ifdef ENABLE_MEM_POOLS
+    header = pool_p_alloc( size );
+    #endif
 
-        if( handles[handle] == 0 ){
+    if( header == 0 ){
 
-            mem_rt_data.handles_used++;
+        uint16_t block_size = size + sizeof(mem_block_header_t) + 1;
 
-            break;
+        // check if there is free space available
+        if( mem_rt_data.free_space < block_size ){
+
+            // return the handle
+            map_v_release( handle_map, index, &handle_map_hint );
+
+            // allocation failed
+            goto finish;
         }
-    }
 
-    // if a handle was not found
-    if( handle >= MAX_MEM_HANDLES ){
+        // create the memory block
+        header = free_space_ptr;
 
-        // reset handle to unallocated
-        handle = -1;
+        // adjust free space
+        free_space_ptr += block_size;
 
-        // handle allocation failed
-        goto finish;
+        mem_rt_data.free_space -= block_size;
+
+        ASSERT_MSG( mem_rt_data.free_space <= mem_rt_data.heap_size, "Free space invalid!" );
+
+        // adjust used space counter
+        mem_rt_data.used_space += block_size;
+
+        // adjust peak usage state
+        if( mem_rt_data.peak_usage < mem_rt_data.used_space ){
+
+            mem_rt_data.peak_usage = mem_rt_data.used_space;
+        }
     }
 
-    // create the memory block
-    handles[handle] = free_space_ptr;
+    handle = index;
+    handles[handle] = header;
 
-    mem_block_header_t *header = handles[handle];
+    mem_rt_data.handles_used++;
 
     header->size = size;
     header->handle = handle;
@@ -447,22 +681,6 @@ static mem_handle_t alloc( uint16_t size, mem_type_t8 type ){
 
     *canary = generate_canary( header );
 
-    // adjust free space
-    free_space_ptr += MEM_BLOCK_SIZE( header );
-
-    mem_rt_data.free_space -= MEM_BLOCK_SIZE( header );
-
-    ASSERT_MSG( mem_rt_data.free_space <= mem_rt_data.heap_size, "Free space invalid!" );
-
-    // adjust used space counter
-    mem_rt_data.used_space += MEM_BLOCK_SIZE( header );
-
-    // adjust peak usage state
-    if( mem_rt_data.peak_usage < mem_rt_data.used_space ){
-
-        mem_rt_data.peak_usage = mem_rt_data.used_space;
-    }
-
     handle = swizzle(handle);
 
     mem_allocs++;
@@ -478,6 +696,20 @@ finish:
         ASSERT( TRUE );
     }
 
+    uint32_t elapsed = tmr_u32_elapsed_time_us( start_time );
+
+    if( elapsed > UINT16_MAX ){
+
+        elapsed = UINT16_MAX;
+    }
+
+    if( elapsed > mem_rt_data.alloc_time_max ){
+
+        mem_rt_data.alloc_time_max = elapsed;
+    }
+
+    mem_alloc_time_total += elapsed;
+
     MEM_END_ATOMIC;
 
     return handle;
@@ -548,10 +780,18 @@ int8_t mem2_i8_realloc( mem_handle_t handle, uint16_t size ){
     new_handle = unswizzle( new_handle );
     mem_block_header_t *new_header = handles[new_handle];
 
-    // move data to new handle
+    // move data to new handle.
+    // if the block is shrinking, only copy what fits.
+    uint16_t copy_len = header->size;
+
+    if( copy_len > new_header->size ){
+
+        copy_len = new_header->size;
+    }
+
     void *old_ptr = handles[handle] + sizeof( mem_block_header_t );;
     void *new_ptr = handles[new_handle] + sizeof( mem_block_header_t );;
-    memcpy( new_ptr, old_ptr, header->size );
+    memcpy( new_ptr, old_ptr, copy_len );
 
     // release old handle
     release_block( handle );
@@ -561,6 +801,9 @@ int8_t mem2_i8_realloc( mem_handle_t handle, uint16_t size ){
     handles[handle]     = new_header;
     handles[new_handle] = 0;
 
+    map_v_set( handle_map, handle );
+    map_v_release( handle_map, new_handle, &handle_map_hint );
+
 
 end:
     MEM_END_ATOMIC;
@@ -634,11 +877,21 @@ static void release_block( mem_handle_t handle ){
 	// clear the handle
 	handles[handle] = 0;
 
+    map_v_release( handle_map, handle, &handle_map_hint );
+
 	mem_rt_data.handles_used--;
 
 	// decrement data space used
 	mem_rt_data.data_space -= header->size;
 
+    #ifdef ENABLE_MEM_POOLS
+    // pool slots are not in the heap, they can be reused right away
+    if( pool_b_release( header ) ){
+
+        return;
+    }
+    #endif
+
 	// set the flags to dirty so the defragmenter can pick it up
 	set_dirty( header );
 
@@ -789,6 +1042,21 @@ void mem2_v_get_rt_data( mem_rt_data_t *rt_data ){
 
 	*rt_data = mem_rt_data;
 
+    uint32_t count = mem_allocs + mem_alloc_fails;
+
+    if( count > 0 ){
+
+        rt_data->alloc_time_avg = mem_alloc_time_total / count;
+    }
+
+    // dirty space can't be used until the garbage collector runs
+    uint32_t unallocated = (uint32_t)mem_rt_data.free_space + mem_rt_data.dirty_space;
+
+    if( unallocated > 0 ){
+
+        rt_data->fragmentation = ( (uint32_t)mem_rt_data.dirty_space * 100 ) / unallocated;
+    }
+
     MEM_END_ATOMIC;
 }
 
@@ -830,115 +1098,129 @@ error indications will likely be misleading.
 
 YOU HAVE BEEN WARNED!
 
+The heap is compacted incrementally. A pass starts once the dirty
+space exceeds MEM_DEFRAG_THRESHOLD, and each call moves at most
+MEM_GC_STEP_BYTES bytes and looks at no more than MEM_GC_STEP_BLOCKS
+blocks before returning, so interrupts are never held off for long.
+The next call resumes where the last one left off.
+
+Between calls, all live blocks before gc_clean have been moved to
+before gc_dirty, so the region between the two only holds garbage.
+Blocks allocated during a pass are added at the free pointer and are
+picked up by the same pass. Blocks freed behind gc_dirty stay dirty
+until the next pass.
+
 */
 void mem2_v_collect_garbage( void ){
 
-    if( mem2_u16_get_dirty() < MEM_DEFRAG_THRESHOLD ){
-
-        return;
-    }
+    if( !gc_active ){
 
-    MEM_ATOMIC;
+        if( mem2_u16_get_dirty() < MEM_DEFRAG_THRESHOLD ){
 
-    EVENT( EVENT_ID_MEM_DEFRAG, 0 );
+            return;
+        }
 
-    mem_block_header_t *clean;
-    mem_block_header_t *next_block;
-    mem_block_header_t *dirty;
+        MEM_ATOMIC;
 
-    clean = ( mem_block_header_t * )heap;
-    next_block = ( mem_block_header_t * )heap;
-    dirty = ( mem_block_header_t * )heap;
+        EVENT( EVENT_ID_MEM_DEFRAG, 0 );
 
-    // search for a dirty block (loop while clean blocks)
-    while( ( is_dirty( dirty ) == FALSE ) &&
-            ( dirty < ( mem_block_header_t * )free_space_ptr ) ){
+        gc_clean = ( mem_block_header_t * )heap;
+        gc_dirty = ( mem_block_header_t * )heap;
+        gc_active = TRUE;
 
-        dirty = ( void * )dirty + MEM_BLOCK_SIZE( dirty );
+        MEM_END_ATOMIC;
     }
 
-    // clean pointer needs to lead dirty pointer
-    if( clean < dirty ){
+    MEM_ATOMIC;
+
+    uint32_t start_time = tmr_u32_get_system_time_us();
 
-        clean = dirty;
-    }
+    uint16_t bytes = 0;
+    uint8_t blocks = 0;
 
-    while( clean < ( mem_block_header_t * )free_space_ptr ){
+    while( ( gc_clean < ( mem_block_header_t * )free_space_ptr ) &&
+           ( bytes < MEM_GC_STEP_BYTES ) &&
+           ( blocks < MEM_GC_STEP_BLOCKS ) ){
 
-        // search for a clean block (loop while dirty)
-        // (couldn't find anymore clean blocks to move, so there should be
-        // no clean blocks between the dirty pointer and the free pointer)
-        while( is_dirty( clean ) == TRUE ){
+        blocks++;
 
-            clean = ( void * )clean + MEM_BLOCK_SIZE( clean );
+        uint16_t block_size = MEM_BLOCK_SIZE( gc_clean );
 
-            // if the free space is reached, the routine is finished
-            if( clean >= ( mem_block_header_t * )free_space_ptr ){
+        // skip dirty blocks
+        if( is_dirty( gc_clean ) ){
 
-                goto done_defrag;
-            }
+            gc_clean = ( void * )gc_clean + block_size;
+
+            continue;
         }
 
-        // get next block
-        next_block = ( void * )clean + MEM_BLOCK_SIZE( clean );
+        if( gc_clean != gc_dirty ){
 
-        // switch the handle from the old block to the new block
-        handles[clean->handle] = dirty;
-        // NOTE:
-        // Could do this instead, and save the need to store the handle index
-        // in the block, saving 2 bytes per object.
-        /*
-        for( uint16_t i = 0; i < MAX_MEM_HANDLES; i++ ){
+            // switch the handle from the old block to the new block
+            handles[gc_clean->handle] = gc_dirty;
 
-            if( handles[i] == clean ){
+            // copy the clean block down to the dirty pointer.
+            // the two blocks can overlap.
+            memmove( gc_dirty, gc_clean, block_size );
 
-                handles[i] = dirty;
-                break;
-            }
+            bytes += block_size;
         }
-        */
 
-        // copy the clean block to the dirty block pointer
-        memcpy( dirty, clean, MEM_BLOCK_SIZE( clean ) );
+        gc_dirty = ( void * )gc_dirty + block_size;
+        gc_clean = ( void * )gc_clean + block_size;
+    }
 
-        // increment dirty pointer
-        dirty = ( void * )dirty + MEM_BLOCK_SIZE( dirty );
+    mem_rt_data.gc_bytes_moved += bytes;
 
-        // assign clean pointer to next block
-        clean = next_block;
+    if( bytes > mem_rt_data.gc_max_moved ){
+
+        mem_rt_data.gc_max_moved = bytes;
     }
 
-done_defrag:
-    // EVENT( EVENT_ID_MEM_DEFRAG, 1 );
+    if( gc_clean >= ( mem_block_header_t * )free_space_ptr ){
 
-    // there should be no clean blocks between the dirty and free pointers,
-    // set the free pointer to the dirty pointer
-    free_space_ptr = dirty;
+        // there are no clean blocks between the dirty and free pointers,
+        // everything past the dirty pointer is now free
+        uint16_t reclaimed = ( void * )free_space_ptr - ( void * )gc_dirty;
 
-    // the dirty space is now free
-    mem_rt_data.free_space += mem_rt_data.dirty_space;
+        free_space_ptr = gc_dirty;
 
-    // no more dirty space
-    mem_rt_data.dirty_space = 0;
+        mem_rt_data.free_space += reclaimed;
+        mem_rt_data.dirty_space -= reclaimed;
 
-    // run canary check
-    mem2_v_check_canaries();
+        gc_active = FALSE;
 
-    // EVENT( EVENT_ID_MEM_DEFRAG, 2 );
+        mem_rt_data.gc_passes++;
 
-    // check stack guard
-    #ifndef __SIM__
-    uint8_t *stack = &__stack - ( MEM_MAX_STACK - MEM_STACK_GUARD_SIZE );
-    ASSERT( *stack++ == CANARY_VALUE );
-    ASSERT( *stack++ == CANARY_VALUE );
-    ASSERT( *stack++ == CANARY_VALUE );
-    ASSERT( *stack++ == CANARY_VALUE );
+        // run canary check
+        mem2_v_check_canaries();
 
-    // assert if the stack is blown up
-    // ASSERT( stack_usage < MEM_MAX_STACK );
-    #endif
+        // check stack guard
+        #ifndef __SIM__
+        uint8_t *stack = &__stack - ( MEM_MAX_STACK - MEM_STACK_GUARD_SIZE );
+        ASSERT( *stack++ == CANARY_VALUE );
+        ASSERT( *stack++ == CANARY_VALUE );
+        ASSERT( *stack++ == CANARY_VALUE );
+        ASSERT( *stack++ == CANARY_VALUE );
 
-    EVENT( EVENT_ID_MEM_DEFRAG, 3 );
+        // assert if the stack is blown up
+        // ASSERT( stack_usage < MEM_MAX_STACK );
+        #endif
+
+        EVENT( EVENT_ID_MEM_DEFRAG, 3 );
+    }
+
+    uint32_t elapsed = tmr_u32_elapsed_time_us( start_time );
+
+    if( elapsed > UINT16_MAX ){
+
+        elapsed = UINT16_MAX;
+    }
+
+    if( elapsed > mem_rt_data.gc_max_pause ){
+
+        mem_rt_data.gc_max_pause = elapsed;
+    }
 
     MEM_END_ATOMIC;
 }
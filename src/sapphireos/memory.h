@@ -38,6 +38,15 @@
 // defragmenter will only run after the amount of dirty space exceeds this threshold
 #define MEM_DEFRAG_THRESHOLD    128
 
+// most bytes the defragmenter will move, and blocks it will look at,
+// in one call. a pass that needs more than this continues on the next call.
+#ifndef MEM_GC_STEP_BYTES
+#define MEM_GC_STEP_BYTES       256
+#endif
+#ifndef MEM_GC_STEP_BLOCKS
+#define MEM_GC_STEP_BLOCKS      32
+#endif
+
 // uncomment to make memory functions atomic
 #define ENABLE_ATOMIC_MEMORY
 
@@ -49,6 +58,20 @@
 #endif
 //#define ENABLE_RECORD_CREATOR
 
+// small object pools:
+// allocations of up to MEM_POOL_SMALL_SIZE or MEM_POOL_LARGE_SIZE bytes
+// are placed in fixed size slots outside of the heap, so they are never
+// moved by the garbage collector and never leave dirty space behind.
+// if a pool is full the allocation falls back to the heap.
+// the pools are enabled by defining the sizes and counts in target.h:
+// #define MEM_POOL_SMALL_SIZE
+// #define MEM_POOL_SMALL_COUNT
+// #define MEM_POOL_LARGE_SIZE
+// #define MEM_POOL_LARGE_COUNT
+#ifdef MEM_POOL_SMALL_COUNT
+    #define ENABLE_MEM_POOLS
+#endif
+
 typedef int8_t mem_handle_t;
 
 typedef struct{
@@ -72,6 +95,15 @@ typedef struct{
 	uint16_t dirty_space;
 	uint16_t data_space;
 	uint16_t peak_usage;
+    uint16_t alloc_time_max;    // microseconds
+    uint16_t alloc_time_avg;    // microseconds
+    uint16_t fragmentation;     // percent of unallocated heap that is dirty
+    uint16_t pool_used;         // pool slots in use
+    uint16_t pool_fails;        // pool allocations that fell back to the heap
+    uint16_t gc_max_pause;      // longest garbage collector call, microseconds
+    uint16_t gc_max_moved;      // most bytes moved in one garbage collector call
+    uint32_t gc_bytes_moved;
+    uint32_t gc_passes;
 } mem_rt_data_t;
 
 typedef struct{
@@ -41,5 +41,7 @@ typedef uint8_t mem_type_t8;
 #define MEM_TYPE_CATBUS_LINK        15
 #define MEM_TYPE_CATBUS_SEND        16
 #define MEM_TYPE_CATBUS_RX_CACHE    17
+#define MEM_TYPE_CATBUS_INDEX       18
+#define MEM_TYPE_KV_PERSIST         19
 
 #endif
@@ -382,7 +382,7 @@ void sys_v_get_fw_id( uint8_t id[FW_ID_LENGTH] ){
 void sys_v_get_os_version( char ver[OS_VER_LEN] ){
 
     #ifdef __SIM__
-        memset( id, 2, OS_VER_LEN );
+        memset( ver, 2, OS_VER_LEN );
     #else
         memcpy_P( ver, (void *)FW_INFO_ADDRESS + offsetof(fw_info_t, os_version), OS_VER_LEN );
     #endif
@@ -391,7 +391,7 @@ void sys_v_get_os_version( char ver[OS_VER_LEN] ){
 void sys_v_get_fw_version( char ver[FW_VER_LEN] ){
 
     #ifdef __SIM__
-        memset( id, 2, FW_VER_LEN );
+        memset( ver, 2, FW_VER_LEN );
     #else
         memcpy_P( ver, (void *)FW_INFO_ADDRESS + offsetof(fw_info_t, firmware_version), FW_VER_LEN );
     #endif
@@ -700,6 +700,9 @@ PT_BEGIN( pt );
 
     log_v_flush();
 
+    // write out persisted values still waiting on the flush timer
+    kv_v_persist_flush();
+
 	TMR_WAIT( pt, 1000 );
 
 	reboot();
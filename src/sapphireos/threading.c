@@ -62,6 +62,21 @@ is not finished processing, and as such, will be guaranteed to be run again
 before sleeping the processor.
 
 
+Scheduling:
+
+Threads that can run (waiting, yielded, or woken by an alarm or signal) are
+kept in a FIFO ready queue per priority level.  Sleeping threads are not in
+any queue, so the scheduler only visits threads that can actually run.
+
+Each scheduler pass runs the threads that were ready at the start of the
+pass, highest priority first.  A thread that waits or yields again goes to
+the back of its queue and runs in the next pass.  Threads woken during a
+pass go to the front of their queue and run in the same pass.
+
+Threads with an alarm set are kept in a min heap ordered by alarm time, so
+checking for due alarms and finding the next alarm only look at the top of
+the heap.
+
 */
 
 // thread state storage
@@ -77,11 +92,37 @@ static uint32_t task_us;
 static uint32_t sleep_us;
 static uint16_t loops;
 
+// run time stats over all threads
+static uint32_t run_time_max;
+static uint32_t run_time_max_addr;
+static uint32_t alarm_late_max;
+static uint16_t run_hist[THREAD_RUN_HIST_BINS];
+
 static volatile uint8_t thread_flags;
 #define FLAGS_SLEEP         0x02
 #define FLAGS_ACTIVE        0x04
 
 static volatile uint16_t signals;
+static volatile bool signal_pending;
+
+// ready queues, one per priority level
+typedef struct{
+    thread_t head;
+    thread_t tail;
+    uint8_t count;
+} ready_queue_t;
+
+static ready_queue_t ready_queues[THREAD_PRIORITY_LEVELS];
+
+// number of threads left to run in the current scheduler pass.
+// these are always the first pass_remaining threads in each queue.
+static uint8_t pass_remaining[THREAD_PRIORITY_LEVELS];
+
+// min heap of threads with an alarm set, soonest first
+#define ALARM_INDEX_NONE    0xff
+
+static thread_t alarm_heap[MAX_MEM_HANDLES];
+static uint8_t alarm_count;
 
 
 #ifdef ENABLE_STACK_LOGGING
@@ -116,6 +157,10 @@ KV_SECTION_META kv_meta_t thread_info_kv[] = {
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &cpu_info.task_time,       0,  "thread_task_time" },
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &cpu_info.sleep_time,      0,  "thread_sleep_time" },
     { SAPPHIRE_TYPE_UINT16,  0, KV_FLAGS_READ_ONLY,  &cpu_info.scheduler_loops, 0,  "thread_loops" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &run_time_max,             0,  "thread_run_max" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &run_time_max_addr,        0,  "thread_run_max_addr" },
+    { SAPPHIRE_TYPE_UINT32,  0, KV_FLAGS_READ_ONLY,  &alarm_late_max,           0,  "thread_alarm_late_max" },
+    { SAPPHIRE_TYPE_UINT16,  KV_ARRAY_LEN(THREAD_RUN_HIST_BINS), KV_FLAGS_READ_ONLY, &run_hist, 0, "thread_run_hist" },
 };
 
 
@@ -123,6 +168,314 @@ PT_THREAD( background_thread( pt_t *pt, void *state ) );
 PT_THREAD( cpu_stats_thread( pt_t *pt, void *state ) );
 
 
+// the queue and heap functions are used in the scheduler loop, so they
+// skip the handle verification in list_vp_get_data.
+static thread_state_t *get_state( thread_t thread ){
+
+    list_node_state_t *ln_state = mem2_vp_get_ptr_fast( thread );
+
+    return (thread_state_t *)&ln_state->data;
+}
+
+static void ready_v_push( thread_t thread, bool front ){
+
+    thread_state_t *state = get_state( thread );
+
+    if( state->flags & THREAD_FLAGS_READY ){
+
+        return;
+    }
+
+    ready_queue_t *queue = &ready_queues[state->priority];
+
+    state->flags        |= THREAD_FLAGS_READY;
+    state->ready_ticks  = tmr_u32_get_ticks();
+
+    if( queue->head < 0 ){
+
+        state->next_ready   = -1;
+        queue->head         = thread;
+        queue->tail         = thread;
+    }
+    else if( front ){
+
+        state->next_ready   = queue->head;
+        queue->head         = thread;
+    }
+    else{
+
+        state->next_ready   = -1;
+        get_state( queue->tail )->next_ready = thread;
+        queue->tail         = thread;
+    }
+
+    queue->count++;
+}
+
+static thread_t ready_t_pop( uint8_t priority ){
+
+    ready_queue_t *queue = &ready_queues[priority];
+
+    thread_t thread = queue->head;
+
+    if( thread < 0 ){
+
+        return -1;
+    }
+
+    thread_state_t *state = get_state( thread );
+
+    queue->head = state->next_ready;
+
+    if( queue->head < 0 ){
+
+        queue->tail = -1;
+    }
+
+    queue->count--;
+
+    state->flags &= ~THREAD_FLAGS_READY;
+
+    return thread;
+}
+
+static void ready_v_remove( thread_t thread ){
+
+    thread_state_t *state = get_state( thread );
+
+    if( ( state->flags & THREAD_FLAGS_READY ) == 0 ){
+
+        return;
+    }
+
+    ready_queue_t *queue = &ready_queues[state->priority];
+
+    thread_t prev = -1;
+    thread_t ln = queue->head;
+    uint8_t position = 0;
+
+    while( ( ln >= 0 ) && ( ln != thread ) ){
+
+        prev = ln;
+        ln = get_state( ln )->next_ready;
+        position++;
+    }
+
+    ASSERT( ln == thread );
+
+    // if the thread was still waiting to run in this pass,
+    // the pass has one less thread to run
+    if( position < pass_remaining[state->priority] ){
+
+        pass_remaining[state->priority]--;
+    }
+
+    if( prev < 0 ){
+
+        queue->head = state->next_ready;
+    }
+    else{
+
+        get_state( prev )->next_ready = state->next_ready;
+    }
+
+    if( queue->tail == thread ){
+
+        queue->tail = prev;
+    }
+
+    queue->count--;
+
+    state->flags &= ~THREAD_FLAGS_READY;
+}
+
+// move a thread to the front of its ready queue and count it
+// in the current pass.  ready_v_remove uncounts it first if it
+// was already pending, so it is only counted once.
+static void ready_v_wake( thread_t thread ){
+
+    ready_v_remove( thread );
+    ready_v_push( thread, TRUE );
+
+    pass_remaining[get_state( thread )->priority]++;
+}
+
+static int8_t alarm_i8_compare( uint8_t a, uint8_t b ){
+
+    return tmr_i8_compare_times( get_state( alarm_heap[a] )->alarm,
+                                 get_state( alarm_heap[b] )->alarm );
+}
+
+static void alarm_v_swap( uint8_t a, uint8_t b ){
+
+    thread_t temp = alarm_heap[a];
+    alarm_heap[a] = alarm_heap[b];
+    alarm_heap[b] = temp;
+
+    get_state( alarm_heap[a] )->alarm_index = a;
+    get_state( alarm_heap[b] )->alarm_index = b;
+}
+
+static void alarm_v_sift_up( uint8_t index ){
+
+    while( index > 0 ){
+
+        uint8_t parent = ( index - 1 ) / 2;
+
+        if( alarm_i8_compare( index, parent ) >= 0 ){
+
+            break;
+        }
+
+        alarm_v_swap( index, parent );
+        index = parent;
+    }
+}
+
+static void alarm_v_sift_down( uint8_t index ){
+
+    while( TRUE ){
+
+        uint16_t child = ( (uint16_t)index * 2 ) + 1;
+
+        if( child >= alarm_count ){
+
+            break;
+        }
+
+        if( ( ( child + 1 ) < alarm_count ) &&
+            ( alarm_i8_compare( child + 1, child ) < 0 ) ){
+
+            child++;
+        }
+
+        if( alarm_i8_compare( child, index ) >= 0 ){
+
+            break;
+        }
+
+        alarm_v_swap( index, child );
+        index = child;
+    }
+}
+
+static void alarm_v_insert( thread_t thread ){
+
+    thread_state_t *state = get_state( thread );
+
+    // already in the heap, just move it to match the new alarm time
+    if( state->alarm_index != ALARM_INDEX_NONE ){
+
+        alarm_v_sift_up( state->alarm_index );
+        alarm_v_sift_down( state->alarm_index );
+
+        return;
+    }
+
+    ASSERT( alarm_count < cnt_of_array(alarm_heap) );
+
+    state->alarm_index = alarm_count;
+    alarm_heap[alarm_count] = thread;
+    alarm_count++;
+
+    alarm_v_sift_up( state->alarm_index );
+}
+
+static void alarm_v_remove( thread_t thread ){
+
+    thread_state_t *state = get_state( thread );
+
+    uint8_t index = state->alarm_index;
+
+    if( index == ALARM_INDEX_NONE ){
+
+        return;
+    }
+
+    state->alarm_index = ALARM_INDEX_NONE;
+    alarm_count--;
+
+    // move the last entry into the hole
+    if( index < alarm_count ){
+
+        alarm_heap[index] = alarm_heap[alarm_count];
+        get_state( alarm_heap[index] )->alarm_index = index;
+
+        alarm_v_sift_down( index );
+        alarm_v_sift_up( index );
+    }
+}
+
+// wake up threads whose alarms are due
+static void process_alarms( void ){
+
+    while( alarm_count > 0 ){
+
+        thread_t thread = alarm_heap[0];
+        thread_state_t *state = get_state( thread );
+
+        if( tmr_i8_compare_time( state->alarm ) >= 0 ){
+
+            break;
+        }
+
+        alarm_v_remove( thread );
+
+        state->flags &= ~THREAD_FLAGS_ALARM;
+        state->flags &= ~THREAD_FLAGS_SLEEPING;
+        state->flags |= THREAD_FLAGS_ALARM_DUE;
+
+        ready_v_wake( thread );
+    }
+}
+
+// wake up threads waiting on a signal
+static void process_signals( void ){
+
+    if( !signal_pending ){
+
+        return;
+    }
+
+    ATOMIC;
+
+    signal_pending = FALSE;
+
+    END_ATOMIC;
+
+    if( thread_u16_get_signals() == 0 ){
+
+        return;
+    }
+
+    // iterate through thread list
+    list_node_t ln = thread_list.head;
+
+    while( ln >= 0 ){
+
+        list_node_state_t *ln_state = mem2_vp_get_ptr_fast( ln );
+        thread_state_t *state = (thread_state_t *)&ln_state->data;
+
+        if( ( state->flags & THREAD_FLAGS_SIGNAL ) != 0 ){
+
+            ready_v_wake( ln );
+        }
+
+        ln = ln_state->next;
+    }
+}
+
+
+static uint16_t saturate_u16( uint32_t value ){
+
+    if( value > 0xffff ){
+
+        return 0xffff;
+    }
+
+    return value;
+}
+
 static uint16_t vfile( vfile_op_t8 op, uint32_t pos, void *ptr, uint16_t len ){
 
     uint16_t ret_val = 0;
@@ -153,6 +506,27 @@ static uint16_t vfile( vfile_op_t8 op, uint32_t pos, void *ptr, uint16_t len ){
                 info.runs           = state->runs;
                 info.line           = state->pt.lc;
                 info.alarm          = state->alarm;
+                info.priority       = state->priority;
+                info.latency_max    = state->latency_max;
+                info.latency_avg    = state->latency_avg;
+                info.run_time_max   = saturate_u16( state->run_time_max );
+                info.alarm_late_max = saturate_u16( state->alarm_late_max );
+                info.alarm_late_avg = saturate_u16( state->alarm_late_avg );
+
+                uint32_t hist_total = 0;
+
+                for( uint8_t i = 0; i < THREAD_RUN_HIST_BINS; i++ ){
+
+                    hist_total += state->run_hist[i];
+                }
+
+                if( hist_total > 0 ){
+
+                    for( uint8_t i = 0; i < THREAD_RUN_HIST_BINS; i++ ){
+
+                        info.run_hist[i] = ( (uint32_t)state->run_hist[i] * 255 + ( hist_total / 2 ) ) / hist_total;
+                    }
+                }
 
                 // get offset info page
                 uint16_t offset = pos - ( page * sizeof(info) );
@@ -195,6 +569,16 @@ void thread_v_init( void ){
 
     // init thread list
     list_v_init( &thread_list );
+
+    for( uint8_t i = 0; i < THREAD_PRIORITY_LEVELS; i++ ){
+
+        ready_queues[i].head    = -1;
+        ready_queues[i].tail    = -1;
+        ready_queues[i].count   = 0;
+        pass_remaining[i]       = 0;
+    }
+
+    alarm_count = 0;
 }
 
 // return current number of threads
@@ -286,6 +670,18 @@ static thread_t make_thread( PT_THREAD( ( *thread )( pt_t *pt, void *state ) ),
     state->runs     = 0;
     state->alarm    = 0;
 
+    state->priority     = THREAD_PRIORITY_NORMAL;
+    state->alarm_index  = ALARM_INDEX_NONE;
+    state->next_ready   = -1;
+    state->ready_ticks  = 0;
+    state->latency_max  = 0;
+    state->latency_avg  = 0;
+
+    state->run_time_max     = 0;
+    state->alarm_late_max   = 0;
+    state->alarm_late_avg   = 0;
+    memset( state->run_hist, 0, sizeof(state->run_hist) );
+
     // copy data (if present)
     if( initial_data != 0 ){
 
@@ -303,6 +699,9 @@ static thread_t make_thread( PT_THREAD( ( *thread )( pt_t *pt, void *state ) ),
     // add to list
     list_v_insert_tail( &thread_list, ln );
 
+    // new threads run in the next scheduler pass
+    ready_v_push( ln, FALSE );
+
     return ln;
 }
 
@@ -353,14 +752,28 @@ void thread_v_restart( thread_t thread_id ){
 
     thread_state_t *state = list_vp_get_data( thread_id );
 
-	state->flags = THREAD_FLAGS_YIELDED;
+    alarm_v_remove( thread_id );
+
+    state->alarm = 0;
+	state->flags = THREAD_FLAGS_YIELDED | ( state->flags & THREAD_FLAGS_READY );
 
 	PT_INIT( &state->pt );
+
+    ready_v_push( thread_id, FALSE );
 }
 
 // kill a thread
 void thread_v_kill( thread_t thread_id ){
 
+    // remove from scheduler
+    alarm_v_remove( thread_id );
+    ready_v_remove( thread_id );
+
+    if( thread_id == current_thread ){
+
+        current_thread = -1;
+    }
+
     // remove from list
     list_v_remove( &thread_list, thread_id );
 
@@ -378,6 +791,45 @@ void thread_v_active( void ){
     thread_v_clear_alarm();
 }
 
+void thread_v_set_priority( thread_t thread_id, uint8_t priority ){
+
+    if( thread_id < 0 ){
+
+        return;
+    }
+
+    if( priority >= THREAD_PRIORITY_LEVELS ){
+
+        priority = THREAD_PRIORITY_LEVELS - 1;
+    }
+
+    thread_state_t *state = list_vp_get_data( thread_id );
+
+    if( state->priority == priority ){
+
+        return;
+    }
+
+    // requeue at the new level
+    bool ready = ( state->flags & THREAD_FLAGS_READY ) != 0;
+
+    ready_v_remove( thread_id );
+
+    state->priority = priority;
+
+    if( ready ){
+
+        ready_v_push( thread_id, FALSE );
+    }
+}
+
+uint8_t thread_u8_get_priority( thread_t thread_id ){
+
+    thread_state_t *state = list_vp_get_data( thread_id );
+
+    return state->priority;
+}
+
 void thread_v_signal( uint8_t signum ){
 
     ASSERT( signum < THREAD_MAX_SIGNALS );
@@ -385,6 +837,7 @@ void thread_v_signal( uint8_t signum ){
     ATOMIC;
 
     signals |= ( (uint16_t)1 << signum );
+    signal_pending = TRUE;
 
     END_ATOMIC;
 
@@ -455,12 +908,16 @@ void thread_v_set_alarm( uint32_t alarm ){
 
     state->alarm = alarm;
     state->flags |= THREAD_FLAGS_ALARM;
+
+    alarm_v_insert( thread_t_get_current_thread() );
 }
 
 void thread_v_clear_alarm( void ){
 
     thread_state_t *state = list_vp_get_data( thread_t_get_current_thread() );
 
+    alarm_v_remove( thread_t_get_current_thread() );
+
     state->alarm = 0;
     state->flags &= ~THREAD_FLAGS_ALARM;
 }
@@ -479,39 +936,94 @@ bool thread_b_alarm( void ){
 
 int32_t thread_i32_get_next_alarm( void ){
 
-    int32_t next_alarm = INT32_MAX;
+    if( alarm_count == 0 ){
 
-    // iterate through thread list
-    list_node_t ln = thread_list.head;
+        return -1;
+    }
 
-    while( ln >= 0 ){
+    return get_state( alarm_heap[0] )->alarm;
+}
 
-        list_node_state_t *ln_state = mem2_vp_get_ptr_fast( ln );
-        thread_state_t *state = (thread_state_t *)&ln_state->data;
+static void record_run_time( thread_state_t *state, uint32_t elapsed_us ){
 
-        if( ( state->flags & THREAD_FLAGS_ALARM ) != 0 ){
+    if( elapsed_us > state->run_time_max ){
 
-            if( (int32_t)state->alarm < next_alarm ){
+        state->run_time_max = elapsed_us;
+    }
 
-                next_alarm = state->alarm;
-            }
+    if( elapsed_us > run_time_max ){
+
+        run_time_max = elapsed_us;
+        run_time_max_addr = (uint32_t)((uintptr_t)state->thread) * 2; //multiply by 2 to get byte address
+    }
+
+    // find histogram bin
+    uint8_t bin = 0;
+    elapsed_us >>= THREAD_RUN_HIST_MIN_SHIFT;
+
+    while( ( elapsed_us > 0 ) && ( bin < ( THREAD_RUN_HIST_BINS - 1 ) ) ){
+
+        elapsed_us >>= 1;
+        bin++;
+    }
+
+    // halve the whole histogram instead of saturating a bin,
+    // so the bins stay in proportion
+    if( state->run_hist[bin] == 0xffff ){
+
+        for( uint8_t i = 0; i < THREAD_RUN_HIST_BINS; i++ ){
+
+            state->run_hist[i] /= 2;
         }
+    }
 
-        ln = ln_state->next;
+    state->run_hist[bin]++;
+
+    if( run_hist[bin] < 0xffff ){
+
+        run_hist[bin]++;
     }
+}
 
-    if( next_alarm == INT32_MAX ){
+// record how long after its requested wake time
+// a thread woken by an alarm actually runs.
+static void record_alarm_late( thread_state_t *state ){
 
-        return -1;
+    uint64_t now_us = tmr_u64_get_system_time_us();
+
+    // the alarm is in milliseconds
+    uint32_t late_ms = (uint32_t)( now_us / 1000 ) - state->alarm;
+    uint32_t late_us = ( late_ms * 1000 ) + (uint32_t)( now_us % 1000 );
+
+    if( late_us > state->alarm_late_max ){
+
+        state->alarm_late_max = late_us;
     }
 
-    return next_alarm;
+    if( late_us > alarm_late_max ){
+
+        alarm_late_max = late_us;
+    }
+
+    state->alarm_late_avg -= state->alarm_late_avg / 8;
+    state->alarm_late_avg += late_us / 8;
 }
 
 void run_thread( thread_t thread, thread_state_t *state ){
 
     uint32_t thread_ticks = tmr_u32_get_ticks();
 
+    // record time from ready to run
+    uint32_t latency = tmr_u32_ticks_to_us( thread_ticks - state->ready_ticks );
+
+    if( latency > state->latency_max ){
+
+        state->latency_max = latency;
+    }
+
+    state->latency_avg -= state->latency_avg / 8;
+    state->latency_avg += latency / 8;
+
 	// set current thread
 	current_thread = thread;
 
@@ -535,6 +1047,14 @@ void run_thread( thread_t thread, thread_state_t *state ){
     // smashes the stack.
     ASSERT( stack_check == 0x12345678 );
 
+    // thread killed itself, the state is gone
+    if( current_thread != thread ){
+
+        run_cause = 0;
+
+        return;
+    }
+
     #ifdef ENABLE_STACK_LOGGING
 
     uint16_t stack_usage = mem2_u16_stack_count();
@@ -558,6 +1078,8 @@ void run_thread( thread_t thread, thread_state_t *state ){
         task_us += elapsed_us;
         state->run_time += elapsed_us;
 
+        record_run_time( state, elapsed_us );
+
         // check for overflow
         if( state->run_time < last_run_time ){
 
@@ -586,6 +1108,7 @@ void run_thread( thread_t thread, thread_state_t *state ){
         case PT_WAITING:
 
             state->flags |= THREAD_FLAGS_WAITING;
+            ready_v_push( thread, FALSE );
 
             break;
 
@@ -593,6 +1116,7 @@ void run_thread( thread_t thread, thread_state_t *state ){
         case PT_YIELDED:
 
             state->flags |= THREAD_FLAGS_YIELDED;
+            ready_v_push( thread, FALSE );
 
             break;
 
@@ -608,7 +1132,7 @@ void run_thread( thread_t thread, thread_state_t *state ){
         case PT_ENDED:
 
             // remove the thread
-            thread_v_kill( current_thread );
+            thread_v_kill( thread );
 
             break;
 
@@ -624,62 +1148,6 @@ void run_thread( thread_t thread, thread_state_t *state ){
     #endif
 }
 
-void process_signalled_threads( void ){
-
-    if( thread_u16_get_signals() == 0 ){
-
-        return;
-    }
-
-    // iterate through thread list
-    list_node_t ln = thread_list.head;
-
-    while( ln >= 0 ){
-
-        list_node_state_t *ln_state = mem2_vp_get_ptr_fast( ln );
-        thread_state_t *state = (thread_state_t *)&ln_state->data;
-
-        if( ( state->flags & THREAD_FLAGS_SIGNAL ) != 0 ){
-
-            run_cause = THREAD_FLAGS_SIGNAL;
-
-            // clear wait flags
-            state->flags &= ~THREAD_FLAGS_WAITING;
-            state->flags &= ~THREAD_FLAGS_YIELDED;
-
-            run_thread( ln, state );
-        }
-
-        ln = ln_state->next;
-    }
-}
-
-
-// void process_alarm_threads( void ){
-
-//     // iterate through thread list
-//     list_node_t ln = thread_list.head;
-
-//     while( ln >= 0 ){
-
-//         list_node_state_t *ln_state = mem2_vp_get_ptr_fast( ln );
-//         thread_state_t *state = (thread_state_t *)&ln_state->data;
-
-//         if( ( ( state->flags & THREAD_FLAGS_ALARM ) != 0 ) &&
-//             ( tmr_i8_compare_time( state->alarm ) < 0 ) ){
-
-//             // clear flags
-//             state->flags &= ~THREAD_FLAGS_ALARM;
-//             state->flags &= ~THREAD_FLAGS_SLEEPING;
-
-//             run_thread( ln, state );
-//         }
-
-//         ln = ln_state->next;
-//     }
-// }
-
-
 // start the thread scheduler
 void thread_start( void ){
 
@@ -708,46 +1176,72 @@ void thread_start( void ){
 		thread_flags |= FLAGS_SLEEP;
 
 		// ********************************************************************
-		// Process Waiting threads
+		// Process ready threads
 		//
-		// Loop through all waiting threads
+		// Run the threads that are ready at the start of the pass,
+		// highest priority first.
 		// ********************************************************************
-        list_node_t ln = thread_list.head;
+        process_alarms();
+        process_signals();
 
-        while( ln >= 0 ){
+        for( uint8_t i = 0; i < THREAD_PRIORITY_LEVELS; i++ ){
 
-            list_node_state_t *ln_state = mem2_vp_get_ptr_fast( ln );
+            pass_remaining[i] = ready_queues[i].count;
+        }
 
-            thread_state_t *state = (thread_state_t *)&ln_state->data;
+        while( TRUE ){
 
-            if( ( ( state->flags & THREAD_FLAGS_ALARM ) != 0 ) &&
-                  ( tmr_i8_compare_time( state->alarm ) < 0 ) ){
+            thread_t thread = -1;
 
-                run_cause = THREAD_FLAGS_ALARM;
+            for( int8_t priority = THREAD_PRIORITY_LEVELS - 1; priority >= 0; priority-- ){
+
+                if( pass_remaining[priority] > 0 ){
+
+                    pass_remaining[priority]--;
+
+                    thread = ready_t_pop( priority );
+
+                    if( thread >= 0 ){
+
+                        break;
+                    }
+
+                    // should not happen, pass_remaining is kept
+                    // within the queue length
+                    pass_remaining[priority] = 0;
+                }
+            }
 
-                // clear flags
-                state->flags &= ~THREAD_FLAGS_ALARM;
-                state->flags &= ~THREAD_FLAGS_SLEEPING;
-                state->flags &= ~THREAD_FLAGS_WAITING;
-                state->flags &= ~THREAD_FLAGS_YIELDED;
+            if( thread < 0 ){
 
-                run_thread( ln, state );
+                break;
             }
-			else if( ( ( ( state->flags & THREAD_FLAGS_WAITING ) != 0 ) ||
-                       ( ( state->flags & THREAD_FLAGS_YIELDED ) != 0 ) ) ){
 
-				// clear wait flags
-				state->flags &= ~THREAD_FLAGS_WAITING;
-				state->flags &= ~THREAD_FLAGS_YIELDED;
-                state->flags &= ~THREAD_FLAGS_SLEEPING;
+            thread_state_t *state = get_state( thread );
 
-				// run the thread
-				run_thread( ln, state );
-			}
+            if( ( state->flags & THREAD_FLAGS_ALARM_DUE ) != 0 ){
+
+                run_cause = THREAD_FLAGS_ALARM;
+
+                record_alarm_late( state );
+            }
+            else if( ( ( state->flags & THREAD_FLAGS_SIGNAL ) != 0 ) &&
+                     ( thread_u16_get_signals() != 0 ) ){
+
+                run_cause = THREAD_FLAGS_SIGNAL;
+            }
+
+            // clear wait flags
+            state->flags &= ~THREAD_FLAGS_WAITING;
+            state->flags &= ~THREAD_FLAGS_YIELDED;
+            state->flags &= ~THREAD_FLAGS_SLEEPING;
+            state->flags &= ~THREAD_FLAGS_ALARM_DUE;
 
-            ln = ln_state->next;
+            // run the thread
+            run_thread( thread, state );
 
-            process_signalled_threads();
+            process_alarms();
+            process_signals();
 
             #ifdef ENABLE_USB
             usb_v_poll();
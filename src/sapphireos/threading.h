@@ -69,6 +69,12 @@
 
 typedef struct pt pt_t;
 
+// run time histogram.  bin 0 counts runs shorter than
+// 2^THREAD_RUN_HIST_MIN_SHIFT microseconds, each bin after that
+// doubles, and the last bin counts everything longer.
+#define THREAD_RUN_HIST_BINS        8
+#define THREAD_RUN_HIST_MIN_SHIFT   8
+
 typedef struct{
 	pt_t pt;    // protothread context
 	PT_THREAD( ( *thread )( pt_t *pt, void *state ) );
@@ -77,6 +83,16 @@ typedef struct{
     uint32_t alarm;
     uint32_t run_time;
     uint32_t runs;
+    uint8_t priority;
+    uint8_t alarm_index;    // position in the alarm heap
+    thread_t next_ready;    // next thread in the ready queue
+    uint32_t ready_ticks;   // when the thread was made ready
+    uint32_t latency_max;   // time from ready to run, in microseconds
+    uint32_t latency_avg;
+    uint32_t run_time_max;  // longest single run, in microseconds
+    uint32_t alarm_late_max;// time from alarm to run, in microseconds
+    uint32_t alarm_late_avg;
+    uint16_t run_hist[THREAD_RUN_HIST_BINS];
 } thread_state_t;
 
 typedef struct{
@@ -88,7 +104,17 @@ typedef struct{
     uint32_t runs;
     uint16_t line;
     uint64_t alarm;
-    uint8_t reserved[24];
+    uint8_t priority;
+    uint32_t latency_max;
+    uint32_t latency_avg;
+    // these fit in the bytes that were reserved, so the record
+    // size does not change.  times are in microseconds and
+    // saturate at 0xffff.
+    uint16_t run_time_max;
+    uint16_t alarm_late_max;
+    uint16_t alarm_late_avg;
+    uint8_t run_hist[THREAD_RUN_HIST_BINS]; // share of runs in each bin, out of 255
+    uint8_t reserved[1];
 } thread_info_t;
 
 #define THREAD_FLAGS_WAITING		0b00000001
@@ -96,6 +122,15 @@ typedef struct{
 #define THREAD_FLAGS_SLEEPING		0b00000100
 #define THREAD_FLAGS_SIGNAL 		0b00001000
 #define THREAD_FLAGS_ALARM          0b00010000
+#define THREAD_FLAGS_READY          0b00100000  // in a ready queue
+#define THREAD_FLAGS_ALARM_DUE      0b01000000  // alarm fired, not run yet
+
+// threads at a higher priority run before lower priority threads
+// that are ready in the same scheduler pass
+#define THREAD_PRIORITY_LOW         0
+#define THREAD_PRIORITY_NORMAL      1
+#define THREAD_PRIORITY_HIGH        2
+#define THREAD_PRIORITY_LEVELS      3
 
 
 #define THREAD_CAST( thread ) (PT_THREAD((*)(pt_t *pt, void *state )))thread
@@ -128,6 +163,8 @@ void *thread_vp_get_data( thread_t thread_id );
 void thread_v_restart( thread_t thread_id );
 void thread_v_kill( thread_t thread_id );
 void thread_v_active( void );
+void thread_v_set_priority( thread_t thread_id, uint8_t priority );
+uint8_t thread_u8_get_priority( thread_t thread_id );
 
 void thread_v_signal( uint8_t signum );
 void thread_v_clear_signal( uint8_t signum );
@@ -0,0 +1,380 @@
+// <license>
+//
+//     This file is part of the Sapphire Operating System.
+//
+//     Copyright (C) 2013-2018  Jeremy Billheimer
+//
+//
+//     This program is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// </license>
+
+/*
+
+Host benchmark for the FX VM.
+
+Loads a compiled .fxb image, runs the init function and then the loop
+function for a number of frames, and reports ns/opcode, cycles/frame
+and an opcode histogram.
+
+Usage:
+    vm_bench <image.fxb> [frames] [max ns/op]
+
+If max ns/op is given, the bench returns a non-zero exit code when the
+measured time per opcode exceeds it, so it can be used as a regression
+check in scripts.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory.h"
+#include "kvdb.h"
+#include "gfx_lib.h"
+#include "vm_core.h"
+#include "vm_config.h"
+
+#ifndef VM_ENABLE_PROFILE
+#error "vm_bench requires VM_ENABLE_PROFILE"
+#endif
+
+#define DEFAULT_FRAMES  10000
+
+// pixel grid the effects run against
+#define BENCH_PIX_SIZE_X    16
+#define BENCH_PIX_SIZE_Y    16
+
+static const char *opcode_names[] = {
+    "mov",              // 0
+    "clr",              // 1
+    "compeq",           // 2
+    "compneq",          // 3
+    "compgt",           // 4
+    "compgte",          // 5
+    "complt",           // 6
+    "complte",          // 7
+    "and",              // 8
+    "or",               // 9
+    "add",              // 10
+    "sub",              // 11
+    "mul",              // 12
+    "div",              // 13
+    "mod",              // 14
+    "jmp",              // 15
+    "jmp_if_z",         // 16
+    "jmp_if_not_z",     // 17
+    "jmp_if_z_dec",     // 18
+    "jmp_if_gte",       // 19
+    "jmp_if_l_pre_inc", // 20
+    "print",            // 21
+    "ret",              // 22
+    "call",             // 23
+    "lta",              // 24
+    "lfa",              // 25
+    "lfa2d",            // 26
+    "lta2d",            // 27
+    "ltah",             // 28
+    "ltas",             // 29
+    "ltav",             // 30
+    "lfah",             // 31
+    "lfas",             // 32
+    "lfav",             // 33
+    "array_add",        // 34
+    "array_sub",        // 35
+    "array_mul",        // 36
+    "array_div",        // 37
+    "array_mod",        // 38
+    "array_mov",        // 39
+    "rand",             // 40
+    "assert",           // 41
+    "halt",             // 42
+    "is_fading",        // 43
+    "lib_call",         // 44
+    "trap",             // 45
+    "trap",             // 46
+    "trap",             // 47
+    "trap",             // 48
+    "lfahsf",           // 49
+    "lfavf",            // 50
+    "ltahsf",           // 51
+    "ltavf",            // 52
+    "trap",             // 53
+    "obj_load",         // 54
+    "obj_store",        // 55
+    "not",              // 56
+    "db_load",          // 57
+    "db_store",         // 58
+    "yield_frames",     // 59
+    "jmp_if_eq",        // 60
+    "jmp_if_neq",       // 61
+    "jmp_if_gt",        // 62
+    "jmp_if_lt",        // 63
+    "jmp_if_lte",       // 64
+    "addi",             // 65
+    "pix_add",          // 66
+    "pix_sub",          // 67
+    "shl",              // 68
+    "div_pow2",         // 69
+};
+
+#define N_OPCODE_NAMES ( sizeof(opcode_names) / sizeof(opcode_names[0]) )
+
+// must be 32 bit aligned, same as the vm slab on the target
+static uint32_t vm_slab[VM_MAX_IMAGE_SIZE / 4];
+
+static vm_profile_t profile;
+
+
+static uint64_t get_ns( void ){
+
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *get_opcode_name( uint8_t opcode ){
+
+    if( opcode < N_OPCODE_NAMES ){
+
+        return opcode_names[opcode];
+    }
+
+    return "trap";
+}
+
+static int16_t load_file( const char *fname ){
+
+    FILE *f = fopen( fname, "rb" );
+
+    if( f == 0 ){
+
+        printf( "Could not open %s\n", fname );
+        return -1;
+    }
+
+    // first 4 bytes are the length of the program image,
+    // which excludes the meta data appended after it.
+    int32_t prog_len = 0;
+
+    if( fread( &prog_len, sizeof(prog_len), 1, f ) != 1 ){
+
+        printf( "Could not read image length\n" );
+        fclose( f );
+        return -1;
+    }
+
+    if( ( prog_len <= 0 ) || ( prog_len > (int32_t)sizeof(vm_slab) ) ){
+
+        printf( "Invalid image length: %d\n", prog_len );
+        fclose( f );
+        return -1;
+    }
+
+    if( fread( vm_slab, prog_len, 1, f ) != 1 ){
+
+        printf( "Could not read image\n" );
+        fclose( f );
+        return -1;
+    }
+
+    fclose( f );
+
+    return prog_len;
+}
+
+static void print_histogram( uint32_t frames ){
+
+    uint8_t order[256];
+
+    for( uint16_t i = 0; i < 256; i++ ){
+
+        order[i] = i;
+    }
+
+    // sort opcodes by count, descending
+    for( uint16_t i = 1; i < 256; i++ ){
+
+        uint8_t temp = order[i];
+        int16_t j = i - 1;
+
+        while( ( j >= 0 ) && ( profile.opcodes[order[j]] < profile.opcodes[temp] ) ){
+
+            order[j + 1] = order[j];
+            j--;
+        }
+
+        order[j + 1] = temp;
+    }
+
+    printf( "\n  op  name                      count  per frame       %%\n" );
+
+    for( uint16_t i = 0; i < 256; i++ ){
+
+        uint8_t opcode = order[i];
+        uint32_t count = profile.opcodes[opcode];
+
+        if( count == 0 ){
+
+            break;
+        }
+
+        printf( "%4d  %-18s %12u %10.1f  %6.2f\n",
+                opcode,
+                get_opcode_name( opcode ),
+                count,
+                (double)count / frames,
+                ( 100.0 * count ) / profile.total_ops );
+    }
+}
+
+int main( int argc, char *argv[] ){
+
+    if( argc < 2 ){
+
+        printf( "Usage: vm_bench <image.fxb> [frames] [max ns/op]\n" );
+        return -1;
+    }
+
+    uint32_t frames = DEFAULT_FRAMES;
+    double max_ns_per_op = 0.0;
+
+    if( argc > 2 ){
+
+        frames = strtoul( argv[2], 0, 0 );
+
+        if( frames == 0 ){
+
+            frames = 1;
+        }
+    }
+
+    if( argc > 3 ){
+
+        max_ns_per_op = strtod( argv[3], 0 );
+    }
+
+    int16_t prog_len = load_file( argv[1] );
+
+    if( prog_len < 0 ){
+
+        return -1;
+    }
+
+    mem2_v_init();
+    kvdb_v_init();
+    gfxlib_v_init();
+    gfx_v_reset();
+
+    gfx_params_t params;
+    gfx_v_get_params( &params );
+
+    params.pix_count    = BENCH_PIX_SIZE_X * BENCH_PIX_SIZE_Y;
+    params.pix_size_x   = BENCH_PIX_SIZE_X;
+    params.pix_size_y   = BENCH_PIX_SIZE_Y;
+
+    gfx_v_set_params( &params );
+
+    uint8_t *stream = (uint8_t *)vm_slab;
+    vm_state_t state;
+
+    int8_t status = vm_i8_load_program( 0, stream, prog_len, &state );
+
+    if( status < 0 ){
+
+        printf( "Load failed: %d\n", status );
+
+        if( status == VM_STATUS_ERR_VERIFY_FAILED ){
+
+            printf( "Bad instruction at code offset: %u\n", state.verify_offset );
+        }
+
+        return -1;
+    }
+
+    gfx_v_init_pixel_arrays( (gfx_pixel_array_t *)( stream + state.pix_obj_start ), state.pix_obj_count );
+
+    vm_v_reset_profile();
+
+    status = vm_i8_run_init( stream, &state );
+
+    if( status < 0 ){
+
+        printf( "Init failed: %d\n", status );
+        return -1;
+    }
+
+    // init runs once, don't count it in the loop stats
+    vm_v_reset_profile();
+
+    uint32_t frames_run = 0;
+    uint64_t elapsed = 0;
+
+    while( frames_run < frames ){
+
+        // only the VM is timed, faders run outside of the measurement
+        uint64_t start = get_ns();
+
+        status = vm_i8_run_loop( stream, &state );
+
+        elapsed += get_ns() - start;
+
+        frames_run++;
+
+        if( status < 0 ){
+
+            printf( "Loop failed: %d on frame %u\n", status, frames_run );
+            return -1;
+        }
+        else if( status == VM_STATUS_HALT ){
+
+            break;
+        }
+
+        gfx_v_process_faders();
+    }
+
+    vm_v_get_profile( &profile );
+
+    double ns_per_frame = (double)elapsed / frames_run;
+    double ns_per_op = 0.0;
+
+    if( profile.total_ops > 0 ){
+
+        ns_per_op = (double)elapsed / profile.total_ops;
+    }
+
+    printf( "Image:           %s (%d bytes)\n", argv[1], prog_len );
+    printf( "Frames:          %u\n", frames_run );
+    printf( "Total time:      %.3f ms\n", elapsed / 1000000.0 );
+    printf( "Time/frame:      %.1f ns\n", ns_per_frame );
+    printf( "Total opcodes:   %u\n", profile.total_ops );
+    printf( "Time/opcode:     %.2f ns\n", ns_per_op );
+    printf( "Cycles/frame:    %.1f\n", (double)profile.total_ops / frames_run );
+    printf( "Max cycles:      %u\n", state.max_cycles );
+    printf( "Max call depth:  %u\n", state.max_call_depth );
+
+    print_histogram( frames_run );
+
+    if( ( max_ns_per_op > 0.0 ) && ( ns_per_op > max_ns_per_op ) ){
+
+        printf( "\nFAIL: %.2f ns/op exceeds limit of %.2f ns/op\n", ns_per_op, max_ns_per_op );
+        return 1;
+    }
+
+    return 0;
+}